@@ -35,9 +35,11 @@
 # include <openssl/ssl.h>
 # define NS_TLS_SSL_CTX SSL_CTX
 # define NS_TLS_SSL SSL
+# define NS_TLS_SSL_SESSION SSL_SESSION
 #else
 # define NS_TLS_SSL_CTX void*
 # define NS_TLS_SSL void*
+# define NS_TLS_SSL_SESSION void*
 #endif
 
 #ifdef NSD_EXPORTS
@@ -184,6 +186,7 @@ typedef enum {
 #define NS_DRIVER_VERSION_4        4    /* Client support, current version */
 #define NS_DRIVER_VERSION_5        5    /* Library info, current connection info */
 #define NS_DRIVER_VERSION_6        6    /* driverThreadProc, headersEncodeProc */
+#define NS_DRIVER_VERSION_7        7    /* handshakeProc */
 
 /*
  * The following are valid Tcl interp traces types.
@@ -431,6 +434,7 @@ struct Ns_Set {
 #endif
     Ns_SetField *fields;
     unsigned int flags;
+    struct NsSetIndex *indexPtr;   /* key index for large sets, maintained by set.c */
 };
 
 /*
@@ -523,6 +527,20 @@ typedef struct Ns_IndexContextSpec {
     Ns_FreeProc *dataFreeProc;
 } Ns_IndexContextSpec;
 
+/*
+ * Statistics of a task queue, as returned by Ns_TaskQueueGetStats().
+ */
+
+typedef struct Ns_TaskQueueStats {
+    intptr_t requests;      /* Number of tasks enqueued so far */
+    int      running;       /* Number of tasks currently on the queue */
+    int      load;          /* Recent busy time of queue thread in permille */
+    intptr_t latencyCount;  /* Number of enqueue latency samples */
+    Ns_Time  latencyTotal;  /* Accumulated enqueue-to-start latency */
+    Ns_Time  latencyMax;    /* Maximum enqueue-to-start latency */
+    Ns_Time  busyTotal;     /* Accumulated busy time of queue thread */
+} Ns_TaskQueueStats;
+
 /*
  * A linked list data structure.
  */
@@ -645,6 +663,17 @@ typedef enum {
     NS_DRIVER_ACCEPT_QUEUE
 } NS_DRIVER_ACCEPT_STATUS;
 
+/*
+ * The following are the valid return values of an Ns_DriverHandshakeProc.
+ */
+
+typedef enum {
+    NS_DRIVER_HANDSHAKE_DONE,
+    NS_DRIVER_HANDSHAKE_WANT_READ,
+    NS_DRIVER_HANDSHAKE_WANT_WRITE,
+    NS_DRIVER_HANDSHAKE_ERROR
+} NS_DRIVER_HANDSHAKE_STATUS;
+
 /*
  * The following typedefs define socket driver callbacks.
  */
@@ -690,6 +719,10 @@ typedef int
 typedef Tcl_Obj *
 (Ns_DriverConnInfoProc)(Ns_Sock *sock);
 
+typedef NS_DRIVER_HANDSHAKE_STATUS
+(Ns_DriverHandshakeProc)(Ns_Sock *sock)
+     NS_GNUC_NONNULL(1);
+
 typedef struct Ns_DriverClientInitArg {
     NS_TLS_SSL_CTX *ctx;
     const char *sniHostname;
@@ -723,6 +756,7 @@ typedef struct Ns_DriverInitData {
     const char              *libraryVersion;   /* NS_DRIVER_VERSION_5: Version of the used library */
     Ns_ThreadProc           *driverThreadProc; /* NS_DRIVER_VERSION_6: event loop */
     Ns_HeadersEncodeProc    *headersEncodeProc;/* NS_DRIVER_VERSION_6: encode headers from Ns_Set */
+    Ns_DriverHandshakeProc  *handshakeProc;    /* NS_DRIVER_VERSION_7: nonblocking handshake step */
 } Ns_DriverInitData;
 
 
@@ -1121,6 +1155,32 @@ NS_EXTERN Ns_ReturnCode
 Ns_InflateEnd(Ns_CompressStream *cStream)
     NS_GNUC_NONNULL(1);
 
+NS_EXTERN Ns_ReturnCode
+Ns_CompressRawInit(Ns_CompressStream *cStream, int level, int windowBits)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN Ns_ReturnCode
+Ns_CompressRawBuffer(Ns_CompressStream *cStream, const void *inBuf, size_t inSize,
+                     Tcl_DString *dsPtr, bool reset)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4);
+
+NS_EXTERN void
+Ns_CompressRawFree(Ns_CompressStream *cStream)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN Ns_ReturnCode
+Ns_InflateRawInit(Ns_CompressStream *cStream, int windowBits)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN int
+Ns_InflateRawBuffer(Ns_CompressStream *cStream, const void *inBuf, size_t inSize,
+                    Tcl_DString *dsPtr, size_t maxSize, bool reset)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4);
+
+NS_EXTERN void
+Ns_InflateRawFree(Ns_CompressStream *cStream)
+    NS_GNUC_NONNULL(1);
+
 /*
  * config.c:
  */
@@ -1916,6 +1976,10 @@ NS_EXTERN intptr_t
 Ns_TaskQueueRequests(Ns_TaskQueue *queue)
     NS_GNUC_NONNULL(1);
 
+NS_EXTERN void
+Ns_TaskQueueGetStats(Ns_TaskQueue *queue, Ns_TaskQueueStats *statsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
 /*
  * tclobj.c:
  */
@@ -4024,6 +4088,13 @@ Ns_TLS_SSLConnect(Tcl_Interp *interp, NS_SOCKET sock, NS_TLS_SSL_CTX *ctx,
                   const Ns_Time *timeoutPtr, NS_TLS_SSL **sslPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(8);
 
+NS_EXTERN Ns_ReturnCode
+Ns_TLS_SSLConnect2(Tcl_Interp *interp, NS_SOCKET sock, NS_TLS_SSL_CTX *ctx,
+                   const char *sni_hostname, const char *caFile, const char *caPath,
+                   NS_TLS_SSL_SESSION *session,
+                   const Ns_Time *timeoutPtr, NS_TLS_SSL **sslPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(9);
+
 NS_EXTERN int
 Ns_TLS_SSLAccept(Tcl_Interp *interp, NS_SOCKET sock,
                  NS_TLS_SSL_CTX *ctx, NS_TLS_SSL **sslPtr)
@@ -98,6 +98,7 @@ ns_section ns/parameters {
 
     #ns_param   progressminsize     1MB      ;# default: 0
     #ns_param   listenbacklog       256      ;# default: 32; backlog for ns_socket commands
+    #ns_param   sockcallbackthreads 4        ;# default: 1; threads for socket callbacks (ns_connchan, ns_sockcallback)
 
     # Reject output operations on already closed or detached connections (e.g. subsequent ns_return statements)
     #ns_param   rejectalreadyclosedconn false;# default: true
@@ -336,6 +337,8 @@ if {[info exists httpsport] && $httpsport ne ""} {
         #
         #ns_param nodelay       false   ;# true; deactivate TCP_NODELAY if Nagle algorithm is wanted
         #ns_param deferaccept	true    ;# false, Performance optimization
+        #ns_param ktls          true    ;# false, use kernel TLS and sendfile() when available
+        #ns_param handshakethreads 1    ;# 0, number of threads performing TLS handshakes
 
         #
         # SSL/TLS parameters
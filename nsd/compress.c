@@ -12,7 +12,9 @@
 /*
  * compress.c --
  *
- *      Support for gzip compression using Zlib.
+ *      Support for gzip compression using Zlib, and for raw deflate
+ *      streams as used by the WebSocket permessage-deflate extension
+ *      (RFC 7692).
  */
 
 #include "nsd.h"
@@ -27,6 +29,16 @@
  */
 
 static void DeflateOrAbort(z_stream *z, int flushFlags);
+static int InflateRawSegment(z_stream *z, const void *inBuf, size_t inSize,
+                             Tcl_DString *dsPtr, size_t maxSize)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4);
+
+/*
+ * The trailer of a sync flush, which is removed from compressed
+ * WebSocket messages and added again before decompression (RFC 7692,
+ * section 7.2.1).
+ */
+static const unsigned char syncFlushTrailer[4] = {0x00u, 0x00u, 0xffu, 0xffu};
 static voidpf ZAlloc(voidpf UNUSED(arg), uInt items, uInt size);
 static void ZFree(voidpf UNUSED(arg), voidpf address);
 
@@ -329,6 +341,277 @@ Ns_CompressGzip(const char *buf, int len, Tcl_DString *dsPtr, int level)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CompressRawInit, Ns_CompressRawBuffer --
+ *
+ *      Initialize a raw deflate stream (without zlib or gzip
+ *      header/footer) and compress a message with it. Every message
+ *      is terminated with a sync flush, where the trailing 4 bytes of
+ *      the empty stored block are removed, as required by the
+ *      WebSocket permessage-deflate extension. When "reset" is true,
+ *      the compression context is reset after the message ("no
+ *      context takeover"), which allows the peer to decompress every
+ *      message independently.
+ *
+ * Results:
+ *      Ns_ReturnCode
+ *
+ * Side effects:
+ *      Compressed data is appended to the Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+Ns_CompressRawInit(Ns_CompressStream *cStream, int level, int windowBits)
+{
+    z_stream     *z = &cStream->z;
+    int           rc;
+    Ns_ReturnCode status = NS_OK;
+
+    cStream->flags = 0u;
+    z->zalloc = ZAlloc;
+    z->zfree = ZFree;
+    z->opaque = Z_NULL;
+
+    /*
+     * A window size of 8 bits is not supported by zlib for raw
+     * deflate.
+     */
+    rc = deflateInit2(z,
+                      MIN(MAX(level, 1), 9),
+                      Z_DEFLATED,
+                      -MIN(MAX(windowBits, 9), 15), /* negative: raw deflate */
+                      8,
+                      Z_DEFAULT_STRATEGY);
+    if (rc != Z_OK) {
+        Ns_Log(Error, "Ns_CompressRawInit: zlib error: %d (%s): %s",
+               rc, zError(rc), (z->msg != NULL) ? z->msg : "(none)");
+        z->zalloc = NULL;
+        status = NS_ERROR;
+    }
+
+    return status;
+}
+
+Ns_ReturnCode
+Ns_CompressRawBuffer(Ns_CompressStream *cStream, const void *inBuf, size_t inSize,
+                     Tcl_DString *dsPtr, bool reset)
+{
+    z_stream     *z = &cStream->z;
+    TCL_SIZE_T    offset = dsPtr->length;
+    size_t        compressLen;
+    int           rc;
+    Ns_ReturnCode status = NS_OK;
+
+    /*
+     * Besides the bound of the compressed data, reserve space for the
+     * sync flush (empty stored block) and the final bits.
+     */
+    compressLen = (size_t)deflateBound(z, (uLong)inSize) + 16u;
+    Tcl_DStringSetLength(dsPtr, offset + (TCL_SIZE_T)compressLen);
+
+    z->next_in   = ns_const2voidp(inBuf);
+    z->avail_in  = (uInt)inSize;
+    z->next_out  = (Bytef *)(dsPtr->string + offset);
+    z->avail_out = (uInt)compressLen;
+
+    rc = deflate(z, Z_SYNC_FLUSH);
+    if (rc != Z_OK || z->avail_in != 0 || z->avail_out == 0) {
+        Ns_Log(Error, "Ns_CompressRawBuffer: zlib error: %d (%s): %s:"
+               " avail_in: %d, avail_out: %d",
+               rc, zError(rc), (z->msg != NULL) ? z->msg : "(unknown)",
+               z->avail_in, z->avail_out);
+        Tcl_DStringSetLength(dsPtr, offset);
+        status = NS_ERROR;
+    } else {
+        TCL_SIZE_T length = dsPtr->length - (TCL_SIZE_T)z->avail_out;
+
+        if (length - offset >= 4
+            && memcmp(dsPtr->string + length - 4, syncFlushTrailer, 4u) == 0) {
+            length -= 4;
+        }
+        Tcl_DStringSetLength(dsPtr, length);
+    }
+    if (reset) {
+        (void) deflateReset(z);
+    }
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_InflateRawInit, Ns_InflateRawBuffer --
+ *
+ *      Initialize a raw inflate stream and decompress a message
+ *      compressed by the peer via the WebSocket permessage-deflate
+ *      extension. The sync flush trailer removed by the peer is added
+ *      again. When "reset" is true, the decompression context is reset
+ *      after the message. When "maxSize" is larger than 0, the
+ *      decompression is aborted, when the uncompressed data would
+ *      exceed this size.
+ *
+ * Results:
+ *      Ns_ReturnCode, TCL_OK or TCL_ERROR.
+ *
+ * Side effects:
+ *      Uncompressed data is appended to the Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+Ns_InflateRawInit(Ns_CompressStream *cStream, int windowBits)
+{
+    z_stream      *zPtr = &cStream->z;
+    int            rc;
+    Ns_ReturnCode  status = NS_OK;
+
+    cStream->flags = 0u;
+    zPtr->zalloc   = ZAlloc;
+    zPtr->zfree    = ZFree;
+    zPtr->opaque   = Z_NULL;
+    zPtr->avail_in = 0;
+    zPtr->next_in  = Z_NULL;
+    /*
+     * zlib raises a raw deflate window of 8 bits to 9 bits, so peers
+     * using zlib with 8 bits produce data for a 9 bit window. Since a
+     * larger window can always be used for inflating, use at least 9
+     * bits (negative: raw inflate).
+     */
+    rc = inflateInit2(zPtr, -MIN(MAX(windowBits, 9), 15));
+    if (rc != Z_OK) {
+        Ns_Log(Error, "Ns_InflateRawInit: zlib error: %d (%s): %s",
+               rc, zError(rc), (zPtr->msg != NULL) ? zPtr->msg : "(unknown)");
+        zPtr->zalloc = NULL;
+        status = NS_ERROR;
+    }
+    return status;
+}
+
+int
+Ns_InflateRawBuffer(Ns_CompressStream *cStream, const void *inBuf, size_t inSize,
+                    Tcl_DString *dsPtr, size_t maxSize, bool reset)
+{
+    z_stream *zPtr = &cStream->z;
+    int       result;
+
+    result = InflateRawSegment(zPtr, inBuf, inSize, dsPtr, maxSize);
+    if (result == TCL_OK) {
+        result = InflateRawSegment(zPtr, syncFlushTrailer, sizeof(syncFlushTrailer), dsPtr, maxSize);
+    }
+    if (reset || result != TCL_OK) {
+        (void) inflateReset(zPtr);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CompressRawFree, Ns_InflateRawFree --
+ *
+ *      Free the raw deflate/inflate streams, if these were
+ *      successfully initialized.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Ns_CompressRawFree(Ns_CompressStream *cStream)
+{
+    Ns_CompressFree(cStream);
+}
+
+void
+Ns_InflateRawFree(Ns_CompressStream *cStream)
+{
+    if (cStream->z.zalloc != NULL) {
+        (void) Ns_InflateEnd(cStream);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InflateRawSegment --
+ *
+ *      Decompress a segment of input data into the Tcl_DString.
+ *
+ * Results:
+ *      TCL_OK or TCL_ERROR.
+ *
+ * Side effects:
+ *      Uncompressed data is appended to the Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InflateRawSegment(z_stream *zPtr, const void *inBuf, size_t inSize,
+                  Tcl_DString *dsPtr, size_t maxSize)
+{
+    int result = TCL_OK;
+
+    zPtr->next_in  = ns_const2voidp(inBuf);
+    zPtr->avail_in = (uInt)inSize;
+
+    for (;;) {
+        TCL_SIZE_T offset = dsPtr->length;
+        uInt       chunkSize = 16384u;
+        int        rc;
+
+        Tcl_DStringSetLength(dsPtr, offset + (TCL_SIZE_T)chunkSize);
+        zPtr->next_out  = (Bytef *)(dsPtr->string + offset);
+        zPtr->avail_out = chunkSize;
+
+        rc = inflate(zPtr, Z_SYNC_FLUSH);
+        Tcl_DStringSetLength(dsPtr, offset + (TCL_SIZE_T)(chunkSize - zPtr->avail_out));
+
+        if (rc == Z_STREAM_END) {
+            /*
+             * The peer sent a final block. Continue with a fresh
+             * context for the remaining data.
+             */
+            (void) inflateReset(zPtr);
+        } else if (rc == Z_BUF_ERROR && zPtr->avail_out > 0u) {
+            /*
+             * No progress possible, all input consumed.
+             */
+            break;
+        } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            Ns_Log(Warning, "Ns_InflateRawBuffer: zlib error: %d (%s): %s",
+                   rc, zError(rc), (zPtr->msg != NULL) ? zPtr->msg : "(unknown)");
+            result = TCL_ERROR;
+            break;
+        }
+        if (maxSize > 0u && (size_t)dsPtr->length > maxSize) {
+            Ns_Log(Warning, "Ns_InflateRawBuffer: uncompressed data exceeds max size %" PRIuz,
+                   maxSize);
+            result = TCL_ERROR;
+            break;
+        }
+        if (zPtr->avail_in == 0u && zPtr->avail_out > 0u) {
+            break;
+        }
+    }
+    return result;
+}
+
+
 
 /*
  *----------------------------------------------------------------------
@@ -444,6 +727,44 @@ Ns_InflateEnd(Ns_CompressStream *UNUSED(cStream))
     return NS_ERROR;
 }
 
+Ns_ReturnCode
+Ns_CompressRawInit(Ns_CompressStream *UNUSED(cStream), int UNUSED(level), int UNUSED(windowBits))
+{
+    return NS_ERROR;
+}
+
+Ns_ReturnCode
+Ns_CompressRawBuffer(Ns_CompressStream *UNUSED(cStream), const void *UNUSED(inBuf), size_t UNUSED(inSize),
+                     Tcl_DString *UNUSED(dsPtr), bool UNUSED(reset))
+{
+    return NS_ERROR;
+}
+
+Ns_ReturnCode
+Ns_InflateRawInit(Ns_CompressStream *UNUSED(cStream), int UNUSED(windowBits))
+{
+    return NS_ERROR;
+}
+
+int
+Ns_InflateRawBuffer(Ns_CompressStream *UNUSED(cStream), const void *UNUSED(inBuf), size_t UNUSED(inSize),
+                    Tcl_DString *UNUSED(dsPtr), size_t UNUSED(maxSize), bool UNUSED(reset))
+{
+    return TCL_ERROR;
+}
+
+void
+Ns_CompressRawFree(Ns_CompressStream *UNUSED(cStream))
+{
+    return;
+}
+
+void
+Ns_InflateRawFree(Ns_CompressStream *UNUSED(cStream))
+{
+    return;
+}
+
 #endif
 
 /*
@@ -76,6 +76,21 @@
 # endif
 #endif
 
+/*
+ * Vector instructions for WebSocket masking/unmasking.
+ */
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define NS_WS_MASK_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define NS_WS_MASK_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define NS_WS_MASK_NEON 1
+#endif
+
 #define ConnChanBufferSize(connChanPtr, buf) ((connChanPtr)->buf != NULL ? (connChanPtr)->buf->length : 0)
 #define ConnChanBufferAddress(connChanPtr, buf) (void*)((connChanPtr)->buf != NULL ? (connChanPtr)->buf->string : 0)
 
@@ -99,6 +114,35 @@ typedef struct ListenCallback {
 } ListenCallback;
 
 
+/*
+ * The following structure is used for a named broadcast group of
+ * connection channels ("ns_connchan group" and "ns_connchan
+ * broadcast"). The members are the channel names.
+ */
+
+typedef struct ConnChanGroup {
+    Tcl_HashTable members;
+    Tcl_WideInt   messages;  /* Number of broadcast messages */
+    Tcl_WideInt   dropped;   /* Messages dropped for slow members */
+    Tcl_WideInt   evicted;   /* Number of evicted members */
+} ConnChanGroup;
+
+
+/*
+ * The following structure keeps the compression contexts of a
+ * connection channel, when the WebSocket permessage-deflate extension
+ * (RFC 7692) was negotiated via "ns_connchan wsdeflate".
+ */
+
+typedef struct WsDeflate {
+    Ns_CompressStream deflate;
+    Ns_CompressStream inflate;
+    size_t            maxSize;                 /* Max size of an inflated message (0: unlimited) */
+    bool              serverNoContextTakeover; /* Reset deflate context after every message */
+    bool              clientNoContextTakeover; /* Reset inflate context after every message */
+} WsDeflate;
+
+
 /*
  * Local functions defined in this file.
  */
@@ -122,6 +166,9 @@ static ssize_t ConnChanReadBuffer(NsConnChan *connChanPtr, char *buffer, size_t
 static NsConnChan *ConnChanGet(Tcl_Interp *interp, NsServer *servPtr, const char *name)
     NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
 
+static NsConnChan *ConnChanGetLocked(Tcl_Interp *interp, NsServer *servPtr, const char *name)
+    NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
 static Ns_ReturnCode SockCallbackRegister(NsConnChan *connChanPtr, Tcl_Obj *scriptObj,
                                           unsigned int when, const Ns_Time *timeoutPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
@@ -154,18 +201,47 @@ static void RequireDsBuffer(Tcl_DString **dsPtr)  NS_GNUC_NONNULL(1);
 static void WebsocketFrameSetCommonMembers(Tcl_Obj *resultObj, ssize_t nRead, const NsConnChan *connChanPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
 
+static int ConnChanWriteBuffer(Tcl_Interp *interp, NsConnChan *connChanPtr, const char *msgString,
+                               TCL_SIZE_T msgLength, const Ns_Time *timeoutPtr,
+                               ssize_t *bytesSentPtr, unsigned long *errnoPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(5)
+    NS_GNUC_NONNULL(6) NS_GNUC_NONNULL(7);
+
+static void WsMaskData(unsigned char *dst, const unsigned char *src, size_t length, const unsigned char *mask)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4);
+
+static void WsEncodeFrame(Tcl_DString *frameDsPtr, const unsigned char *messageString, TCL_SIZE_T messageLength,
+                          int opcode, bool fin, bool masked, bool compressed)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void WsDeflateFree(WsDeflate *wsDeflatePtr)
+    NS_GNUC_NONNULL(1);
+
+static bool WsDeflateNegotiate(const char *offers, int maxWindowBits, bool noContextTakeover,
+                               Tcl_DString *responseDsPtr, int *serverWindowBitsPtr,
+                               int *clientWindowBitsPtr, bool *serverNoContextTakeoverPtr,
+                               bool *clientNoContextTakeoverPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5) NS_GNUC_NONNULL(6)
+    NS_GNUC_NONNULL(7) NS_GNUC_NONNULL(8);
+
+static bool GroupRemoveMember(Tcl_HashEntry *groupEntryPtr, const char *channelName)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
 static Ns_SockProc NsTclConnChanProc;
 
+static TCL_OBJCMDPROC_T   ConnChanBroadcastObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanCallbackObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanCloseObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanDetachObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanDebugObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanExistsObjCmd;
+static TCL_OBJCMDPROC_T   ConnChanGroupObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanListObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanListenObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanOpenObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanReadObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanWriteObjCmd;
+static TCL_OBJCMDPROC_T   ConnChanWsdeflateObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanWsencodeObjCmd;
 
 static Ns_SockProc CallbackFree;
@@ -322,6 +398,7 @@ ConnChanCreate(NsServer *servPtr, Sock *sockPtr,
 
     connChanPtr = ns_malloc(sizeof(NsConnChan));
     connChanPtr->cbPtr = NULL;
+    Ns_MutexInit(&connChanPtr->lock);
     connChanPtr->startTime = *startTime;
     connChanPtr->rBytes = 0;
     connChanPtr->wBytes = 0;
@@ -334,6 +411,8 @@ ConnChanCreate(NsServer *servPtr, Sock *sockPtr,
     connChanPtr->secondarySendBuffer = NULL;
     connChanPtr->frameBuffer = NULL;
     connChanPtr->fragmentsBuffer = NULL;
+    connChanPtr->fragmentsCompressed = NS_FALSE;
+    connChanPtr->wsDeflatePtr = NULL;
     connChanPtr->frameNeedsData = NS_TRUE;
     connChanPtr->debugLevel = 0;
     connChanPtr->debugFD = 0;
@@ -365,6 +444,7 @@ ConnChanCreate(NsServer *servPtr, Sock *sockPtr,
 
     connChanPtr->channelName = ns_strdup(name);
     Ns_RWLockUnlock(&servPtr->connchans.lock);
+    Ns_MutexSetName2(&connChanPtr->lock, "ns:connchan", name);
 
     return connChanPtr;
 }
@@ -403,7 +483,21 @@ ConnChanFree(NsConnChan *connChanPtr, NsServer *servPtr) {
     Ns_RWLockWrLock(&servPtr->connchans.lock);
     hPtr = Tcl_FindHashEntry(&servPtr->connchans.table, connChanPtr->channelName);
     if (hPtr != NULL) {
+        Tcl_HashEntry *groupEntryPtr;
+        Tcl_HashSearch search;
+
         Tcl_DeleteHashEntry(hPtr);
+
+        /*
+         * Remove the channel from all broadcast groups.
+         */
+        groupEntryPtr = Tcl_FirstHashEntry(&servPtr->connchans.groups, &search);
+        while (groupEntryPtr != NULL) {
+            Tcl_HashEntry *nextPtr = Tcl_NextHashEntry(&search);
+
+            (void) GroupRemoveMember(groupEntryPtr, connChanPtr->channelName);
+            groupEntryPtr = nextPtr;
+        }
     } else {
         Ns_Log(Error, "ns_connchan: could not delete hash entry for channel '%s'",
                connChanPtr->channelName);
@@ -413,8 +507,14 @@ ConnChanFree(NsConnChan *connChanPtr, NsServer *servPtr) {
     if (hPtr != NULL) {
         /*
          * Only in cases, where we found the entry, we can free the
-         * connChanPtr content.
+         * connChanPtr content. Wait for send operations of other
+         * threads (e.g., "ns_connchan broadcast"), which have obtained
+         * the channel via ConnChanGetLocked() before it was removed from
+         * the table.
          */
+        Ns_MutexLock(&connChanPtr->lock);
+        Ns_MutexUnlock(&connChanPtr->lock);
+
         if (connChanPtr->cbPtr != NULL) {
             /*
              * Add CancelCallback() to the sock callback queue.
@@ -456,6 +556,10 @@ ConnChanFree(NsConnChan *connChanPtr, NsServer *servPtr) {
             Tcl_DStringFree(connChanPtr->fragmentsBuffer);
             ns_free((char *)connChanPtr->fragmentsBuffer);
         }
+        if (connChanPtr->wsDeflatePtr != NULL) {
+            WsDeflateFree(connChanPtr->wsDeflatePtr);
+        }
+        Ns_MutexDestroy(&connChanPtr->lock);
         ns_free((char *)connChanPtr);
     } else {
         Ns_Log(Bug, "ns_connchan: could not delete hash entry for channel '%s'",
@@ -509,6 +613,49 @@ NsConnChan *NsConnChanGet(Tcl_Interp *interp, NsServer *servPtr, const char *nam
 
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanGetLocked --
+ *
+ *      Retrieves a connection channel from the server's channel table
+ *      by name and locks it for a send operation. Since the channel lock
+ *      is obtained while holding the table lock, the channel cannot be
+ *      freed before the caller releases the lock via Ns_MutexUnlock().
+ *
+ * Results:
+ *      Locked NsConnChan if found, otherwise NULL. If the channel is not
+ *      found and an interpreter is provided, an error message is set in
+ *      the interpreter.
+ *
+ * Side effects:
+ *      Locks the channel.
+ *
+ *----------------------------------------------------------------------
+ */
+static NsConnChan *
+ConnChanGetLocked(Tcl_Interp *interp, NsServer *servPtr, const char *name) {
+    const Tcl_HashEntry *hPtr;
+    NsConnChan          *connChanPtr;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(name != NULL);
+
+    Ns_RWLockRdLock(&servPtr->connchans.lock);
+    hPtr = Tcl_FindHashEntry(&servPtr->connchans.table, name);
+    connChanPtr = hPtr != NULL ? (NsConnChan *)Tcl_GetHashValue(hPtr) : NULL;
+    if (connChanPtr != NULL) {
+        Ns_MutexLock(&connChanPtr->lock);
+    }
+    Ns_RWLockUnlock(&servPtr->connchans.lock);
+
+    if (connChanPtr == NULL && interp != NULL) {
+        Ns_TclPrintfResult(interp, "channel \"%s\" does not exist", name);
+    }
+
+    return connChanPtr;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2333,7 +2480,7 @@ static Tcl_Obj*
 GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
 {
     unsigned char *data;
-    bool           finished, masked;
+    bool           finished, masked, compressed;
     int            opcode;
     TCL_SIZE_T     frameLength, fragmentsBufferLength;
     size_t         payloadLength, offset;
@@ -2374,10 +2521,21 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
     data = (unsigned char *)connChanPtr->frameBuffer->string;
 
     finished      = ((data[0] & 0x80u) != 0);
+    compressed    = ((data[0] & 0x40u) != 0); /* RSV1, permessage-deflate */
     masked        = ((data[1] & 0x80u) != 0);
     opcode        = (data[0] & 0x0Fu);
     payloadLength = (data[1] & 0x7Fu);
 
+    if (compressed && (opcode == 0 || opcode >= 8)) {
+        /*
+         * RSV1 is only allowed on the first frame of a data message
+         * (RFC 7692, section 6.1).
+         */
+        Ns_Log(Warning, "WS: %s received RSV1 bit on %s frame",
+               connChanPtr->channelName, opcode == 0 ? "continuation" : "control");
+        goto exception;
+    }
+
     if (payloadLength <= 125) {
         offset = 2;
     } else if (payloadLength == 126) {
@@ -2424,17 +2582,15 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
     }
 
     if (masked) {
-        size_t i, j;
-
-        for( i = offset, j = 0u; j < payloadLength; i++, j++ ) {
-            data[ i ] = data[ i ] ^ mask[ j % 4];
-        }
+        WsMaskData(&data[offset], &data[offset], payloadLength, mask);
     }
 
     fragmentsBufferLength = ConnChanBufferSize(connChanPtr, fragmentsBuffer);
 
     if (finished) {
-        Tcl_Obj *payloadObj;
+        Tcl_Obj             *payloadObj;
+        const unsigned char *payloadString;
+        TCL_SIZE_T           payloadSize;
         /*
          * The "fin" bit is set, this message is complete. If we have
          * fragments, append the new data to the fragments already
@@ -2442,19 +2598,51 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
          */
 
         if (fragmentsBufferLength == 0) {
-            payloadObj = Tcl_NewByteArrayObj(&data[offset], (TCL_SIZE_T)payloadLength);
+            payloadString = &data[offset];
+            payloadSize = (TCL_SIZE_T)payloadLength;
         } else {
             Tcl_DStringAppend(connChanPtr->fragmentsBuffer,
                               (const char *)&data[offset], (TCL_SIZE_T)payloadLength);
-            payloadObj = Tcl_NewByteArrayObj((const unsigned char *)connChanPtr->fragmentsBuffer->string,
-                                             connChanPtr->fragmentsBuffer->length);
+            payloadString = (const unsigned char *)connChanPtr->fragmentsBuffer->string;
+            payloadSize = connChanPtr->fragmentsBuffer->length;
             Ns_Log(Ns_LogConnchanDebug,
                    "WS: append final payload opcode %d (fragments opcode %d) %" PRITcl_Size" bytes, "
                    "totaling %" PRITcl_Size " bytes, clear fragmentsBuffer",
                    opcode, connChanPtr->fragmentsOpcode,
                    (TCL_SIZE_T)payloadLength, connChanPtr->fragmentsBuffer->length);
-            Tcl_DStringSetLength(connChanPtr->fragmentsBuffer, 0);
             opcode = connChanPtr->fragmentsOpcode;
+            compressed = connChanPtr->fragmentsCompressed;
+        }
+
+        if (compressed && (opcode == 1 || opcode == 2)) {
+            Tcl_DString inflateDs;
+            int         rc;
+
+            /*
+             * The message was compressed via permessage-deflate.
+             */
+            if (connChanPtr->wsDeflatePtr == NULL) {
+                Ns_Log(Warning, "WS: %s received compressed message, but permessage-deflate"
+                       " was not negotiated", connChanPtr->channelName);
+                goto exception;
+            }
+            Tcl_DStringInit(&inflateDs);
+            rc = Ns_InflateRawBuffer(&connChanPtr->wsDeflatePtr->inflate,
+                                     payloadString, (size_t)payloadSize, &inflateDs,
+                                     connChanPtr->wsDeflatePtr->maxSize,
+                                     connChanPtr->wsDeflatePtr->clientNoContextTakeover);
+            if (rc != TCL_OK) {
+                Tcl_DStringFree(&inflateDs);
+                goto exception;
+            }
+            payloadObj = Tcl_NewByteArrayObj((const unsigned char *)inflateDs.string, inflateDs.length);
+            Tcl_DStringFree(&inflateDs);
+            Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("compressed", 10), Tcl_NewIntObj(1));
+        } else {
+            payloadObj = Tcl_NewByteArrayObj(payloadString, payloadSize);
+        }
+        if (fragmentsBufferLength > 0) {
+            Tcl_DStringSetLength(connChanPtr->fragmentsBuffer, 0);
         }
         Tcl_DictObjPut(NULL, resultObj,
                        Tcl_NewStringObj("opcode", 6),
@@ -2475,6 +2663,7 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
          */
         if (fragmentsBufferLength == 0) {
             connChanPtr->fragmentsOpcode = opcode;
+            connChanPtr->fragmentsCompressed = compressed;
         }
         Tcl_DStringAppend(connChanPtr->fragmentsBuffer,
                           (const char *)&data[offset], (TCL_SIZE_T)payloadLength);
@@ -2516,7 +2705,7 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
     connChanPtr->frameNeedsData = NS_FALSE;
     Tcl_DictObjPut(NULL, resultObj,
                    Tcl_NewStringObj("frame", 5),
-                   Tcl_NewStringObj("exception", 10));
+                   Tcl_NewStringObj("exception", 9));
     WebsocketFrameSetCommonMembers(resultObj, nRead, connChanPtr);
     return resultObj;
 }
@@ -3100,6 +3289,202 @@ CompactBuffers(NsConnChan *connChanPtr, const char *msgString, TCL_SIZE_T msgLen
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanWriteBuffer --
+ *
+ *      Sends data over the specified connection channel. Unsent data
+ *      is kept in the send buffer of the connection channel and is
+ *      sent together with the data of the next write operation. This
+ *      function is the workhorse of NsConnChanWrite() and is as well
+ *      used for broadcasting a message to the members of a group. The
+ *      caller must hold the lock of the channel.
+ *
+ *      The send operation waits for writability of the socket for at
+ *      most the time specified by "timeoutPtr". When this time is 0,
+ *      the function never blocks, and all data, which cannot be sent
+ *      immediately, is buffered.
+ *
+ * Results:
+ *      Returns TCL_OK if the message is sent successfully (or partially sent with
+ *      no fatal errors), or TCL_ERROR if an error occurs during the send operation.
+ *
+ * Side Effects:
+ *      See NsConnChanWrite().
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ConnChanWriteBuffer(Tcl_Interp *interp, NsConnChan *connChanPtr, const char *msgString, TCL_SIZE_T msgLength,
+                    const Ns_Time *timeoutPtr, ssize_t *bytesSentPtr, unsigned long *errnoPtr)
+{
+    int          result = TCL_OK;
+    ssize_t      bytesSent = 0, bytes_written;
+    struct iovec iovecs[2];
+    int          nBuffers = 1;
+    size_t       toSend;
+    int          caseInt = -1;
+
+    (void)bytes_written;
+
+    iovecs[0].iov_len = 0;
+    iovecs[1].iov_len = 0;
+
+    if (connChanPtr->debugLevel > 1 && connChanPtr->debugFD == 0) {
+        static char  fnbuffer[256];
+
+        snprintf(fnbuffer, sizeof(fnbuffer), "/tmp/OUT-%s-XXXXXX", connChanPtr->channelName);
+        connChanPtr->debugFD = ns_mkstemp(fnbuffer);
+        Ns_Log(Notice, "CREATED file %s fd %d", fnbuffer, connChanPtr->debugFD);
+    }
+
+    toSend = PrepareSendBuffers(connChanPtr, msgString, msgLength, iovecs, &nBuffers, &caseInt);
+
+    Ns_Log(Ns_LogConnchanDebug, "%s new message length %" PRITcl_Size
+           " buffered length %" PRITcl_Size
+           " total %" PRIdz,
+           connChanPtr->channelName, msgLength, connChanPtr->sendBuffer != NULL ? connChanPtr->sendBuffer->length : 0,
+           toSend);
+
+    /*
+     * Perform the send operation as registered in the driver.
+     */
+    bytesSent = (toSend > 0)
+        ? ConnchanDriverSend(interp, connChanPtr, iovecs, nBuffers, 0u, timeoutPtr)
+        : 0;
+
+    if (bytesSent != 0 && connChanPtr->sockPtr->sendRejected != 0) {
+        Ns_Log(Warning, "REJECT HANDLING %s (%d,%ld): something was sent (%ld) but send rejected is still %ld, toSend %ld send buffer %p sendreject base %p",
+               connChanPtr->channelName, connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendCount,
+               bytesSent, connChanPtr->sockPtr->sendRejected, toSend,
+               ConnChanBufferAddress(connChanPtr,sendBuffer),
+               connChanPtr->sockPtr->sendRejectedBase);
+    }
+
+    Ns_Log(Ns_LogConnchanDebug, "%s after ConnchanDriverSend nbufs %d len[0] %" PRIdz
+        ", len[1] %" PRIdz " sent %" PRIdz,
+        connChanPtr->channelName, nBuffers, iovecs[0].iov_len, iovecs[1].iov_len, bytesSent);
+
+    /*
+     * If some data was sent (bytesSent > -1), update the state accordingly.
+     */
+    if (bytesSent > -1) {
+        size_t unsentBytes = (size_t)toSend - (size_t)bytesSent;
+
+        if (connChanPtr->debugLevel > 1 && connChanPtr->sendBuffer != NULL) {
+            DebugLogBufferState(connChanPtr, toSend, bytesSent, connChanPtr->sendBuffer->string,
+                                "partial write, unsent bytes %ld", unsentBytes);
+            bytes_written = write(connChanPtr->debugFD, "\n-----CUT-HERE-----\n", 20u);
+        }
+
+        connChanPtr->wBytes += (size_t)bytesSent;
+
+        if (unsentBytes > 0) {
+
+            if (bytesSent == 0 && connChanPtr->requireStableSendBuffer) {
+                /*
+                 * Nothing was sent.  In case, we require a stable
+                 * send buffer, we have always a send buffer and
+                 * always a single iovec. There is nothing to
+                 * shift or concatenate.
+                 */
+
+                if (connChanPtr->debugLevel > 1 && connChanPtr->sendBuffer != NULL) {
+                    DebugLogBufferState(connChanPtr, toSend, bytesSent, connChanPtr->sendBuffer->string,
+                                        "nothing was sent, unsent bytes %ld", unsentBytes);
+                }
+                if (connChanPtr->debugLevel > 0) {
+                    Ns_Log(Notice, "REJECT HANDLING %s (%d,%ld): nothing was sent, send buffer %p sendreject base %p",
+                           connChanPtr->channelName, connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendCount,
+                           ConnChanBufferAddress(connChanPtr,sendBuffer),
+                           connChanPtr->sockPtr->sendRejectedBase);
+                }
+
+            } else {
+                TCL_SIZE_T unsentNewData;
+
+                if (connChanPtr->debugLevel > 0) {
+                    Ns_Log(Notice, "REJECT HANDLING %s (%d,%ld): something was sent (%ld), send buffer %p sendreject base %p, will call CompactBuffers",
+                           connChanPtr->channelName, connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendCount,
+                           bytesSent,
+                           ConnChanBufferAddress(connChanPtr,sendBuffer),
+                           connChanPtr->sockPtr->sendRejectedBase);
+                }
+                /*
+                 * Something was sent.  Ensure that the send
+                 * buffer is properly allocated.
+                 */
+                if (connChanPtr->sendBuffer == NULL && connChanPtr->sockPtr->sendRejected > 0) {
+                    Ns_Log(Notice, "NsConnChanWrite sock %d acquires send buffer with rejected data (%ld)",
+                           connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendRejected);
+                }
+                RequireDsBuffer(&connChanPtr->sendBuffer);
+
+                /*
+                 * Compact old data in the sendBuffer.  If two buffers
+                 * were used, determine how much of the new data has to be appended.
+                 */
+                unsentNewData = CompactBuffers(connChanPtr, msgString, msgLength, bytesSent, iovecs, nBuffers, toSend, caseInt);
+
+                /*
+                 * If there is unsent new data, append it to the
+                 * send buffer for later transmission.
+                 */
+                if (unsentNewData > 0) {
+                    Tcl_DStringAppend(connChanPtr->sendBuffer,
+                                      msgString + (msgLength - unsentNewData),
+                                      unsentNewData);
+
+                    if (connChanPtr->sockPtr->sendRejected > 0) {
+                        Ns_Log(Notice, "NsConnChanWrite sock %d rejected data (%ld): "
+                               "append unsent new data",
+                               connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendRejected);
+                    }
+                }
+            }
+        } else {
+            /*
+             * All data was sent successfully.
+             */
+            TCL_SIZE_T buffedLen = ConnChanBufferSize(connChanPtr, sendBuffer);
+
+            Ns_Log(Ns_LogConnchanDebug, "... buffedLen %" PRITcl_Size
+                   " msgLength %" PRITcl_Size
+                   " everything was sent, unsentBytes %" PRIdz
+                   ", (BYTES from %" PRIdz " to %" PRIdz ")",
+                   buffedLen, msgLength, unsentBytes,
+                   connChanPtr->wBytes - (size_t)bytesSent, connChanPtr->wBytes);
+            assert(unsentBytes == 0);
+
+            /*
+             * Clear the send buffer since all data was sent.
+             */
+
+            if (buffedLen > 0) {
+                Tcl_DStringSetLength(connChanPtr->sendBuffer, 0);
+            }
+            if (connChanPtr->debugLevel > 1) {
+                DebugLogBufferState(connChanPtr, toSend, bytesSent, NULL, "all sent");
+            }
+
+        }
+    } else {
+        /*
+         * The send operation failed, mark the result as an error.
+         */
+        result = TCL_ERROR;
+    }
+
+    /*
+     * Update the error number from the socket's send error value.
+     */
+    *errnoPtr = connChanPtr->sockPtr->sendErrno;
+
+    *bytesSentPtr = bytesSent;
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -3144,12 +3529,10 @@ NsConnChanWrite(Tcl_Interp *interp, const char *connChanName, const char *msgStr
     NsServer    *servPtr;
     NsConnChan  *connChanPtr;
     int          result = TCL_OK;
-    ssize_t      bytesSent = 0, bytes_written;
-
-    (void)bytes_written;
+    ssize_t      bytesSent = 0;
 
     servPtr = itPtr->servPtr;
-    connChanPtr = ConnChanGet(interp, servPtr, connChanName);
+    connChanPtr = ConnChanGetLocked(interp, servPtr, connChanName);
 
     if (unlikely(connChanPtr == NULL)) {
         /*
@@ -3161,164 +3544,9 @@ NsConnChanWrite(Tcl_Interp *interp, const char *connChanName, const char *msgStr
         /*
          * The provided channel name exists.
          */
-        struct iovec iovecs[2];
-        int          nBuffers = 1;
-        size_t       toSend;
-        int          caseInt = -1;
-
-        iovecs[0].iov_len = 0;
-        iovecs[1].iov_len = 0;
-
-        if (connChanPtr->debugLevel > 1 && connChanPtr->debugFD == 0) {
-            static char  fnbuffer[256];
-
-            snprintf(fnbuffer, sizeof(fnbuffer), "/tmp/OUT-%s-XXXXXX", connChanName);
-            connChanPtr->debugFD = ns_mkstemp(fnbuffer);
-            Ns_Log(Notice, "CREATED file %s fd %d", fnbuffer, connChanPtr->debugFD);
-        }
-
-        toSend = PrepareSendBuffers(connChanPtr, msgString, msgLength, iovecs, &nBuffers, &caseInt);
-
-        Ns_Log(Ns_LogConnchanDebug, "%s new message length %" PRITcl_Size
-               " buffered length %" PRITcl_Size
-               " total %" PRIdz,
-               connChanName, msgLength, connChanPtr->sendBuffer != NULL ? connChanPtr->sendBuffer->length : 0,
-               toSend);
-
-        /*
-         * Perform the send operation as registered in the driver.
-         */
-        bytesSent = (toSend > 0)
-            ? ConnchanDriverSend(interp, connChanPtr, iovecs, nBuffers, 0u, &connChanPtr->sendTimeout)
-            : 0;
-
-        if (bytesSent != 0 && connChanPtr->sockPtr->sendRejected != 0) {
-            Ns_Log(Warning, "REJECT HANDLING %s (%d,%ld): something was sent (%ld) but send rejected is still %ld, toSend %ld send buffer %p sendreject base %p",
-                   connChanPtr->channelName, connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendCount,
-                   bytesSent, connChanPtr->sockPtr->sendRejected, toSend,
-                   ConnChanBufferAddress(connChanPtr,sendBuffer),
-                   connChanPtr->sockPtr->sendRejectedBase);
-        }
-
-        Ns_Log(Ns_LogConnchanDebug, "%s after ConnchanDriverSend nbufs %d len[0] %" PRIdz
-            ", len[1] %" PRIdz " sent %" PRIdz,
-            connChanName, nBuffers, iovecs[0].iov_len, iovecs[1].iov_len, bytesSent);
-
-        /*
-         * If some data was sent (bytesSent > -1), update the state accordingly.
-         */
-        if (bytesSent > -1) {
-            size_t unsentBytes = (size_t)toSend - (size_t)bytesSent;
-
-            if (connChanPtr->debugLevel > 1 && connChanPtr->sendBuffer != NULL) {
-                DebugLogBufferState(connChanPtr, toSend, bytesSent, connChanPtr->sendBuffer->string,
-                                    "partial write, unsent bytes %ld", unsentBytes);
-                bytes_written = write(connChanPtr->debugFD, "\n-----CUT-HERE-----\n", 20u);
-            }
-
-            connChanPtr->wBytes += (size_t)bytesSent;
-
-            if (unsentBytes > 0) {
-
-                if (bytesSent == 0 && connChanPtr->requireStableSendBuffer) {
-                    /*
-                     * Nothing was sent.  In case, we require a stable
-                     * send buffer, we have always a send buffer and
-                     * always a single iovec. There is nothing to
-                     * shift or concatenate.
-                     */
-
-                    if (connChanPtr->debugLevel > 1 && connChanPtr->sendBuffer != NULL) {
-                        DebugLogBufferState(connChanPtr, toSend, bytesSent, connChanPtr->sendBuffer->string,
-                                            "nothing was sent, unsent bytes %ld", unsentBytes);
-                    }
-                    if (connChanPtr->debugLevel > 0) {
-                        Ns_Log(Notice, "REJECT HANDLING %s (%d,%ld): nothing was sent, send buffer %p sendreject base %p",
-                               connChanPtr->channelName, connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendCount,
-                               ConnChanBufferAddress(connChanPtr,sendBuffer),
-                               connChanPtr->sockPtr->sendRejectedBase);
-                    }
-
-                } else {
-                    TCL_SIZE_T unsentNewData;
-
-                    if (connChanPtr->debugLevel > 0) {
-                        Ns_Log(Notice, "REJECT HANDLING %s (%d,%ld): something was sent (%ld), send buffer %p sendreject base %p, will call CompactBuffers",
-                               connChanPtr->channelName, connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendCount,
-                               bytesSent,
-                               ConnChanBufferAddress(connChanPtr,sendBuffer),
-                               connChanPtr->sockPtr->sendRejectedBase);
-                    }
-                    /*
-                     * Something was sent.  Ensure that the send
-                     * buffer is properly allocated.
-                     */
-                    if (connChanPtr->sendBuffer == NULL && connChanPtr->sockPtr->sendRejected > 0) {
-                        Ns_Log(Notice, "NsConnChanWrite sock %d acquires send buffer with rejected data (%ld)",
-                               connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendRejected);
-                    }
-                    RequireDsBuffer(&connChanPtr->sendBuffer);
-
-                    /*
-                     * Compact old data in the sendBuffer.  If two buffers
-                     * were used, determine how much of the new data has to be appended.
-                     */
-                    unsentNewData = CompactBuffers(connChanPtr, msgString, msgLength, bytesSent, iovecs, nBuffers, toSend, caseInt);
-
-                    /*
-                     * If there is unsent new data, append it to the
-                     * send buffer for later transmission.
-                     */
-                    if (unsentNewData > 0) {
-                        Tcl_DStringAppend(connChanPtr->sendBuffer,
-                                          msgString + (msgLength - unsentNewData),
-                                          unsentNewData);
-
-                        if (connChanPtr->sockPtr->sendRejected > 0) {
-                            Ns_Log(Notice, "NsConnChanWrite sock %d rejected data (%ld): "
-                                   "append unsent new data",
-                                   connChanPtr->sockPtr->sock, connChanPtr->sockPtr->sendRejected);
-                        }
-                    }
-                }
-            } else {
-                /*
-                 * All data was sent successfully.
-                 */
-                TCL_SIZE_T buffedLen = ConnChanBufferSize(connChanPtr, sendBuffer);
-
-                Ns_Log(Ns_LogConnchanDebug, "... buffedLen %" PRITcl_Size
-                       " msgLength %" PRITcl_Size
-                       " everything was sent, unsentBytes %" PRIdz
-                       ", (BYTES from %" PRIdz " to %" PRIdz ")",
-                       buffedLen, msgLength, unsentBytes,
-                       connChanPtr->wBytes - (size_t)bytesSent, connChanPtr->wBytes);
-                assert(unsentBytes == 0);
-
-                /*
-                 * Clear the send buffer since all data was sent.
-                 */
-
-                if (buffedLen > 0) {
-                    Tcl_DStringSetLength(connChanPtr->sendBuffer, 0);
-                }
-                if (connChanPtr->debugLevel > 1) {
-                    DebugLogBufferState(connChanPtr, toSend, bytesSent, NULL, "all sent");
-                }
-
-            }
-        } else {
-            /*
-             * The send operation failed, mark the result as an error.
-             */
-            result = TCL_ERROR;
-        }
-
-        /*
-         * Update the error number from the socket's send error value.
-         */
-        *errnoPtr = connChanPtr->sockPtr->sendErrno;
-
+        result = ConnChanWriteBuffer(interp, connChanPtr, msgString, msgLength,
+                                     &connChanPtr->sendTimeout, &bytesSent, errnoPtr);
+        Ns_MutexUnlock(&connChanPtr->lock);
     }
     Ns_Log(Ns_LogConnchanDebug, "%s ns_connchan write returns %s", connChanName, Ns_TclReturnCodeString(result));
 
@@ -3444,29 +3672,515 @@ ConnChanDebugObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc,
 /*
  *----------------------------------------------------------------------
  *
- * ConnChanWsencodeObjCmd --
+ * WsMaskData --
  *
- *      Implements "ns_connchan wsencode". Returns a WebSocket frame in
- *      form of binary data produced from the input parameters.
+ *      Apply the 4-byte WebSocket mask to the payload (RFC 6455,
+ *      section 5.3). Since masking is an XOR operation, the same
+ *      function is used for masking and unmasking. The payload is
+ *      processed in blocks of 32 bytes (AVX2), 16 bytes (SSE2, NEON) or
+ *      8 bytes (portable fallback) with the mask replicated over the
+ *      block, the remaining bytes are processed one by one. The
+ *      source and destination might be identical for in-place
+ *      operation.
  *
  * Results:
- *      A standard Tcl result.
+ *      None.
  *
  * Side effects:
- *      None.
+ *      Updates the destination buffer.
  *
  *----------------------------------------------------------------------
  */
-static int
-ConnChanWsencodeObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+static void
+WsMaskData(unsigned char *dst, const unsigned char *src, size_t length, const unsigned char *mask)
 {
-    int                      result = TCL_OK, isBinary = 0, opcode = 1, fin = 1, masked = 0;
-    Tcl_Obj                 *messageObj;
-    static Ns_ObjvTable      finValues[] = {
-        {"0",  0u},
-        {"1",  1u},
-        {NULL, 0u}
-    };
+    size_t   i = 0u;
+    uint32_t mask32;
+    uint64_t mask64;
+
+    memcpy(&mask32, mask, 4u);
+    mask64 = ((uint64_t)mask32 << 32) | (uint64_t)mask32;
+
+#if defined(NS_WS_MASK_AVX2)
+    if (length >= 32u) {
+        const __m256i vmask = _mm256_set1_epi32((int)mask32);
+
+        for (; i + 32u <= length; i += 32u) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)(src + i));
+
+            _mm256_storeu_si256((__m256i *)(void *)(dst + i), _mm256_xor_si256(v, vmask));
+        }
+    }
+#endif
+#if defined(NS_WS_MASK_SSE2)
+    if (length - i >= 16u) {
+        const __m128i vmask = _mm_set1_epi32((int)mask32);
+
+        for (; i + 16u <= length; i += 16u) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(src + i));
+
+            _mm_storeu_si128((__m128i *)(void *)(dst + i), _mm_xor_si128(v, vmask));
+        }
+    }
+#elif defined(NS_WS_MASK_NEON)
+    if (length - i >= 16u) {
+        const uint8x16_t vmask = vreinterpretq_u8_u32(vdupq_n_u32(mask32));
+
+        for (; i + 16u <= length; i += 16u) {
+            vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), vmask));
+        }
+    }
+#endif
+    /*
+     * Portable fallback and remaining full words. All block sizes are
+     * multiples of 4, so the mask phase is always 0 here.
+     */
+    for (; i + 8u <= length; i += 8u) {
+        uint64_t v;
+
+        memcpy(&v, src + i, 8u);
+        v ^= mask64;
+        memcpy(dst + i, &v, 8u);
+    }
+    for (; i < length; i++) {
+        dst[i] = src[i] ^ mask[i & 3u];
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WsEncodeFrame --
+ *
+ *      Encode a WebSocket frame with the provided opcode and payload
+ *      into the provided (initialized) Tcl_DString. When "compressed"
+ *      is set, the payload was already compressed and the RSV1 bit is
+ *      set (RFC 7692).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+WsEncodeFrame(Tcl_DString *frameDsPtr, const unsigned char *messageString, TCL_SIZE_T messageLength,
+              int opcode, bool fin, bool masked, bool compressed)
+{
+    unsigned char *data;
+    size_t         offset;
+
+    data = (unsigned char *)frameDsPtr->string;
+
+    Tcl_DStringSetLength(frameDsPtr, 2);
+    /*
+     * Initialize first two bytes, and then XOR flags into it.
+     */
+    data[0] = '\0';
+    data[1] = '\0';
+
+    data[0] = (unsigned char)(data[0] | ((unsigned char)opcode & 0x0Fu));
+    if (fin) {
+        data[0] |= 0x80u;
+    }
+    if (compressed) {
+        data[0] |= 0x40u;
+    }
+
+    if ( messageLength <= 125 ) {
+        data[1] = (unsigned char)(data[1] | ((unsigned char)messageLength & 0x7Fu));
+        offset = 2;
+    } else if ( messageLength <= 65535 ) {
+        uint16_t len16;
+        /*
+         * Together with the first clause, this means:
+         * messageLength > 125 && messageLength <= 65535
+         */
+
+        Tcl_DStringSetLength(frameDsPtr, 4);
+        data[1] |= (( unsigned char )126 & 0x7Fu);
+        len16 = htobe16((short unsigned int)messageLength);
+        memcpy(&data[2], &len16, 2);
+        offset = 4;
+    } else {
+        uint64_t len64;
+        /*
+         * Together with the first two clauses, this means:
+         * messageLength > 65535
+         */
+
+        Tcl_DStringSetLength(frameDsPtr, 10);
+        data[1] |= (( unsigned char )127 & 0x7Fu);
+        len64 = htobe64((uint64_t)messageLength);
+        memcpy(&data[2], &len64, 8);
+        offset = 10;
+    }
+
+    if (masked) {
+        unsigned char mask[4];
+
+        data[1] |= 0x80u;
+#ifdef HAVE_OPENSSL_EVP_H
+        (void) RAND_bytes(&mask[0], 4);
+#else
+        {
+            double d = Ns_DRand();
+            /*
+             * In case double is 64-bits (which is the case on
+             * most platforms) the first four bytes contains much
+             * less randoness than the second 4 bytes.
+             */
+            if (sizeof(d) == 8) {
+                const char *p = (const char *)&d;
+                memcpy(&mask[0], p+4, 4);
+            } else {
+                memcpy(&mask[0], &d, 4);
+            }
+        }
+#endif
+        Tcl_DStringSetLength(frameDsPtr, (TCL_SIZE_T)offset + 4 + messageLength);
+        data = (unsigned char *)frameDsPtr->string;
+        memcpy(&data[offset], &mask[0], 4);
+        offset += 4;
+        WsMaskData(&data[offset], messageString, (size_t)messageLength, mask);
+    } else {
+        Tcl_DStringSetLength(frameDsPtr, (TCL_SIZE_T)offset + messageLength);
+        data = (unsigned char *)frameDsPtr->string;
+        memcpy(&data[offset], &messageString[0], (size_t)messageLength);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WsDeflateFree --
+ *
+ *      Free the permessage-deflate contexts of a connection channel.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees memory.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+WsDeflateFree(WsDeflate *wsDeflatePtr)
+{
+    Ns_CompressRawFree(&wsDeflatePtr->deflate);
+    Ns_InflateRawFree(&wsDeflatePtr->inflate);
+    ns_free(wsDeflatePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WsDeflateNegotiate --
+ *
+ *      Process the extension offers sent by the client in the
+ *      "Sec-WebSocket-Extensions" request header field and select the
+ *      first acceptable "permessage-deflate" offer (RFC 7692, section
+ *      7.1). Offers with unknown or invalid parameters are declined.
+ *
+ *      The server uses at most "maxWindowBits" for its compression
+ *      window; when the client announces support for
+ *      "client_max_window_bits", the client window is limited as
+ *      well. When "noContextTakeover" is set, the context takeover is
+ *      disabled in both directions, trading compression ratio for
+ *      memory.
+ *
+ * Results:
+ *      NS_TRUE, when an offer was accepted. In this case, the value
+ *      for the "Sec-WebSocket-Extensions" reply header field is
+ *      appended to responseDsPtr and the negotiated parameters are
+ *      returned in the last arguments.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+WsDeflateNegotiate(const char *offers, int maxWindowBits, bool noContextTakeover,
+                   Tcl_DString *responseDsPtr, int *serverWindowBitsPtr,
+                   int *clientWindowBitsPtr, bool *serverNoContextTakeoverPtr,
+                   bool *clientNoContextTakeoverPtr)
+{
+    const char *p = offers;
+    bool        accepted = NS_FALSE;
+
+    while (*p != '\0' && !accepted) {
+        const char *nameStart;
+        size_t      nameLength;
+        bool        valid = NS_TRUE, clientWindowBitsOffered = NS_FALSE;
+        bool        serverNoContextTakeover = noContextTakeover;
+        bool        clientNoContextTakeover = noContextTakeover;
+        int         serverWindowBits = 0, clientWindowBits = 0;
+
+        /*
+         * Extension name.
+         */
+        while (CHARTYPE(space, *p) != 0 || *p == ',') {
+            p++;
+        }
+        nameStart = p;
+        while (*p != '\0' && *p != ';' && *p != ',' && CHARTYPE(space, *p) == 0) {
+            p++;
+        }
+        nameLength = (size_t)(p - nameStart);
+        if (nameLength == 0u) {
+            break;
+        }
+
+        /*
+         * Extension parameters.
+         */
+        for (;;) {
+            const char *paramStart;
+            size_t      paramLength;
+            Tcl_DString valueDs;
+            bool        hasValue = NS_FALSE;
+
+            while (CHARTYPE(space, *p) != 0) {
+                p++;
+            }
+            if (*p != ';') {
+                break;
+            }
+            p++;
+            while (CHARTYPE(space, *p) != 0) {
+                p++;
+            }
+            paramStart = p;
+            while (*p != '\0' && *p != ';' && *p != ',' && *p != '=' && CHARTYPE(space, *p) == 0) {
+                p++;
+            }
+            paramLength = (size_t)(p - paramStart);
+            while (CHARTYPE(space, *p) != 0) {
+                p++;
+            }
+            Tcl_DStringInit(&valueDs);
+            if (*p == '=') {
+                hasValue = NS_TRUE;
+                p++;
+                while (CHARTYPE(space, *p) != 0) {
+                    p++;
+                }
+                if (*p == '"') {
+                    for (p++; *p != '\0' && *p != '"'; p++) {
+                        Tcl_DStringAppend(&valueDs, p, 1);
+                    }
+                    if (*p == '"') {
+                        p++;
+                    }
+                } else {
+                    const char *valueStart = p;
+
+                    while (*p != '\0' && *p != ';' && *p != ',' && CHARTYPE(space, *p) == 0) {
+                        p++;
+                    }
+                    Tcl_DStringAppend(&valueDs, valueStart, (TCL_SIZE_T)(p - valueStart));
+                }
+            }
+
+            if (paramLength == 26u && strncmp(paramStart, "server_no_context_takeover", 26u) == 0 && !hasValue) {
+                serverNoContextTakeover = NS_TRUE;
+
+            } else if (paramLength == 26u && strncmp(paramStart, "client_no_context_takeover", 26u) == 0 && !hasValue) {
+                clientNoContextTakeover = NS_TRUE;
+
+            } else if (paramLength == 22u && strncmp(paramStart, "server_max_window_bits", 22u) == 0 && hasValue) {
+                int bits = 0;
+
+                /*
+                 * zlib does not support a window size of 8 bits for
+                 * raw deflate, so decline such offers.
+                 */
+                if (Ns_StrToInt(valueDs.string, &bits) != NS_OK || bits < 9 || bits > 15) {
+                    valid = NS_FALSE;
+                } else {
+                    serverWindowBits = bits;
+                }
+
+            } else if (paramLength == 22u && strncmp(paramStart, "client_max_window_bits", 22u) == 0) {
+                int bits = 15;
+
+                if (hasValue && (Ns_StrToInt(valueDs.string, &bits) != NS_OK || bits < 8 || bits > 15)) {
+                    valid = NS_FALSE;
+                } else {
+                    clientWindowBitsOffered = NS_TRUE;
+                    clientWindowBits = bits;
+                }
+            } else {
+                valid = NS_FALSE;
+            }
+            Tcl_DStringFree(&valueDs);
+        }
+
+        if (valid && nameLength == 18u && strncmp(nameStart, "permessage-deflate", 18u) == 0) {
+            Tcl_DStringAppend(responseDsPtr, "permessage-deflate", 18);
+            if (serverNoContextTakeover) {
+                Tcl_DStringAppend(responseDsPtr, "; server_no_context_takeover", 28);
+            }
+            if (clientNoContextTakeover) {
+                Tcl_DStringAppend(responseDsPtr, "; client_no_context_takeover", 28);
+            }
+            if (serverWindowBits > 0) {
+                serverWindowBits = MIN(serverWindowBits, maxWindowBits);
+                Ns_DStringPrintf(responseDsPtr, "; server_max_window_bits=%d", serverWindowBits);
+            } else {
+                serverWindowBits = maxWindowBits;
+            }
+            if (clientWindowBitsOffered) {
+                clientWindowBits = MIN(clientWindowBits, maxWindowBits);
+                if (clientWindowBits < 15) {
+                    Ns_DStringPrintf(responseDsPtr, "; client_max_window_bits=%d", clientWindowBits);
+                }
+            } else {
+                clientWindowBits = 15;
+            }
+            *serverWindowBitsPtr = serverWindowBits;
+            *clientWindowBitsPtr = clientWindowBits;
+            *serverNoContextTakeoverPtr = serverNoContextTakeover;
+            *clientNoContextTakeoverPtr = clientNoContextTakeover;
+            accepted = NS_TRUE;
+        } else {
+            /*
+             * Skip the remainder of this offer.
+             */
+            while (*p != '\0' && *p != ',') {
+                p++;
+            }
+        }
+    }
+
+    return accepted;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanWsdeflateObjCmd --
+ *
+ *      Implements "ns_connchan wsdeflate". Negotiates the WebSocket
+ *      permessage-deflate extension based on the
+ *      "Sec-WebSocket-Extensions" request header field of the client
+ *      and activates per-channel compression contexts.
+ *
+ * Results:
+ *      A standard Tcl result. The result is the value for the
+ *      "Sec-WebSocket-Extensions" reply header field, or empty, when
+ *      the extension was not negotiated.
+ *
+ * Side effects:
+ *      Allocates compression contexts for the channel.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ConnChanWsdeflateObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp   *itPtr = clientData;
+    int               result = TCL_OK, level = 6, maxWindowBits = 15, noContextTakeover = 0;
+    char             *channelName, *offers;
+    Tcl_WideInt       maxSize = 0;
+    Ns_ObjvValueRange levelRange = {1, 9};
+    Ns_ObjvValueRange windowBitsRange = {9, 15};
+    Ns_ObjvValueRange maxSizeRange = {0, LLONG_MAX};
+    Ns_ObjvSpec opts[] = {
+        {"-level",             Ns_ObjvInt,     &level,             &levelRange},
+        {"-maxsize",           Ns_ObjvMemUnit, &maxSize,           &maxSizeRange},
+        {"-maxwindowbits",     Ns_ObjvInt,     &maxWindowBits,     &windowBitsRange},
+        {"-nocontexttakeover", Ns_ObjvBool,    &noContextTakeover, INT2PTR(NS_TRUE)},
+        {"--",                 Ns_ObjvBreak,   NULL,               NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"channel",    Ns_ObjvString, &channelName, NULL},
+        {"extensions", Ns_ObjvString, &offers,      NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        NsConnChan *connChanPtr = ConnChanGetLocked(interp, itPtr->servPtr, channelName);
+        Tcl_DString responseDs;
+        int         serverWindowBits = 15, clientWindowBits = 15;
+        bool        serverNoContextTakeover = NS_FALSE, clientNoContextTakeover = NS_FALSE;
+
+        Tcl_DStringInit(&responseDs);
+        if (connChanPtr == NULL) {
+            result = TCL_ERROR;
+
+        } else if (WsDeflateNegotiate(offers, maxWindowBits, noContextTakeover == 1, &responseDs,
+                                      &serverWindowBits, &clientWindowBits,
+                                      &serverNoContextTakeover, &clientNoContextTakeover)) {
+            WsDeflate *wsDeflatePtr = ns_calloc(1u, sizeof(WsDeflate));
+
+            wsDeflatePtr->maxSize = (size_t)maxSize;
+            wsDeflatePtr->serverNoContextTakeover = serverNoContextTakeover;
+            wsDeflatePtr->clientNoContextTakeover = clientNoContextTakeover;
+
+            if (Ns_CompressRawInit(&wsDeflatePtr->deflate, level, serverWindowBits) != NS_OK
+                || Ns_InflateRawInit(&wsDeflatePtr->inflate, clientWindowBits) != NS_OK) {
+                WsDeflateFree(wsDeflatePtr);
+                Ns_TclPrintfResult(interp, "could not initialize compression for channel \"%s\"",
+                                   channelName);
+                result = TCL_ERROR;
+            } else {
+                if (connChanPtr->wsDeflatePtr != NULL) {
+                    WsDeflateFree(connChanPtr->wsDeflatePtr);
+                }
+                connChanPtr->wsDeflatePtr = wsDeflatePtr;
+                Tcl_DStringResult(interp, &responseDs);
+            }
+        }
+        if (connChanPtr != NULL) {
+            Ns_MutexUnlock(&connChanPtr->lock);
+        }
+        Tcl_DStringFree(&responseDs);
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanWsencodeObjCmd --
+ *
+ *      Implements "ns_connchan wsencode". Returns a WebSocket frame in
+ *      form of binary data produced from the input parameters. When a
+ *      channel with negotiated permessage-deflate extension is
+ *      provided, data messages are compressed. Note that the
+ *      compression context of the channel advances when the frame is
+ *      encoded, so with context takeover, the frames have to be sent in
+ *      the order they were encoded, and none of them may be dropped.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      Might update the compression context of the channel.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ConnChanWsencodeObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp          *itPtr = clientData;
+    int                      result = TCL_OK, isBinary = 0, opcode = 1, fin = 1, masked = 0;
+    char                    *channelName = NULL;
+    Tcl_Obj                 *messageObj;
+    static Ns_ObjvTable      finValues[] = {
+        {"0",  0u},
+        {"1",  1u},
+        {NULL, 0u}
+    };
     static Ns_ObjvTable      opcodes[] = {
         {"continue",  0},
         {"text",      1},
@@ -3477,9 +4191,10 @@ ConnChanWsencodeObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SI
         {NULL,       0u}
     };
     Ns_ObjvSpec opts[] = {
-        {"-binary",     Ns_ObjvBool,  &isBinary, INT2PTR(NS_TRUE)},
-        {"-fin",        Ns_ObjvIndex, &fin,      &finValues},
-        {"-mask",       Ns_ObjvBool,  &masked,   INT2PTR(NS_TRUE)},
+        {"-binary",     Ns_ObjvBool,   &isBinary,    INT2PTR(NS_TRUE)},
+        {"-channel",    Ns_ObjvString, &channelName, NULL},
+        {"-fin",        Ns_ObjvIndex,  &fin,         &finValues},
+        {"-mask",       Ns_ObjvBool,   &masked,      INT2PTR(NS_TRUE)},
         {"-opcode",     Ns_ObjvIndex, &opcode,   &opcodes},
         {"--",          Ns_ObjvBreak, NULL,      NULL},
         {NULL, NULL, NULL, NULL}
@@ -3492,12 +4207,14 @@ ConnChanWsencodeObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SI
     if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
         result = TCL_ERROR;
 
+    } else if (channelName != NULL && ConnChanGet(interp, itPtr->servPtr, channelName) == NULL) {
+        result = TCL_ERROR;
+
     } else {
         const unsigned char *messageString;
-        unsigned char       *data;
         TCL_SIZE_T           messageLength;
-        Tcl_DString          messageDs, frameDs;
-        size_t               offset;
+        Tcl_DString          messageDs, frameDs, deflateDs;
+        bool                 compressed = NS_FALSE;
 
         Tcl_DStringInit(&messageDs);
         Tcl_DStringInit(&frameDs);
@@ -3510,96 +4227,435 @@ ConnChanWsencodeObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SI
             isBinary = 1;
         }
         messageString = Ns_GetBinaryString(messageObj, isBinary == 1, &messageLength, &messageDs);
-        data = (unsigned char *)frameDs.string;
+        Tcl_DStringInit(&deflateDs);
+        if (channelName != NULL && fin == 1 && (opcode == 1 || opcode == 2)) {
+            NsConnChan *connChanPtr = ConnChanGetLocked(NULL, itPtr->servPtr, channelName);
 
-        Tcl_DStringSetLength(&frameDs, 2);
-        /*
-         * Initialize first two bytes, and then XOR flags into it.
-         */
-        data[0] = '\0';
-        data[1] = '\0';
+            /*
+             * When permessage-deflate was negotiated for the channel,
+             * compress data messages. Control frames and fragmented
+             * messages are sent uncompressed. The channel lock
+             * serializes the updates of the compression context.
+             */
+            if (connChanPtr != NULL) {
+                if (connChanPtr->wsDeflatePtr != NULL
+                    && Ns_CompressRawBuffer(&connChanPtr->wsDeflatePtr->deflate, messageString,
+                                            (size_t)messageLength, &deflateDs,
+                                            connChanPtr->wsDeflatePtr->serverNoContextTakeover) == NS_OK) {
+                    messageString = (const unsigned char *)deflateDs.string;
+                    messageLength = deflateDs.length;
+                    compressed = NS_TRUE;
+                }
+                Ns_MutexUnlock(&connChanPtr->lock);
+            }
+        }
+        WsEncodeFrame(&frameDs, messageString, messageLength, opcode, fin == 1, masked == 1, compressed);
+
+        Tcl_SetObjResult(interp, Tcl_NewByteArrayObj((unsigned char *)frameDs.string, frameDs.length));
+
+        Tcl_DStringFree(&messageDs);
+        Tcl_DStringFree(&frameDs);
+        Tcl_DStringFree(&deflateDs);
+    }
+    return result;
+}
+
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GroupRemoveMember --
+ *
+ *      Remove a channel from a broadcast group. When the last member
+ *      is removed, the group is deleted. The caller must hold the
+ *      write lock for the connchans of the server.
+ *
+ * Results:
+ *      Boolean value indicating whether the channel was a member.
+ *
+ * Side effects:
+ *      Might free the group.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+GroupRemoveMember(Tcl_HashEntry *groupEntryPtr, const char *channelName)
+{
+    ConnChanGroup *groupPtr = Tcl_GetHashValue(groupEntryPtr);
+    Tcl_HashEntry *hPtr;
+    bool           found = NS_FALSE;
 
-        data[0] = (unsigned char)(data[0] | ((unsigned char)opcode & 0x0Fu));
-        if (fin) {
-            data[0] |= 0x80u;
+    hPtr = Tcl_FindHashEntry(&groupPtr->members, channelName);
+    if (hPtr != NULL) {
+        Tcl_DeleteHashEntry(hPtr);
+        found = NS_TRUE;
+        if (groupPtr->members.numEntries == 0) {
+            Tcl_DeleteHashTable(&groupPtr->members);
+            ns_free(groupPtr);
+            Tcl_DeleteHashEntry(groupEntryPtr);
         }
+    }
+    return found;
+}
 
-        if ( messageLength <= 125 ) {
-            data[1] = (unsigned char)(data[1] | ((unsigned char)messageLength & 0x7Fu));
-            offset = 2;
-        } else if ( messageLength <= 65535 ) {
-            uint16_t len16;
-            /*
-             * Together with the first clause, this means:
-             * messageLength > 125 && messageLength <= 65535
-             */
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanGroupObjCmd --
+ *
+ *      Implements "ns_connchan group". Maintains named broadcast
+ *      groups of connection channels, which can be used as targets of
+ *      "ns_connchan broadcast". A group is created when the first
+ *      channel is added and deleted, when its last member is removed
+ *      or closed.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      Updates the group table of the server.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ConnChanGroupObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr   = clientData;
+    NsServer       *servPtr = itPtr->servPtr;
+    int             result  = TCL_OK, action = 0;
+    char           *groupName, *channelName = NULL;
+    enum { GAdd, GDelete, GMembers, GRemove, GStats };
+    static Ns_ObjvTable actions[] = {
+        {"add",     GAdd},
+        {"delete",  GDelete},
+        {"members", GMembers},
+        {"remove",  GRemove},
+        {"stats",   GStats},
+        {NULL,      0u}
+    };
+    Ns_ObjvSpec     args[] = {
+        {"action",   Ns_ObjvIndex,  &action,      actions},
+        {"group",    Ns_ObjvString, &groupName,   NULL},
+        {"?channel", Ns_ObjvString, &channelName, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
 
-            Tcl_DStringSetLength(&frameDs, 4);
-            data[1] |= (( unsigned char )126 & 0x7Fu);
-            len16 = htobe16((short unsigned int)messageLength);
-            memcpy(&data[2], &len16, 2);
-            offset = 4;
+    } else if ((action == GAdd || action == GRemove) && channelName == NULL) {
+        Ns_TclPrintfResult(interp, "action \"%s\" requires a channel", Tcl_GetString(objv[2]));
+        result = TCL_ERROR;
+
+    } else if ((action == GDelete || action == GMembers || action == GStats) && channelName != NULL) {
+        Ns_TclPrintfResult(interp, "action \"%s\" does not accept a channel", Tcl_GetString(objv[2]));
+        result = TCL_ERROR;
+
+    } else if (action == GAdd) {
+        Tcl_HashEntry *hPtr;
+        ConnChanGroup *groupPtr;
+        int            isNew = 0;
+
+        Ns_RWLockWrLock(&servPtr->connchans.lock);
+        if (Tcl_FindHashEntry(&servPtr->connchans.table, channelName) == NULL) {
+            Ns_TclPrintfResult(interp, "channel \"%s\" does not exist", channelName);
+            result = TCL_ERROR;
         } else {
-            uint64_t len64;
-            /*
-             * Together with the first two clauses, this means:
-             * messageLength > 65535
-             */
+            hPtr = Tcl_CreateHashEntry(&servPtr->connchans.groups, groupName, &isNew);
+            if (isNew != 0) {
+                groupPtr = ns_calloc(1u, sizeof(ConnChanGroup));
+                Tcl_InitHashTable(&groupPtr->members, TCL_STRING_KEYS);
+                Tcl_SetHashValue(hPtr, groupPtr);
+            } else {
+                groupPtr = Tcl_GetHashValue(hPtr);
+            }
+            (void) Tcl_CreateHashEntry(&groupPtr->members, channelName, &isNew);
+            Tcl_SetObjResult(interp, Tcl_NewBooleanObj(isNew));
+        }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
+
+    } else if (action == GRemove) {
+        Tcl_HashEntry *hPtr;
+        bool           found = NS_FALSE;
 
-            Tcl_DStringSetLength(&frameDs, 10);
-            data[1] |= (( unsigned char )127 & 0x7Fu);
-            len64 = htobe64((uint64_t)messageLength);
-            memcpy(&data[2], &len64, 8);
-            offset = 10;
+        Ns_RWLockWrLock(&servPtr->connchans.lock);
+        hPtr = Tcl_FindHashEntry(&servPtr->connchans.groups, groupName);
+        if (hPtr != NULL) {
+            found = GroupRemoveMember(hPtr, channelName);
         }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
+        Tcl_SetObjResult(interp, Tcl_NewBooleanObj(found));
 
-        if (masked) {
-            unsigned char mask[4];
-            size_t        i, j;
+    } else if (action == GDelete) {
+        Tcl_HashEntry *hPtr;
 
-            data[1] |= 0x80u;
-#ifdef HAVE_OPENSSL_EVP_H
-            (void) RAND_bytes(&mask[0], 4);
-#else
-            {
-                double d = Ns_DRand();
+        Ns_RWLockWrLock(&servPtr->connchans.lock);
+        hPtr = Tcl_FindHashEntry(&servPtr->connchans.groups, groupName);
+        if (hPtr != NULL) {
+            ConnChanGroup *groupPtr = Tcl_GetHashValue(hPtr);
+
+            Tcl_DeleteHashTable(&groupPtr->members);
+            ns_free(groupPtr);
+            Tcl_DeleteHashEntry(hPtr);
+        }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
+        Tcl_SetObjResult(interp, Tcl_NewBooleanObj(hPtr != NULL));
+
+    } else {
+        const Tcl_HashEntry *hPtr;
+        Tcl_Obj             *resultObj = Tcl_NewListObj(0, NULL);
+
+        Ns_RWLockRdLock(&servPtr->connchans.lock);
+        hPtr = Tcl_FindHashEntry(&servPtr->connchans.groups, groupName);
+        if (hPtr != NULL) {
+            ConnChanGroup *groupPtr = Tcl_GetHashValue(hPtr);
+
+            if (action == GMembers) {
+                Tcl_HashSearch search;
+
+                for (hPtr = Tcl_FirstHashEntry(&groupPtr->members, &search); hPtr != NULL;
+                     hPtr = Tcl_NextHashEntry(&search)) {
+                    Tcl_ListObjAppendElement(interp, resultObj,
+                                             Tcl_NewStringObj(Tcl_GetHashKey(&groupPtr->members, hPtr),
+                                                              TCL_INDEX_NONE));
+                }
+            } else {
+                Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewStringObj("members", 7));
+                Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewIntObj(groupPtr->members.numEntries));
+                Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewStringObj("messages", 8));
+                Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewWideIntObj(groupPtr->messages));
+                Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewStringObj("dropped", 7));
+                Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewWideIntObj(groupPtr->dropped));
+                Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewStringObj("evicted", 7));
+                Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewWideIntObj(groupPtr->evicted));
+            }
+        } else if (action == GStats) {
+            Ns_TclPrintfResult(interp, "group \"%s\" does not exist", groupName);
+            result = TCL_ERROR;
+        }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
+
+        if (result == TCL_OK) {
+            Tcl_SetObjResult(interp, resultObj);
+        } else {
+            Tcl_DecrRefCount(resultObj);
+        }
+    }
+
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanBroadcastObjCmd --
+ *
+ *      Implements "ns_connchan broadcast". Encodes the message once
+ *      as a WebSocket frame and sends this frame to all members of the
+ *      specified group. The frame is sent directly from this buffer;
+ *      only data, which cannot be sent immediately to a member, is
+ *      copied to the send buffer of this member. The send operations
+ *      are performed with a zero timeout, such that a slow member
+ *      never blocks the broadcast for the other members, independent
+ *      of the "-sendtimeout" of the channel. The send operations are
+ *      serialized with the send operations of the threads owning the
+ *      channels via the channel locks.
+ *
+ *      When "-maxbuffered" is specified, members having more than
+ *      this amount of unsent data are treated as slow consumers: the
+ *      message is either dropped for this member (policy "drop") or the
+ *      member is removed from the group (policy "evict"). Members,
+ *      where the send operation fails, are always evicted.
+ *
+ * Results:
+ *      A standard Tcl result. The result is a dict with the number of
+ *      members which received the message ("sent"), from these, the
+ *      number of members with pending data ("buffered"), the number of
+ *      members for which the message was dropped ("dropped"), and the
+ *      list of evicted channels ("evicted").
+ *
+ * Side effects:
+ *      Sends data to the members of the group.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ConnChanBroadcastObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr   = clientData;
+    NsServer       *servPtr = itPtr->servPtr;
+    int             result  = TCL_OK, isBinary = 0, opcode = 1, policy = 0;
+    char           *groupName;
+    Tcl_Obj        *messageObj;
+    Tcl_WideInt     maxBuffered = 0;
+    Ns_ObjvValueRange maxBufferedRange = {0, LLONG_MAX};
+    static Ns_ObjvTable opcodes[] = {
+        {"text",      1},
+        {"binary",    2},
+        {"close",     8},
+        {"ping",      9},
+        {"pong",     10},
+        {NULL,       0u}
+    };
+    static Ns_ObjvTable policies[] = {
+        {"drop",  0},
+        {"evict", 1},
+        {NULL,    0u}
+    };
+    Ns_ObjvSpec opts[] = {
+        {"-binary",      Ns_ObjvBool,    &isBinary,    INT2PTR(NS_TRUE)},
+        {"-maxbuffered", Ns_ObjvMemUnit, &maxBuffered, &maxBufferedRange},
+        {"-opcode",      Ns_ObjvIndex,   &opcode,      &opcodes},
+        {"-policy",      Ns_ObjvIndex,   &policy,      &policies},
+        {"--",           Ns_ObjvBreak,   NULL,         NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"group",   Ns_ObjvString, &groupName,  NULL},
+        {"message", Ns_ObjvObj,    &messageObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const unsigned char *messageString;
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashEntry       *groupEntryPtr;
+        TCL_SIZE_T           messageLength, nMembers = 0, i;
+        Tcl_DString          messageDs, frameDs;
+        Tcl_Obj             *membersObj, *evictedObj, *resultObj, **memberObjv;
+        Tcl_WideInt          nSent = 0, nBuffered = 0, nDropped = 0;
+        const Ns_Time        noTimeout = {0, 0};
+
+        Tcl_DStringInit(&messageDs);
+        Tcl_DStringInit(&frameDs);
+        if (opcode == 2) {
+            isBinary = 1;
+        }
+        messageString = Ns_GetBinaryString(messageObj, isBinary == 1, &messageLength, &messageDs);
+        WsEncodeFrame(&frameDs, messageString, messageLength, opcode, NS_TRUE, NS_FALSE, NS_FALSE);
+
+        /*
+         * Take a snapshot of the member names, such that the send
+         * operations are performed without holding the lock.
+         */
+        membersObj = Tcl_NewListObj(0, NULL);
+        Tcl_IncrRefCount(membersObj);
+        evictedObj = Tcl_NewListObj(0, NULL);
+
+        Ns_RWLockRdLock(&servPtr->connchans.lock);
+        hPtr = Tcl_FindHashEntry(&servPtr->connchans.groups, groupName);
+        if (hPtr != NULL) {
+            ConnChanGroup *groupPtr = Tcl_GetHashValue(hPtr);
+            Tcl_HashSearch search;
+
+            for (hPtr = Tcl_FirstHashEntry(&groupPtr->members, &search); hPtr != NULL;
+                 hPtr = Tcl_NextHashEntry(&search)) {
+                Tcl_ListObjAppendElement(interp, membersObj,
+                                         Tcl_NewStringObj(Tcl_GetHashKey(&groupPtr->members, hPtr),
+                                                          TCL_INDEX_NONE));
+            }
+        }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
+
+        (void) Tcl_ListObjGetElements(interp, membersObj, &nMembers, &memberObjv);
+
+        for (i = 0; i < nMembers; i++) {
+            const char *channelName = Tcl_GetString(memberObjv[i]);
+            NsConnChan *connChanPtr = ConnChanGetLocked(NULL, servPtr, channelName);
+
+            if (connChanPtr == NULL) {
+                Tcl_ListObjAppendElement(interp, evictedObj, memberObjv[i]);
+
+            } else if (connChanPtr->sockPtr == NULL) {
+                Tcl_ListObjAppendElement(interp, evictedObj, memberObjv[i]);
+
+            } else if (maxBuffered > 0
+                       && (Tcl_WideInt)(ConnChanBufferSize(connChanPtr, sendBuffer)
+                                        + ConnChanBufferSize(connChanPtr, secondarySendBuffer)) > maxBuffered) {
                 /*
-                 * In case double is 64-bits (which is the case on
-                 * most platforms) the first four bytes contains much
-                 * less randoness than the second 4 bytes.
+                 * Slow consumer.
                  */
-                if (sizeof(d) == 8) {
-                    const char *p = (const char *)&d;
-                    memcpy(&mask[0], p+4, 4);
+                Ns_Log(Ns_LogConnchanDebug, "%s broadcast to group %s: slow consumer, %s",
+                       channelName, groupName, policy == 0 ? "drop message" : "evict");
+                if (policy == 0) {
+                    nDropped ++;
+                } else {
+                    Tcl_ListObjAppendElement(interp, evictedObj, memberObjv[i]);
+                }
+
+            } else {
+                ssize_t       bytesSent = 0;
+                unsigned long errorCode = 0u;
+
+                if (ConnChanWriteBuffer(interp, connChanPtr, frameDs.string, frameDs.length,
+                                        &noTimeout, &bytesSent, &errorCode) == TCL_OK) {
+                    nSent ++;
+                    if (ConnChanBufferSize(connChanPtr, sendBuffer) > 0
+                        || ConnChanBufferSize(connChanPtr, secondarySendBuffer) > 0) {
+                        nBuffered ++;
+                    }
                 } else {
-                    memcpy(&mask[0], &d, 4);
+                    Ns_Log(Ns_LogConnchanDebug, "%s broadcast to group %s failed: %s",
+                           channelName, groupName, Tcl_GetString(Tcl_GetObjResult(interp)));
+                    Tcl_ListObjAppendElement(interp, evictedObj, memberObjv[i]);
                 }
             }
-#endif
-            Tcl_DStringSetLength(&frameDs, (TCL_SIZE_T)offset + 4 + messageLength);
-            data = (unsigned char *)frameDs.string;
-            memcpy(&data[offset], &mask[0], 4);
-            offset += 4;
-            for( i = offset, j = 0u; j < (size_t)messageLength; i++, j++ ) {
-                data[ i ] = messageString[ j ] ^ mask[ j % 4];
+            if (connChanPtr != NULL) {
+                Ns_MutexUnlock(&connChanPtr->lock);
             }
-        } else {
-            Tcl_DStringSetLength(&frameDs, (TCL_SIZE_T)offset + messageLength);
-            data = (unsigned char *)frameDs.string;
-            memcpy(&data[offset], &messageString[0], (size_t)messageLength);
         }
+        Tcl_ResetResult(interp);
 
-        Tcl_SetObjResult(interp, Tcl_NewByteArrayObj(data, frameDs.length));
+        /*
+         * Update the group statistics and remove the evicted members.
+         */
+        Ns_RWLockWrLock(&servPtr->connchans.lock);
+        groupEntryPtr = Tcl_FindHashEntry(&servPtr->connchans.groups, groupName);
+        if (groupEntryPtr != NULL) {
+            ConnChanGroup *groupPtr = Tcl_GetHashValue(groupEntryPtr);
+            TCL_SIZE_T     nEvicted = 0;
+            Tcl_Obj      **evictedObjv;
+
+            (void) Tcl_ListObjGetElements(interp, evictedObj, &nEvicted, &evictedObjv);
+            groupPtr->messages ++;
+            groupPtr->dropped += nDropped;
+            groupPtr->evicted += (Tcl_WideInt)nEvicted;
+            for (i = 0; i < nEvicted; i++) {
+                bool last = (groupPtr->members.numEntries == 1);
+
+                if (GroupRemoveMember(groupEntryPtr, Tcl_GetString(evictedObjv[i])) && last) {
+                    /*
+                     * The group was deleted together with its last member.
+                     */
+                    break;
+                }
+            }
+        }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
 
+        resultObj = Tcl_NewListObj(0, NULL);
+        Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewStringObj("sent", 4));
+        Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewWideIntObj(nSent));
+        Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewStringObj("buffered", 8));
+        Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewWideIntObj(nBuffered));
+        Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewStringObj("dropped", 7));
+        Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewWideIntObj(nDropped));
+        Tcl_ListObjAppendElement(interp, resultObj, Tcl_NewStringObj("evicted", 7));
+        Tcl_ListObjAppendElement(interp, resultObj, evictedObj);
+        Tcl_SetObjResult(interp, resultObj);
+
+        Tcl_DecrRefCount(membersObj);
         Tcl_DStringFree(&messageDs);
         Tcl_DStringFree(&frameDs);
     }
     return result;
 }
 
-
-
-
 /*
  *----------------------------------------------------------------------
  *
@@ -3624,18 +4680,21 @@ int
 NsTclConnChanObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
     const Ns_SubCmdSpec subcmds[] = {
+        {"broadcast", ConnChanBroadcastObjCmd},
         {"callback", ConnChanCallbackObjCmd},
         {"connect",  ConnChanConnectObjCmd},
         {"close",    ConnChanCloseObjCmd},
         {"debug",    ConnChanDebugObjCmd},
         {"detach",   ConnChanDetachObjCmd},
         {"exists",   ConnChanExistsObjCmd},
+        {"group",    ConnChanGroupObjCmd},
         {"list",     ConnChanListObjCmd},
         {"listen",   ConnChanListenObjCmd},
         {"open",     ConnChanOpenObjCmd},
         {"read",     ConnChanReadObjCmd},
         {"status",   ConnChanStatusObjCmd},
         {"write",    ConnChanWriteObjCmd},
+        {"wsdeflate", ConnChanWsdeflateObjCmd},
         {"wsencode", ConnChanWsencodeObjCmd},
         {NULL, NULL}
     };
@@ -28,6 +28,7 @@ typedef enum {
     SOCK_READY =               0,
     SOCK_MORE =                1,
     SOCK_SPOOL =               2,
+    SOCK_HANDSHAKE =           3,
     SOCK_ERROR =              -1,
     SOCK_CLOSE =              -2,
     SOCK_CLOSETIMEOUT =       -3,
@@ -60,23 +61,38 @@ typedef struct {
 } SpoolerStateMap;
 
 
+/*
+ * Well-known request header fields, sorted by name. Singleton fields must
+ * not be provided more than once. For non-singleton fields, the first
+ * occurrence is extracted (like Ns_SetIGet() would return it).
+ *
+ * The extracted values point into the request header Ns_Set, which is still
+ * built eagerly by Ns_ParseHeader() while reading the request; the headers
+ * are not kept as offsets into the request buffer.
+ */
 const struct {
     const char     *name;
     NsExtractedHeaderIndex  extract;
-} singletonRequestHeaderFields[] = {
-    { "authorization",       NS_EXTRACTED_HEADER_AUTHORIZATION},
-    { "content-length",      NS_EXTRACTED_HEADER_CONTENT_LENGTH},
-    { "content-type",        NS_EXTRACTED_NONE},
-    { "expect",              NS_EXTRACTED_HEADER_EXPECT},
-    { "host",                NS_EXTRACTED_HEADER_HOST},
-    { "if-match",            NS_EXTRACTED_NONE},
-    { "if-modified-since",   NS_EXTRACTED_NONE},
-    { "if-none-match",       NS_EXTRACTED_NONE},
-    { "if-range",            NS_EXTRACTED_NONE},
-    { "if-unmodified-since", NS_EXTRACTED_NONE},
-    { "origin",              NS_EXTRACTED_NONE},
-    { "upgrade",             NS_EXTRACTED_NONE},
-    { "user-agent",          NS_EXTRACTED_NONE}
+    bool            singleton;
+} requestHeaderFields[] = {
+    { "accept-encoding",          NS_EXTRACTED_HEADER_ACCEPT_ENCODING,          NS_FALSE},
+    { "authorization",            NS_EXTRACTED_HEADER_AUTHORIZATION,            NS_TRUE},
+    { "content-length",           NS_EXTRACTED_HEADER_CONTENT_LENGTH,           NS_TRUE},
+    { "content-type",             NS_EXTRACTED_HEADER_CONTENT_TYPE,             NS_TRUE},
+    { "expect",                   NS_EXTRACTED_HEADER_EXPECT,                   NS_TRUE},
+    { "host",                     NS_EXTRACTED_HEADER_HOST,                     NS_TRUE},
+    { "if-match",                 NS_EXTRACTED_NONE,                            NS_TRUE},
+    { "if-modified-since",        NS_EXTRACTED_NONE,                            NS_TRUE},
+    { "if-none-match",            NS_EXTRACTED_NONE,                            NS_TRUE},
+    { "if-range",                 NS_EXTRACTED_NONE,                            NS_TRUE},
+    { "if-unmodified-since",      NS_EXTRACTED_NONE,                            NS_TRUE},
+    { "origin",                   NS_EXTRACTED_NONE,                            NS_TRUE},
+    { "range",                    NS_EXTRACTED_HEADER_RANGE,                    NS_FALSE},
+    { "transfer-encoding",        NS_EXTRACTED_HEADER_TRANSFER_ENCODING,        NS_FALSE},
+    { "upgrade",                  NS_EXTRACTED_NONE,                            NS_TRUE},
+    { "user-agent",               NS_EXTRACTED_NONE,                            NS_TRUE},
+    { "x-expected-entity-length", NS_EXTRACTED_HEADER_X_EXPECTED_ENTITY_LENGTH, NS_FALSE},
+    { "x-forwarded-for",          NS_EXTRACTED_HEADER_X_FORWARDED_FOR,          NS_FALSE}
 };
 
 /*
@@ -109,6 +125,7 @@ typedef struct PollData {
     unsigned int   maxfds;     /* Max fds (will grow as needed). */
     struct pollfd *pfds;        /* Dynamic array of poll structs. */
     Ns_Time        timeout;     /* Min timeout, if any, for next spin. */
+    NsTimerWheel  *timersPtr;   /* Timer wheel for socket timeouts, if any. */
 } PollData;
 
 #define PollIn(ppd, i)           (((ppd)->pfds[(i)].revents & POLLIN)  == POLLIN )
@@ -210,6 +227,7 @@ static AsyncWriter *asyncWriter = NULL;
 
 static Ns_ThreadProc DriverThread;
 static Ns_ThreadProc SpoolerThread;
+static Ns_ThreadProc HandshakeThread;
 static Ns_ThreadProc WriterThread;
 static Ns_ThreadProc AsyncWriterThread;
 
@@ -275,8 +293,10 @@ static void  SockError(Sock *sockPtr, SockState reason, int err)
 static void  SockSendResponse(Sock *sockPtr, int statusCode, const char *errMsg, const char *headers)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
 static void  SockTrigger(NS_SOCKET sock);
-static void  SockTimeout(Sock *sockPtr, const Ns_Time *nowPtr, const Ns_Time *timeout)
-    NS_GNUC_NONNULL(1);
+static void  SockTimeout(Sock *sockPtr, NsTimerWheel *timersPtr, const Ns_Time *nowPtr,
+                         const Ns_Time *timeout)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+static NsTimerWheelProc SockExpired;
 static void  SockClose(Sock *sockPtr, int keep)
     NS_GNUC_NONNULL(1);
 static SockState SockRead(Sock *sockPtr, int spooler, const Ns_Time *timePtr)
@@ -287,6 +307,14 @@ static void SockPoll(Sock *sockPtr, short type, PollData *pdata)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
 static void SockSpoolerQueue(Driver *drvPtr, Sock *sockPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void SockHandshakeQueue(Driver *drvPtr, Sock *sockPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void HandshakeStatsAppend(Tcl_Interp *interp, Tcl_Obj *listObj, DrvHandshake *hsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+static void HandshakeDone(Sock *sockPtr, bool success, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
+static void HandshakeStep(Sock *sockPtr, const Ns_Time *nowPtr, Sock **waitPtrPtr, Sock **readyPtrPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
 static void SpoolerQueueStart(SpoolerQueue *queuePtr, Ns_ThreadProc *proc)
     NS_GNUC_NONNULL(2);
 static void SpoolerQueueStop(SpoolerQueue *queuePtr, const Ns_Time *timeoutPtr, const char *name)
@@ -437,6 +465,7 @@ GetSockStateName(SockState sockState)
         "SOCK_READY",
         "SOCK_MORE",
         "SOCK_SPOOL",
+        "SOCK_HANDSHAKE",
         "SOCK_ERROR",
         "SOCK_CLOSE",
         "SOCK_CLOSETIMEOUT",
@@ -454,7 +483,7 @@ GetSockStateName(SockState sockState)
     };
 
     if (sockStateInt < 0) {
-        sockStateInt = (- sockStateInt) + 2;
+        sockStateInt = (- sockStateInt) + 3;
     }
     assert(sockStateInt < Ns_NrElements(sockStateStrings));
     return sockStateStrings[sockStateInt];
@@ -1280,6 +1309,7 @@ DriverInit(const char *server, const char *moduleName, const char *threadName,
     Driver         *drvPtr;
     DrvWriter      *wrPtr;
     DrvSpooler     *spPtr;
+    DrvHandshake   *hsPtr;
     int             i;
     unsigned short  defport;
 
@@ -1317,6 +1347,9 @@ DriverInit(const char *server, const char *moduleName, const char *threadName,
     Ns_MutexInit(&drvPtr->writer.lock);
     Ns_MutexSetName2(&drvPtr->writer.lock, "ns:drv:writer", threadName);
 
+    Ns_MutexInit(&drvPtr->handshake.lock);
+    Ns_MutexSetName2(&drvPtr->handshake.lock, "ns:drv:handshake", threadName);
+
     if (ns_sockpair(drvPtr->trigger) != 0) {
         Ns_Fatal("ns_sockpair() failed: %s", ns_sockstrerror(ns_sockerrno));
     }
@@ -1348,6 +1381,9 @@ DriverInit(const char *server, const char *moduleName, const char *threadName,
         drvPtr->driverThreadProc  = init->driverThreadProc;
         drvPtr->headersEncodeProc = init->headersEncodeProc;
     }
+    if (init->version >= NS_DRIVER_VERSION_7) {
+        drvPtr->handshakeProc = init->handshakeProc;
+    }
 
     drvPtr->servPtr        = servPtr;
     drvPtr->defport        = defport;
@@ -1522,6 +1558,33 @@ DriverInit(const char *server, const char *moduleName, const char *threadName,
                threadName, wrPtr->threads);
     }
 
+    /*
+     * Enable handshake threads, performing e.g. the TLS handshakes of new
+     * connections outside the driver thread.
+     */
+    hsPtr = &drvPtr->handshake;
+    hsPtr->threads = Ns_ConfigIntRange(section, "handshakethreads", 0, 0, 32);
+
+    if (hsPtr->threads > 0 && drvPtr->handshakeProc == NULL) {
+        Ns_Log(Warning, "%s: driver does not support handshake threads, ignore handshakethreads %d",
+               threadName, hsPtr->threads);
+        hsPtr->threads = 0;
+
+    } else if (hsPtr->threads > 0) {
+        Ns_Log(Notice, "%s: enable %d handshake thread(s)", threadName, hsPtr->threads);
+
+        for (i = 0; i < hsPtr->threads; i++) {
+            SpoolerQueue *queuePtr = ns_calloc(1u, sizeof(SpoolerQueue));
+            char          buffer[100];
+
+            snprintf(buffer, sizeof(buffer), "ns:driver:handshake:%s:%d", threadName, i);
+            Ns_MutexSetName2(&queuePtr->lock, buffer, "queue");
+            Ns_CondInit(&queuePtr->cond);
+            queuePtr->id = i;
+            Push(queuePtr, hsPtr->firstPtr);
+        }
+    }
+
     return NS_OK;
 }
 
@@ -1645,6 +1708,7 @@ NsStopSpoolers(void)
             Ns_IncrTime(&timeout, shutdownTime->sec, shutdownTime->usec);
             SpoolerQueueStop(drvPtr->writer.firstPtr, &timeout, "writer");
             SpoolerQueueStop(drvPtr->spooler.firstPtr, &timeout, "spooler");
+            SpoolerQueueStop(drvPtr->handshake.firstPtr, &timeout, "handshake");
         }
     }
 }
@@ -1819,6 +1883,69 @@ DriverInfoObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T o
 }
 
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HandshakeStatsAppend --
+ *
+ *      Append the statistics of the handshake threads of a driver to the
+ *      provided list in attribute value notation.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates listObj.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HandshakeStatsAppend(Tcl_Interp *interp, Tcl_Obj *listObj, DrvHandshake *hsPtr)
+{
+    int         queued, maxqueued;
+    Tcl_WideInt completed, failed;
+    Ns_Time     avgTime, maxTime;
+
+    Ns_MutexLock(&hsPtr->lock);
+    queued    = hsPtr->queued;
+    maxqueued = hsPtr->maxqueued;
+    completed = hsPtr->completed;
+    failed    = hsPtr->failed;
+    maxTime   = hsPtr->maxTime;
+    if (completed > 0) {
+        Tcl_WideInt us = ((Tcl_WideInt)hsPtr->totalTime.sec * 1000000 + hsPtr->totalTime.usec) / completed;
+
+        avgTime.sec  = (time_t)(us / 1000000);
+        avgTime.usec = (long)(us % 1000000);
+    } else {
+        avgTime.sec  = 0;
+        avgTime.usec = 0;
+    }
+    Ns_MutexUnlock(&hsPtr->lock);
+
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("handshakethreads", 16));
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewIntObj(hsPtr->threads));
+
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("handshakequeue", 14));
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewIntObj(queued));
+
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("handshakemaxqueue", 17));
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewIntObj(maxqueued));
+
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("handshakes", 10));
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewWideIntObj(completed));
+
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("handshakeerrors", 15));
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewWideIntObj(failed));
+
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("handshakeavgtime", 16));
+    Tcl_ListObjAppendElement(interp, listObj, Ns_TclNewTimeObj(&avgTime));
+
+    Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("handshakemaxtime", 16));
+    Tcl_ListObjAppendElement(interp, listObj, Ns_TclNewTimeObj(&maxTime));
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -1850,14 +1977,15 @@ DriverStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
         result = TCL_ERROR;
 
     } else {
-        const Driver *drvPtr;
-        Tcl_Obj      *resultObj = Tcl_NewListObj(0, NULL);
+        Driver  *drvPtr;
+        Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
 
         /*
          * Iterate over all drivers and collect results.
          */
         for (drvPtr = firstDrvPtr; drvPtr != NULL;  drvPtr = drvPtr->nextPtr) {
-            Tcl_Obj *listObj;
+            Tcl_Obj    *listObj;
+            Tcl_WideInt tlsHandshakes, tlsResumed;
 
             if (servPtr != NULL && !DriverIsRegisterdForServer(drvPtr, servPtr)) {
                 continue;
@@ -1882,6 +2010,15 @@ DriverStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
             Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("errors", 6));
             Tcl_ListObjAppendElement(interp, listObj, Tcl_NewWideIntObj(drvPtr->stats.errors));
 
+            NsTlsDriverStats((const Ns_Driver *)drvPtr, &tlsHandshakes, &tlsResumed);
+            Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("tlshandshakes", 13));
+            Tcl_ListObjAppendElement(interp, listObj, Tcl_NewWideIntObj(tlsHandshakes));
+
+            Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("tlsresumed", 10));
+            Tcl_ListObjAppendElement(interp, listObj, Tcl_NewWideIntObj(tlsResumed));
+
+            HandshakeStatsAppend(interp, listObj, &drvPtr->handshake);
+
             Tcl_ListObjAppendElement(interp, resultObj, listObj);
         }
         Tcl_SetObjResult(interp, resultObj);
@@ -2346,6 +2483,7 @@ NsDriverBindAddresses(Driver *drvPtr)
 void NsDriverStartSpoolers(Driver *drvPtr) {
     SpoolerQueueStart(drvPtr->spooler.firstPtr, SpoolerThread);
     SpoolerQueueStart(drvPtr->writer.firstPtr, WriterThread);
+    SpoolerQueueStart(drvPtr->handshake.firstPtr, HandshakeThread);
 }
 
 
@@ -2657,7 +2795,9 @@ DriverThread(void *arg)
     bool           stopping;
     unsigned int   flags;
     Sock          *sockPtr, *nextPtr, *closePtr = NULL, *waitPtr = NULL, *readPtr = NULL;
+    Sock          *handshakePtr;
     PollData       pdata;
+    NsTimerWheel   timers;
 
     Ns_ThreadSetName("-driver:%s-", drvPtr->threadName);
     Ns_Log(Notice, "starting %s", drvPtr->threadName);
@@ -2686,6 +2826,8 @@ DriverThread(void *arg)
 
     PollCreate(&pdata);
     Ns_GetTime(&now);
+    NsTimerWheelInit(&timers, &now);
+    pdata.timersPtr = &timers;
     stopping = ((flags & NS_DRIVER_THREAD_SHUTDOWN) != 0u);
 
     if (!stopping) {
@@ -2713,7 +2855,9 @@ DriverThread(void *arg)
 
         /*
          * If there are any closing or read-ahead sockets, set the bits
-         * and determine the minimum relative timeout.
+         * and determine the minimum relative timeout. The timeouts of the
+         * sockets are maintained in the timer wheel, which provides the
+         * next deadline without scanning all sockets.
          *
          * TODO: the various poll timeouts should probably be configurable.
          */
@@ -2722,6 +2866,7 @@ DriverThread(void *arg)
             pollTimeout = 10 * 1000;
 
         } else {
+            Ns_Time deadline;
 
             for (sockPtr = readPtr; sockPtr != NULL; sockPtr = sockPtr->nextPtr) {
                 SockPoll(sockPtr, (short)POLLIN, &pdata);
@@ -2730,13 +2875,13 @@ DriverThread(void *arg)
                 SockPoll(sockPtr, (short)POLLIN, &pdata);
             }
 
-            if (pdata.timeout.sec == TIME_T_MAX) {
+            if (!NsTimerWheelNext(&timers, &deadline)) {
                 /*
                  * No deadline set. Use default instead.
                  */
                 pollTimeout = 10 * 1000;
 
-            } else if (Ns_DiffTime(&pdata.timeout, &now, &diff) > 0)  {
+            } else if (Ns_DiffTime(&deadline, &now, &diff) > 0)  {
                 /*
                  * The resolution of "pollTimeout" is ms, therefore, we round
                  * up. If we would round down (e.g. 500 microseconds to 0 ms),
@@ -2789,10 +2934,11 @@ DriverThread(void *arg)
         }
 
         /*
-         * Update the current time and drain and/or release any
-         * closing sockets.
+         * Update the current time, advance the timer wheel and drain
+         * and/or release any closing sockets.
          */
         Ns_GetTime(&now);
+        (void) NsTimerWheelExpire(&timers, &now, SockExpired, NULL);
 
         if (closePtr != NULL) {
             sockPtr  = closePtr;
@@ -2813,10 +2959,15 @@ DriverThread(void *arg)
                         Ns_Log(DriverDebug, "poll closewait pollin; sockrelease SOCK_READERROR (sock %d)",
                                sockPtr->sock);
                         SockRelease(sockPtr, SOCK_READERROR, 0);
+                    } else if (sockPtr->timedOut) {
+                        /*
+                         * Draining is bounded by the closewait timeout.
+                         */
+                        SockRelease(sockPtr, SOCK_CLOSETIMEOUT, 0);
                     } else {
                         Push(sockPtr, closePtr);
                     }
-                } else if (Ns_DiffTime(&sockPtr->timeout, &now, &diff) <= 0) {
+                } else if (sockPtr->timedOut) {
                     /* no PollHup, no PollIn, maybe timeout */
                     Ns_Log(DriverDebug, "poll closewait timeout; sockrelease SOCK_CLOSETIMEOUT (sock %d)",
                            sockPtr->sock);
@@ -2852,7 +3003,7 @@ DriverThread(void *arg)
                  * Got no data for this sockPtr.
                  */
                 Ns_Log(DriverDebug, "Got no data for this sockPtr %p", (void*)sockPtr);
-                if (Ns_DiffTime(&sockPtr->timeout, &now, &diff) <= 0) {
+                if (sockPtr->timedOut) {
                     SockRelease(sockPtr, SOCK_READTIMEOUT, 0);
                 } else {
                     Push(sockPtr, readPtr);
@@ -2882,7 +3033,7 @@ DriverThread(void *arg)
 
                     case SOCK_MORE:
                         drvPtr->stats.partial++;
-                        SockTimeout(sockPtr, &now, &drvPtr->recvwait);
+                        SockTimeout(sockPtr, &timers, &now, &drvPtr->recvwait);
                         Push(sockPtr, readPtr);
                         break;
 
@@ -2892,6 +3043,13 @@ DriverThread(void *arg)
                         }
                         break;
 
+                    case SOCK_HANDSHAKE:
+                        /*
+                         * Not returned by SockRead(), the socket was passed
+                         * to a handshake thread.
+                         */
+                        break;
+
                         /*
                          * Already handled or normal cases
                          */
@@ -2935,10 +3093,10 @@ DriverThread(void *arg)
                     /*
                      * Potentially blocking driver, NS_DRIVER_ASYNC is not defined
                      */
-                    if (Ns_DiffTime(&sockPtr->timeout, &now, &diff) <= 0) {
+                    if (sockPtr->timedOut) {
                         drvPtr->stats.errors++;
-                        Ns_Log(Notice, "read-ahead has some data, no async sock read ===== diff time %ld",
-                               Ns_DiffTime(&sockPtr->timeout, &now, &diff));
+                        Ns_Log(Notice, "read-ahead has some data, no async sock read, timeout on sock %d",
+                               sockPtr->sock);
                         sockPtr->keep = NS_FALSE;
                         SockRelease(sockPtr, SOCK_READTIMEOUT, 0);
                     } else {
@@ -3007,7 +3165,7 @@ DriverThread(void *arg)
 
                         case SOCK_MORE:
                             drvPtr->stats.partial++;
-                            SockTimeout(sockPtr, &now, &drvPtr->recvwait);
+                            SockTimeout(sockPtr, &timers, &now, &drvPtr->recvwait);
                             Push(sockPtr, readPtr);
                             break;
 
@@ -3017,6 +3175,13 @@ DriverThread(void *arg)
                             }
                             break;
 
+                        case SOCK_HANDSHAKE:
+                            /*
+                             * The socket was passed to a handshake thread,
+                             * which returns it via drvPtr->handshakePtr.
+                             */
+                            break;
+
                         case SOCK_ERROR: {
                             int sockerrno = ns_sockerrno;
 
@@ -3074,11 +3239,24 @@ DriverThread(void *arg)
          */
 
         Ns_MutexLock(&drvPtr->lock);
-        sockPtr          = drvPtr->closePtr;
-        drvPtr->closePtr = NULL;
-        flags            = drvPtr->flags;
+        sockPtr              = drvPtr->closePtr;
+        drvPtr->closePtr     = NULL;
+        handshakePtr         = drvPtr->handshakePtr;
+        drvPtr->handshakePtr = NULL;
+        flags                = drvPtr->flags;
         Ns_MutexUnlock(&drvPtr->lock);
 
+        /*
+         * Sockets with a completed handshake are read like newly accepted
+         * sockets.
+         */
+        while (handshakePtr != NULL) {
+            nextPtr = handshakePtr->nextPtr;
+            SockTimeout(handshakePtr, &timers, &now, &drvPtr->recvwait);
+            Push(handshakePtr, readPtr);
+            handshakePtr = nextPtr;
+        }
+
         stopping = ((flags & NS_DRIVER_THREAD_SHUTDOWN) != 0u);
 
         /*
@@ -3096,7 +3274,7 @@ DriverThread(void *arg)
                        (int64_t)drvPtr->keepwait.sec, drvPtr->keepwait.usec,
                        sockPtr->sock);
 
-                SockTimeout(sockPtr, &now, &drvPtr->keepwait);
+                SockTimeout(sockPtr, &timers, &now, &drvPtr->keepwait);
                 Push(sockPtr, readPtr);
             } else {
 
@@ -3120,7 +3298,7 @@ DriverThread(void *arg)
                 } else {
                     Ns_Log(DriverDebug, "setting closewait " NS_TIME_FMT " for socket %d",
                            (int64_t)drvPtr->closewait.sec,  drvPtr->closewait.usec, sockPtr->sock);
-                    SockTimeout(sockPtr, &now, &drvPtr->closewait);
+                    SockTimeout(sockPtr, &timers, &now, &drvPtr->closewait);
                     Push(sockPtr, closePtr);
                 }
             }
@@ -3425,6 +3603,11 @@ RequestFree(Sock *sockPtr)
     reqPtr->avail          = 0u;
     reqPtr->savedChar      = '\0';
 
+    if (reqPtr->multipartScan != NULL) {
+        NsMultipartScanFree(reqPtr->multipartScan);
+        reqPtr->multipartScan = NULL;
+    }
+
     /*
      * The headers should be already cleared, except maybe in error cases.
      * Maybe, this should be moved to the error handling, and the assert
@@ -3503,6 +3686,11 @@ SockQueue(Sock *sockPtr, const Ns_Time *timePtr)
      */
     assert(sockPtr->reqPtr != NULL);
 
+    /*
+     * The socket leaves the lists of the driver thread.
+     */
+    NsTimerWheelCancel(&sockPtr->timer);
+
     result = SockSetServer(sockPtr);
     if (likely(result == NS_OK)) {
         assert(sockPtr->servPtr != NULL || *sockPtr->reqPtr->request.method == 'B');
@@ -3587,7 +3775,14 @@ SockPoll(Sock *sockPtr, short type, PollData *pdata)
     NS_NONNULL_ASSERT(sockPtr != NULL);
     NS_NONNULL_ASSERT(pdata != NULL);
 
-    sockPtr->pidx = PollSet(pdata, sockPtr->sock, type, &sockPtr->timeout);
+    if (pdata->timersPtr != NULL) {
+        /*
+         * The timeout is maintained in the timer wheel of the thread.
+         */
+        sockPtr->pidx = PollSet(pdata, sockPtr->sock, type, NULL);
+    } else {
+        sockPtr->pidx = PollSet(pdata, sockPtr->sock, type, &sockPtr->timeout);
+    }
 }
 
 /*
@@ -3595,7 +3790,9 @@ SockPoll(Sock *sockPtr, short type, PollData *pdata)
  *
  * SockTimeout --
  *
- *      Update socket with timeout
+ *      Update socket with timeout. When a timer wheel is provided, the
+ *      socket is armed in this wheel, which reports the expiry via
+ *      SockExpired().
  *
  * Results:
  *      None.
@@ -3607,11 +3804,43 @@ SockPoll(Sock *sockPtr, short type, PollData *pdata)
  */
 
 static void
-SockTimeout(Sock *sockPtr, const Ns_Time *nowPtr, const Ns_Time *timeout)
+SockTimeout(Sock *sockPtr, NsTimerWheel *timersPtr, const Ns_Time *nowPtr, const Ns_Time *timeout)
 {
     NS_NONNULL_ASSERT(sockPtr != NULL);
     sockPtr->timeout = *nowPtr;
     Ns_IncrTime(&sockPtr->timeout, timeout->sec, timeout->usec);
+    sockPtr->timedOut = NS_FALSE;
+    if (timersPtr != NULL) {
+        NsTimerWheelSet(timersPtr, &sockPtr->timer, &sockPtr->timeout, sockPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SockExpired --
+ *
+ *      Timer wheel callback for sockets reaching their deadline. The
+ *      socket is only marked, since it is still linked in a list of
+ *      the calling thread; the thread releases it while processing
+ *      the poll results.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets sockPtr->timedOut.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SockExpired(void *clientData, void *UNUSED(arg))
+{
+    Sock *sockPtr = (Sock *)clientData;
+
+    sockPtr->timedOut = NS_TRUE;
 }
 
 
@@ -3624,7 +3853,7 @@ SockTimeout(Sock *sockPtr, const Ns_Time *nowPtr, const Ns_Time *timeout)
  *      Accept and initialize a new Sock in sockPtrPtr.
  *
  * Results:
- *      SOCK_READY, SOCK_MORE, SOCK_SPOOL,
+ *      SOCK_READY, SOCK_MORE, SOCK_SPOOL, SOCK_HANDSHAKE,
  *      SOCK_ERROR + NULL sockPtr.
  *
  * Side effects:
@@ -3675,7 +3904,18 @@ SockAccept(Driver *drvPtr, NS_SOCKET sock, Sock **sockPtrPtr, const Ns_Time *now
         sockPtr->acceptTime = *nowPtr;
         drvPtr->queuesize++;
 
-        if (status == NS_DRIVER_ACCEPT_DATA) {
+        if (drvPtr->handshake.threads > 0
+            && status != NS_DRIVER_ACCEPT_QUEUE
+            && (drvPtr->opts & NS_DRIVER_ASYNC) != 0u) {
+            /*
+             * Let a handshake thread complete the (TLS) handshake, such
+             * that the driver thread is not blocked by the cryptographic
+             * operations.
+             */
+            SockHandshakeQueue(drvPtr, sockPtr);
+            sockStatus = SOCK_HANDSHAKE;
+
+        } else if (status == NS_DRIVER_ACCEPT_DATA) {
 
             /*
              * If there is already data present then read it without
@@ -3774,6 +4014,7 @@ SockNew(Driver *drvPtr)
         sockPtr->recvSockState = NS_SOCK_NONE;
         sockPtr->recvErrno = 0u;
         sockPtr->sendErrno = 0u;
+        sockPtr->timedOut = NS_FALSE;
     }
     return sockPtr;
 }
@@ -3819,6 +4060,8 @@ SockRelease(Sock *sockPtr, SockState reason, int err)
 
     /*fprintf(stderr, "=== SockRelease %p\n", (void*)sockPtr);*/
 
+    NsTimerWheelCancel(&sockPtr->timer);
+
     drvPtr = sockPtr->drvPtr;
     assert(drvPtr != NULL);
 
@@ -3874,6 +4117,7 @@ SockError(Sock *sockPtr, SockState reason, int err)
     switch (reason) {
     case SOCK_READY: NS_FALL_THROUGH; /* fall through */
     case SOCK_SPOOL: NS_FALL_THROUGH; /* fall through */
+    case SOCK_HANDSHAKE: NS_FALL_THROUGH; /* fall through */
     case SOCK_MORE:  NS_FALL_THROUGH; /* fall through */
     case SOCK_CLOSE: NS_FALL_THROUGH; /* fall through */
     case SOCK_CLOSETIMEOUT:
@@ -4625,6 +4869,9 @@ SockRead(Sock *sockPtr, int spooler, const Ns_Time *timePtr)
         if (ns_write(sockPtr->tfd, tbuf, (size_t)n) != n) {
             return SOCK_WRITEERROR;
         }
+        if (reqPtr->multipartScan != NULL) {
+            NsMultipartScanFeed(reqPtr->multipartScan, tbuf, (size_t)n);
+        }
     } else {
         Tcl_DStringSetLength(bufPtr, (TCL_SIZE_T)(buflen + (size_t)n));
     }
@@ -4642,6 +4889,20 @@ SockRead(Sock *sockPtr, int spooler, const Ns_Time *timePtr)
 
     resultState = SockParse(sockPtr);
 
+    /*
+     * Scan the newly received multipart content in the buffer. Spooled
+     * content was scanned above, when it was written to the spool file.
+     */
+    if (reqPtr->multipartScan != NULL && sockPtr->tfd <= 0 && reqPtr->coff > 0u) {
+        size_t received = MIN((size_t)bufPtr->length - reqPtr->coff, reqPtr->length);
+
+        if (received > reqPtr->multipartScan->scanned) {
+            NsMultipartScanFeed(reqPtr->multipartScan,
+                                bufPtr->string + reqPtr->coff + reqPtr->multipartScan->scanned,
+                                received - reqPtr->multipartScan->scanned);
+        }
+    }
+
     return resultState;
 }
 
@@ -4722,10 +4983,7 @@ LogBuffer(Ns_LogSeverity severity, const char *msg, const char *buffer, size_t l
 static void
 DeterminePeerAddrFromHeaders(Sock *sockPtr)
 {
-    Request    *reqPtr = sockPtr->reqPtr;
-    const char *s = Ns_SetIGet(reqPtr->headers, "x-forwarded-for");
-
-    //Ns_Log(Notice, "XXXXX DeterminePeerAddrFromHeaders sockPtr %p reqPtr %p", (void*)sockPtr, (void*)reqPtr);
+    const char *s = sockPtr->extractedHeaderFields[NS_EXTRACTED_HEADER_X_FORWARDED_FOR];
 
     if (s != NULL && !strcasecmp(s, "unknown")) {
         s = NULL;
@@ -4941,7 +5199,7 @@ EndOfHeader(Sock *sockPtr)
     //s = Ns_SetIGet(reqPtr->headers, "content-length");
     s = sockPtr->extractedHeaderFields[NS_EXTRACTED_HEADER_CONTENT_LENGTH];
     if (s == NULL) {
-        s = Ns_SetIGet(reqPtr->headers, "transfer-encoding");
+        s = sockPtr->extractedHeaderFields[NS_EXTRACTED_HEADER_TRANSFER_ENCODING];
 
         if (s != NULL) {
             /* Lower case is in the standard, capitalized by macOS */
@@ -4955,7 +5213,7 @@ EndOfHeader(Sock *sockPtr)
                 /*
                  * We need reqPtr->expectedLength for safely terminating read loop.
                  */
-                s = Ns_SetIGet(reqPtr->headers, "x-expected-entity-length");
+                s = sockPtr->extractedHeaderFields[NS_EXTRACTED_HEADER_X_EXPECTED_ENTITY_LENGTH];
 
                 if ((s != NULL)
                     && (Ns_StrToWideInt(s, &expected) == NS_OK)
@@ -5001,7 +5259,7 @@ EndOfHeader(Sock *sockPtr)
      */
     sockPtr->flags &= ~(NS_CONN_ZIPACCEPTED|NS_CONN_BROTLIACCEPTED);
 
-    s = Ns_SetIGet(reqPtr->headers, "accept-encoding");
+    s = sockPtr->extractedHeaderFields[NS_EXTRACTED_HEADER_ACCEPT_ENCODING];
     if (s != NULL) {
         bool gzipAccept, brotliAccept;
 
@@ -5013,7 +5271,7 @@ EndOfHeader(Sock *sockPtr)
             /*
              * Don't allow compression formats for Range requests.
              */
-            s = Ns_SetIGet(reqPtr->headers, "range");
+            s = sockPtr->extractedHeaderFields[NS_EXTRACTED_HEADER_RANGE];
             if (s == NULL) {
                 if (gzipAccept) {
                     sockPtr->flags |= NS_CONN_ZIPACCEPTED;
@@ -5042,6 +5300,22 @@ EndOfHeader(Sock *sockPtr)
         reqPtr->length = reqPtr->contentLength;
     }
 
+    /*
+     * For "multipart/form-data" content, which will be accessible via
+     * memory, locate the boundaries while the content arrives (see
+     * SockRead()). Chunked content is decoded in place and is not
+     * scanned.
+     */
+    s = sockPtr->extractedHeaderFields[NS_EXTRACTED_HEADER_CONTENT_TYPE];
+    if (s != NULL
+        && reqPtr->length > 0u
+        && reqPtr->chunkStartOff == 0u
+        && (sockPtr->drvPtr->maxupload == 0 || reqPtr->length <= (size_t)sockPtr->drvPtr->maxupload)
+        && strncasecmp(s, "multipart/form-data", 19u) == 0
+        ) {
+        reqPtr->multipartScan = NsMultipartScanNew(s);
+    }
+
     return reqPtr->roff;
 }
 
@@ -5738,7 +6012,9 @@ NsDriverLookupHostCtx(Tcl_DString *hostDs, const char *hostName, Ns_Driver *drvP
  *
  *      Check if the singleton request header fields are provided only once.
  *      Certain header field values, which are often used are extracted into
- *      "extractedHeaderFields".
+ *      "extractedHeaderFields", such that the driver can access these in
+ *      constant time instead of scanning the header set with
+ *      Ns_SetIGet().
  *
  *      Note that these strings are only guaranteed to be correct as long the
  *      underlying Ns_Set is not changed. This typically the case just in the
@@ -5758,7 +6034,7 @@ CheckSingletonHeaderFields(Sock *sockPtr)
 {
     size_t        i, idx;
     Ns_Set       *headers = sockPtr->reqPtr->headers;
-    int           counts[Ns_NrElements(singletonRequestHeaderFields)] = {0};
+    int           counts[Ns_NrElements(requestHeaderFields)] = {0};
     const char **singletonFields = sockPtr->extractedHeaderFields;
 
     memset(sockPtr->extractedHeaderFields, 0, sizeof(sockPtr->extractedHeaderFields));
@@ -5771,8 +6047,8 @@ CheckSingletonHeaderFields(Sock *sockPtr)
         const char *name       = headers->fields[idx].name;
         char        first_char = (CHARTYPE(lower, *name) != 0) ? *name : CHARCONV(lower, *name);
 
-        for (i = 0; i < Ns_NrElements(singletonRequestHeaderFields); i++) {
-            const char *singletonName = singletonRequestHeaderFields[i].name;
+        for (i = 0; i < Ns_NrElements(requestHeaderFields); i++) {
+            const char *singletonName = requestHeaderFields[i].name;
             int         cmp;
 
             /*
@@ -5786,19 +6062,19 @@ CheckSingletonHeaderFields(Sock *sockPtr)
 
             if (cmp == 0) {
                 if (++counts[i] > 1) {
-                    Ns_Log(Warning, "request header field \"%s\" is provided more than once. Request: \"%s\"\n",
-                           singletonName, sockPtr->reqPtr->request.line);
-                    return NS_ERROR;
-
-                }
-                if (singletonRequestHeaderFields[i].extract != NS_EXTRACTED_NONE) {
-                    singletonFields[singletonRequestHeaderFields[i].extract] = headers->fields[idx].value;
+                    if (requestHeaderFields[i].singleton) {
+                        Ns_Log(Warning, "request header field \"%s\" is provided more than once. Request: \"%s\"\n",
+                               singletonName, sockPtr->reqPtr->request.line);
+                        return NS_ERROR;
+                    }
+                } else if (requestHeaderFields[i].extract != NS_EXTRACTED_NONE) {
+                    singletonFields[requestHeaderFields[i].extract] = headers->fields[idx].value;
                 }
                 break;
             } else if (cmp > 0) {
                 /*
-                 * The fields in singletonRequestHeaderFields are
-                 * sorted. Later values can't match.
+                 * The fields in requestHeaderFields are sorted. Later values
+                 * can't match.
                  */
                 break;
             }
@@ -6037,6 +6313,7 @@ SpoolerThread(void *arg)
     Ns_Time        now, diff;
     const Driver  *drvPtr;
     PollData       pdata;
+    NsTimerWheel   timers;
 
     Ns_ThreadSetName("-spooler%d-", queuePtr->id);
     queuePtr->threadName = Ns_ThreadGetName();
@@ -6050,6 +6327,8 @@ SpoolerThread(void *arg)
 
     PollCreate(&pdata);
     Ns_GetTime(&now);
+    NsTimerWheelInit(&timers, &now);
+    pdata.timersPtr = &timers;
 
     while (!stopping) {
 
@@ -6064,12 +6343,20 @@ SpoolerThread(void *arg)
         if (readPtr == NULL) {
             pollTimeout = 30 * 1000;
         } else {
+            Ns_Time deadline;
+
             sockPtr = readPtr;
             while (sockPtr != NULL) {
                 SockPoll(sockPtr, (short)POLLIN, &pdata);
                 sockPtr = sockPtr->nextPtr;
             }
-            pollTimeout = -1;
+            if (!NsTimerWheelNext(&timers, &deadline)) {
+                pollTimeout = -1;
+            } else if (Ns_DiffTime(&deadline, &now, &diff) > 0) {
+                pollTimeout = (int)Ns_TimeToMilliseconds(&diff) + 1;
+            } else {
+                pollTimeout = 0;
+            }
         }
 
         /*
@@ -6088,6 +6375,7 @@ SpoolerThread(void *arg)
          */
 
         Ns_GetTime(&now);
+        (void) NsTimerWheelExpire(&timers, &now, SockExpired, NULL);
         sockPtr = readPtr;
         readPtr = NULL;
 
@@ -6104,7 +6392,7 @@ SpoolerThread(void *arg)
                 /*
                  * Got no data
                  */
-                if (Ns_DiffTime(&sockPtr->timeout, &now, &diff) <= 0) {
+                if (sockPtr->timedOut) {
                     SockRelease(sockPtr, SOCK_READTIMEOUT, 0);
                     queuePtr->queuesize--;
                 } else {
@@ -6117,13 +6405,14 @@ SpoolerThread(void *arg)
                 SockState n = SockRead(sockPtr, 1, &now);
                 switch (n) {
                 case SOCK_MORE:
-                    SockTimeout(sockPtr, &now, &drvPtr->recvwait);
+                    SockTimeout(sockPtr, &timers, &now, &drvPtr->recvwait);
                     Push(sockPtr, readPtr);
                     break;
 
                 case SOCK_READY:
                     assert(sockPtr->reqPtr != NULL);
                     Ns_Log(DriverDebug, "spooler thread done with request");
+                    NsTimerWheelCancel(&sockPtr->timer);
                     if (likely(SockSetServer(sockPtr) == NS_OK)) {
                         Push(sockPtr, waitPtr);
                     } else {
@@ -6142,6 +6431,7 @@ SpoolerThread(void *arg)
                 case SOCK_READTIMEOUT:    NS_FALL_THROUGH; /* fall through */
                 case SOCK_SHUTERROR:      NS_FALL_THROUGH; /* fall through */
                 case SOCK_SPOOL:          NS_FALL_THROUGH; /* fall through */
+                case SOCK_HANDSHAKE:      NS_FALL_THROUGH; /* fall through */
                 case SOCK_TOOMANYHEADERS: NS_FALL_THROUGH; /* fall through */
                 case SOCK_WRITEERROR:     NS_FALL_THROUGH; /* fall through */
                 case SOCK_QUEUEFULL:      NS_FALL_THROUGH; /* fall through */
@@ -6188,7 +6478,7 @@ SpoolerThread(void *arg)
             while (sockPtr != NULL) {
                 nextPtr = sockPtr->nextPtr;
                 drvPtr  = sockPtr->drvPtr;
-                SockTimeout(sockPtr, &now, &drvPtr->recvwait);
+                SockTimeout(sockPtr, &timers, &now, &drvPtr->recvwait);
                 Push(sockPtr, readPtr);
                 queuePtr->queuesize++;
                 sockPtr = nextPtr;
@@ -6308,6 +6598,9 @@ SockSpoolerQueue(Driver *drvPtr, Sock *sockPtr)
 
     NS_NONNULL_ASSERT(drvPtr != NULL);
     NS_NONNULL_ASSERT(sockPtr != NULL);
+
+    NsTimerWheelCancel(&sockPtr->timer);
+
     /*
      * Get the next spooler thread from the list; spooler requests are
      * distributed round-robin among all available spooler threads.
@@ -6340,6 +6633,315 @@ SockSpoolerQueue(Driver *drvPtr, Sock *sockPtr)
     }
 }
 
+/*
+ *======================================================================
+ *  Handshake Thread: Complete handshakes of new connections
+ *======================================================================
+ */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SockHandshakeQueue --
+ *
+ *      Pass a newly accepted socket to one of the handshake threads of the
+ *      driver (round-robin). The handshake thread performs the handshake
+ *      via the handshakeProc of the driver and returns the socket to the
+ *      driver thread via drvPtr->handshakePtr when the handshake is
+ *      complete.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the handshake queue statistics, may trigger a handshake
+ *      thread.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+SockHandshakeQueue(Driver *drvPtr, Sock *sockPtr)
+{
+    bool          trigger = NS_FALSE;
+    SpoolerQueue *queuePtr;
+
+    NS_NONNULL_ASSERT(drvPtr != NULL);
+    NS_NONNULL_ASSERT(sockPtr != NULL);
+
+    NsTimerWheelCancel(&sockPtr->timer);
+    SockTimeout(sockPtr, NULL, &sockPtr->acceptTime, &drvPtr->recvwait);
+
+    Ns_MutexLock(&drvPtr->handshake.lock);
+    if (drvPtr->handshake.curPtr == NULL) {
+        drvPtr->handshake.curPtr = drvPtr->handshake.firstPtr;
+    }
+    queuePtr = drvPtr->handshake.curPtr;
+    drvPtr->handshake.curPtr = drvPtr->handshake.curPtr->nextPtr;
+    drvPtr->handshake.queued++;
+    if (drvPtr->handshake.queued > drvPtr->handshake.maxqueued) {
+        drvPtr->handshake.maxqueued = drvPtr->handshake.queued;
+    }
+    Ns_MutexUnlock(&drvPtr->handshake.lock);
+
+    Ns_MutexLock(&queuePtr->lock);
+    if (queuePtr->sockPtr == NULL) {
+        trigger = NS_TRUE;
+    }
+    Push(sockPtr, queuePtr->sockPtr);
+    Ns_MutexUnlock(&queuePtr->lock);
+
+    if (trigger) {
+        SockTrigger(queuePtr->pipe[1]);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HandshakeDone --
+ *
+ *      Update the handshake statistics of the driver of the socket after
+ *      the handshake has finished or failed. The latency is measured from
+ *      the accept time of the socket.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates drvPtr->handshake.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HandshakeDone(Sock *sockPtr, bool success, const Ns_Time *nowPtr)
+{
+    DrvHandshake *hsPtr = &sockPtr->drvPtr->handshake;
+    Ns_Time       diff;
+
+    (void)Ns_DiffTime(nowPtr, &sockPtr->acceptTime, &diff);
+
+    Ns_MutexLock(&hsPtr->lock);
+    hsPtr->queued--;
+    if (success) {
+        hsPtr->completed++;
+        Ns_IncrTime(&hsPtr->totalTime, diff.sec, diff.usec);
+        if (Ns_DiffTime(&diff, &hsPtr->maxTime, NULL) > 0) {
+            hsPtr->maxTime = diff;
+        }
+    } else {
+        hsPtr->failed++;
+    }
+    Ns_MutexUnlock(&hsPtr->lock);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HandshakeStep --
+ *
+ *      Perform a handshake step on a socket via the handshakeProc of the
+ *      driver and add the socket to the list of waiting sockets or the
+ *      list of sockets with completed handshakes.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Socket is released in case of an error.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HandshakeStep(Sock *sockPtr, const Ns_Time *nowPtr, Sock **waitPtrPtr, Sock **readyPtrPtr)
+{
+    switch ((*sockPtr->drvPtr->handshakeProc)((Ns_Sock *)sockPtr)) {
+    case NS_DRIVER_HANDSHAKE_DONE:
+        NsTimerWheelCancel(&sockPtr->timer);
+        sockPtr->flags &= ~NS_CONN_SSL_WANT_WRITE;
+        HandshakeDone(sockPtr, NS_TRUE, nowPtr);
+        Push(sockPtr, *readyPtrPtr);
+        break;
+
+    case NS_DRIVER_HANDSHAKE_WANT_READ:
+        sockPtr->flags &= ~NS_CONN_SSL_WANT_WRITE;
+        Push(sockPtr, *waitPtrPtr);
+        break;
+
+    case NS_DRIVER_HANDSHAKE_WANT_WRITE:
+        sockPtr->flags |= NS_CONN_SSL_WANT_WRITE;
+        Push(sockPtr, *waitPtrPtr);
+        break;
+
+    case NS_DRIVER_HANDSHAKE_ERROR:
+        HandshakeDone(sockPtr, NS_FALSE, nowPtr);
+        SockRelease(sockPtr, SOCK_READERROR, 0);
+        break;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HandshakeThread --
+ *
+ *      Thread performing the handshakes of newly accepted connections
+ *      via the nonblocking handshakeProc of the driver. Sockets with a
+ *      completed handshake are returned to the driver thread for reading
+ *      the request. Sockets failing the handshake or not completing it
+ *      within "recvwait" are closed.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Moves the CPU intensive part of the handshakes out of the driver
+ *      thread.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HandshakeThread(void *arg)
+{
+    SpoolerQueue  *queuePtr = (SpoolerQueue*)arg;
+    char           charBuffer[1];
+    int            pollTimeout;
+    bool           stopping = NS_FALSE;
+    Sock          *sockPtr, *nextPtr, *newPtr, *waitPtr = NULL, *readyPtr = NULL;
+    Ns_Time        now, diff;
+    PollData       pdata;
+    NsTimerWheel   timers;
+
+    Ns_ThreadSetName("-handshake%d-", queuePtr->id);
+    queuePtr->threadName = Ns_ThreadGetName();
+
+    Ns_Log(Notice, "handshake%d: accepting connections", queuePtr->id);
+
+    PollCreate(&pdata);
+    Ns_GetTime(&now);
+    NsTimerWheelInit(&timers, &now);
+    pdata.timersPtr = &timers;
+
+    while (!stopping) {
+
+        PollReset(&pdata);
+        (void)PollSet(&pdata, queuePtr->pipe[0], (short)POLLIN, NULL);
+
+        if (waitPtr == NULL) {
+            pollTimeout = 30 * 1000;
+        } else {
+            Ns_Time deadline;
+
+            for (sockPtr = waitPtr; sockPtr != NULL; sockPtr = sockPtr->nextPtr) {
+                SockPoll(sockPtr,
+                         (sockPtr->flags & NS_CONN_SSL_WANT_WRITE) != 0u ? (short)POLLOUT : (short)POLLIN,
+                         &pdata);
+            }
+            if (!NsTimerWheelNext(&timers, &deadline)) {
+                pollTimeout = -1;
+            } else if (Ns_DiffTime(&deadline, &now, &diff) > 0) {
+                pollTimeout = (int)Ns_TimeToMilliseconds(&diff) + 1;
+            } else {
+                pollTimeout = 0;
+            }
+        }
+
+        (void) PollWait(&pdata, pollTimeout);
+
+        if (PollIn(&pdata, 0) && unlikely(ns_recv(queuePtr->pipe[0], charBuffer, 1u, 0) != 1)) {
+            Ns_Fatal("handshake: trigger ns_recv() failed: %s",
+                     ns_sockstrerror(ns_sockerrno));
+        }
+
+        Ns_GetTime(&now);
+        (void) NsTimerWheelExpire(&timers, &now, SockExpired, NULL);
+
+        /*
+         * Get the newly queued sockets. The handshake is attempted on these
+         * right away, since the first message from the client is typically
+         * already available.
+         */
+        Ns_MutexLock(&queuePtr->lock);
+        newPtr = (Sock*)queuePtr->sockPtr;
+        queuePtr->sockPtr = NULL;
+        stopping = queuePtr->shutdown;
+        Ns_MutexUnlock(&queuePtr->lock);
+
+        /*
+         * Check the waiting sockets for events and timeouts.
+         */
+        sockPtr = waitPtr;
+        waitPtr = NULL;
+        while (sockPtr != NULL) {
+            nextPtr = sockPtr->nextPtr;
+
+            if (unlikely(PollHup(&pdata, sockPtr->pidx))) {
+                /*
+                 * Peer has closed the connection.
+                 */
+                HandshakeDone(sockPtr, NS_FALSE, &now);
+                SockRelease(sockPtr, SOCK_CLOSE, 0);
+
+            } else if (sockPtr->timedOut) {
+                /*
+                 * The handshake was not completed within "recvwait".
+                 */
+                HandshakeDone(sockPtr, NS_FALSE, &now);
+                SockRelease(sockPtr, SOCK_READTIMEOUT, 0);
+
+            } else if (pdata.pfds[sockPtr->pidx].revents == 0) {
+                /*
+                 * Nothing happened on this socket.
+                 */
+                Push(sockPtr, waitPtr);
+
+            } else {
+                HandshakeStep(sockPtr, &now, &waitPtr, &readyPtr);
+            }
+            sockPtr = nextPtr;
+        }
+
+        while (newPtr != NULL) {
+            nextPtr = newPtr->nextPtr;
+            NsTimerWheelSet(&timers, &newPtr->timer, &newPtr->timeout, newPtr);
+            HandshakeStep(newPtr, &now, &waitPtr, &readyPtr);
+            newPtr = nextPtr;
+        }
+
+        /*
+         * Return the sockets with completed handshakes to the driver
+         * thread.
+         */
+        if (readyPtr != NULL) {
+            Driver *drvPtr = readyPtr->drvPtr;
+
+            Ns_MutexLock(&drvPtr->lock);
+            while ((sockPtr = readyPtr) != NULL) {
+                readyPtr = sockPtr->nextPtr;
+                Push(sockPtr, drvPtr->handshakePtr);
+            }
+            Ns_MutexUnlock(&drvPtr->lock);
+            SockTrigger(drvPtr->trigger[1]);
+        }
+    }
+
+    /*
+     * Release the sockets with still incomplete handshakes.
+     */
+    while ((sockPtr = waitPtr) != NULL) {
+        waitPtr = sockPtr->nextPtr;
+        HandshakeDone(sockPtr, NS_FALSE, &now);
+        SockRelease(sockPtr, SOCK_SHUTERROR, 0);
+    }
+    PollFree(&pdata);
+
+    Ns_Log(Notice, "exiting");
+
+    Ns_MutexLock(&queuePtr->lock);
+    queuePtr->stopped = NS_TRUE;
+    Ns_CondBroadcast(&queuePtr->cond);
+    Ns_MutexUnlock(&queuePtr->lock);
+}
+
 /*
  *======================================================================
  *  Writer Thread: Write asynchronously to the client socket
@@ -7462,7 +8064,7 @@ WriterThread(void *arg)
                            (void *)curPtr, sockPtr->sock,
                            (int64_t)curPtr->sockPtr->drvPtr->sendwait.sec,
                            curPtr->sockPtr->drvPtr->sendwait.usec);
-                    SockTimeout(sockPtr, &now, &curPtr->sockPtr->drvPtr->sendwait);
+                    SockTimeout(sockPtr, NULL, &now, &curPtr->sockPtr->drvPtr->sendwait);
                 } else if (Ns_DiffTime(&sockPtr->timeout, &now, NULL) <= 0) {
                     Ns_Log(DriverDebug, "Writer %p fd %d timeout", (void *)curPtr, sockPtr->sock);
                     err          = NS_ETIMEDOUT;
@@ -7516,7 +8118,7 @@ WriterThread(void *arg)
                     nextPtr = curPtr->nextPtr;
                     sockPtr = curPtr->sockPtr;
                     drvPtr  = sockPtr->drvPtr;
-                    SockTimeout(sockPtr, &now, &drvPtr->sendwait);
+                    SockTimeout(sockPtr, NULL, &now, &drvPtr->sendwait);
                     Push(curPtr, writePtr);
                     queuePtr->queuesize++;
                     curPtr = nextPtr;
@@ -43,14 +43,8 @@ static char *Ext2utf(Tcl_DString *dsPtr, const char *start, size_t len, Tcl_Enco
 static bool GetBoundary(Tcl_DString *dsPtr, const char *contentType)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
-#define NS_USE_MEMMEM 1
-#if defined(NS_USE_MEMMEM)
 static char *NextBoundary(char *content, size_t contentLength, const Tcl_DString *boundaryDsPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3) NS_GNUC_PURE;
-#else
-static char *NextBoundary(const Tcl_DString *boundaryDsPtr, char *s, const char *e)
-    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_PURE;
-#endif
 
 static bool GetValue(const char *hdr, const char *att, size_t attLength, const char **vsPtr, const char **vePtr, char *uPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5) NS_GNUC_NONNULL(6);
@@ -191,23 +185,48 @@ Ns_ConnGetQuery(Tcl_Interp *interp, Ns_Conn *conn, Tcl_Obj *fallbackCharsetObj,
                 /*
                  * GetBoundary cares for "multipart/form-data; boundary=...".
                  */
-                const char  *formEndPtr = content + connPtr->reqPtr->length;
-                char        *firstBoundary, *s;
-                Tcl_Encoding valueEncoding = connPtr->urlEncoding;
+                const char    *formEndPtr = content + connPtr->reqPtr->length;
+                char          *s;
+                Tcl_Encoding   valueEncoding = connPtr->urlEncoding;
+                Ns_DList       parts;
+                const NsMultipartScan *scanPtr = connPtr->reqPtr->multipartScan;
 
-#if defined(NS_USE_MEMMEM)
-                firstBoundary = NextBoundary(content, connPtr->reqPtr->length, &boundaryDs);
-#else
-                firstBoundary = NextBoundary(&boundaryDs, content, formEndPtr);
-#endif
                 /*NsHexPrint("multipart content",
                            (const unsigned char *)content, connPtr->reqPtr->length,
                            20, NS_TRUE);*/
 
-                s = firstBoundary;
-                for (;;) {
-                    const char *defaultCharset;
+                /*
+                 * Locate all parts. The start and end positions are
+                 * recorded in "parts", such that a reparse with a
+                 * different default charset (see below) does not have to
+                 * scan the content again.
+                 */
+                Ns_DListInit(&parts);
 
+                if (scanPtr != NULL
+                    && scanPtr->scanned == connPtr->reqPtr->length
+                    && STREQ(scanPtr->boundary.string, boundaryDs.string)
+                    ) {
+                    size_t i;
+
+                    /*
+                     * The boundaries were already located by the driver
+                     * or spooler thread while the content was received.
+                     */
+                    for (i = 0u; i + 1u < scanPtr->nOffsets; i++) {
+                        s = content + scanPtr->offsets[i] + boundaryDs.length;
+                        if (*s == '\r') {
+                            ++s;
+                        }
+                        if (*s == '\n') {
+                            ++s;
+                        }
+                        Ns_DListAppend(&parts, s);
+                        Ns_DListAppend(&parts, content + scanPtr->offsets[i + 1u] - 1);
+                    }
+
+                } else {
+                    s = NextBoundary(content, connPtr->reqPtr->length, &boundaryDs);
                     while (s != NULL) {
                         char  *e;
 
@@ -218,20 +237,27 @@ Ns_ConnGetQuery(Tcl_Interp *interp, Ns_Conn *conn, Tcl_Obj *fallbackCharsetObj,
                         if (*s == '\n') {
                             ++s;
                         }
-#if defined(NS_USE_MEMMEM)
                         e = NextBoundary(s, (size_t)(formEndPtr - s), &boundaryDs);
-#else
-                        e = NextBoundary(&boundaryDs, s, formEndPtr);
-#endif
                         if (e != NULL) {
-                            status = ParseMultipartEntry(connPtr, valueEncoding, s, e);
-                            if (status == NS_ERROR) {
-                                Ns_Log(Debug, "ParseMultipartEntry -> error");
-                                toParse = s;
-                            }
+                            Ns_DListAppend(&parts, s);
+                            Ns_DListAppend(&parts, e);
                         }
                         s = e;
                     }
+                }
+
+                for (;;) {
+                    const char *defaultCharset;
+                    size_t      i;
+
+                    for (i = 0u; i < parts.size; i += 2u) {
+                        s = parts.data[i];
+                        status = ParseMultipartEntry(connPtr, valueEncoding, s, parts.data[i + 1u]);
+                        if (status == NS_ERROR) {
+                            Ns_Log(Debug, "ParseMultipartEntry -> error");
+                            toParse = s;
+                        }
+                    }
 
                     /*
                      * We have now parsed all form fields into
@@ -251,7 +277,6 @@ Ns_ConnGetQuery(Tcl_Interp *interp, Ns_Conn *conn, Tcl_Obj *fallbackCharsetObj,
                         if (valueEncoding != NULL) {
                             if (valueEncoding != defaultEncoding) {
                                 valueEncoding = defaultEncoding;
-                                s = firstBoundary;
                                 Ns_SetTrunc(connPtr->query, 0u);
                                 Ns_Log(Debug, "form: retry with default charset %s", defaultCharset);
                                 continue;
@@ -283,6 +308,7 @@ Ns_ConnGetQuery(Tcl_Interp *interp, Ns_Conn *conn, Tcl_Obj *fallbackCharsetObj,
                     }
                     break;
                 }
+                Ns_DListFree(&parts);
             }
             Tcl_DStringFree(&boundaryDs);
         }
@@ -805,6 +831,11 @@ GetBoundary(Tcl_DString *dsPtr, const char *contentType)
  *      Locate the next form boundary. On success, the result points to the
  *      character before the boundary.
  *
+ *      The search is performed via ns_memmem(), which is memmem() when
+ *      available. The Two-Way implementation of glibc was measured to be
+ *      substantially faster than a scalar Boyer-Moore-Horspool search for
+ *      typical boundary lengths.
+ *
  * Results:
  *      Pointer to start of next input field or NULL on end of fields.
  *
@@ -813,59 +844,224 @@ GetBoundary(Tcl_DString *dsPtr, const char *contentType)
  *
  *----------------------------------------------------------------------
  */
-#if defined(NS_USE_MEMMEM)
 static char *
 NextBoundary(char *content, size_t contentLength, const Tcl_DString *boundaryDsPtr)
 {
     char *result;
 
+    NS_NONNULL_ASSERT(content != NULL);
+    NS_NONNULL_ASSERT(boundaryDsPtr != NULL);
+
     result = ns_memmem(content, contentLength,
                        boundaryDsPtr->string, (size_t)boundaryDsPtr->length);
     if (result != NULL) {
-        /*Ns_Log(Notice, "NextBoundary found boundary offset %ld", result-start);*/
         result--;
         /*
          * We could check, whether the preceding character is an expected
          * delimiter such as \0x0, 0xa, 0xd. However, previous version did not
          * test this as well.
          */
-        //NsHexPrint("boundary previous", (const unsigned char *)result, 10, 30, NS_TRUE);
     }
     return result;
 }
-#else
-static char *
-NextBoundary(const Tcl_DString *boundaryDsPtr, char *s, const char *e)
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsMultipartScanNew --
+ *
+ *      Create the state for an incremental boundary scan of
+ *      "multipart/form-data" content, based on the boundary specified
+ *      in the provided content type.
+ *
+ * Results:
+ *      Scan state or NULL, when the content type has no boundary.
+ *
+ * Side effects:
+ *      Memory allocation, to be freed via NsMultipartScanFree().
+ *
+ *----------------------------------------------------------------------
+ */
+NsMultipartScan *
+NsMultipartScanNew(const char *contentType)
 {
-    char        c, sc;
-    const char *find;
-    size_t      len;
+    NsMultipartScan *scanPtr = NULL;
+    Tcl_DString      boundaryDs;
 
-    NS_NONNULL_ASSERT(boundaryDsPtr != NULL);
-    NS_NONNULL_ASSERT(s != NULL);
-    NS_NONNULL_ASSERT(e != NULL);
-
-    find = boundaryDsPtr->string;
-    c = *find++;
-    len = (size_t)(boundaryDsPtr->length - 1);
-    /* Ns_Log(Notice, "search for boundary <%s> (boundary len %lu) firstchar '%c' in <%s>",
-       boundaryDsPtr->string, len, c, s);*/
-    e -= len;
-    do {
-        do {
-            sc = *s++;
-            if (s > e) {
-                return NULL;
+    NS_NONNULL_ASSERT(contentType != NULL);
+
+    Tcl_DStringInit(&boundaryDs);
+    if (GetBoundary(&boundaryDs, contentType)) {
+        scanPtr = ns_calloc(1u, sizeof(NsMultipartScan));
+        Tcl_DStringInit(&scanPtr->boundary);
+        Tcl_DStringInit(&scanPtr->tail);
+        Tcl_DStringAppend(&scanPtr->boundary, boundaryDs.string, boundaryDs.length);
+    }
+    Tcl_DStringFree(&boundaryDs);
+
+    return scanPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsMultipartScanFree --
+ *
+ *      Free the state of a multipart boundary scan.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+NsMultipartScanFree(NsMultipartScan *scanPtr)
+{
+    NS_NONNULL_ASSERT(scanPtr != NULL);
+
+    Tcl_DStringFree(&scanPtr->boundary);
+    Tcl_DStringFree(&scanPtr->tail);
+    ns_free(scanPtr->offsets);
+    ns_free(scanPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MultipartScanRecord --
+ *
+ *      Record the content offset of a boundary delimiter.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Might grow the offsets array.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+MultipartScanRecord(NsMultipartScan *scanPtr, size_t offset)
+{
+    if (scanPtr->nOffsets == scanPtr->maxOffsets) {
+        scanPtr->maxOffsets = (scanPtr->maxOffsets == 0u) ? 16u : scanPtr->maxOffsets * 2u;
+        scanPtr->offsets = ns_realloc(scanPtr->offsets, scanPtr->maxOffsets * sizeof(size_t));
+    }
+    scanPtr->offsets[scanPtr->nOffsets++] = offset;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsMultipartScanFeed --
+ *
+ *      Scan the next chunk of multipart content for boundary
+ *      delimiters. The chunks have to be provided in order and without
+ *      gaps. Delimiters spanning two chunks are detected via the kept
+ *      tail of the previous chunk, which is always shorter than the
+ *      delimiter. Therefore, every byte of the content is searched only
+ *      once, independent of whether the content is kept in memory or
+ *      spooled to a file.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Records the content offsets of the found delimiters.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+NsMultipartScanFeed(NsMultipartScan *scanPtr, const char *bytes, size_t length)
+{
+    const char *needle, *p;
+    size_t      needleLength, tailLength, keep, start, minOffset;
+
+    NS_NONNULL_ASSERT(scanPtr != NULL);
+    NS_NONNULL_ASSERT(bytes != NULL);
+
+    if (length == 0u) {
+        return;
+    }
+
+    needle = scanPtr->boundary.string;
+    needleLength = (size_t)scanPtr->boundary.length;
+    tailLength = (size_t)scanPtr->tail.length;
+
+    /*
+     * Like a search over the full content, continue after the last found
+     * delimiter, overlapping matches are not reported.
+     */
+    minOffset = (scanPtr->nOffsets > 0u)
+        ? scanPtr->offsets[scanPtr->nOffsets - 1u] + needleLength
+        : 0u;
+
+    /*
+     * Delimiters starting in the tail of the previous chunk. Since the
+     * tail is shorter than the delimiter, every match starting there
+     * spans both chunks.
+     */
+    if (tailLength > 0u) {
+        size_t tailOffset = scanPtr->scanned - tailLength;
+
+        Tcl_DStringAppend(&scanPtr->tail, bytes,
+                          (TCL_SIZE_T)MIN(length, needleLength - 1u));
+        start = (minOffset > tailOffset) ? minOffset - tailOffset : 0u;
+        while (start < tailLength
+               && (p = ns_memmem(scanPtr->tail.string + start, (size_t)scanPtr->tail.length - start,
+                                 needle, needleLength)) != NULL) {
+            size_t pos = (size_t)(p - scanPtr->tail.string);
+
+            if (pos >= tailLength) {
+                break;
             }
-        } while (sc != c);
-    } while (strncmp(s, find, len) != 0);
-    s--;
+            MultipartScanRecord(scanPtr, tailOffset + pos);
+            minOffset = tailOffset + pos + needleLength;
+            start = pos + needleLength;
+        }
+        Tcl_DStringSetLength(&scanPtr->tail, (TCL_SIZE_T)tailLength);
+    }
+
+    /*
+     * Delimiters inside of the current chunk.
+     */
+    start = (minOffset > scanPtr->scanned) ? minOffset - scanPtr->scanned : 0u;
+    while (start < length
+           && (p = ns_memmem(bytes + start, length - start, needle, needleLength)) != NULL) {
+        size_t pos = (size_t)(p - bytes);
+
+        MultipartScanRecord(scanPtr, scanPtr->scanned + pos);
+        start = pos + needleLength;
+    }
+
+    /*
+     * Keep the last bytes for detecting delimiters spanning into the
+     * next chunk.
+     */
+    keep = needleLength - 1u;
+    if (length >= keep) {
+        Tcl_DStringSetLength(&scanPtr->tail, 0);
+        Tcl_DStringAppend(&scanPtr->tail, bytes + length - keep, (TCL_SIZE_T)keep);
+    } else {
+        Tcl_DStringAppend(&scanPtr->tail, bytes, (TCL_SIZE_T)length);
+        if ((size_t)scanPtr->tail.length > keep) {
+            size_t drop = (size_t)scanPtr->tail.length - keep;
 
-    return s;
+            memmove(scanPtr->tail.string, scanPtr->tail.string + drop, keep);
+            Tcl_DStringSetLength(&scanPtr->tail, (TCL_SIZE_T)keep);
+        }
+    }
+    scanPtr->scanned += length;
 }
-#endif
 
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -685,7 +685,7 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
         "major", "meminfo", "minor", "mimetypes", "name", "nsd",
         "patchlevel", "pid", "pools",
         "scheduled", "server", "servers",
-        "sockcallbacks", "ssl", "tag", "threads", "uptime",
+        "sockcallbacks", "sockcallbackstats", "ssl", "tag", "threads", "uptime",
         "version",
         "shutdownpending", "started",
 #ifdef NS_WITH_DEPRECATED
@@ -702,7 +702,7 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
         IPatchLevelIdx,
         IPidIdx, IPoolsIdx,
         IScheduledIdx, IServerIdx, IServersIdx,
-        ISockCallbacksIdx, ISSLIdx, ITagIdx, IThreadsIdx, IUptimeIdx,
+        ISockCallbacksIdx, ISockCallbackStatsIdx, ISSLIdx, ITagIdx, IThreadsIdx, IUptimeIdx,
         IVersionIdx,
         IShutdownPendingIdx, IStartedIdx,
 #ifdef NS_WITH_DEPRECATED
@@ -719,8 +719,8 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
                                      &opt) != TCL_OK)) {
         return TCL_ERROR;
     }
-    if ((opt != IMeminfoIdx && objc != 2)
-        || (opt == IMeminfoIdx && objc > 3)) {
+    if ((opt != IMeminfoIdx && opt != IScheduledIdx && objc != 2)
+        || ((opt == IMeminfoIdx || opt == IScheduledIdx) && objc > 3)) {
         if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
             return TCL_ERROR;
         } else {
@@ -774,11 +774,27 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
         Tcl_DStringResult(interp, &ds);
         break;
 
-    case IScheduledIdx:
-        NsGetScheduled(&ds);
+    case ISockCallbackStatsIdx:
+        NsGetSockCallbackStats(&ds);
         Tcl_DStringResult(interp, &ds);
         break;
 
+    case IScheduledIdx: {
+        int         withStats = 0;
+        Ns_ObjvSpec flags[] = {
+            {"-stats", Ns_ObjvBool, &withStats, INT2PTR(NS_TRUE)},
+            {NULL,     NULL,        NULL,       NULL}
+        };
+
+        if (Ns_ParseObjv(flags, NULL, interp, 2, objc, objv) != NS_OK) {
+            result = TCL_ERROR;
+        } else {
+            NsGetScheduled(&ds, withStats != 0);
+            Tcl_DStringResult(interp, &ds);
+        }
+        break;
+    }
+
     case ILocksIdx:
         Ns_MutexList(&ds);
         Ns_RWLockList(&ds);
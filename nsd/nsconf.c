@@ -131,6 +131,8 @@ NsConfUpdate(void)
      * sched.c
      */
     nsconf.sched.jobsperthread = Ns_ConfigIntRange(section, "schedsperthread", 0, 0, INT_MAX);
+    nsconf.sched.maxthreads = Ns_ConfigIntRange(section, "schedmaxthreads", 10, 0, INT_MAX);
+    nsconf.sched.syncinpool = Ns_ConfigBool(section, "schedsyncinpool", NS_FALSE);
     Ns_ConfigTimeUnitRange(section, "schedlogminduration", "2s",
                            /* min sec */1, /* min usec */ 0, LONG_MAX, 0,
                            &nsconf.sched.maxelapsed);
@@ -141,10 +143,17 @@ NsConfUpdate(void)
     nsconf.listenbacklog = Ns_ConfigIntRange(section, "listenbacklog", 32, 0, INT_MAX);
     nsconf.sockacceptlog = Ns_ConfigIntRange(section, "sockacceptlog", 4,  2, 100);
 
+    /*
+     * sockcallback.c
+     */
+
+    nsconf.sockcallbackthreads = Ns_ConfigIntRange(section, "sockcallbackthreads", 1, 1, 32);
+
     /*
      * tcljob.c
      */
     nsconf.job.jobsperthread = Ns_ConfigIntRange(section, "jobsperthread", 0, 0, INT_MAX);
+    nsconf.job.interpcleanup = Ns_ConfigIntRange(section, "jobinterpcleanup", 1, 0, INT_MAX);
     Ns_ConfigTimeUnitRange(section, "jobtimeout",
                            "5m", 0, 0, LONG_MAX, 0,
                            &nsconf.job.timeout);
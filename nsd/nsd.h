@@ -159,6 +159,7 @@ struct nsconf {
     Ns_Time     shutdowntimeout;
     int         listenbacklog;
     int         sockacceptlog;
+    int         sockcallbackthreads;
     int         sanitize_logfiles;
     bool        reject_already_closed_or_detached_connection;
     bool        nocache;
@@ -200,6 +201,8 @@ struct nsconf {
     struct {
         Ns_Time maxelapsed;
         int jobsperthread;
+        int maxthreads;
+        bool syncinpool;
     } sched;
 
 #ifdef _WIN32
@@ -218,6 +221,7 @@ struct nsconf {
         Ns_Time timeout;
         Ns_Time logminduration;
         int     jobsperthread;
+        int     interpcleanup;
     } job;
 
     struct {
@@ -342,13 +346,16 @@ typedef struct {
     Ns_Time          sendTimeout;
     const char      *clientData;
     struct Callback *cbPtr;
+    Ns_Mutex         lock;                    /* Serializes send operations of different threads */
     Tcl_DString     *sendBuffer;              /* For unsent bytes in "ns_connchan write -buffered" */
     Tcl_DString     *secondarySendBuffer;     /* For unsent bytes while we have rejected data */
     Tcl_DString     *frameBuffer;             /* Buffer of for a single WebSocket frame */
     Tcl_DString     *fragmentsBuffer;         /* Buffer for multiple WebSocket segments */
     int              fragmentsOpcode;         /* Opcode of the first WebSocket segment */
+    struct WsDeflate *wsDeflatePtr;           /* Contexts for WebSocket permessage-deflate */
     int              debugLevel;              /* Debug level (1 log statements, > 1 extra log files) */
     bool             frameNeedsData;          /* Indicator, if additional reads are required */
+    bool             fragmentsCompressed;     /* First WebSocket segment was compressed (RSV1) */
     bool             requireStableSendBuffer; /* Retransmits for OpenSSL are required to have the same base address and length */
     NS_SOCKET        debugFD;
 } NsConnChan;
@@ -360,6 +367,22 @@ typedef struct {
  * including HTTP request line, headers, and content.
  */
 
+/*
+ * The following structure keeps the state of the incremental boundary scan
+ * of "multipart/form-data" content. The scan is fed by the driver or
+ * spooler thread while the content arrives, such that form parsing does not
+ * have to scan the full content again.
+ */
+
+typedef struct NsMultipartScan {
+    Tcl_DString boundary;       /* Boundary delimiter including the leading "--" */
+    Tcl_DString tail;           /* Trailing bytes of the previous chunk, shorter than the boundary */
+    size_t      scanned;        /* Number of content bytes scanned so far */
+    size_t     *offsets;        /* Content offsets of the boundary delimiters */
+    size_t      nOffsets;       /* Number of recorded offsets */
+    size_t      maxOffsets;     /* Allocated size of offsets */
+} NsMultipartScan;
+
 typedef struct Request {
     struct Request *nextPtr;     /* Next on free list */
     Ns_Request request;          /* Parsed request structure */
@@ -396,6 +419,7 @@ typedef struct Request {
     size_t leftover;              /* Leftover bytes from earlier requests */
     Tcl_DString buffer;           /* Request and content buffer */
     char   savedChar;             /* Character potentially clobbered by null character */
+    NsMultipartScan *multipartScan; /* Boundary scan of multipart content, or NULL */
 
 } Request;
 
@@ -422,6 +446,19 @@ typedef struct {
     NsWriterStreamState doStream;       /* Activate writer for HTML streaming */
 } DrvWriter;
 
+typedef struct {
+    Ns_Mutex            lock;           /* Lock around handshake queues and statistics */
+    SpoolerQueue       *firstPtr;       /* List of handshake threads */
+    SpoolerQueue       *curPtr;         /* Current handshake thread */
+    int                 threads;        /* Number of handshake threads to run */
+    int                 queued;         /* Sockets waiting for handshake completion */
+    int                 maxqueued;      /* Maximum value of "queued" */
+    Tcl_WideInt         completed;      /* Completed handshakes */
+    Tcl_WideInt         failed;         /* Failed or timed out handshakes */
+    Ns_Time             totalTime;      /* Accumulated time from accept to completion */
+    Ns_Time             maxTime;        /* Maximum time from accept to completion */
+} DrvHandshake;
+
 /*
  * ServerMap maintains Host header to server mappings, but is upaque for nsd.h
  */
@@ -468,6 +505,7 @@ typedef struct Driver {
     Ns_DriverClientInitProc *clientInitProc;   /* Optional - initialization of client connections */
     Ns_ThreadProc           *driverThreadProc; /* Optional - use alternate driver thread proc */
     Ns_HeadersEncodeProc    *headersEncodeProc;/* Optional - use alternate header encode proc */
+    Ns_DriverHandshakeProc  *handshakeProc;    /* Optional - handshake step for the handshake threads */
 
     ssize_t                              locationLength;
     const char *path;                   /* Path in the configuration namespace */
@@ -506,9 +544,11 @@ typedef struct Driver {
 
     struct Sock *sockPtr;               /* Free list of Sock structures */
     struct Sock *closePtr;              /* First conn ready for graceful close */
+    struct Sock *handshakePtr;          /* Conns returned from the handshake threads */
 
     DrvSpooler spooler;                 /* Tracks upload spooler threads */
     DrvWriter  writer;                  /* Tracks writer threads */
+    DrvHandshake handshake;             /* Tracks TLS handshake threads */
     Ns_Time    recvTimeout;             /* recvwait in form of Ns_Time to avoid frequent mappings */
 
     struct {
@@ -528,17 +568,54 @@ typedef struct Driver {
 
 /*
  * Define, which request header fields should be extracted directly into the
- * sock structure.
+ * sock structure. The driver classifies these well-known fields while
+ * iterating once over the request headers, such that later lookups in the
+ * driver do not have to scan the header set.
  */
 typedef enum {
-    NS_EXTRACTED_HEADER_AUTHORIZATION =   0,
-    NS_EXTRACTED_HEADER_CONTENT_LENGTH =  1,
-    NS_EXTRACTED_HEADER_HOST =            2,
-    NS_EXTRACTED_HEADER_EXPECT =          3,
-    NS_EXTRACTED_NONE =                   4
+    NS_EXTRACTED_HEADER_AUTHORIZATION =            0,
+    NS_EXTRACTED_HEADER_CONTENT_LENGTH =           1,
+    NS_EXTRACTED_HEADER_HOST =                     2,
+    NS_EXTRACTED_HEADER_EXPECT =                   3,
+    NS_EXTRACTED_HEADER_ACCEPT_ENCODING =          4,
+    NS_EXTRACTED_HEADER_RANGE =                    5,
+    NS_EXTRACTED_HEADER_TRANSFER_ENCODING =        6,
+    NS_EXTRACTED_HEADER_X_EXPECTED_ENTITY_LENGTH = 7,
+    NS_EXTRACTED_HEADER_X_FORWARDED_FOR =          8,
+    NS_EXTRACTED_HEADER_CONTENT_TYPE =             9,
+    NS_EXTRACTED_NONE =                            10
 } NsExtractedHeaderIndex;
 
 
+/*
+ * The following structures define a hierarchical timing wheel
+ * (see timerwheel.c) and its entries, used by event loop threads
+ * to manage large numbers of deadlines.
+ */
+
+#define NS_TIMERWHEEL_LEVELS 4
+#define NS_TIMERWHEEL_SLOTS  64
+
+typedef void (NsTimerWheelProc)(void *clientData, void *arg);
+
+typedef struct NsTimerWheelEntry {
+    struct NsTimerWheelEntry *nextPtr;
+    struct NsTimerWheelEntry *prevPtr;
+    struct NsTimerWheel      *wheelPtr;    /* Wheel when armed, NULL otherwise */
+    void                     *clientData;  /* Passed to NsTimerWheelProc */
+    uint64_t                  expires;     /* Deadline in ticks (ms) */
+    unsigned char             level;       /* Level of the slot */
+    unsigned char             slot;        /* Slot on this level */
+} NsTimerWheelEntry;
+
+typedef struct NsTimerWheel {
+    uint64_t           current;            /* Next tick to be processed */
+    size_t             count;              /* Number of armed entries */
+    uint64_t           bitmap[NS_TIMERWHEEL_LEVELS];
+    NsTimerWheelEntry *slots[NS_TIMERWHEEL_LEVELS][NS_TIMERWHEEL_SLOTS];
+} NsTimerWheel;
+
+
 /*
  * The following structure maintains a socket to a
  * connected client.  The socket is used to maintain state
@@ -569,6 +646,8 @@ typedef struct Sock {
     NS_POLL_NFDS_TYPE   pidx;             /* poll() index */
     unsigned int        flags;            /* State flags used by driver */
     Ns_Time             timeout;
+    NsTimerWheelEntry   timer;            /* Timeout entry in driver/spooler wheel */
+    bool                timedOut;         /* Deadline passed, set via the timer wheel */
     Request            *reqPtr;
 
     Ns_Time             acceptTime;
@@ -1062,6 +1141,7 @@ typedef struct NsServer {
         Ns_RWLock lock;
         //Ns_Mutex wlock;
         Tcl_HashTable table;
+        Tcl_HashTable groups;  /* Broadcast groups of connchans */
     } connchans;
 
     struct {
@@ -1077,10 +1157,14 @@ typedef struct NsServer {
         int  fd;
         bool logging;
         bool validateCertificates;
+        bool tlsContextCache;
         int verbose_mode;
         int verify_depth;
         int always_continue;
+        int keepaliveMaxIdle;
+        int keepaliveMinIdle;
         Ns_DList validationExceptions;
+        Ns_DList preconnects;
     } httpclient;
 
     Tcl_HashTable hosts;
@@ -1301,6 +1385,7 @@ typedef struct _NsHttpChunk {
 #define NS_HTTP_HEADERS_PENDING    (1u<<10)
 #define NS_HTTP_PARTIAL_RESULTS    (1u<<11)
 #define NS_HTTP_OUTPUT_ERROR       (1u<<12)
+#define NS_HTTP_FRESH_CONNECTION   (1u<<13)
 
 /*
  * Definition of validity exceptions for accepting invalid peer certificates
@@ -1554,6 +1639,7 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclSymlinkObjCmd,
     NsTclThreadObjCmd,
     NsTclTimeObjCmd,
+    NsTclTimerWheelTestObjCmd,
     NsTclTrimObjCmd,
     NsTclTruncateObjCmd,
     NsTclUnRegisterOpObjCmd,
@@ -1892,6 +1978,19 @@ NS_EXTERN Ns_ReturnCode NsGetFallbackEncoding(Tcl_Interp *interp, NsServer *serv
                                               Tcl_Encoding *encodingPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(5);
 
+/*
+ * form.c
+ */
+
+NS_EXTERN NsMultipartScan *NsMultipartScanNew(const char *contentType)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN void NsMultipartScanFeed(NsMultipartScan *scanPtr, const char *bytes, size_t length)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+NS_EXTERN void NsMultipartScanFree(NsMultipartScan *scanPtr)
+    NS_GNUC_NONNULL(1);
+
 /*
  * filter.c
  */
@@ -2036,7 +2135,7 @@ NS_EXTERN const char *NsHttpStatusPhrase(int statusCode)
 /*
  * sched.c
  */
-NS_EXTERN void NsGetScheduled(Tcl_DString *dsPtr) NS_GNUC_NONNULL(1);
+NS_EXTERN void NsGetScheduled(Tcl_DString *dsPtr, bool withStats) NS_GNUC_NONNULL(1);
 NS_EXTERN void NsStartSchedShutdown(void);
 NS_EXTERN void NsWaitSchedShutdown(const Ns_Time *toPtr);
 
@@ -2094,6 +2193,7 @@ NS_EXTERN int NsPoll(struct pollfd *pfds, NS_POLL_NFDS_TYPE nfds, const Ns_Time
  * sockcallback.c
  */
 NS_EXTERN void NsGetSockCallbacks(Tcl_DString *dsPtr) NS_GNUC_NONNULL(1);
+NS_EXTERN void NsGetSockCallbackStats(Tcl_DString *dsPtr) NS_GNUC_NONNULL(1);
 NS_EXTERN void NsStartSockShutdown(void);
 NS_EXTERN void NsWaitSockShutdown(const Ns_Time *toPtr);
 
@@ -2141,6 +2241,7 @@ NS_EXTERN void NsInitHttp(NsServer *servPtr)
     NS_GNUC_NONNULL(1);
 NS_EXTERN void NsStopHttp(NsServer *servPtr)
     NS_GNUC_NONNULL(1);
+NS_EXTERN void NsHttpClientCtxFlush(void);
 
 /*
  * tcljob.c
@@ -2204,6 +2305,22 @@ NS_EXTERN struct Bucket *NsTclCreateBuckets(const NsServer *servPtr, int nbucket
 NS_EXTERN void NsTclInitKeylistType(void);
 #endif
 
+/*
+ * timerwheel.c
+ */
+NS_EXTERN void NsTimerWheelInit(NsTimerWheel *wheelPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+NS_EXTERN void NsTimerWheelSet(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr,
+                               const Ns_Time *deadlinePtr, void *clientData)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+NS_EXTERN void NsTimerWheelCancel(NsTimerWheelEntry *entryPtr)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN bool NsTimerWheelNext(const NsTimerWheel *wheelPtr, Ns_Time *deadlinePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+NS_EXTERN size_t NsTimerWheelExpire(NsTimerWheel *wheelPtr, const Ns_Time *nowPtr,
+                                    NsTimerWheelProc *proc, void *arg)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
 /*
  * tls.c
  */
@@ -2216,6 +2333,9 @@ NS_EXTERN int NsTlsGetParameters(NsInterp *itPtr, bool tlsContext, int insecureI
 NS_EXTERN void NsTlsAddOutputHeaders(Ns_Set *outputHeaders, const Ns_Sock  *sockPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
+NS_EXTERN void NsTlsDriverStats(const Ns_Driver *driver, Tcl_WideInt *handshakesPtr, Tcl_WideInt *resumedPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
 /*
  * unix.c
  */
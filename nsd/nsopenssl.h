@@ -106,10 +106,14 @@ typedef struct NsTLSConfig {
             int    nodelay;           /* Enable the TCP_NODELAY optimization.              */
             bool   h3advertise;       /* add h3 advertise automatically when h3 is enabled */
             bool   h3persist;         /* add persit flag to h3 advertise when activated    */
+            bool   ktls;              /* enable kernel TLS offload when available          */
         } h1;
 # if defined(HAVE_OPENSSL_4)
         struct {
             size_t     recvbufsize;  /* value for setting SO_RCVBUF */
+            bool       udpgso;       /* use UDP generic segmentation offload */
+            int        shard;        /* index of the QUIC driver thread */
+            int        nshards;      /* number of QUIC driver threads (first config) */
             size_t     nr_listeners; /* number of listener SSL* at the start of the pollset */
             int        cc_idx;       /* slot to fetch ConnCtx an SSL*                */
             int        sc_idx;       /* slot to fetch StreamCtx an SSL*              */
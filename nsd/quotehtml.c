@@ -18,15 +18,32 @@
 
 #include "nsd.h"
 
-static const char *htmlQuoteChars = "<>&'\"";
+/*
+ * SIMD support for scanning for special characters 16 bytes at a
+ * time. SSE2 is part of the x86_64 baseline, NEON of aarch64.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define NS_HTML_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define NS_HTML_NEON 1
+#endif
 
 /*
  * Static functions defined in this file.
  */
+static const char *FirstHtmlQuoteChar(const char *s, const char *end)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_PURE;
+
+static const char *FirstCharOf2(const char *s, const char *end, char c1, char c2)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_PURE;
+
 static void QuoteHtml(Tcl_DString *NS_RESTRICT dsPtr,
                       const char  *NS_RESTRICT htmlString,
-                      const char  *firstHit)
-    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+                      const char  *firstHit,
+                      const char  *end)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
 
 static bool WordEndsInSemi(const char *word, size_t *lengthPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
@@ -47,6 +64,117 @@ HtmlParseTagAtts(const char *string, ptrdiff_t length)
 
 static bool InitOnce(void);
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FirstHtmlQuoteChar --
+ *
+ *      Search for the first character in the range [s, end), which has
+ *      to be quoted in HTML (one of "<>&'\""). When SIMD instructions
+ *      are available, 16 characters are checked at a time; the exact
+ *      position within a block is determined by the scalar loop.
+ *
+ * Results:
+ *      Pointer to the first such character or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static const char *
+FirstHtmlQuoteChar(const char *s, const char *end)
+{
+#if defined(NS_HTML_SSE2)
+    const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>'), amp = _mm_set1_epi8('&');
+    const __m128i apos = _mm_set1_epi8('\''), quot = _mm_set1_epi8('"');
+
+    for (; end - s >= 16; s += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)s);
+        const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt),
+                                                                    _mm_cmpeq_epi8(v, gt)),
+                                                       _mm_or_si128(_mm_cmpeq_epi8(v, amp),
+                                                                    _mm_cmpeq_epi8(v, apos))),
+                                          _mm_cmpeq_epi8(v, quot));
+        if (_mm_movemask_epi8(hits) != 0) {
+            break;
+        }
+    }
+#elif defined(NS_HTML_NEON)
+    for (; end - s >= 16; s += 16) {
+        const uint8x16_t v = vld1q_u8((const uint8_t *)s);
+        const uint8x16_t hits = vorrq_u8(vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('<')),
+                                                           vceqq_u8(v, vdupq_n_u8('>'))),
+                                                  vorrq_u8(vceqq_u8(v, vdupq_n_u8('&')),
+                                                           vceqq_u8(v, vdupq_n_u8('\'')))),
+                                         vceqq_u8(v, vdupq_n_u8('"')));
+        if (vmaxvq_u8(hits) != 0u) {
+            break;
+        }
+    }
+#endif
+    for (; s < end; s++) {
+        switch (*s) {
+        case '<':
+        case '>':
+        case '&':
+        case '\'':
+        case '"':
+            return s;
+        default:
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FirstCharOf2 --
+ *
+ *      Search for the first occurrence of one of the two provided
+ *      characters in the range [s, end), 16 characters at a time when
+ *      SIMD instructions are available.
+ *
+ * Results:
+ *      Pointer to the first such character or "end".
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static const char *
+FirstCharOf2(const char *s, const char *end, char c1, char c2)
+{
+#if defined(NS_HTML_SSE2)
+    const __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2);
+
+    for (; end - s >= 16; s += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)s);
+
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, v1), _mm_cmpeq_epi8(v, v2))) != 0) {
+            break;
+        }
+    }
+#elif defined(NS_HTML_NEON)
+    const uint8x16_t v1 = vdupq_n_u8(UCHAR(c1)), v2 = vdupq_n_u8(UCHAR(c2));
+
+    for (; end - s >= 16; s += 16) {
+        const uint8x16_t v = vld1q_u8((const uint8_t *)s);
+
+        if (vmaxvq_u8(vorrq_u8(vceqq_u8(v, v1), vceqq_u8(v, v2))) != 0u) {
+            break;
+        }
+    }
+#endif
+    while (s < end && *s != c1 && *s != c2) {
+        s++;
+    }
+    return s;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -62,13 +190,9 @@ static bool InitOnce(void);
  *
  *----------------------------------------------------------------------
  */
- static inline const char *
-FirstHtmlQuoteChar(const char *s) {
-    return strpbrk(s, htmlQuoteChars);
-}
-
 static void
-QuoteHtml(Tcl_DString *NS_RESTRICT dsPtr, const char  *NS_RESTRICT htmlString, const char  *firstHit)
+QuoteHtml(Tcl_DString *NS_RESTRICT dsPtr, const char  *NS_RESTRICT htmlString, const char  *firstHit,
+          const char *end)
 {
     const char *toProcess = htmlString;
     const char *breakChar = firstHit;
@@ -119,15 +243,15 @@ QuoteHtml(Tcl_DString *NS_RESTRICT dsPtr, const char  *NS_RESTRICT htmlString, c
          * Check for further protected characters.
          */
         toProcess = breakChar + 1;
-        breakChar =  FirstHtmlQuoteChar(toProcess);;
+        breakChar =  FirstHtmlQuoteChar(toProcess, end);
 
     } while (breakChar != NULL);
 
     /*
      * Append the last part if nonempty.
      */
-    if (toProcess != NULL) {
-        Tcl_DStringAppend(dsPtr, toProcess, TCL_INDEX_NONE);
+    if (toProcess < end) {
+        Tcl_DStringAppend(dsPtr, toProcess, (TCL_SIZE_T)(end - toProcess));
     }
 }
 
@@ -142,12 +266,14 @@ Ns_QuoteHtml(Tcl_DString *dsPtr, const char *htmlString)
      * If the first character is a NUL character, there is nothing to do.
      */
     if (*htmlString != '\0') {
-        const char *first = FirstHtmlQuoteChar(htmlString);
+        size_t      length = strlen(htmlString);
+        const char *end = htmlString + length;
+        const char *first = FirstHtmlQuoteChar(htmlString, end);
 
         if (first != NULL) {
-            QuoteHtml(dsPtr, htmlString, first);
+            QuoteHtml(dsPtr, htmlString, first, end);
         } else {
-            Tcl_DStringAppend(dsPtr, htmlString, TCL_INDEX_NONE);
+            Tcl_DStringAppend(dsPtr, htmlString, (TCL_SIZE_T)length);
         }
     }
 }
@@ -184,10 +310,12 @@ NsTclQuoteHtmlObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE
         result = TCL_ERROR;
 
     } else {
-        const char *htmlString = Tcl_GetString(htmlObj);
+        TCL_SIZE_T  htmlLength;
+        const char *htmlString = Tcl_GetStringFromObj(htmlObj, &htmlLength);
 
         if (*htmlString != '\0') {
-            const char *first = FirstHtmlQuoteChar(htmlString);
+            const char *end = htmlString + htmlLength;
+            const char *first = FirstHtmlQuoteChar(htmlString, end);
 
             if (first == NULL) {
                 /*
@@ -198,7 +326,7 @@ NsTclQuoteHtmlObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE
                 Tcl_DString ds;
 
                 Tcl_DStringInit(&ds);
-                QuoteHtml(&ds, htmlString, first);
+                QuoteHtml(&ds, htmlString, first, end);
                 Tcl_DStringResult(interp, &ds);
             }
         }
@@ -2898,6 +3026,29 @@ NsTclStripHtmlObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE
         needEncode = NS_FALSE;
 
         while (*inPtr != '\0') {
+            const char *nextPtr;
+
+            /*
+             * Skip quickly to the next character relevant in the current
+             * state: in regular text, copy everything up to the next tag
+             * or entity; inside a tag, skip to the end of the tag, and in
+             * a comment to the next candidate for the end of the
+             * comment.
+             */
+            if (!intag) {
+                nextPtr = FirstCharOf2(inPtr, endOfString, '<', '&');
+                if (nextPtr != inPtr) {
+                    Tcl_DStringAppend(outputDsPtr, inPtr, (TCL_SIZE_T)(nextPtr - inPtr));
+                }
+            } else if (!incomment) {
+                nextPtr = FirstCharOf2(inPtr, endOfString, '<', '>');
+            } else {
+                nextPtr = FirstCharOf2(inPtr, endOfString, '<', '-');
+            }
+            inPtr = nextPtr;
+            if (inPtr == endOfString) {
+                break;
+            }
 
             Ns_Log(Debug, "inptr %c intag %d incomment %d string <%s>",
                    *inPtr, intag, incomment, inPtr);
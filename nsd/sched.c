@@ -39,6 +39,26 @@
  * #define NS_SCHED_TRACE_EVENTS
  */
 
+/*
+ * The following defines the upper bounds (in microseconds) of the buckets of
+ * the run-time and lateness histograms of the scheduled events. The last
+ * bucket collects all values above the last bound.
+ */
+
+#define SCHED_HIST_BUCKETS 7
+
+static const struct {
+    long        usec;
+    const char *label;
+} histBuckets[SCHED_HIST_BUCKETS - 1] = {
+    {    1000L, "1ms"   },
+    {   10000L, "10ms"  },
+    {  100000L, "100ms" },
+    { 1000000L, "1s"    },
+    {10000000L, "10s"   },
+    {60000000L, "60s"   }
+};
+
 /*
  * The following structure defines a scheduled event.
  */
@@ -60,6 +80,13 @@ typedef struct Event {
     unsigned int    flags;      /* One or more of NS_SCHED_ONCE, NS_SCHED_THREAD,
                                  * NS_SCHED_DAILY, or NS_SCHED_WEEKLY. */
     bool            waslate;    /* true while we are in a \"late\" period */
+    unsigned long   runs;       /* Number of runs. */
+    unsigned long   lateruns;   /* Number of runs started late. */
+    Ns_Time         runtime;    /* Accumulated run time. */
+    Ns_Time         maxruntime; /* Maximum run time. */
+    Ns_Time         maxlate;    /* Maximum lateness of a run. */
+    unsigned long   runtimeHist[SCHED_HIST_BUCKETS];  /* Run-time histogram. */
+    unsigned long   lateHist[SCHED_HIST_BUCKETS];     /* Lateness histogram. */
 } Event;
 
 /*
@@ -67,7 +94,15 @@ typedef struct Event {
  */
 
 static Ns_ThreadProc SchedThread;       /* Detached event firing thread. */
-static Ns_ThreadProc EventThread;       /* Proc for NS_SCHED_THREAD events. */
+static Ns_ThreadProc EventThread;       /* Worker proc for pooled events. */
+static void EventRecordStart(Event *ePtr, const Ns_Time *startPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void EventRecordEnd(Event *ePtr, const Ns_Time *endPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void HistAdd(unsigned long *hist, const Ns_Time *timePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void DStringAppendHist(Tcl_DString *dsPtr, const char *key, const unsigned long *hist)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
 static Event *DeQueueEvent(int k);      /* Remove event from heap. */
 static void FreeEvent(Event *ePtr)      /* Free completed or cancelled event. */
     NS_GNUC_NONNULL(1);
@@ -87,7 +122,8 @@ static Ns_Mutex lock = NULL;        /* Lock around heap and hash table. */
 static Ns_Cond schedcond = NULL;    /* Condition to wakeup SchedThread. */
 static Ns_Cond eventcond = NULL;    /* Condition to wakeup EventThread(s). */
 static Event **queue = NULL;        /* Heap priority queue (dynamically re-sized). */
-static Event *firstEventPtr = NULL; /* Pointer to the first event */
+static Event *firstEventPtr = NULL; /* First event waiting for a worker thread */
+static Event *lastEventPtr = NULL;  /* Last event waiting for a worker thread */
 static int nqueue = 0;              /* Number of events in queue. */
 static int maxqueue = 0;            /* Max queue events (dynamically re-sized). */
 
@@ -327,7 +363,7 @@ Ns_ScheduleProcEx(Ns_SchedProc *proc, void *clientData, unsigned int flags,
         Event    *ePtr;
         int       isNew;
 
-        ePtr = ns_malloc(sizeof(Event));
+        ePtr = ns_calloc(1u, sizeof(Event));
         ePtr->flags = flags;
         ePtr->nextqueue.sec = 0;
         ePtr->nextqueue.usec = 0;
@@ -867,7 +903,9 @@ DeQueueEvent(int k)
  *
  * EventThread --
  *
- *  Run detached thread events.
+ *  Worker thread of the scheduler pool. Runs events from the list of
+ *  events waiting for a worker (NS_SCHED_THREAD events, and all events
+ *  when "schedsyncinpool" is configured) in FIFO order.
  *
  * Results:
  *  None.
@@ -904,8 +942,12 @@ EventThread(void *arg)
         firstEventPtr = ePtr->nextPtr;
         if (firstEventPtr != NULL) {
             Ns_CondSignal(&eventcond);
+        } else {
+            lastEventPtr = NULL;
         }
         --nIdleThreads;
+        Ns_GetTime(&now);
+        EventRecordStart(ePtr, &now);
         Ns_MutexUnlock(&lock);
 
         Ns_ThreadSetName("-sched:%" PRIuPTR ":%" PRIuPTR ":%d-",
@@ -916,13 +958,13 @@ EventThread(void *arg)
 
         Ns_MutexLock(&lock);
         ++nIdleThreads;
+        EventRecordEnd(ePtr, &now);
         if (ePtr->hPtr == NULL) {
             Ns_MutexUnlock(&lock);
             FreeEvent(ePtr);
             Ns_MutexLock(&lock);
         } else {
             ePtr->flags &= ~NS_SCHED_RUNNING;
-            ePtr->lastend = now;
             /*
              * EventThread triggers QueueEvent() based on lastqueue.
              */
@@ -947,6 +989,107 @@ EventThread(void *arg)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * EventRecordStart, EventRecordEnd --
+ *
+ *  Record the start and the end of a run of an event and update the
+ *  run-time and lateness statistics. The lateness is the difference
+ *  between the actual start and the nominal start time of the run, so
+ *  it includes the time waiting for a worker thread. Must be called
+ *  with the scheduler lock held.
+ *
+ * Results:
+ *  None.
+ *
+ * Side effects:
+ *  Updates statistics of the event.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EventRecordStart(Event *ePtr, const Ns_Time *startPtr)
+{
+    Ns_Time late;
+
+    NS_NONNULL_ASSERT(ePtr != NULL);
+    NS_NONNULL_ASSERT(startPtr != NULL);
+
+    ePtr->laststart = *startPtr;
+    ePtr->flags |= NS_SCHED_RUNNING;
+
+    if (Ns_DiffTime(startPtr, &ePtr->scheduled, &late) <= 0) {
+        late.sec = 0;
+        late.usec = 0;
+    } else if (late.sec > 0 || late.usec > 100000) {
+        ePtr->lateruns++;
+    }
+    if (Ns_DiffTime(&late, &ePtr->maxlate, NULL) > 0) {
+        ePtr->maxlate = late;
+    }
+    HistAdd(ePtr->lateHist, &late);
+}
+
+static void
+EventRecordEnd(Event *ePtr, const Ns_Time *endPtr)
+{
+    Ns_Time diff;
+
+    NS_NONNULL_ASSERT(ePtr != NULL);
+    NS_NONNULL_ASSERT(endPtr != NULL);
+
+    ePtr->lastend = *endPtr;
+    ePtr->runs++;
+
+    if (Ns_DiffTime(endPtr, &ePtr->laststart, &diff) < 0) {
+        diff.sec = 0;
+        diff.usec = 0;
+    }
+    Ns_IncrTime(&ePtr->runtime, diff.sec, diff.usec);
+    if (Ns_DiffTime(&diff, &ePtr->maxruntime, NULL) > 0) {
+        ePtr->maxruntime = diff;
+    }
+    HistAdd(ePtr->runtimeHist, &diff);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HistAdd --
+ *
+ *  Add a duration to a histogram with SCHED_HIST_BUCKETS buckets.
+ *
+ * Results:
+ *  None.
+ *
+ * Side effects:
+ *  Increments one bucket of the histogram.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HistAdd(unsigned long *hist, const Ns_Time *timePtr)
+{
+    size_t i;
+
+    NS_NONNULL_ASSERT(hist != NULL);
+    NS_NONNULL_ASSERT(timePtr != NULL);
+
+    for (i = 0u; i < Ns_NrElements(histBuckets); i++) {
+        if (timePtr->sec < (time_t)(histBuckets[i].usec / 1000000L)
+            || (timePtr->sec == (time_t)(histBuckets[i].usec / 1000000L)
+                && timePtr->usec <= histBuckets[i].usec % 1000000L)) {
+            break;
+        }
+    }
+    hist[i]++;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1131,11 +1274,21 @@ SchedThread(void *UNUSED(arg))
                 ePtr->hPtr = NULL;
             }
             ePtr->lastqueue = now;
-            if ((ePtr->flags & NS_SCHED_THREAD) != 0u) {
+            if ((ePtr->flags & NS_SCHED_THREAD) != 0u || nsconf.sched.syncinpool) {
+                /*
+                 * Append the event to the FIFO list of events waiting for
+                 * a worker thread. The event is not in the heap while it
+                 * is waiting or running, so the same event never runs
+                 * concurrently.
+                 */
                 ePtr->flags |= NS_SCHED_RUNNING;
-                ePtr->laststart = now;
-                ePtr->nextPtr = firstEventPtr;
-                firstEventPtr = ePtr;
+                ePtr->nextPtr = NULL;
+                if (lastEventPtr == NULL) {
+                    firstEventPtr = ePtr;
+                } else {
+                    lastEventPtr->nextPtr = ePtr;
+                }
+                lastEventPtr = ePtr;
             } else {
                 ePtr->nextPtr = readyPtr;
                 readyPtr = ePtr;
@@ -1151,11 +1304,15 @@ SchedThread(void *UNUSED(arg))
 #endif
 
         /*
-         * Dispatch any threaded events.
+         * Dispatch any threaded events. Create a new worker thread, when
+         * no worker is idle, unless the maximum number of worker threads
+         * is reached. In the latter case, the events wait in the list
+         * until a worker becomes available.
          */
 
         if (firstEventPtr != NULL) {
-            if (nIdleThreads == 0) {
+            if (nIdleThreads == 0
+                && (nsconf.sched.maxthreads == 0 || nThreads < nsconf.sched.maxthreads)) {
                 Ns_ThreadCreate(EventThread, INT2PTR(nThreads), 0, NULL);
                 ++nIdleThreads;
                 ++nThreads;
@@ -1171,25 +1328,27 @@ SchedThread(void *UNUSED(arg))
             Ns_Time diff;
 
             readyPtr = ePtr->nextPtr;
-            ePtr->laststart = now;
-            ePtr->flags |= NS_SCHED_RUNNING;
+            Ns_GetTime(&now);
+            EventRecordStart(ePtr, &now);
             Ns_MutexUnlock(&lock);
             (*ePtr->proc) (ePtr->arg, ePtr->id);
             Ns_GetTime(&now);
 
-            (void)Ns_DiffTime(&ePtr->laststart, &now, &diff);
+            (void)Ns_DiffTime(&now, &ePtr->laststart, &diff);
             if (Ns_DiffTime(&diff, &nsconf.sched.maxelapsed, NULL) == 1) {
                 Ns_Log(Warning, "sched: excessive time taken by proc %d (" NS_TIME_FMT " seconds)",
                        ePtr->id, (int64_t)diff.sec, diff.usec);
             }
+            Ns_MutexLock(&lock);
+            EventRecordEnd(ePtr, &now);
             if (ePtr->hPtr == NULL) {
+                Ns_MutexUnlock(&lock);
                 FreeEvent(ePtr);
+                Ns_MutexLock(&lock);
                 ePtr = NULL;
             }
-            Ns_MutexLock(&lock);
             if (ePtr != NULL) {
                 ePtr->flags &= ~NS_SCHED_RUNNING;
-                ePtr->lastend = now;
                 /*
                  * Base repeating thread on the last queue time, and not on
                  * the last endtime to avoid a growing timeshift for events
@@ -1253,8 +1412,61 @@ SchedThread(void *UNUSED(arg))
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * DStringAppendHist --
+ *
+ *  Append a histogram as a key and a dict value to the Tcl_DString.
+ *
+ * Results:
+ *  None.
+ *
+ * Side effects:
+ *  Appends to the Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DStringAppendHist(Tcl_DString *dsPtr, const char *key, const unsigned long *hist)
+{
+    size_t i;
+
+    Tcl_DStringAppendElement(dsPtr, key);
+    Tcl_DStringStartSublist(dsPtr);
+    for (i = 0u; i < SCHED_HIST_BUCKETS; i++) {
+        Ns_DStringPrintf(dsPtr, "%s%s %lu",
+                         i > 0u ? " " : "",
+                         i < Ns_NrElements(histBuckets) ? histBuckets[i].label : "inf",
+                         hist[i]);
+    }
+    Tcl_DStringEndSublist(dsPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsGetScheduled --
+ *
+ *  Append information about all scheduled procedures to the
+ *  Tcl_DString. Every element is a list of id, flags, interval,
+ *  nextqueue, lastqueue, laststart, lastend, procname and arg. When
+ *  "withStats" is set, a dict with the run-time and lateness statistics
+ *  is appended as 10th element.
+ *
+ * Results:
+ *  None.
+ *
+ * Side effects:
+ *  Appends to the Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
 void
-NsGetScheduled(Tcl_DString *dsPtr)
+NsGetScheduled(Tcl_DString *dsPtr, bool withStats)
 {
     const Tcl_HashEntry *hPtr;
     Tcl_HashSearch       search;
@@ -1279,6 +1491,20 @@ NsGetScheduled(Tcl_DString *dsPtr)
         Ns_DStringAppendTime(dsPtr, &ePtr->lastend);
         Tcl_DStringAppend(dsPtr, " ", 1);
         Ns_GetProcInfo(dsPtr, (ns_funcptr_t)ePtr->proc, ePtr->arg);
+
+        if (withStats) {
+            Tcl_DStringStartSublist(dsPtr);
+            Ns_DStringPrintf(dsPtr, "runs %lu lateruns %lu runtime ", ePtr->runs, ePtr->lateruns);
+            Ns_DStringAppendTime(dsPtr, &ePtr->runtime);
+            Tcl_DStringAppend(dsPtr, " maxruntime ", 12);
+            Ns_DStringAppendTime(dsPtr, &ePtr->maxruntime);
+            Tcl_DStringAppend(dsPtr, " maxlate ", 9);
+            Ns_DStringAppendTime(dsPtr, &ePtr->maxlate);
+            DStringAppendHist(dsPtr, "runtimes", ePtr->runtimeHist);
+            DStringAppendHist(dsPtr, "lateness", ePtr->lateHist);
+            Tcl_DStringEndSublist(dsPtr);
+        }
+
         Tcl_DStringEndSublist(dsPtr);
         hPtr = Tcl_NextHashEntry(&search);
     }
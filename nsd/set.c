@@ -24,6 +24,28 @@
 typedef int (*StringCmpProc)(const char *s1, const char *s2);
 typedef int (*SetFindProc)(const Ns_Set *set, const char *key);
 
+/*
+ * Sets growing beyond NS_SET_INDEX_THRESHOLD elements receive an auxiliary
+ * open-addressing index (linear probing) over their keys. Every slot holds a
+ * case-insensitive hash of the key and the position of the field, such that
+ * the same index serves case-sensitive and case-insensitive lookups and is
+ * not affected when the string buffer of the set is moved. Since entries
+ * are only ever appended to the index, fields with the same key are found
+ * in the probe sequence in the order of their positions.
+ */
+#define NS_SET_INDEX_THRESHOLD 32u
+
+typedef struct NsSetIndexSlot {
+    unsigned int hash;
+    unsigned int pos;          /* position in set->fields + 1, 0 means empty */
+} NsSetIndexSlot;
+
+struct NsSetIndex {
+    size_t          mask;      /* number of slots - 1 */
+    size_t          nrEntries;
+    NsSetIndexSlot *slots;
+};
+
 /*
  * Local functions defined in this file
  */
@@ -45,6 +67,20 @@ static const char *DStringLowerStringWhenNeeded(Tcl_DString *dsPtr, const char *
 static char *LowerStringWhenNeeded(char *inputString, size_t stringLength)
     NS_GNUC_NONNULL(1);
 
+static unsigned int SetIndexHash(const char *key)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+static void SetIndexFree(Ns_Set *set)
+    NS_GNUC_NONNULL(1);
+static void SetIndexBuild(Ns_Set *set)
+    NS_GNUC_NONNULL(1);
+static void SetIndexAdd(Ns_Set *set, size_t idx)
+    NS_GNUC_NONNULL(1);
+static void SetIndexReset(Ns_Set *set)
+    NS_GNUC_NONNULL(1);
+static int SetIndexNext(const Ns_Set *set, const char *key, unsigned int hash,
+                        StringCmpProc cmp, size_t *slotPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5);
+
 #ifdef NS_SET_DSTRING
 static void ShiftData(Ns_Set *set, const char *oldDataStart)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
@@ -137,6 +173,168 @@ LowerStringWhenNeeded(char *inputString, size_t stringLength)
     return inputString;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetIndexHash --
+ *
+ *      Compute a case-insensitive hash value (FNV-1a over the lowercased
+ *      octets) of a key.
+ *
+ * Results:
+ *      Hash value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static unsigned int
+SetIndexHash(const char *key)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*key != '\0') {
+        hash ^= (uint32_t)(unsigned char)CHARCONV(lower, *key);
+        hash *= 16777619u;
+        key++;
+    }
+    return (unsigned int)hash;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetIndexFree, SetIndexBuild, SetIndexAdd, SetIndexReset --
+ *
+ *      Maintain the key index of a set. SetIndexBuild() (re)creates the
+ *      index from all fields, SetIndexAdd() registers a freshly appended
+ *      field, and SetIndexReset() has to be called after fields were
+ *      removed, since the positions of the remaining fields might have
+ *      changed. The index is only kept for sets with at least
+ *      NS_SET_INDEX_THRESHOLD elements.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Allocates or frees memory of the index.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+SetIndexFree(Ns_Set *set)
+{
+    if (set->indexPtr != NULL) {
+        ns_free(set->indexPtr);
+        set->indexPtr = NULL;
+    }
+}
+
+static void
+SetIndexBuild(Ns_Set *set)
+{
+    struct NsSetIndex *indexPtr;
+    size_t             i, nrSlots = 64u;
+
+    /*
+     * Keep the load factor below 50%.
+     */
+    while (nrSlots < set->size * 2u + 2u) {
+        nrSlots *= 2u;
+    }
+    SetIndexFree(set);
+    indexPtr = ns_calloc(1u, sizeof(struct NsSetIndex) + nrSlots * sizeof(NsSetIndexSlot));
+    indexPtr->slots = (NsSetIndexSlot *)(indexPtr + 1);
+    indexPtr->mask = nrSlots - 1u;
+    set->indexPtr = indexPtr;
+
+    for (i = 0u; i < set->size; i++) {
+        SetIndexAdd(set, i);
+    }
+}
+
+static void
+SetIndexAdd(Ns_Set *set, size_t idx)
+{
+    struct NsSetIndex *indexPtr = set->indexPtr;
+
+    if (indexPtr == NULL) {
+        if (set->size >= NS_SET_INDEX_THRESHOLD) {
+            SetIndexBuild(set);
+        }
+    } else if ((indexPtr->nrEntries + 1u) * 2u > indexPtr->mask + 1u) {
+        SetIndexBuild(set);
+    } else {
+        unsigned int hash = SetIndexHash(set->fields[idx].name);
+        size_t       slot = hash & indexPtr->mask;
+
+        while (indexPtr->slots[slot].pos != 0u) {
+            slot = (slot + 1u) & indexPtr->mask;
+        }
+        indexPtr->slots[slot].hash = hash;
+        indexPtr->slots[slot].pos = (unsigned int)idx + 1u;
+        indexPtr->nrEntries++;
+    }
+}
+
+static void
+SetIndexReset(Ns_Set *set)
+{
+    if (set->size < NS_SET_INDEX_THRESHOLD) {
+        SetIndexFree(set);
+    } else {
+        SetIndexBuild(set);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetIndexNext --
+ *
+ *      Continue a lookup of "key" in the index of the set, starting at the
+ *      slot referenced by slotPtr, which has to be initialized by the caller
+ *      with (hash & indexPtr->mask). The comparison function has to be
+ *      either strcmp or strcasecmp.
+ *
+ * Results:
+ *      Position of the next matching field or -1 if there are no more
+ *      matches.
+ *
+ * Side effects:
+ *      Updates the slot referenced by slotPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+SetIndexNext(const Ns_Set *set, const char *key, unsigned int hash,
+             StringCmpProc cmp, size_t *slotPtr)
+{
+    const struct NsSetIndex *indexPtr = set->indexPtr;
+    size_t                   slot = *slotPtr;
+    int                      result = -1;
+
+    while (indexPtr->slots[slot].pos != 0u) {
+        const NsSetIndexSlot *entryPtr = &indexPtr->slots[slot];
+
+        slot = (slot + 1u) & indexPtr->mask;
+        if (entryPtr->hash == hash) {
+            const char *name = set->fields[entryPtr->pos - 1u].name;
+
+            if ((*cmp)(key, name) == 0) {
+                result = (int)entryPtr->pos - 1;
+                break;
+            }
+        }
+    }
+    *slotPtr = slot;
+    return result;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -396,6 +594,7 @@ SetCreate(const char *name, size_t size)
     Tcl_DStringInit(&setPtr->data);
 #endif
     setPtr->flags = 0u;
+    setPtr->indexPtr = NULL;
 #ifdef NS_SET_DEBUG
     Ns_Log(Notice, "SetCreate %p '%s': size %ld/%ld (created %ld)",
            (void*)setPtr, setPtr->name, size, setPtr->maxSize, createdSets);
@@ -463,6 +662,7 @@ Ns_SetFree(Ns_Set *set)
             ns_free(set->fields[i].value);
         }
 #endif
+        SetIndexFree(set);
         ns_free(set->fields);
         ns_free_const(set->name);
         ns_free(set);
@@ -524,6 +724,7 @@ Ns_SetPutSz(Ns_Set *set,
                               ? strlen(set->fields[idx].name)
                               : (size_t)keyLength);
     }
+    SetIndexAdd(set, idx);
     Ns_Log(Ns_LogNsSetDebug, "Ns_SetPut %p [%lu] key '%s' value '%s' size %" PRITcl_Size,
            (void*)set, idx, set->fields[idx].name, set->fields[idx].value, valueLength);
     return idx;
@@ -580,7 +781,19 @@ Ns_SetUniqueCmp(const Ns_Set *set, const char *key, StringCmpProc cmp)
     }
 
     found = NS_FALSE;
-    for (i = 0u; i < set->size; ++i) {
+    if (set->indexPtr != NULL && (cmp == strcmp || cmp == strcasecmp)) {
+        unsigned int hash = SetIndexHash(key);
+        size_t       slot = hash & set->indexPtr->mask;
+
+        if (SetIndexNext(set, key, hash, cmp, &slot) != -1
+            && SetIndexNext(set, key, hash, cmp, &slot) != -1) {
+            result = NS_FALSE;
+        }
+        i = set->size;
+    } else {
+        i = 0u;
+    }
+    for (; i < set->size; ++i) {
         const char *name = set->fields[i].name;
 
         if (cmp == strcasecmp) {
@@ -651,7 +864,16 @@ Ns_SetFindCmp(const Ns_Set *set, const char *key, StringCmpProc cmp)
 #endif
     }
 
-    for (i = 0u; i < set->size; i++) {
+    if (set->indexPtr != NULL && (cmp == strcmp || cmp == strcasecmp)) {
+        unsigned int hash = SetIndexHash(key);
+        size_t       slot = hash & set->indexPtr->mask;
+
+        result = SetIndexNext(set, key, hash, cmp, &slot);
+        i = set->size;
+    } else {
+        i = 0u;
+    }
+    for (; i < set->size; i++) {
         const char *name = set->fields[i].name;
 
         assert(name != NULL);
@@ -768,7 +990,23 @@ NsSetGetCmpDListAppend(const Ns_Set *set, const char *key, bool all, StringCmpPr
             }*/
     }
 
-    for (idx = 0u; idx < set->size; idx++) {
+    if (set->indexPtr != NULL && (cmp == strcmp || cmp == strcasecmp)) {
+        unsigned int hash = SetIndexHash(key);
+        size_t       slot = hash & set->indexPtr->mask;
+        int          pos;
+
+        while ((pos = SetIndexNext(set, key, hash, cmp, &slot)) != -1) {
+            count ++;
+            Ns_DListAppend(dlPtr, getIdx ? UINT2PTR(pos) : set->fields[pos].value);
+            if (!all) {
+                break;
+            }
+        }
+        idx = set->size;
+    } else {
+        idx = 0u;
+    }
+    for (; idx < set->size; idx++) {
         const char *name = set->fields[idx].name;
         bool        found = NS_FALSE;
 
@@ -1084,6 +1322,9 @@ Ns_SetTrunc(Ns_Set *set, size_t size)
         }
 #endif
         set->size = size;
+        if (set->indexPtr != NULL) {
+            SetIndexReset(set);
+        }
     }
 }
 
@@ -1133,6 +1374,9 @@ Ns_SetDelete(Ns_Set *set, ssize_t index)
             set->fields[i].name = set->fields[i + 1u].name;
             set->fields[i].value = set->fields[i + 1u].value;
         }
+        if (set->indexPtr != NULL) {
+            SetIndexReset(set);
+        }
     } else {
         result = NS_FALSE;
     }
@@ -1757,11 +2001,13 @@ Ns_SetRecreate(Ns_Set *set)
     newSet->maxSize = set->maxSize;
     newSet->name = ns_strcopy(set->name);
     newSet->fields = ns_malloc(sizeof(Ns_SetField) * newSet->maxSize);
+    newSet->indexPtr = NULL;
 #ifdef NS_SET_DSTRING
     Tcl_DStringInit(&newSet->data);
 #endif
     SetCopyElements("recreate", set, newSet);
     set->size = 0u;
+    SetIndexFree(set);
 #ifdef NS_SET_DSTRING
     Tcl_DStringSetLength(&set->data, 0);
 #endif
@@ -1796,6 +2042,7 @@ SetCopyElements(const char* msg, const Ns_Set *from, Ns_Set *const to)
            msg, (const void*)from, from->name, from->size, (const void*)from, (void*)to);
 
     to->size = 0u;
+    SetIndexFree(to);
     for (i = 0u; i < from->size; i++) {
         Ns_SetPutSz(to,
                     from->fields[i].name, TCL_INDEX_NONE,
@@ -1807,6 +2054,7 @@ SetCopyElements(const char* msg, const Ns_Set *from, Ns_Set *const to)
         to->fields[i].name  = from->fields[i].name;
         to->fields[i].value = from->fields[i].value;
     }
+    SetIndexReset(to);
 #endif
 }
 
@@ -1854,6 +2102,7 @@ Ns_SetRecreate2(Ns_Set **toPtr, Ns_Set *from)
         newSet->size = from->size;
         newSet->maxSize = from->maxSize;
         newSet->fields = ns_malloc(sizeof(Ns_SetField) * newSet->maxSize);
+        newSet->indexPtr = NULL;
 #ifdef NS_SET_DSTRING
         Tcl_DStringInit(&newSet->data);
 #endif
@@ -1891,6 +2140,7 @@ Ns_SetRecreate2(Ns_Set **toPtr, Ns_Set *from)
     }
     SetCopyElements("recreate2", from, newSet);
     from->size = 0u;
+    SetIndexFree(from);
 #ifdef NS_SET_DSTRING
     Tcl_DStringSetLength(&from->data, 0);
 #endif
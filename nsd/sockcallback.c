@@ -13,11 +13,25 @@
 /*
  * sockcallback.c --
  *
- *      Support for the socket callback thread.
+ *      Support for the socket callback threads. Sockets are sharded
+ *      over the configured number of callback threads by their file
+ *      descriptor, such that all callbacks and cancel requests of a
+ *      socket are handled in order by the same thread. Where available,
+ *      the threads wait for socket readiness via epoll, otherwise via
+ *      ns_poll().
  */
 
 #include "nsd.h"
 
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+# define NS_SOCKCALLBACK_EPOLL 1
+/*
+ * Maximum number of ready sockets returned by a single epoll_wait().
+ */
+# define SOCKCALLBACK_MAX_EVENTS 256
+#endif
+
 /*
  * The following defines a socket being monitored.
  */
@@ -33,6 +47,35 @@ typedef struct Callback {
     void                *arg;
 } Callback;
 
+/*
+ * The following defines a callback thread together with its queue of
+ * pending updates, its active callbacks and its statistics.
+ */
+
+typedef struct CallbackQueue {
+    Callback      *firstQueuePtr;
+    Callback      *lastQueuePtr;
+    bool           shutdownPending;
+    bool           running;
+    Ns_Thread      thread;
+    Ns_Mutex       lock;
+    Ns_Cond        cond;
+    NS_SOCKET      trigPipe[2];
+    Tcl_HashTable  activeCallbacks;
+    int            id;
+    char           threadName[16];
+    struct {
+        int         callbacks;   /* Number of active callbacks */
+        int         backlog;     /* Ready callbacks in the last poll */
+        int         maxbacklog;  /* Max ready callbacks in one poll */
+        Tcl_WideInt calls;       /* Number of callback invocations */
+        Ns_Time     totalTime;   /* Accumulated callback run time */
+        Ns_Time     maxTime;     /* Max callback run time */
+    } stats;
+} CallbackQueue;
+
+#define MAX_SOCKCALLBACK_THREADS 32
+
 /*
  * Local functions defined in this file
  */
@@ -40,20 +83,21 @@ typedef struct Callback {
 static Ns_ThreadProc SockCallbackThread;
 static Ns_ReturnCode Queue(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int when,
                            const Ns_Time *timeout, const char **threadNamePtr);
-static void CallbackTrigger(void);
+static void CallbackTrigger(const CallbackQueue *queuePtr)
+    NS_GNUC_NONNULL(1);
+static bool RunCallback(CallbackQueue *queuePtr, Callback *cbPtr, unsigned int why)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static int QueueCount(void);
+#ifdef NS_SOCKCALLBACK_EPOLL
+static void EpollUpdate(int epfd, int op, const Callback *cbPtr)
+    NS_GNUC_NONNULL(3);
+#endif
 
 /*
  * Static variables defined in this file
  */
 
-static Callback     *firstQueuePtr = NULL, *lastQueuePtr = NULL;
-static bool          shutdownPending = NS_FALSE;
-static bool          running = NS_FALSE;
-static Ns_Thread     sockThread;
-static Ns_Mutex      lock = NULL;
-static Ns_Cond       cond = NULL;
-static NS_SOCKET     trigPipe[2];
-static Tcl_HashTable activeCallbacks;
+static CallbackQueue queues[MAX_SOCKCALLBACK_THREADS];
 
 
 /*
@@ -139,14 +183,54 @@ NsInitSockCallback(void)
     static bool initialized = NS_FALSE;
 
     if (!initialized) {
-        Tcl_InitHashTable(&activeCallbacks, TCL_ONE_WORD_KEYS);
-        Ns_MutexInit(&lock);
-        Ns_MutexSetName(&lock, "ns:sockcallbacks");
-        Ns_CondInit(&cond);
+        int i;
+
+        for (i = 0; i < MAX_SOCKCALLBACK_THREADS; i++) {
+            CallbackQueue *queuePtr = &queues[i];
+            char           buffer[TCL_INTEGER_SPACE];
+
+            queuePtr->id = i;
+            Tcl_InitHashTable(&queuePtr->activeCallbacks, TCL_ONE_WORD_KEYS);
+            Ns_MutexInit(&queuePtr->lock);
+            snprintf(buffer, sizeof(buffer), "%d", i);
+            Ns_MutexSetName2(&queuePtr->lock, "ns:sockcallbacks", buffer);
+            Ns_CondInit(&queuePtr->cond);
+        }
         initialized = NS_TRUE;
     }
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * QueueCount --
+ *
+ *      Return the number of socket callback threads as configured by
+ *      "sockcallbackthreads" in the global parameters.
+ *
+ * Results:
+ *      Number of callback queues, at least 1.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+QueueCount(void)
+{
+    int n = nsconf.sockcallbackthreads;
+
+    if (n < 1) {
+        n = 1;
+    } else if (n > MAX_SOCKCALLBACK_THREADS) {
+        n = MAX_SOCKCALLBACK_THREADS;
+    }
+    return n;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -167,31 +251,43 @@ NsInitSockCallback(void)
 void
 NsStartSockShutdown(void)
 {
-    Ns_MutexLock(&lock);
-    if (running) {
-        shutdownPending = NS_TRUE;
-        CallbackTrigger();
+    int i;
+
+    for (i = 0; i < MAX_SOCKCALLBACK_THREADS; i++) {
+        CallbackQueue *queuePtr = &queues[i];
+
+        Ns_MutexLock(&queuePtr->lock);
+        if (queuePtr->running) {
+            queuePtr->shutdownPending = NS_TRUE;
+            CallbackTrigger(queuePtr);
+        }
+        Ns_MutexUnlock(&queuePtr->lock);
     }
-    Ns_MutexUnlock(&lock);
 }
 
 void
 NsWaitSockShutdown(const Ns_Time *toPtr)
 {
-    Ns_ReturnCode status = NS_OK;
+    int i;
 
-    Ns_MutexLock(&lock);
-    while (status == NS_OK && running) {
-        status = Ns_CondTimedWait(&cond, &lock, toPtr);
-    }
-    Ns_MutexUnlock(&lock);
-    if (status != NS_OK) {
-        Ns_Log(Warning, "socks: timeout waiting for callback shutdown");
-    } else if (sockThread != NULL) {
-        Ns_ThreadJoin(&sockThread, NULL);
-        sockThread = NULL;
-        ns_sockclose(trigPipe[0]);
-        ns_sockclose(trigPipe[1]);
+    for (i = 0; i < MAX_SOCKCALLBACK_THREADS; i++) {
+        CallbackQueue *queuePtr = &queues[i];
+        Ns_ReturnCode  status = NS_OK;
+
+        Ns_MutexLock(&queuePtr->lock);
+        while (status == NS_OK && queuePtr->running) {
+            status = Ns_CondTimedWait(&queuePtr->cond, &queuePtr->lock, toPtr);
+        }
+        Ns_MutexUnlock(&queuePtr->lock);
+        if (status != NS_OK) {
+            Ns_Log(Warning, "socks: timeout waiting for callback shutdown of %s",
+                   queuePtr->threadName);
+        } else if (queuePtr->thread != NULL) {
+            Ns_ThreadJoin(&queuePtr->thread, NULL);
+            queuePtr->thread = NULL;
+            ns_sockclose(queuePtr->trigPipe[0]);
+            ns_sockclose(queuePtr->trigPipe[1]);
+        }
     }
 }
 
@@ -213,20 +309,21 @@ NsWaitSockShutdown(const Ns_Time *toPtr)
  */
 
 static void
-CallbackTrigger(void)
+CallbackTrigger(const CallbackQueue *queuePtr)
 {
-    if (ns_send(trigPipe[1], NS_EMPTY_STRING, 1u, 0) != 1) {
+    if (ns_send(queuePtr->trigPipe[1], NS_EMPTY_STRING, 1u, 0) != 1) {
         Ns_Fatal("trigger send() failed: %s", ns_sockstrerror(ns_sockerrno));
     }
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
  * Queue --
  *
- *      Queue a callback for socket.
+ *      Queue a callback for socket. The callback is queued to the
+ *      callback thread responsible for the socket.
  *
  * Results:
  *      NS_OK or NS_ERROR on shutdown pending.
@@ -241,9 +338,10 @@ static Ns_ReturnCode
 Queue(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int when,
       const Ns_Time *timeout, const char **threadNamePtr)
 {
-    Callback     *cbPtr;
-    Ns_ReturnCode status;
-    bool          trigger, create;
+    Callback      *cbPtr;
+    CallbackQueue *queuePtr;
+    Ns_ReturnCode  status;
+    bool           trigger, create;
 
     cbPtr = ns_calloc(1u, sizeof(Callback));
     cbPtr->sock = sock;
@@ -261,56 +359,163 @@ Queue(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int when,
         cbPtr->timeout.usec = 0;
     }
 
-    Ns_MutexLock(&lock);
-    if (shutdownPending) {
+    /*
+     * Shard by the socket, such that all requests for the same socket
+     * are processed in order by the same thread.
+     */
+    queuePtr = &queues[(size_t)sock % (size_t)QueueCount()];
+
+    Ns_MutexLock(&queuePtr->lock);
+    if (queuePtr->shutdownPending) {
         ns_free(cbPtr);
         status = NS_ERROR;
     } else {
-        if (!running) {
+        if (!queuePtr->running) {
             create = NS_TRUE;
-            running = NS_TRUE;
-        } else if (firstQueuePtr == NULL) {
+            queuePtr->running = NS_TRUE;
+        } else if (queuePtr->firstQueuePtr == NULL) {
             trigger = NS_TRUE;
         }
-        if (firstQueuePtr == NULL) {
-            firstQueuePtr = cbPtr;
+        if (queuePtr->firstQueuePtr == NULL) {
+            queuePtr->firstQueuePtr = cbPtr;
         } else {
-            lastQueuePtr->nextPtr = cbPtr;
+            queuePtr->lastQueuePtr->nextPtr = cbPtr;
         }
         cbPtr->nextPtr = NULL;
-        lastQueuePtr = cbPtr;
+        queuePtr->lastQueuePtr = cbPtr;
         status = NS_OK;
     }
-    Ns_MutexUnlock(&lock);
+    if (queuePtr->threadName[0] == '\0') {
+        if (QueueCount() == 1) {
+            memcpy(queuePtr->threadName, "-socks-", 8u);
+        } else {
+            snprintf(queuePtr->threadName, sizeof(queuePtr->threadName),
+                     "-socks%d-", queuePtr->id);
+        }
+    }
+    Ns_MutexUnlock(&queuePtr->lock);
 
     if (threadNamePtr != NULL) {
-        /*
-         * The thread name is currently just a constant, but when
-         * implementing multiple "-socks-" threads, threadNamePtr should
-         * return the associated queue. This way, we can keep the
-         * interface constant.
-         */
-        *threadNamePtr = "-socks-";
+        *threadNamePtr = queuePtr->threadName;
     }
 
     if (trigger) {
-        CallbackTrigger();
+        CallbackTrigger(queuePtr);
     } else if (create) {
-        if (ns_sockpair(trigPipe) != 0) {
+        if (ns_sockpair(queuePtr->trigPipe) != 0) {
             Ns_Fatal("ns_sockpair() failed: %s", ns_sockstrerror(ns_sockerrno));
         }
-        Ns_ThreadCreate(SockCallbackThread, NULL, 0, &sockThread);
+        Ns_ThreadCreate(SockCallbackThread, queuePtr, 0, &queuePtr->thread);
     }
     return status;
 }
 
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RunCallback --
+ *
+ *      Call the Ns_SockProc of a callback and account its run time in
+ *      the statistics of the callback thread.
+ *
+ * Results:
+ *      Boolean result of the Ns_SockProc.
+ *
+ * Side effects:
+ *      Depends on callback.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RunCallback(CallbackQueue *queuePtr, Callback *cbPtr, unsigned int why)
+{
+    Ns_Time start, end, diff;
+    bool    result;
+
+    Ns_GetTime(&start);
+    result = (*cbPtr->proc)(cbPtr->sock, cbPtr->arg, why);
+    Ns_GetTime(&end);
+    (void)Ns_DiffTime(&end, &start, &diff);
+
+    Ns_MutexLock(&queuePtr->lock);
+    queuePtr->stats.calls ++;
+    Ns_IncrTime(&queuePtr->stats.totalTime, diff.sec, diff.usec);
+    if (Ns_DiffTime(&diff, &queuePtr->stats.maxTime, NULL) > 0) {
+        queuePtr->stats.maxTime = diff;
+    }
+    Ns_MutexUnlock(&queuePtr->lock);
+
+    return result;
+}
+
+
+#ifdef NS_SOCKCALLBACK_EPOLL
+/*
+ *----------------------------------------------------------------------
+ *
+ * EpollUpdate --
+ *
+ *      Add, modify or remove the socket of a callback in the epoll
+ *      interest set of a callback thread. The requested events are
+ *      derived from the "when" conditions of the callback.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the epoll interest set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EpollUpdate(int epfd, int op, const Callback *cbPtr)
+{
+    struct epoll_event ev;
+
+    NS_NONNULL_ASSERT(cbPtr != NULL);
+
+    memset(&ev, 0, sizeof(ev));
+    if ((cbPtr->when & (unsigned int)NS_SOCK_READ) != 0u) {
+        ev.events |= (uint32_t)EPOLLIN;
+    }
+    if ((cbPtr->when & (unsigned int)NS_SOCK_WRITE) != 0u) {
+        ev.events |= (uint32_t)EPOLLOUT;
+    }
+    ev.data.fd = cbPtr->sock;
+
+    if (epoll_ctl(epfd, op, cbPtr->sock, &ev) != 0) {
+        if (op == EPOLL_CTL_DEL) {
+            /*
+             * The socket might be already closed by the callback, which
+             * removes it from the interest set as well.
+             */
+        } else if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+            /*
+             * The registered socket was closed and its file descriptor
+             * was reused for the new callback.
+             */
+            EpollUpdate(epfd, EPOLL_CTL_ADD, cbPtr);
+        } else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+            EpollUpdate(epfd, EPOLL_CTL_MOD, cbPtr);
+        } else {
+            Ns_Log(Warning, "sockcallback: epoll_ctl() failed for fd %d: %s",
+                   cbPtr->sock, strerror(errno));
+        }
+    }
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------
  *
  * SockCallbackThread --
  *
- *      Run callbacks registered with Ns_SockCallback.
+ *      Run callbacks registered with Ns_SockCallback for the sockets
+ *      assigned to this thread.
  *
  * Results:
  *      None.
@@ -322,19 +527,28 @@ Queue(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int when,
  */
 
 static void
-SockCallbackThread(void *UNUSED(arg))
+SockCallbackThread(void *arg)
 {
+    CallbackQueue *queuePtr = arg;
+    Tcl_HashTable *tablePtr = &queuePtr->activeCallbacks;
     char           c;
     unsigned int   when[3];
-    short          events[3];
     int            n, i, isNew;
-    size_t         maxPollfds = 100u;
-    Callback      *cbPtr, *nextPtr;
+    Callback      *cbPtr, *nextPtr, *cancelPtr, **cancelTailPtrPtr;
     Tcl_HashEntry *hPtr;
     Tcl_HashSearch search;
-    struct pollfd *pfds;
-
-    Ns_ThreadSetName("-socks-");
+#ifdef NS_SOCKCALLBACK_EPOLL
+    uint32_t            events[3];
+    int                 epfd;
+    bool                timeoutsActive = NS_FALSE;
+    struct epoll_event *evs;
+#else
+    short               events[3];
+    size_t              maxPollfds = 100u;
+    struct pollfd      *pfds;
+#endif
+
+    Ns_ThreadSetName("%s", queuePtr->threadName);
     (void)Ns_WaitForStartup();
     Ns_Log(Notice, "socks: starting");
 
@@ -348,37 +562,65 @@ SockCallbackThread(void *UNUSED(arg))
      * elements.  The positions in this array are for 'r', 'w' and 'e'
      * callback types in this order.
      */
+#ifdef NS_SOCKCALLBACK_EPOLL
+    events[0] = (uint32_t)EPOLLIN;
+    events[1] = (uint32_t)EPOLLOUT;
+    events[2] = (uint32_t)EPOLLERR;
+#else
     events[0] = (short)POLLIN;
     events[1] = (short)POLLOUT;
     events[2] = (short)POLLERR;
+#endif
     when[0] = (unsigned int)NS_SOCK_READ;
     when[1] = (unsigned int)NS_SOCK_WRITE;
     when[2] = (unsigned int)NS_SOCK_EXCEPTION | (unsigned int)NS_SOCK_DONE;
 
+#ifdef NS_SOCKCALLBACK_EPOLL
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        Ns_Fatal("sockcallback: epoll_create1() failed: %s", strerror(errno));
+    }
+    {
+        struct epoll_event ev;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = (uint32_t)EPOLLIN;
+        ev.data.fd = queuePtr->trigPipe[0];
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, queuePtr->trigPipe[0], &ev) != 0) {
+            Ns_Fatal("sockcallback: epoll_ctl() failed for trigger pipe: %s", strerror(errno));
+        }
+    }
+    evs = (struct epoll_event *)ns_malloc(sizeof(struct epoll_event) * SOCKCALLBACK_MAX_EVENTS);
+#else
     pfds = (struct pollfd *)ns_malloc(sizeof(struct pollfd) * maxPollfds);
-    pfds[0].fd = trigPipe[0];
+    pfds[0].fd = queuePtr->trigPipe[0];
     pfds[0].events = (short)POLLIN;
+#endif
 
     for (;;) {
         long              pollTimeout;
-        NS_POLL_NFDS_TYPE nfds;
         bool              stop;
+        int               ready;
         Ns_Time           now, diff = {0, 0};
+#ifndef NS_SOCKCALLBACK_EPOLL
+        NS_POLL_NFDS_TYPE nfds;
+#endif
 
         /*
-         * Grab the list of any queue updates and the shutdown flag.
+         * Grab the list of any queue updates and the shutdown flag and
+         * move the queued callbacks to the activeCallbacks table. The
+         * table is modified under the lock, since NsGetSockCallbacks()
+         * iterates over it from other threads.
          */
 
-        Ns_MutexLock(&lock);
-        cbPtr = firstQueuePtr;
-        firstQueuePtr = NULL;
-        lastQueuePtr = NULL;
-        stop = shutdownPending;
-        Ns_MutexUnlock(&lock);
+        cancelPtr = NULL;
+        cancelTailPtrPtr = &cancelPtr;
 
-        /*
-         * Move any queued callbacks to the activeCallbacks table.
-         */
+        Ns_MutexLock(&queuePtr->lock);
+        cbPtr = queuePtr->firstQueuePtr;
+        queuePtr->firstQueuePtr = NULL;
+        queuePtr->lastQueuePtr = NULL;
+        stop = queuePtr->shutdownPending;
 
         while (cbPtr != NULL) {
             nextPtr = cbPtr->nextPtr;
@@ -387,39 +629,63 @@ SockCallbackThread(void *UNUSED(arg))
                  * We have a cancel callback. Find active callback in
                  * hash table and remove it.
                  */
-                hPtr = Tcl_FindHashEntry(&activeCallbacks, NSSOCK2PTR(cbPtr->sock));
+                hPtr = Tcl_FindHashEntry(tablePtr, NSSOCK2PTR(cbPtr->sock));
                 if (hPtr != NULL) {
+#ifdef NS_SOCKCALLBACK_EPOLL
+                    EpollUpdate(epfd, EPOLL_CTL_DEL, cbPtr);
+#endif
                     ns_free(Tcl_GetHashValue(hPtr));
                     Tcl_DeleteHashEntry(hPtr);
                 }
                 /*
-                 * If there is a callback proc, execute it.
+                 * If there is a callback proc, execute it after releasing
+                 * the lock.
                  */
                 if (cbPtr->proc != NULL) {
-                    /*
-                     * For the time being, ignore boolean result.
-                     */
-                    (void) (*cbPtr->proc)(cbPtr->sock, cbPtr->arg, (unsigned int)NS_SOCK_CANCEL);
+                    cbPtr->nextPtr = NULL;
+                    *cancelTailPtrPtr = cbPtr;
+                    cancelTailPtrPtr = &cbPtr->nextPtr;
+                } else {
+                    ns_free(cbPtr);
                 }
-                ns_free(cbPtr);
             } else {
-                hPtr = Tcl_CreateHashEntry(&activeCallbacks, NSSOCK2PTR(cbPtr->sock), &isNew);
+                hPtr = Tcl_CreateHashEntry(tablePtr, NSSOCK2PTR(cbPtr->sock), &isNew);
                 if (isNew == 0) {
                     ns_free(Tcl_GetHashValue(hPtr));
                 }
                 Tcl_SetHashValue(hPtr, cbPtr);
+#ifdef NS_SOCKCALLBACK_EPOLL
+                EpollUpdate(epfd, isNew != 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, cbPtr);
+                if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
+                    timeoutsActive = NS_TRUE;
+                }
+#endif
             }
             cbPtr = nextPtr;
         }
+        Ns_MutexUnlock(&queuePtr->lock);
+
+        while (cancelPtr != NULL) {
+            nextPtr = cancelPtr->nextPtr;
+            /*
+             * For the time being, ignore boolean result.
+             */
+            (void) RunCallback(queuePtr, cancelPtr, (unsigned int)NS_SOCK_CANCEL);
+            ns_free(cancelPtr);
+            cancelPtr = nextPtr;
+        }
 
+#ifndef NS_SOCKCALLBACK_EPOLL
         /*
          * Check, if we have to extend maxPollfds and realloc memory if
          * necessary.
          */
-        if (maxPollfds <= (size_t)activeCallbacks.numEntries) {
-            maxPollfds  = (size_t)activeCallbacks.numEntries + 100u;
+        if (maxPollfds <= (size_t)tablePtr->numEntries) {
+            maxPollfds  = (size_t)tablePtr->numEntries + 100u;
             pfds = (struct pollfd *)ns_realloc(pfds, sizeof(struct pollfd) * maxPollfds);
         }
+        nfds = 1;
+#endif
 
         /*
          * Wake up every 30 seconds to process expired sockets
@@ -429,68 +695,110 @@ SockCallbackThread(void *UNUSED(arg))
         Ns_GetTime(&now);
 
         /*
-         * Verify and set the poll bits for all active callbacks.
+         * Check the timeouts and set the poll bits for all active
+         * callbacks. With epoll, the interest set is maintained by the
+         * kernel, so the scan is only needed when callbacks with a timeout
+         * are registered.
          */
 
-        nfds = 1;
-        for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
-            cbPtr = Tcl_GetHashValue(hPtr);
-            if ((cbPtr->timeout.sec > 0 || cbPtr->timeout.usec > 0)) {
-
-                if (Ns_DiffTime(&now, &cbPtr->expires, &diff) > 0) {
-                    /*
-                     * Call Ns_SockProc to notify about timeout. For the
-                     * time being, ignore boolean result.
-                     */
-                    Ns_Log(Notice, "sockcallback: fd %d timeout " NS_TIME_FMT " exceeded by " NS_TIME_FMT,
-                           cbPtr->sock, (int64_t) cbPtr->timeout.sec, cbPtr->timeout.usec,
-                           (int64_t) diff.sec, diff.usec
-                           );
-                    (void) (*cbPtr->proc)(cbPtr->sock, cbPtr->arg, (unsigned int)NS_SOCK_TIMEOUT);
-                    cbPtr->when = 0u;
-                }
-            }
-            if ((cbPtr->when & NS_SOCK_ANY) == 0u) {
-                Tcl_DeleteHashEntry(hPtr);
-                ns_free(cbPtr);
-            } else {
-                cbPtr->idx = nfds;
-                pfds[nfds].fd = cbPtr->sock;
-                pfds[nfds].events = pfds[nfds].revents = 0;
-                for (i = 0; i < Ns_NrElements(when); ++i) {
-                    //Ns_Log(Notice, "SockCallback check when[%d]: fd %d %.4x", i, pfds[i].fd, when[i]);
-                    if ((cbPtr->when & when[i]) != 0u) {
-                        pfds[nfds].events |= events[i];
+#ifdef NS_SOCKCALLBACK_EPOLL
+        if (timeoutsActive) {
+            timeoutsActive = NS_FALSE;
+#else
+        {
+#endif
+            for (hPtr = Tcl_FirstHashEntry(tablePtr, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+                cbPtr = Tcl_GetHashValue(hPtr);
+                if ((cbPtr->timeout.sec > 0 || cbPtr->timeout.usec > 0)) {
+
+                    if (Ns_DiffTime(&now, &cbPtr->expires, &diff) > 0) {
+                        /*
+                         * Call Ns_SockProc to notify about timeout. For the
+                         * time being, ignore boolean result.
+                         */
+                        Ns_Log(Notice, "sockcallback: fd %d timeout " NS_TIME_FMT " exceeded by " NS_TIME_FMT,
+                               cbPtr->sock, (int64_t) cbPtr->timeout.sec, cbPtr->timeout.usec,
+                               (int64_t) diff.sec, diff.usec
+                               );
+                        (void) RunCallback(queuePtr, cbPtr, (unsigned int)NS_SOCK_TIMEOUT);
+                        cbPtr->when = 0u;
                     }
                 }
-                ++nfds;
-
-                if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
-                    time_t to = diff.sec * -1000 + diff.usec / 1000 + 1;
+                if ((cbPtr->when & NS_SOCK_ANY) == 0u) {
+#ifdef NS_SOCKCALLBACK_EPOLL
+                    EpollUpdate(epfd, EPOLL_CTL_DEL, cbPtr);
+#endif
+                    Ns_MutexLock(&queuePtr->lock);
+                    Tcl_DeleteHashEntry(hPtr);
+                    Ns_MutexUnlock(&queuePtr->lock);
+                    ns_free(cbPtr);
+                } else {
+#ifndef NS_SOCKCALLBACK_EPOLL
+                    cbPtr->idx = nfds;
+                    pfds[nfds].fd = cbPtr->sock;
+                    pfds[nfds].events = pfds[nfds].revents = 0;
+                    for (i = 0; i < Ns_NrElements(when); ++i) {
+                        if ((cbPtr->when & when[i]) != 0u) {
+                            pfds[nfds].events |= events[i];
+                        }
+                    }
+                    ++nfds;
+#endif
+                    if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
+                        Ns_Time remain;
+                        time_t  to;
 
-                    if (to < pollTimeout)  {
                         /*
-                         * Reduce poll timeout to smaller value.
+                         * Compute the remaining time from the expiry
+                         * time, since a negative "diff" of less than a
+                         * second has a negative usec value.
                          */
-                        pollTimeout = (long)to;
+                        (void) Ns_DiffTime(&cbPtr->expires, &now, &remain);
+                        to = remain.sec * 1000 + remain.usec / 1000 + 1;
+
+#ifdef NS_SOCKCALLBACK_EPOLL
+                        timeoutsActive = NS_TRUE;
+#endif
+                        if (to < pollTimeout)  {
+                            /*
+                             * Reduce poll timeout to smaller value.
+                             */
+                            pollTimeout = (long)to;
+                        }
                     }
                 }
             }
         }
 
-        /*for (i=0; i<(int)nfds; i++) {
-            Ns_Log(Notice, "SockCallback pollbits [%d]: fd %d %.4x", i, pfds[i].fd, pfds[i].events);
-            }*/
-
         /*
-         * Call poll() on the sockets and drain the trigger pipe if
-         * necessary.
+         * Wait for the sockets to become ready and drain the trigger pipe
+         * if necessary.
          */
 
         if (stop) {
             break;
         }
 
+#ifdef NS_SOCKCALLBACK_EPOLL
+        do {
+            Ns_Log(Debug, "SockCallback before epoll_wait timeout %ld", pollTimeout);
+            n = epoll_wait(epfd, evs, SOCKCALLBACK_MAX_EVENTS, (int)pollTimeout);
+            Ns_Log(Debug, "SockCallback epoll_wait returned %d", n);
+        } while (n < 0  && errno == NS_EINTR);
+
+        if (n < 0) {
+            Ns_Fatal("sockcallback: epoll_wait() failed: %s", strerror(errno));
+        }
+        ready = n;
+        for (i = 0; i < n; i++) {
+            if (evs[i].data.fd == queuePtr->trigPipe[0]) {
+                if (recv(queuePtr->trigPipe[0], &c, 1, 0) != 1) {
+                    Ns_Fatal("trigger ns_read() failed: %s", strerror(errno));
+                }
+                ready--;
+            }
+        }
+#else
         pfds[0].revents = 0;
         do {
             Ns_Log(Debug, "SockCallback before poll nfds %ld timeout %zd", (long)nfds, pollTimeout);
@@ -502,21 +810,54 @@ SockCallbackThread(void *UNUSED(arg))
             Ns_Fatal("sockcallback: ns_poll() failed: %s",
                      ns_sockstrerror(ns_sockerrno));
         }
-        if (((pfds[0].revents & POLLIN) != 0)
-            && recv(trigPipe[0], &c, 1, 0) != 1) {
-            Ns_Fatal("trigger ns_read() failed: %s", strerror(errno));
+        ready = n;
+        if ((pfds[0].revents & POLLIN) != 0) {
+            if (recv(queuePtr->trigPipe[0], &c, 1, 0) != 1) {
+                Ns_Fatal("trigger ns_read() failed: %s", strerror(errno));
+            }
+            ready--;
+        }
+#endif
+
+        /*
+         * Update the backlog statistics: the number of callbacks
+         * becoming ready in a single poll iteration.
+         */
+        Ns_MutexLock(&queuePtr->lock);
+        queuePtr->stats.callbacks = tablePtr->numEntries;
+        queuePtr->stats.backlog = ready;
+        if (ready > queuePtr->stats.maxbacklog) {
+            queuePtr->stats.maxbacklog = ready;
         }
+        Ns_MutexUnlock(&queuePtr->lock);
 
-        if (n > 0) {
+        if (ready > 0) {
             /*
              * Execute any ready callbacks.
              */
-            for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL;
+#ifdef NS_SOCKCALLBACK_EPOLL
+            int e;
+
+            for (e = 0; e < n; e++) {
+                if (evs[e].data.fd == queuePtr->trigPipe[0]) {
+                    continue;
+                }
+                hPtr = Tcl_FindHashEntry(tablePtr, NSSOCK2PTR(evs[e].data.fd));
+                if (hPtr == NULL) {
+                    continue;
+                }
+                cbPtr = Tcl_GetHashValue(hPtr);
+                for (i = 0; i < Ns_NrElements(when); ++i) {
+                    if (((cbPtr->when & when[i]) != 0u)
+                        && (evs[e].events & events[i]) != 0u) {
+#else
+            for (hPtr = Tcl_FirstHashEntry(tablePtr, &search); hPtr != NULL;
                  hPtr = Tcl_NextHashEntry(&search)) {
                 cbPtr = Tcl_GetHashValue(hPtr);
                 for (i = 0; i < Ns_NrElements(when); ++i) {
                     if (((cbPtr->when & when[i]) != 0u)
                         && (pfds[cbPtr->idx].revents & events[i]) != 0) {
+#endif
                         /*
                          * Call the Sock_Proc with the SockState flag
                          * combination from when[i]. This is actually
@@ -526,7 +867,7 @@ SockCallbackThread(void *UNUSED(arg))
                          * could set the type of the last parameter of
                          * Ns_SockProc to Ns_SockState.
                          */
-                        if ((*cbPtr->proc)(cbPtr->sock, cbPtr->arg, when[i]) == NS_FALSE) {
+                        if (!RunCallback(queuePtr, cbPtr, when[i])) {
                             cbPtr->when = 0u;
                         } else {
                             if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
@@ -536,6 +877,20 @@ SockCallbackThread(void *UNUSED(arg))
                         }
                     }
                 }
+#ifdef NS_SOCKCALLBACK_EPOLL
+                /*
+                 * The interest set is level-triggered, so a finished
+                 * callback has to be removed right away, otherwise its
+                 * socket would be reported again by every epoll_wait().
+                 */
+                if ((cbPtr->when & NS_SOCK_ANY) == 0u) {
+                    EpollUpdate(epfd, EPOLL_CTL_DEL, cbPtr);
+                    Ns_MutexLock(&queuePtr->lock);
+                    Tcl_DeleteHashEntry(hPtr);
+                    Ns_MutexUnlock(&queuePtr->lock);
+                    ns_free(cbPtr);
+                }
+#endif
             }
         }
     }
@@ -544,33 +899,44 @@ SockCallbackThread(void *UNUSED(arg))
      */
 
     Ns_Log(Notice, "socks: shutdown pending");
-    for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+    for (hPtr = Tcl_FirstHashEntry(tablePtr, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
         cbPtr = Tcl_GetHashValue(hPtr);
         if ((cbPtr->when & (unsigned int)NS_SOCK_EXIT) != 0u) {
             (void) ((*cbPtr->proc)(cbPtr->sock, cbPtr->arg, (unsigned int)NS_SOCK_EXIT));
         }
     }
+
     /*
-     * Clean up the registered callbacks.
+     * Clean up the registered callbacks. The table is cleaned up under
+     * the lock and left initialized, since NsGetSockCallbacks() might
+     * still iterate over it.
      */
-    for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+    Ns_MutexLock(&queuePtr->lock);
+    for (hPtr = Tcl_FirstHashEntry(tablePtr, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
         ns_free(Tcl_GetHashValue(hPtr));
     }
-    Tcl_DeleteHashTable(&activeCallbacks);
+    Tcl_DeleteHashTable(tablePtr);
+    Tcl_InitHashTable(tablePtr, TCL_ONE_WORD_KEYS);
+    queuePtr->stats.callbacks = 0;
+    Ns_MutexUnlock(&queuePtr->lock);
+#ifdef NS_SOCKCALLBACK_EPOLL
+    ns_free(evs);
+    (void) close(epfd);
+#else
     ns_free(pfds);
+#endif
 
     Ns_Log(Notice, "socks: shutdown complete");
 
     /*
      * Tell others that shutdown is complete.
      */
-    Ns_MutexLock(&lock);
-    running = NS_FALSE;
-    Ns_CondBroadcast(&cond);
-    Ns_MutexUnlock(&lock);
+    Ns_MutexLock(&queuePtr->lock);
+    queuePtr->running = NS_FALSE;
+    Ns_CondBroadcast(&queuePtr->cond);
+    Ns_MutexUnlock(&queuePtr->lock);
 }
 
-
 /*
  *----------------------------------------------------------------------
  *
@@ -592,46 +958,113 @@ SockCallbackThread(void *UNUSED(arg))
 void
 NsGetSockCallbacks(Tcl_DString *dsPtr)
 {
-    Tcl_HashSearch  search;
+    int i;
 
     NS_NONNULL_ASSERT(dsPtr != NULL);
 
-    Ns_MutexLock(&lock);
-    if (running) {
-        const Tcl_HashEntry *hPtr;
+    for (i = 0; i < MAX_SOCKCALLBACK_THREADS; i++) {
+        CallbackQueue *queuePtr = &queues[i];
 
-        for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
-            const Callback *cbPtr = Tcl_GetHashValue(hPtr);
-            char            buf[TCL_INTEGER_SPACE];
+        Ns_MutexLock(&queuePtr->lock);
+        if (queuePtr->running) {
+            const Tcl_HashEntry *hPtr;
+            Tcl_HashSearch       search;
 
-            /*
-             * The "when" conditions are ORed together. Return these
-             * as a sublist of conditions.
-             */
-            Tcl_DStringStartSublist(dsPtr);
-            snprintf(buf, sizeof(buf), "%d", (int) cbPtr->sock);
-            Tcl_DStringAppendElement(dsPtr, buf);
-            Tcl_DStringStartSublist(dsPtr);
-            if ((cbPtr->when & (unsigned int)NS_SOCK_READ) != 0u) {
-                Tcl_DStringAppendElement(dsPtr, "read");
-            }
-            if ((cbPtr->when & (unsigned int)NS_SOCK_WRITE) != 0u) {
-                Tcl_DStringAppendElement(dsPtr, "write");
-            }
-            if ((cbPtr->when & (unsigned int)NS_SOCK_EXCEPTION) != 0u) {
-                Tcl_DStringAppendElement(dsPtr, "exception");
-            }
-            if ((cbPtr->when & (unsigned int)NS_SOCK_EXIT) != 0u) {
-                Tcl_DStringAppendElement(dsPtr, "exit");
+            for (hPtr = Tcl_FirstHashEntry(&queuePtr->activeCallbacks, &search); hPtr != NULL;
+                 hPtr = Tcl_NextHashEntry(&search)) {
+                const Callback *cbPtr = Tcl_GetHashValue(hPtr);
+                char            buf[TCL_INTEGER_SPACE];
+
+                /*
+                 * The "when" conditions are ORed together. Return these
+                 * as a sublist of conditions.
+                 */
+                Tcl_DStringStartSublist(dsPtr);
+                snprintf(buf, sizeof(buf), "%d", (int) cbPtr->sock);
+                Tcl_DStringAppendElement(dsPtr, buf);
+                Tcl_DStringStartSublist(dsPtr);
+                if ((cbPtr->when & (unsigned int)NS_SOCK_READ) != 0u) {
+                    Tcl_DStringAppendElement(dsPtr, "read");
+                }
+                if ((cbPtr->when & (unsigned int)NS_SOCK_WRITE) != 0u) {
+                    Tcl_DStringAppendElement(dsPtr, "write");
+                }
+                if ((cbPtr->when & (unsigned int)NS_SOCK_EXCEPTION) != 0u) {
+                    Tcl_DStringAppendElement(dsPtr, "exception");
+                }
+                if ((cbPtr->when & (unsigned int)NS_SOCK_EXIT) != 0u) {
+                    Tcl_DStringAppendElement(dsPtr, "exit");
+                }
+                Tcl_DStringEndSublist(dsPtr);
+                Ns_GetProcInfo(dsPtr, (ns_funcptr_t)cbPtr->proc, cbPtr->arg);
+                Tcl_DStringAppend(dsPtr, " ", 1);
+                Ns_DStringAppendTime(dsPtr, &cbPtr->timeout);
+                Tcl_DStringEndSublist(dsPtr);
             }
-            Tcl_DStringEndSublist(dsPtr);
-            Ns_GetProcInfo(dsPtr, (ns_funcptr_t)cbPtr->proc, cbPtr->arg);
-            Tcl_DStringAppend(dsPtr, " ", 1);
-            Ns_DStringAppendTime(dsPtr, &cbPtr->timeout);
-            Tcl_DStringEndSublist(dsPtr);
         }
+        Ns_MutexUnlock(&queuePtr->lock);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsGetSockCallbackStats --
+ *
+ *      Return the statistics of the socket callback threads in form of
+ *      a valid Tcl list in the provided Tcl_DString. Every element is a
+ *      dict containing the thread name, the number of active
+ *      callbacks, the current and maximum backlog (callbacks ready in
+ *      a single poll iteration), the number of callback invocations
+ *      and the average and maximum callback run time. The passed
+ *      Tcl_DString has to be initialized by the caller.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      DString is updated
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsGetSockCallbackStats(Tcl_DString *dsPtr)
+{
+    int i, nQueues = QueueCount();
+
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    for (i = 0; i < nQueues; i++) {
+        CallbackQueue *queuePtr = &queues[i];
+        Ns_Time        avgTime = {0, 0};
+
+        Ns_MutexLock(&queuePtr->lock);
+        if (queuePtr->stats.calls > 0) {
+            Tcl_WideInt us = ((Tcl_WideInt)queuePtr->stats.totalTime.sec * 1000000
+                              + queuePtr->stats.totalTime.usec) / queuePtr->stats.calls;
+
+            avgTime.sec  = (time_t)(us / 1000000);
+            avgTime.usec = (long)(us % 1000000);
+        }
+        Tcl_DStringStartSublist(dsPtr);
+        Tcl_DStringAppendElement(dsPtr, "thread");
+        Tcl_DStringAppendElement(dsPtr, queuePtr->threadName[0] != '\0'
+                                 ? queuePtr->threadName : NS_EMPTY_STRING);
+        Ns_DStringPrintf(dsPtr, " running %d callbacks %d backlog %d maxbacklog %d"
+                         " calls %" TCL_LL_MODIFIER "d avgtime ",
+                         queuePtr->running ? 1 : 0,
+                         queuePtr->stats.callbacks,
+                         queuePtr->stats.backlog,
+                         queuePtr->stats.maxbacklog,
+                         queuePtr->stats.calls);
+        Ns_DStringAppendTime(dsPtr, &avgTime);
+        Tcl_DStringAppend(dsPtr, " maxtime ", 9);
+        Ns_DStringAppendTime(dsPtr, &queuePtr->stats.maxTime);
+        Tcl_DStringEndSublist(dsPtr);
+        Ns_MutexUnlock(&queuePtr->lock);
     }
-    Ns_MutexUnlock(&lock);
 }
 
 /*
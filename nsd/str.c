@@ -24,10 +24,121 @@
 # include <openssl/err.h>
 #endif
 
+/*
+ * Vectorized UTF-8 validation. On x86, the AVX2 variant is compiled
+ * via function attributes and selected at runtime based on the CPU
+ * features, since distribution builds typically do not enable AVX2
+ * globally. On aarch64, NEON is always available.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NS_NO_SIMD)
+# include <immintrin.h>
+# define NS_UTF8_AVX2 1
+# define NS_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(NS_NO_SIMD)
+# include <arm_neon.h>
+# define NS_UTF8_NEON 1
+#endif
+
+/*
+ * Error classes of the lookup algorithm of Keiser and Lemire. Every
+ * class is a bit; an error is detected, when a pair of bytes has a bit
+ * set in all three lookup tables (see Utf8ValidAvx2()).
+ */
+#define UTF8_TOO_SHORT      0x01u /* 11______ 0_______ or 11______ 11______ */
+#define UTF8_TOO_LONG       0x02u /* 0_______ 10______ */
+#define UTF8_OVERLONG_3     0x04u /* 11100000 100_____ */
+#define UTF8_TOO_LARGE      0x08u /* 11110100 1001____, 11110100 101_____, 11110101 ... */
+#define UTF8_SURROGATE      0x10u /* 11101101 101_____ */
+#define UTF8_OVERLONG_2     0x20u /* 1100000_ 10______ */
+#define UTF8_TOO_LARGE_1000 0x40u /* 11110101 1000____, 1111011_ 1000____, 11111___ 1000____ */
+#define UTF8_OVERLONG_4     0x40u /* 11110000 1000____ */
+#define UTF8_TWO_CONTS      0x80u /* 10______ 10______ */
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+/*
+ * Table for the high nibble of the first byte.
+ */
+#define UTF8_BYTE1_HIGH_TABLE                                           \
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,         \
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,         \
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,     \
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,                                   \
+    UTF8_TOO_SHORT,                                                     \
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,                  \
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+
+/*
+ * Table for the low nibble of the first byte.
+ */
+#define UTF8_BYTE1_LOW_TABLE                                            \
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,   \
+    UTF8_CARRY | UTF8_OVERLONG_2,                                       \
+    UTF8_CARRY,                                                         \
+    UTF8_CARRY,                                                         \
+    UTF8_CARRY | UTF8_TOO_LARGE,                                        \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE, \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                  \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+
+/*
+ * Table for the high nibble of the second byte.
+ */
+#define UTF8_BYTE2_HIGH_TABLE                                           \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,     \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,     \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3  \
+        | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,                        \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3  \
+        | UTF8_TOO_LARGE,                                               \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE   \
+        | UTF8_TOO_LARGE,                                               \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE   \
+        | UTF8_TOO_LARGE,                                               \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+
+#if defined(NS_UTF8_AVX2) || defined(NS_UTF8_NEON)
+static const uint8_t utf8Byte1HighTable[16] = {UTF8_BYTE1_HIGH_TABLE};
+static const uint8_t utf8Byte1LowTable[16]  = {UTF8_BYTE1_LOW_TABLE};
+static const uint8_t utf8Byte2HighTable[16] = {UTF8_BYTE2_HIGH_TABLE};
+
+/*
+ * Bytes larger than these values at the end of a block start a sequence
+ * continuing in the next block. The table is used for 16 and 32 byte
+ * blocks, the relevant values are at the end.
+ */
+static const uint8_t utf8IncompleteMax[32] = {
+    0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu,
+    0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu,
+    0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu,
+    0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xFFu, 0xF0u - 1u, 0xE0u - 1u, 0xC0u - 1u
+};
+#endif
+
 static void
 InvalidUtf8ErrorMessage(Tcl_DString *dsPtr, const unsigned char *bytes, size_t nrBytes,
                  size_t index, TCL_SIZE_T nrMaxBytes, bool isTruncated);
 
+static bool Utf8ValidScalar(const unsigned char *bytes, size_t nrBytes, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1);
+
+#if defined(NS_UTF8_AVX2)
+static bool Utf8ValidAvx2(const unsigned char *bytes, size_t nrBytes)
+    NS_GNUC_NONNULL(1) NS_TARGET_AVX2;
+static bool Is7bitAvx2(const unsigned char *bytes, size_t nrBytes)
+    NS_GNUC_NONNULL(1) NS_TARGET_AVX2;
+#elif defined(NS_UTF8_NEON)
+static bool Utf8ValidNeon(const unsigned char *bytes, size_t nrBytes)
+    NS_GNUC_NONNULL(1);
+#endif
+
 
 /*
  *----------------------------------------------------------------------
@@ -719,18 +830,18 @@ InvalidUtf8ErrorMessage(Tcl_DString *dsPtr, const unsigned char *bytes, size_t n
  *
  *      Check the validity of the UTF-8 input string.
  *
- *      This implementation is fully platform independent and
- *      based on the code from Daniel Lemire, but not using
- *      the SIMD operations from
+ *      Longer strings are validated with the SIMD lookup algorithm
+ *      from
  *
  *         John Keiser, Daniel Lemire, Validating UTF-8 In Less Than
  *         One Instruction Per Byte, Software: Practice &
  *         Experience 51 (5), 2021
  *         https://github.com/lemire/fastvalidate-utf-8
  *
- *      If necessary, more performance can be squeezed
- *      out. This might be the case, when this function would
- *      be used internally for validating.
+ *      when the platform supports it (AVX2 or NEON). Short strings
+ *      and invalid strings are handled by the platform independent
+ *      scalar implementation, which determines as well the position
+ *      of the error.
  *
  *      When a dsPtr is provided, and a validation error occurs, it will ne
  *      initialized and filled with a truncated error string.
@@ -744,6 +855,45 @@ InvalidUtf8ErrorMessage(Tcl_DString *dsPtr, const unsigned char *bytes, size_t n
  *----------------------------------------------------------------------
  */
 bool Ns_Valid_UTF8(const unsigned char *bytes, size_t nrBytes, Tcl_DString *dsPtr)
+{
+    NS_NONNULL_ASSERT(bytes != NULL);
+
+#if defined(NS_UTF8_AVX2)
+    if (nrBytes >= 32u && __builtin_cpu_supports("avx2") && Utf8ValidAvx2(bytes, nrBytes)) {
+        return NS_TRUE;
+    }
+#elif defined(NS_UTF8_NEON)
+    if (nrBytes >= 16u && Utf8ValidNeon(bytes, nrBytes)) {
+        return NS_TRUE;
+    }
+#endif
+    /*
+     * The scalar validator is used for short strings, on platforms
+     * without SIMD support, and for determining the error position,
+     * when the vectorized validator reported an error.
+     */
+    return Utf8ValidScalar(bytes, nrBytes, dsPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Utf8ValidScalar --
+ *
+ *      Platform independent UTF-8 validator, based on the code from
+ *      Daniel Lemire, processing eight 7-bit characters at a time and
+ *      multi-byte sequences via a state machine.
+ *
+ * Results:
+ *      Boolean value.
+ *
+ * Side effects:
+ *      Fills dsPtr with an error message, when provided.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+Utf8ValidScalar(const unsigned char *bytes, size_t nrBytes, Tcl_DString *dsPtr)
 {
     size_t idx = 0;
 
@@ -870,6 +1020,197 @@ bool Ns_Valid_UTF8(const unsigned char *bytes, size_t nrBytes, Tcl_DString *dsPt
     }
 }
 
+#if defined(NS_UTF8_AVX2)
+/*
+ *----------------------------------------------------------------------
+ *
+ * Utf8ValidAvx2 --
+ *
+ *      Validate UTF-8 in blocks of 32 bytes with the lookup algorithm
+ *      of Keiser and Lemire. For every byte, the high and low nibble of
+ *      the previous byte and the high nibble of the current byte are
+ *      mapped via three lookup tables to error classes; an error is
+ *      present, when all three lookups agree on an error class. The
+ *      remaining errors (missing or excess continuation bytes of 3-
+ *      and 4-byte sequences) are detected by checking, whether the
+ *      bytes following a 3- or 4-byte lead are continuation bytes.
+ *
+ *      Blocks consisting of 7-bit characters are skipped, unless the
+ *      previous block ended with an incomplete sequence.
+ *
+ * Results:
+ *      NS_TRUE when the string is valid UTF-8.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+Utf8ValidAvx2(const unsigned char *bytes, size_t nrBytes)
+{
+    const __m256i byte1HighTable = _mm256_broadcastsi128_si256(
+                                       _mm_loadu_si128((const __m128i *)(const void *)utf8Byte1HighTable));
+    const __m256i byte1LowTable  = _mm256_broadcastsi128_si256(
+                                       _mm_loadu_si128((const __m128i *)(const void *)utf8Byte1LowTable));
+    const __m256i byte2HighTable = _mm256_broadcastsi128_si256(
+                                       _mm_loadu_si128((const __m128i *)(const void *)utf8Byte2HighTable));
+    const __m256i incompleteMax  = _mm256_loadu_si256((const __m256i *)(const void *)utf8IncompleteMax);
+    const __m256i nibbleMask     = _mm256_set1_epi8(0x0F);
+    __m256i       previous = _mm256_setzero_si256(), incomplete = _mm256_setzero_si256();
+    __m256i       error = _mm256_setzero_si256();
+    unsigned char lastBlock[32];
+    size_t        idx = 0u;
+
+    for (;;) {
+        __m256i input;
+
+        if (idx + 32u <= nrBytes) {
+            input = _mm256_loadu_si256((const __m256i *)(const void *)(bytes + idx));
+            idx += 32u;
+        } else if (idx < nrBytes) {
+            /*
+             * Pad the last partial block with NUL bytes.
+             */
+            memset(lastBlock, 0, sizeof(lastBlock));
+            memcpy(lastBlock, bytes + idx, nrBytes - idx);
+            input = _mm256_loadu_si256((const __m256i *)(const void *)lastBlock);
+            idx = nrBytes;
+        } else {
+            break;
+        }
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            /*
+             * Only 7-bit characters in this block.
+             */
+            error = _mm256_or_si256(error, incomplete);
+        } else {
+            const __m256i shifted = _mm256_permute2x128_si256(previous, input, 0x21);
+            const __m256i prev1 = _mm256_alignr_epi8(input, shifted, 16 - 1);
+            const __m256i prev2 = _mm256_alignr_epi8(input, shifted, 16 - 2);
+            const __m256i prev3 = _mm256_alignr_epi8(input, shifted, 16 - 3);
+            __m256i       special, must23;
+
+            special = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(byte1HighTable,
+                                        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibbleMask)),
+                    _mm256_shuffle_epi8(byte1LowTable, _mm256_and_si256(prev1, nibbleMask))),
+                _mm256_shuffle_epi8(byte2HighTable,
+                                    _mm256_and_si256(_mm256_srli_epi16(input, 4), nibbleMask)));
+            must23 = _mm256_and_si256(
+                _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0u - 0x80u))),
+                                _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0u - 0x80u)))),
+                _mm256_set1_epi8((char)0x80u));
+            error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+            incomplete = _mm256_subs_epu8(input, incompleteMax);
+        }
+        previous = input;
+    }
+    error = _mm256_or_si256(error, incomplete);
+
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Is7bitAvx2 --
+ *
+ *      Check 64 bytes at a time, whether the input has only 7-bit
+ *      characters. The length has to be a multiple of 64.
+ *
+ * Results:
+ *      Boolean value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+Is7bitAvx2(const unsigned char *bytes, size_t nrBytes)
+{
+    __m256i mask1 = _mm256_setzero_si256(), mask2 = _mm256_setzero_si256();
+    size_t  idx;
+
+    for (idx = 0u; idx < nrBytes; idx += 64u) {
+        mask1 = _mm256_or_si256(mask1, _mm256_loadu_si256((const __m256i *)(const void *)(bytes + idx)));
+        mask2 = _mm256_or_si256(mask2, _mm256_loadu_si256((const __m256i *)(const void *)(bytes + idx + 32u)));
+    }
+    return _mm256_movemask_epi8(_mm256_or_si256(mask1, mask2)) == 0;
+}
+
+#elif defined(NS_UTF8_NEON)
+/*
+ *----------------------------------------------------------------------
+ *
+ * Utf8ValidNeon --
+ *
+ *      Validate UTF-8 in blocks of 16 bytes with the lookup algorithm
+ *      of Keiser and Lemire, see Utf8ValidAvx2() for details.
+ *
+ * Results:
+ *      NS_TRUE when the string is valid UTF-8.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+Utf8ValidNeon(const unsigned char *bytes, size_t nrBytes)
+{
+    const uint8x16_t byte1HighTable = vld1q_u8(utf8Byte1HighTable);
+    const uint8x16_t byte1LowTable = vld1q_u8(utf8Byte1LowTable);
+    const uint8x16_t byte2HighTable = vld1q_u8(utf8Byte2HighTable);
+    const uint8x16_t incompleteMax = vld1q_u8(utf8IncompleteMax + 16);
+    const uint8x16_t nibbleMask = vdupq_n_u8(0x0F);
+    uint8x16_t       previous = vdupq_n_u8(0), incomplete = vdupq_n_u8(0), error = vdupq_n_u8(0);
+    unsigned char    lastBlock[16];
+    size_t           idx = 0u;
+
+    for (;;) {
+        uint8x16_t input;
+
+        if (idx + 16u <= nrBytes) {
+            input = vld1q_u8(bytes + idx);
+            idx += 16u;
+        } else if (idx < nrBytes) {
+            memset(lastBlock, 0, sizeof(lastBlock));
+            memcpy(lastBlock, bytes + idx, nrBytes - idx);
+            input = vld1q_u8(lastBlock);
+            idx = nrBytes;
+        } else {
+            break;
+        }
+
+        if (vmaxvq_u8(input) < 0x80u) {
+            error = vorrq_u8(error, incomplete);
+        } else {
+            const uint8x16_t prev1 = vextq_u8(previous, input, 16 - 1);
+            const uint8x16_t prev2 = vextq_u8(previous, input, 16 - 2);
+            const uint8x16_t prev3 = vextq_u8(previous, input, 16 - 3);
+            uint8x16_t       special, must23;
+
+            special = vandq_u8(vandq_u8(vqtbl1q_u8(byte1HighTable, vshrq_n_u8(prev1, 4)),
+                                        vqtbl1q_u8(byte1LowTable, vandq_u8(prev1, nibbleMask))),
+                               vqtbl1q_u8(byte2HighTable, vshrq_n_u8(input, 4)));
+            must23 = vandq_u8(vorrq_u8(vqsubq_u8(prev2, vdupq_n_u8(0xE0u - 0x80u)),
+                                       vqsubq_u8(prev3, vdupq_n_u8(0xF0u - 0x80u))),
+                              vdupq_n_u8(0x80u));
+            error = vorrq_u8(error, veorq_u8(must23, special));
+            incomplete = vqsubq_u8(input, incompleteMax);
+        }
+        previous = input;
+    }
+    error = vorrq_u8(error, incomplete);
+
+    return vmaxvq_u8(error) == 0u;
+}
+#endif
+
 /*
  *----------------------------------------------------------------------
  *
@@ -892,6 +1233,17 @@ bool Ns_Is7bit(const char *bytes, size_t nrBytes)
     const char *current = bytes, *end = bytes + nrBytes;
     uint64_t mask1 = 0u, mask2 = 0u, mask3 = 0u, mask4 = 0u, last_mask = 0u;
 
+#if defined(NS_UTF8_AVX2)
+    if (nrBytes >= 64u && __builtin_cpu_supports("avx2")) {
+        size_t blockBytes = nrBytes & ~(size_t)63u;
+
+        if (!Is7bitAvx2((const unsigned char *)bytes, blockBytes)) {
+            return NS_FALSE;
+        }
+        current += blockBytes;
+    }
+#endif
+
     /*
      * An unsigned 64-bit integral type is not guaranteed by the C
      * standard but is typically available on 32-bit machines, and on
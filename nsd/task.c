@@ -31,6 +31,14 @@ typedef struct TaskQueue {
     bool               shutdown;          /* Shutdown flag */
     bool               stopped;           /* Stop flag */
     int                numTasks;          /* Number of tasks running on queue */
+    int                load;              /* Busy permille of last load window */
+    intptr_t           latencyCount;      /* Number of latency samples */
+    Ns_Time            latencyTotal;      /* Accumulated enqueue latency */
+    Ns_Time            latencyMax;        /* Maximum enqueue latency */
+    Ns_Time            busyTotal;         /* Accumulated time spent outside poll */
+    Ns_Time            busySince;         /* Start of current busy period or zero */
+    Ns_Time            windowStart;       /* Start of current load window */
+    Ns_Time            windowBusy;        /* Busy time in current load window */
     NS_SOCKET          trigger[2];        /* Trigger pipes */
     char               name[1];           /* Name of the queue */
 } TaskQueue;
@@ -49,6 +57,14 @@ typedef struct TaskQueue {
 #define TASK_EXPIRE   0x0040u
 #define TASK_TIMEDOUT 0x0080u
 #define TASK_EXPIRED  0x0100u
+#define TASK_DEADLINE 0x0200u /* Deadline reached, set via the timer wheel */
+
+/*
+ * Length of the window (in microseconds) used for computing the recent
+ * load of a task queue.
+ */
+
+#define TASK_LOAD_WINDOW INT64_C(1000000)
 
 /*
  * The following defines a task.
@@ -65,6 +81,8 @@ typedef struct Task {
     short              events;        /* Poll events */
     Ns_Time            timeout;       /* Read/write timeout (wall-clock time) */
     Ns_Time            expire;        /* Task (wall-clock time) */
+    Ns_Time            queued;        /* Time when task was enqueued */
+    NsTimerWheelEntry  timer;         /* Timeout entry in queue's timer wheel */
     int                refCount;      /* For reserve/release purposes */
     unsigned int       signalFlags;   /* Signal flags sent to queue thread */
     unsigned int       flags;         /* Flags private to the task */
@@ -86,6 +104,7 @@ static void FreeTask(Task *taskPtr)
     NS_GNUC_NONNULL(1);
 static void RunTask(Task *taskPtr, short revents, const Ns_Time *nowPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
+static NsTimerWheelProc TaskExpired;
 static void ReleaseTask(Task *taskPtr)
     NS_GNUC_NONNULL(1);
 static void ReserveTask(Task *taskPtr)
@@ -96,6 +115,11 @@ static void LogDebug(const char *before, Task *taskPtr, const char *after)
 static char *DStringAppendTaskFlags(Tcl_DString *dsPtr, unsigned int flags)
     NS_GNUC_NONNULL(1);
 
+static void AccountBusyTime(TaskQueue *queuePtr, const Ns_Time *startPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+static int64_t TimeToUsec(const Ns_Time *timePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
 static Ns_ThreadProc TaskThread;
 
 #define Call(tp, w) ((*((tp)->proc))((Ns_Task *)(tp), (tp)->sock, (tp)->arg, (w)))
@@ -155,6 +179,7 @@ DStringAppendTaskFlags(Tcl_DString *dsPtr, unsigned int flags)
         { TASK_EXPIRE,   "EXPIRE"},
         { TASK_TIMEDOUT, "TIMEDOUT"},
         { TASK_EXPIRED,  "EXPIRED"},
+        { TASK_DEADLINE, "DEADLINE"},
     };
 
     for (i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
@@ -169,6 +194,7 @@ DStringAppendTaskFlags(Tcl_DString *dsPtr, unsigned int flags)
     return dsPtr->string;
 }
 
+
 /*----------------------------------------------------------------------
  *
  * LogDebug --
@@ -464,6 +490,7 @@ Ns_TaskEnqueue(Ns_Task *task, Ns_TaskQueue *queue)
     queuePtr = (TaskQueue *)queue;
 
     taskPtr->queuePtr = queuePtr;
+    Ns_GetTime(&taskPtr->queued);
 
     Ns_Log(Ns_LogTaskDebug, "Ns_TaskEnqueue: task %p, queue:%p",
            (void*)taskPtr, (void*)queuePtr);
@@ -542,6 +569,11 @@ Ns_TaskRun(Ns_Task *task)
         } else {
             Ns_Time now;
             Ns_GetTime(&now);
+            /*
+             * Without a timer wheel, the deadlines are checked on every
+             * run.
+             */
+            taskPtr->flags |= TASK_DEADLINE;
             RunTask(taskPtr, pfd.revents, &now);
         }
     }
@@ -980,6 +1012,61 @@ Ns_TaskQueueRequests(Ns_TaskQueue *queue)
     return result;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_TaskQueueGetStats --
+ *
+ *      Fill in the statistics of a task queue. The reported load is the
+ *      fraction (in permille) of time the queue thread spent outside of
+ *      poll (i.e. running task callbacks) during the most recent load
+ *      window. When the window is already over (thread is idle in poll or
+ *      stuck in a long callback), the load is computed up to the current
+ *      time.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the passed in stats structure.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+Ns_TaskQueueGetStats(Ns_TaskQueue *queue, Ns_TaskQueueStats *statsPtr)
+{
+    TaskQueue *queuePtr = (TaskQueue *)queue;
+    Ns_Time    now, elapsed, busy;
+    int64_t    elapsedUsec;
+
+    NS_NONNULL_ASSERT(queuePtr != NULL);
+    NS_NONNULL_ASSERT(statsPtr != NULL);
+
+    Ns_GetTime(&now);
+
+    Ns_MutexLock(&queuePtr->lock);
+    statsPtr->requests     = queuePtr->count;
+    statsPtr->running      = queuePtr->numTasks;
+    statsPtr->load         = queuePtr->load;
+    statsPtr->latencyCount = queuePtr->latencyCount;
+    statsPtr->latencyTotal = queuePtr->latencyTotal;
+    statsPtr->latencyMax   = queuePtr->latencyMax;
+    statsPtr->busyTotal    = queuePtr->busyTotal;
+
+    (void) Ns_DiffTime(&now, &queuePtr->windowStart, &elapsed);
+    elapsedUsec = TimeToUsec(&elapsed);
+    if (elapsedUsec >= TASK_LOAD_WINDOW) {
+        int64_t busyUsec = TimeToUsec(&queuePtr->windowBusy);
+
+        if (queuePtr->busySince.sec != 0
+            && Ns_DiffTime(&now, &queuePtr->busySince, &busy) > 0) {
+            busyUsec += TimeToUsec(&busy);
+        }
+        statsPtr->load = (int)MIN(1000, (busyUsec / (elapsedUsec / 1000)));
+    }
+    Ns_MutexUnlock(&queuePtr->lock);
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -1092,6 +1179,7 @@ static void
 RunTask(Task *taskPtr, short revents, const Ns_Time *nowPtr)
 {
     Tcl_DString dsFlags;
+    bool        deadline;
 
     NS_NONNULL_ASSERT(taskPtr != NULL);
 
@@ -1103,7 +1191,15 @@ RunTask(Task *taskPtr, short revents, const Ns_Time *nowPtr)
         Tcl_DStringFree(&dsFlags);
     }
 
-    if ((taskPtr->flags & TASK_EXPIRE) != 0u
+    /*
+     * The deadlines have to be checked only, when the timer wheel has
+     * reported that the earliest deadline of the task was reached.
+     */
+    deadline = ((taskPtr->flags & TASK_DEADLINE) != 0u);
+    taskPtr->flags &= ~TASK_DEADLINE;
+
+    if (deadline
+        && (taskPtr->flags & TASK_EXPIRE) != 0u
         && Ns_DiffTime(&taskPtr->expire, nowPtr, NULL) <= 0) {
         taskPtr->flags |= TASK_EXPIRED;
 
@@ -1126,7 +1222,8 @@ RunTask(Task *taskPtr, short revents, const Ns_Time *nowPtr)
                 Call(taskPtr, map[idx].when);
             }
         }
-    } else if ((taskPtr->flags & TASK_TIMEOUT) != 0u
+    } else if (deadline
+               && (taskPtr->flags & TASK_TIMEOUT) != 0u
                && Ns_DiffTime(&taskPtr->timeout, nowPtr, NULL) <= 0) {
 
         taskPtr->flags |= TASK_TIMEDOUT;
@@ -1138,6 +1235,33 @@ RunTask(Task *taskPtr, short revents, const Ns_Time *nowPtr)
     return;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TaskExpired --
+ *
+ *      Timer wheel callback for tasks reaching their earliest deadline
+ *      (timeout or expire time). The task is marked such that
+ *      RunTask() checks its deadlines.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets TASK_DEADLINE in the flags of the task.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TaskExpired(void *clientData, void *UNUSED(arg))
+{
+    Task *taskPtr = (Task *)clientData;
+
+    taskPtr->flags |= TASK_DEADLINE;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -1354,6 +1478,74 @@ ReserveTask(Task *taskPtr)
 
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TimeToUsec --
+ *
+ *      Convert an Ns_Time to microseconds.
+ *
+ * Results:
+ *      Microseconds.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int64_t
+TimeToUsec(const Ns_Time *timePtr)
+{
+    return (int64_t)timePtr->sec * INT64_C(1000000) + (int64_t)timePtr->usec;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AccountBusyTime --
+ *
+ *      Add the time between startPtr and nowPtr to the busy time of the
+ *      queue and recompute the load, when the current load window is
+ *      over. The caller must hold the queue lock.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the load statistics of the queue.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AccountBusyTime(TaskQueue *queuePtr, const Ns_Time *startPtr, const Ns_Time *nowPtr)
+{
+    Ns_Time diff, elapsed;
+    int64_t elapsedUsec;
+
+    NS_NONNULL_ASSERT(queuePtr != NULL);
+    NS_NONNULL_ASSERT(startPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    if (Ns_DiffTime(nowPtr, startPtr, &diff) > 0) {
+        Ns_IncrTime(&queuePtr->busyTotal, diff.sec, diff.usec);
+        Ns_IncrTime(&queuePtr->windowBusy, diff.sec, diff.usec);
+    }
+
+    (void) Ns_DiffTime(nowPtr, &queuePtr->windowStart, &elapsed);
+    elapsedUsec = TimeToUsec(&elapsed);
+    if (elapsedUsec >= TASK_LOAD_WINDOW) {
+        queuePtr->load = (int)MIN(1000, TimeToUsec(&queuePtr->windowBusy)
+                                  / (elapsedUsec / 1000));
+        queuePtr->windowStart = *nowPtr;
+        queuePtr->windowBusy.sec = 0;
+        queuePtr->windowBusy.usec = 0;
+    }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1376,16 +1568,26 @@ TaskThread(void *arg)
     Task          *taskPtr, *nextPtr, *firstWaitPtr = NULL;
     struct pollfd *pFds;
     size_t         maxFds = 100u; /* Initial count of pollfd's */
+    Ns_Time        busyStart, deadline;
+    NsTimerWheel   timers;        /* Timeouts of the waiting tasks */
 
     Ns_ThreadSetName("-task:%s", queuePtr->name);
     Ns_Log(Notice, "starting");
 
     pFds = (struct pollfd *)ns_calloc(maxFds, sizeof(struct pollfd));
 
+    Ns_GetTime(&busyStart);
+    NsTimerWheelInit(&timers, &busyStart);
+    Ns_MutexLock(&queuePtr->lock);
+    queuePtr->windowStart = busyStart;
+    queuePtr->busySince = busyStart;
+    Ns_MutexUnlock(&queuePtr->lock);
+
     for (;;) {
         NS_POLL_NFDS_TYPE nFds;
         bool              queueShutdown = NS_FALSE, broadcast = NS_FALSE;
-        Ns_Time           now;
+        Ns_Time           now, latencyTotal = {0, 0}, latencyMax = {0, 0};
+        intptr_t          latencyCount = 0;
         const Ns_Time    *timeoutPtr;
 
         Ns_MutexLock(&queuePtr->lock);
@@ -1460,7 +1662,6 @@ TaskThread(void *arg)
 
         nFds = 1; /* Count of the pollable sockets (+ the trigger pipe) */
         broadcast = 0; /* Signal any waiting threads about completed tasks */
-        timeoutPtr = NULL; /* Minimum time for NsPoll() */
 
         /*
          * Invoke pre-poll callbacks (TASK_INIT, TASK_CANCEL, TASK_DONE),
@@ -1485,8 +1686,23 @@ TaskThread(void *arg)
             Ns_Log(Ns_LogTaskDebug, "... next:%p", (void*)nextPtr);
 
             if ((taskPtr->flags & TASK_INIT) != 0u) {
+                Ns_Time latency;
+
                 LogDebug("TASK_INIT", taskPtr, "");
 
+                /*
+                 * Record the latency between enqueuing the task and
+                 * running its first callback.
+                 */
+                Ns_GetTime(&now);
+                if (Ns_DiffTime(&now, &taskPtr->queued, &latency) >= 0) {
+                    Ns_IncrTime(&latencyTotal, latency.sec, latency.usec);
+                    if (Ns_DiffTime(&latency, &latencyMax, NULL) > 0) {
+                        latencyMax = latency;
+                    }
+                    latencyCount++;
+                }
+
                 taskPtr->flags &= ~(TASK_INIT);
                 Call(taskPtr, NS_SOCK_INIT);
 
@@ -1546,21 +1762,25 @@ TaskThread(void *arg)
                 nFds++;
 
                 /*
-                 * Figure out minimum timeout to wait for socket events
+                 * Maintain the earliest deadline of the task in the timer
+                 * wheel, which provides the minimum timeout to wait for
+                 * socket events. Setting an unchanged deadline is cheap.
                  */
-                if ((taskPtr->flags & TASK_TIMEOUT) != 0u) {
-                    if (timeoutPtr == NULL
-                        || Ns_DiffTime(&taskPtr->timeout, timeoutPtr, NULL) < 0) {
+                {
+                    const Ns_Time *taskDeadlinePtr = NULL;
 
-                        timeoutPtr = &taskPtr->timeout;
+                    if ((taskPtr->flags & TASK_TIMEOUT) != 0u) {
+                        taskDeadlinePtr = &taskPtr->timeout;
                     }
-                }
-
-                if ((taskPtr->flags & TASK_EXPIRE) != 0u) {
-                    if (timeoutPtr == NULL
-                        || Ns_DiffTime(&taskPtr->expire, timeoutPtr, NULL) < 0) {
-
-                        timeoutPtr = &taskPtr->expire;
+                    if ((taskPtr->flags & TASK_EXPIRE) != 0u
+                        && (taskDeadlinePtr == NULL
+                            || Ns_DiffTime(&taskPtr->expire, taskDeadlinePtr, NULL) < 0)) {
+                        taskDeadlinePtr = &taskPtr->expire;
+                    }
+                    if (taskDeadlinePtr != NULL) {
+                        NsTimerWheelSet(&timers, &taskPtr->timer, taskDeadlinePtr, taskPtr);
+                    } else {
+                        NsTimerWheelCancel(&taskPtr->timer);
                     }
                 }
 
@@ -1571,6 +1791,11 @@ TaskThread(void *arg)
                 firstWaitPtr = taskPtr;
                 ReserveTask(taskPtr); /* Acquired for the waiting list */
                 LogDebug("TASK_WAIT", taskPtr, "");
+            } else {
+                /*
+                 * The task leaves the waiting list.
+                 */
+                NsTimerWheelCancel(&taskPtr->timer);
             }
 
             /*
@@ -1611,6 +1836,29 @@ TaskThread(void *arg)
             break;
         }
 
+        /*
+         * Minimum time for NsPoll() is the next deadline of the timer
+         * wheel.
+         */
+        timeoutPtr = NsTimerWheelNext(&timers, &deadline) ? &deadline : NULL;
+
+        /*
+         * Update the queue statistics before going to sleep in poll.
+         */
+        Ns_GetTime(&now);
+        Ns_MutexLock(&queuePtr->lock);
+        AccountBusyTime(queuePtr, &busyStart, &now);
+        queuePtr->busySince.sec = 0;
+        queuePtr->busySince.usec = 0;
+        if (latencyCount > 0) {
+            queuePtr->latencyCount += latencyCount;
+            Ns_IncrTime(&queuePtr->latencyTotal, latencyTotal.sec, latencyTotal.usec);
+            if (Ns_DiffTime(&latencyMax, &queuePtr->latencyMax, NULL) > 0) {
+                queuePtr->latencyMax = latencyMax;
+            }
+        }
+        Ns_MutexUnlock(&queuePtr->lock);
+
         /*
          * Poll on task sockets. This where we spend most of the time.
          * Result is just logged but otherwise ignored.
@@ -1646,6 +1894,12 @@ TaskThread(void *arg)
          * Execute socket events for waiting tasks.
          */
         Ns_GetTime(&now);
+        busyStart = now;
+        Ns_MutexLock(&queuePtr->lock);
+        queuePtr->busySince = now;
+        Ns_MutexUnlock(&queuePtr->lock);
+        (void) NsTimerWheelExpire(&timers, &now, TaskExpired, NULL);
+
         taskPtr = firstWaitPtr;
         while (taskPtr != NULL) {
             nextPtr = taskPtr->nextWaitPtr;
@@ -1662,6 +1916,7 @@ TaskThread(void *arg)
     taskPtr = firstWaitPtr;
     while (taskPtr != NULL) {
         nextPtr = taskPtr->nextWaitPtr;
+        NsTimerWheelCancel(&taskPtr->timer);
         Call(taskPtr, NS_SOCK_EXIT);
         taskPtr = nextPtr;
     }
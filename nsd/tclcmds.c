@@ -33,6 +33,7 @@ typedef struct Cmd {
  */
 
 static const Cmd basicCmds[] = {
+    {"_ns_timerwheel_test",      NsTclTimerWheelTestObjCmd},
 #ifdef NS_WITH_DEPRECATED
     {"keyldel",                  TclX_KeyldelObjCmd},
     {"keylget",                  TclX_KeylgetObjCmd},
@@ -19,6 +19,7 @@
 #include "nsd.h"
 
 #ifdef HAVE_OPENSSL_EVP_H
+#include "nsopenssl.h"
 #include <openssl/err.h>
 #endif
 
@@ -57,6 +58,7 @@ typedef struct {
     NS_SOCKET          sock;             /* socket to the remote peer */
     CloseWaitingState  state;
     unsigned short     port;
+    int                minIdle;          /* idle connections kept beyond expiry */
 } CloseWaitingData;
 
 
@@ -64,6 +66,53 @@ static Ns_Mutex closeWaitingMutex = NULL;  // TODO: maybe an rwlock
 static Ns_DList closeWaitingList;
 static Ns_SchedProc CloseWaitingCheckExpire;
 
+/*
+ * Client TLS contexts shared between requests with the same TLS
+ * parameters. Creating a fresh SSL_CTX per request requires loading the CA
+ * bundles each time, which dominates the setup cost of short requests to the
+ * same backends. The table keeps one reference to every context, every
+ * request using the context holds an additional one.
+ */
+static Ns_Mutex      clientCtxMutex = NULL;
+static Tcl_HashTable clientCtxTable;
+
+/*
+ * TLS session resumption requires reference counting of sessions and
+ * contexts (OpenSSL 1.1.0 or newer).
+ */
+#if defined(HAVE_OPENSSL_EVP_H) && !defined(HAVE_OPENSSL_PRE_1_1)
+# define HTTP_TLS_SESSION_REUSE 1
+#endif
+
+/*
+ * Per-origin statistics of the HTTP client, keyed by "host:port" of the
+ * peer. The entries keep as well the most recent TLS session of the origin
+ * for resumption. Entries are removed by the janitor, when the origin has
+ * no idle connections and no resumable TLS session.
+ */
+#define HTTP_LATENCY_BUCKETS 11
+
+static const long latencyBucketBounds[HTTP_LATENCY_BUCKETS - 1] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000
+};
+static const char *const latencyBucketNames[HTTP_LATENCY_BUCKETS] = {
+    "1ms", "2ms", "5ms", "10ms", "20ms", "50ms", "100ms", "200ms", "500ms", "1s", "inf"
+};
+
+typedef struct {
+    NS_TLS_SSL_CTX     *sessionCtx;      /* TLS context of the stored session */
+    NS_TLS_SSL_SESSION *session;         /* TLS session for resumption */
+    char               *sessionSni;      /* SNI hostname of the stored session */
+    Tcl_WideInt         connects;        /* fresh connections */
+    Tcl_WideInt         reuses;          /* requests on persistent connections */
+    Tcl_WideInt         handshakes;      /* full TLS handshakes */
+    Tcl_WideInt         resumed;         /* resumed TLS handshakes */
+    Tcl_WideInt         latency[HTTP_LATENCY_BUCKETS]; /* connect latency histogram */
+} HttpOrigin;
+
+static Ns_Mutex      originMutex = NULL;
+static Tcl_HashTable originTable;
+
 /*
  * String equivalents of some methods, header keys
  */
@@ -112,6 +161,15 @@ static Ns_TaskQueue* HttpGetTaskQueue(
 
 static bool InitOnceHttp(void);
 
+static int HttpClientCtxGet(
+    NsInterp *itPtr,
+    const char *cert,
+    const char *caFile,
+    const char *caPath,
+    bool verify,
+    NS_TLS_SSL_CTX **ctxPtr
+) NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(6);
+
 static void CloseWaitingDataClean(CloseWaitingData *cwDataPtr)
     NS_GNUC_NONNULL(1);
 
@@ -295,6 +353,29 @@ static bool PersistentConnectionAdd(NsHttpTask *httpPtr, const char **reasonPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 static void HttpCloseWaitingDataRelease(NsHttpTask *httpPtr)
     NS_GNUC_NONNULL(1);
+static size_t CloseWaitingIdleCount(const char *host, unsigned short port)
+    NS_GNUC_NONNULL(1);
+
+static HttpOrigin *HttpOriginGet(const char *host, unsigned short port)
+    NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
+static void HttpOriginRecordConnect(const NsHttpTask *httpPtr, const Ns_Time *startTimePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void HttpOriginSessionSave(const NsHttpTask *httpPtr)
+    NS_GNUC_NONNULL(1);
+static size_t HttpOriginIdleCount(const char *key)
+    NS_GNUC_NONNULL(1);
+static void HttpOriginsPrune(void);
+static NS_TLS_SSL_SESSION *HttpOriginSessionGet(const char *host, unsigned short port,
+                                                const NS_TLS_SSL_CTX *ctx, const char *sniHostname)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
+
+static int HttpPreconnect(NsInterp *itPtr, const char *url, int count,
+                          const Ns_Time *keepAliveTimeoutPtr, const Ns_Time *timeoutPtr,
+                          int *connectedPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(6);
+static void HttpPreconnectSessionSave(const NsHttpTask *httpPtr, const Ns_Time *startTimePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static Ns_Callback HttpClientPreconnect;
 
 static void LogDebug(const char *before, NsHttpTask *httpPtr, const char *after)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
@@ -355,6 +436,8 @@ static TCL_OBJCMDPROC_T HttpListObjCmd;
 #ifdef MEM_RECORD_DEBUG
 static TCL_OBJCMDPROC_T HttpMeminfoObjCmd;
 #endif
+static TCL_OBJCMDPROC_T HttpOriginsObjCmd;
+static TCL_OBJCMDPROC_T HttpPreconnectObjCmd;
 static TCL_OBJCMDPROC_T HttpQueueObjCmd;
 static TCL_OBJCMDPROC_T HttpRunObjCmd;
 static TCL_OBJCMDPROC_T HttpStatsObjCmd;
@@ -808,6 +891,28 @@ NsInitHttp(NsServer *servPtr)
            servPtr->httpclient.caFile);
 
     servPtr->httpclient.validateCertificates = Ns_ConfigBool(section, "validatecertificates", NS_TRUE);
+    servPtr->httpclient.tlsContextCache = Ns_ConfigBool(section, "tlscontextcache", NS_TRUE);
+    servPtr->httpclient.keepaliveMaxIdle = Ns_ConfigIntRange(section, "keepalivemaxidle", 0, 0, INT_MAX);
+    servPtr->httpclient.keepaliveMinIdle = Ns_ConfigIntRange(section, "keepaliveminidle", 0, 0, INT_MAX);
+
+    Ns_DListInit(&servPtr->httpclient.preconnects);
+    {
+        Ns_Set *set = Ns_ConfigGetSection2(section, NS_FALSE);
+
+        if (set != NULL) {
+            /*
+             * Examples of preconnect specifications (URL and optional number
+             * of connections):
+             *    ns_param preconnect https://search.example.com/
+             *    ns_param preconnect {https://payment.example.com:8443/ 4}
+             */
+            (void) NsSetGetCmpDListAppend(set, "preconnect", NS_TRUE, strcasecmp,
+                                          &servPtr->httpclient.preconnects, NS_FALSE);
+        }
+        if (servPtr->httpclient.preconnects.size > 0) {
+            Ns_RegisterAtReady(HttpClientPreconnect, servPtr);
+        }
+    }
     Ns_DListInit(&servPtr->httpclient.validationExceptions);
 
     if (!servPtr->httpclient.validateCertificates) {
@@ -1772,6 +1877,8 @@ NsTclHttpObjCmd(
 #ifdef MEM_RECORD_DEBUG
         {"meminfo",     HttpMeminfoObjCmd},
 #endif
+        {"origins",     HttpOriginsObjCmd},
+        {"preconnect",  HttpPreconnectObjCmd},
         {"queue",       HttpQueueObjCmd},
         {"run",         HttpRunObjCmd},
         {"stats",       HttpStatsObjCmd},
@@ -2551,19 +2658,41 @@ HttpTaskthreadsObjCmd(
         Tcl_Obj *resultObj = Tcl_NewListObj((TCL_SIZE_T)nsconf.tclhttptasks.numqueues, NULL);
 
         for (idx = 0; idx < (size_t)nsconf.tclhttptasks.numqueues; idx++) {
-            Ns_TaskQueue *queue   = nsconf.tclhttptasks.queues[idx];
-            Tcl_Obj      *dictObj = Tcl_NewDictObj();
-            const char   *qName   = Ns_TaskQueueName(queue);
+            Ns_TaskQueue     *queue   = nsconf.tclhttptasks.queues[idx];
+            Tcl_Obj          *dictObj = Tcl_NewDictObj();
+            const char       *qName   = Ns_TaskQueueName(queue);
+            Ns_TaskQueueStats stats;
+            Ns_Time           avgLatency = {0, 0};
+
+            Ns_TaskQueueGetStats(queue, &stats);
+            if (stats.latencyCount > 0) {
+                Tcl_WideInt usec = ((Tcl_WideInt)stats.latencyTotal.sec * 1000000
+                                    + stats.latencyTotal.usec) / stats.latencyCount;
+                avgLatency.sec = (time_t)(usec / 1000000);
+                avgLatency.usec = (long)(usec % 1000000);
+            }
 
             (void) Tcl_DictObjPut(NULL, dictObj,
                                   Tcl_NewStringObj("name", 4),
                                   Tcl_NewStringObj(qName, TCL_INDEX_NONE));
             (void) Tcl_DictObjPut(NULL, dictObj,
                                   Tcl_NewStringObj("running", 7),
-                                  Tcl_NewIntObj(Ns_TaskQueueLength(queue)));
+                                  Tcl_NewIntObj(stats.running));
             (void) Tcl_DictObjPut(NULL, dictObj,
                                   Tcl_NewStringObj("requests", 8),
-                                  Tcl_NewWideIntObj(Ns_TaskQueueRequests(queue)));
+                                  Tcl_NewWideIntObj(stats.requests));
+            (void) Tcl_DictObjPut(NULL, dictObj,
+                                  Tcl_NewStringObj("load", 4),
+                                  Tcl_NewDoubleObj((double)stats.load / 1000.0));
+            (void) Tcl_DictObjPut(NULL, dictObj,
+                                  Tcl_NewStringObj("busytime", 8),
+                                  Ns_TclNewTimeObj(&stats.busyTotal));
+            (void) Tcl_DictObjPut(NULL, dictObj,
+                                  Tcl_NewStringObj("latency", 7),
+                                  Ns_TclNewTimeObj(&avgLatency));
+            (void) Tcl_DictObjPut(NULL, dictObj,
+                                  Tcl_NewStringObj("maxlatency", 10),
+                                  Ns_TclNewTimeObj(&stats.latencyMax));
 
             Tcl_ListObjAppendElement(interp, resultObj, dictObj);
         }
@@ -2663,6 +2792,151 @@ HttpKeepalivesObjCmd(
     return result;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpOriginsObjCmd --
+ *
+ *      This command implements "ns_http origins". It returns per-origin
+ *      statistics of the HTTP client as a list of dictionaries. Every
+ *      dictionary contains the origin (peer host and port), the number of
+ *      currently idle persistent connections, the number of fresh
+ *      connections and of requests on reused persistent connections, the
+ *      reuse ratio, the number of full and resumed TLS handshakes, and a
+ *      histogram of the connect latencies (including TLS handshakes).
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+HttpOriginsObjCmd(
+    ClientData         UNUSED(clientData),
+    Tcl_Interp        *interp,
+    TCL_SIZE_T         objc,
+    Tcl_Obj    *const* objv
+) {
+    int result = TCL_OK;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_Obj             *resultObj = Tcl_NewListObj(0, NULL);
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashSearch       search;
+
+        Ns_MutexLock(&originMutex);
+        for (hPtr = Tcl_FirstHashEntry(&originTable, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            const HttpOrigin *originPtr = Tcl_GetHashValue(hPtr);
+            const char       *key = Tcl_GetHashKey(&originTable, hPtr);
+            Tcl_Obj          *dictObj = Tcl_NewDictObj(), *latencyObj = Tcl_NewDictObj();
+            size_t            idle = HttpOriginIdleCount(key), i;
+            Tcl_WideInt       total = originPtr->connects + originPtr->reuses;
+
+            for (i = 0u; i < HTTP_LATENCY_BUCKETS; i++) {
+                (void) Tcl_DictObjPut(NULL, latencyObj,
+                                      Tcl_NewStringObj(latencyBucketNames[i], TCL_INDEX_NONE),
+                                      Tcl_NewWideIntObj(originPtr->latency[i]));
+            }
+
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("origin", 6),
+                                  Tcl_NewStringObj(key, TCL_INDEX_NONE));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("idle", 4),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)idle));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("connects", 8),
+                                  Tcl_NewWideIntObj(originPtr->connects));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("reuses", 6),
+                                  Tcl_NewWideIntObj(originPtr->reuses));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("reuseratio", 10),
+                                  Tcl_NewDoubleObj(total > 0
+                                                   ? (double)originPtr->reuses / (double)total
+                                                   : 0.0));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("handshakes", 10),
+                                  Tcl_NewWideIntObj(originPtr->handshakes));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("resumed", 7),
+                                  Tcl_NewWideIntObj(originPtr->resumed));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("connectlatency", 14),
+                                  latencyObj);
+
+            Tcl_ListObjAppendElement(interp, resultObj, dictObj);
+        }
+        Ns_MutexUnlock(&originMutex);
+
+        Tcl_SetObjResult(interp, resultObj);
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpPreconnectObjCmd --
+ *
+ *      This command implements "ns_http preconnect". It establishes
+ *      persistent connections to the origin of the provided URL, such that
+ *      subsequent requests to this origin can use warm connections without
+ *      paying the connection setup and TLS handshake costs.
+ *
+ * Results:
+ *      A standard Tcl result. On success, the number of newly established
+ *      connections is returned.
+ *
+ * Side Effects:
+ *      Opening connections to the remote server.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+HttpPreconnectObjCmd(
+    ClientData         clientData,
+    Tcl_Interp        *interp,
+    TCL_SIZE_T         objc,
+    Tcl_Obj    *const* objv
+) {
+    NsInterp         *itPtr = clientData;
+    int               result = TCL_OK, count = 1;
+    char             *url = NULL;
+    Ns_Time          *keepAliveTimeoutPtr = NULL, *timeoutPtr = NULL;
+    Ns_ObjvValueRange countRange = {1, INT_MAX};
+    Ns_ObjvSpec opts[] = {
+        {"-count",     Ns_ObjvInt,  &count,               &countRange},
+        {"-keepalive", Ns_ObjvTime, &keepAliveTimeoutPtr, NULL},
+        {"-timeout",   Ns_ObjvTime, &timeoutPtr,          NULL},
+        {"--",         Ns_ObjvBreak, NULL,                NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"url", Ns_ObjvString, &url, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        int connected = 0;
+
+        if (keepAliveTimeoutPtr == NULL) {
+            keepAliveTimeoutPtr = &itPtr->servPtr->httpclient.keepaliveTimeout;
+        }
+        if (timeoutPtr == NULL) {
+            timeoutPtr = &itPtr->servPtr->httpclient.defaultTimeout;
+        }
+        result = HttpPreconnect(itPtr, url, count, keepAliveTimeoutPtr, timeoutPtr, &connected);
+        if (result == TCL_OK) {
+            Tcl_SetObjResult(interp, Tcl_NewIntObj(connected));
+        }
+    }
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2718,6 +2992,14 @@ static bool InitOnceHttp(void) {
     Ns_MutexInit(&closeWaitingMutex);
     Ns_MutexSetName2(&closeWaitingMutex, "ns:closewaiting", NULL);
 
+    Tcl_InitHashTable(&clientCtxTable, TCL_STRING_KEYS);
+    Ns_MutexInit(&clientCtxMutex);
+    Ns_MutexSetName2(&clientCtxMutex, "ns:httpclientctx", NULL);
+
+    Tcl_InitHashTable(&originTable, TCL_STRING_KEYS);
+    Ns_MutexInit(&originMutex);
+    Ns_MutexSetName2(&originMutex, "ns:httpclientorigins", NULL);
+
 #ifdef MEM_RECORD_DEBUG
     Ns_MutexInit(&ckMutex);
     Tcl_InitHashTable(&ckPointerTable, TCL_ONE_WORD_KEYS);
@@ -2794,6 +3076,24 @@ CloseWaitingCheckExpire(void *UNUSED(arg), int UNUSED(id)) {
                 }
 
             } else {
+                if (currentCwDataPtr->minIdle > 0
+                    && CloseWaitingIdleCount(currentCwDataPtr->host, currentCwDataPtr->port)
+                       <= (size_t)currentCwDataPtr->minIdle) {
+                    char    buffer[1];
+                    ssize_t nread;
+
+                    /*
+                     * Keep the minimum number of idle connections per origin
+                     * open beyond the keep-alive timeout, as long as there
+                     * is nothing to read. EOF, socket errors and pending
+                     * data (e.g., a TLS close_notify alert) make the
+                     * connection unusable.
+                     */
+                    nread = ns_recv(currentCwDataPtr->sock, buffer, 1, MSG_PEEK|MSG_DONTWAIT);
+                    if (nread == -1 && NS_ERRNO_WOULDBLOCK(ns_sockerrno)) {
+                        continue;
+                    }
+                }
                 Ns_Log(Ns_LogTaskDebug, "CloseWaitingCheckExpire closes sock %d host %s:%hu in state %s",
                        currentCwDataPtr->sock, currentCwDataPtr->host, currentCwDataPtr->port,
                        CloseWaitingDataPrettyState(currentCwDataPtr));
@@ -2802,6 +3102,8 @@ CloseWaitingCheckExpire(void *UNUSED(arg), int UNUSED(id)) {
         }
     }
     Ns_MutexUnlock(&closeWaitingMutex);
+
+    HttpOriginsPrune();
     Ns_Log(Ns_LogTaskDebug, "CloseWaitingCheckExpire done");
 
 }
@@ -4312,7 +4614,8 @@ EstablishTCPConnection(
     /*
      * First, try to look up a persistent (cached) connection
      */
-    reuseConnection = PersistentConnectionLookup(rhost, rport, &cwData);
+    reuseConnection = ((httpPtr->flags & NS_HTTP_FRESH_CONNECTION) == 0u
+                       && PersistentConnectionLookup(rhost, rport, &cwData));
     Ns_Log(Ns_LogTaskDebug, "======= reuseConnection %d host %s rport %d path %s tail %s",
            reuseConnection, rhost, rport, urlPtr->path, urlPtr->tail);
     if (reuseConnection) {
@@ -4355,6 +4658,140 @@ EstablishTCPConnection(
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpClientCtxGet --
+ *
+ *        Return a client TLS context for the provided TLS parameters. When
+ *        the TLS context cache is enabled for the server, contexts are
+ *        shared between all requests using the same certificate, CA file, CA
+ *        path and verification mode. The returned context is
+ *        reference-counted, so the caller can release it via SSL_CTX_free()
+ *        as with a freshly created one. The cache is flushed on certificate
+ *        reloads via NsHttpClientCtxFlush().
+ *
+ * Results:
+ *        A standard Tcl result.
+ *
+ * Side effects:
+ *        Potentially creating a new TLS context and adding it to the cache.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+HttpClientCtxGet(
+    NsInterp *itPtr,
+    const char *cert,
+    const char *caFile,
+    const char *caPath,
+    bool verify,
+    NS_TLS_SSL_CTX **ctxPtr
+) {
+    int result;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(ctxPtr != NULL);
+
+#if defined(HAVE_OPENSSL_EVP_H) && !defined(HAVE_OPENSSL_PRE_1_1)
+    if (itPtr->servPtr != NULL && itPtr->servPtr->httpclient.tlsContextCache) {
+        Tcl_DString    ds;
+        Tcl_HashEntry *hPtr;
+        NS_TLS_SSL_CTX *ctx = NULL;
+        int            isNew;
+
+        /*
+         * The server is part of the key, since the context refers to the
+         * server-specific certificate validation settings.
+         */
+        Tcl_DStringInit(&ds);
+        Ns_DStringPrintf(&ds, "%p %d %s %s %s", (void*)itPtr->servPtr, verify,
+                         cert != NULL ? cert : "",
+                         caFile != NULL ? caFile : "",
+                         caPath != NULL ? caPath : "");
+
+        Ns_MutexLock(&clientCtxMutex);
+        hPtr = Tcl_FindHashEntry(&clientCtxTable, ds.string);
+        if (hPtr != NULL) {
+            ctx = Tcl_GetHashValue(hPtr);
+            SSL_CTX_up_ref(ctx);
+        }
+        Ns_MutexUnlock(&clientCtxMutex);
+
+        if (ctx != NULL) {
+            Ns_Log(Ns_LogTaskDebug, "HttpClientCtxGet: reuse TLS context %p", (void*)ctx);
+            *ctxPtr = ctx;
+            result = TCL_OK;
+
+        } else {
+            /*
+             * Create the context outside the lock, since loading the CA
+             * bundle might take a while. When another thread was faster,
+             * use the freshly created context just for this request.
+             */
+            result = Ns_TLS_CtxClientCreate(itPtr->interp, cert, caFile, caPath, verify, ctxPtr);
+            if (result == TCL_OK) {
+                Ns_MutexLock(&clientCtxMutex);
+                hPtr = Tcl_CreateHashEntry(&clientCtxTable, ds.string, &isNew);
+                if (isNew != 0) {
+                    SSL_CTX_up_ref(*ctxPtr);
+                    Tcl_SetHashValue(hPtr, *ctxPtr);
+                }
+                Ns_MutexUnlock(&clientCtxMutex);
+            }
+        }
+        Tcl_DStringFree(&ds);
+    } else
+#endif
+    {
+        result = Ns_TLS_CtxClientCreate(itPtr->interp, cert, caFile, caPath, verify, ctxPtr);
+    }
+
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsHttpClientCtxFlush --
+ *
+ *        Remove all cached client TLS contexts, such that subsequent
+ *        requests load certificates, CA file and CA path again from the
+ *        disk. The function is called when the certificates are reloaded
+ *        (SIGHUP or "ns_certctl reload"). Contexts still used by running
+ *        requests are freed when these requests release them.
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Frees the cache references of the TLS contexts.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+NsHttpClientCtxFlush(void)
+{
+#if defined(HAVE_OPENSSL_EVP_H) && !defined(HAVE_OPENSSL_PRE_1_1)
+    if (clientCtxMutex != NULL) {
+        Tcl_HashEntry  *hPtr;
+        Tcl_HashSearch  search;
+        size_t          count = 0u;
+
+        Ns_MutexLock(&clientCtxMutex);
+        hPtr = Tcl_FirstHashEntry(&clientCtxTable, &search);
+        while (hPtr != NULL) {
+            SSL_CTX_free(Tcl_GetHashValue(hPtr));
+            Tcl_DeleteHashEntry(hPtr);
+            count++;
+            hPtr = Tcl_NextHashEntry(&search);
+        }
+        Ns_MutexUnlock(&clientCtxMutex);
+        Ns_Log(Notice, "ns_http: flushed %" PRIuz " cached client TLS contexts", count);
+    }
+#endif
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -4362,7 +4799,7 @@ EstablishTCPConnection(
  *
  *        Establish a TLS‐secured connection for the given HTTP task.  First
  *        calls EstablishTCPConnection to obtain or reuse a TCP socket
- *        (honoring httpProxy and proxyHost/proxyPortNr if set). Then creates
+ *        (honoring httpProxy and proxyHost/proxyPortNr if set). Then obtains
  *        a client TLS context using cert, caFile, caPath and verifyCert,
  *        selects an SNI hostname (either the provided sniHostname or, when
  *        NULL and the URL host is not numeric, urlPtr->host), and performs
@@ -4423,16 +4860,17 @@ EstablishTLSConnection(
          */
         result = TCL_OK;
     } else {
-        Tcl_Interp     *interp = itPtr->interp;
-        NS_TLS_SSL_CTX *ctx = NULL;
-        NS_TLS_SSL     *ssl = NULL;
-        Ns_ReturnCode   rc;
+        Tcl_Interp         *interp = itPtr->interp;
+        NS_TLS_SSL_CTX     *ctx = NULL;
+        NS_TLS_SSL         *ssl = NULL;
+        NS_TLS_SSL_SESSION *session;
+        Ns_ReturnCode       rc;
 
         /*
-         * Perform the TLS handshake.  Create a TLS context for this client
-         * connection.
+         * Perform the TLS handshake.  Obtain a TLS context for this client
+         * connection, potentially shared with other requests.
          */
-        result = Ns_TLS_CtxClientCreate(interp, cert, caFile, caPath, verifyCert, &ctx);
+        result = HttpClientCtxGet(itPtr, cert, caFile, caPath, verifyCert, &ctx);
         Ns_Log(Ns_LogTaskDebug, "EstablishHttpsConnection: TLS ctx creation result %s",
                Ns_TclReturnCodeString(result));
         if (result == TCL_OK) {
@@ -4448,9 +4886,19 @@ EstablishTLSConnection(
                 Ns_Log(Debug, "Automatically use SNI <%s>", urlPtr->host);
             }
 
-            rc = Ns_TLS_SSLConnect(interp, httpPtr->sock, ctx,
-                                   sniHostname, caFile, caPath,
-                                   toPtr, &ssl);
+            /*
+             * Offer the most recent TLS session of this origin for
+             * resumption, when it was obtained with the same context.
+             */
+            session = HttpOriginSessionGet(httpPtr->host, httpPtr->port, ctx, sniHostname);
+            rc = Ns_TLS_SSLConnect2(interp, httpPtr->sock, ctx,
+                                    sniHostname, caFile, caPath, session,
+                                    toPtr, &ssl);
+#ifdef HTTP_TLS_SESSION_REUSE
+            if (session != NULL) {
+                SSL_SESSION_free(session);
+            }
+#endif
             if (rc == NS_TIMEOUT) {
                 Ns_TclPrintfResult(interp, "timeout waiting for TLS handshake");
                 HttpClientLogWrite(httpPtr, "tlsconnecttimeout");
@@ -4692,6 +5140,9 @@ HttpConnect(
             result = EstablishTCPConnection(itPtr, httpPtr, urlPtr, portNr,
                                             proxyHost, proxyPortNr, httpProxy, toPtr);
         }
+        if (result == TCL_OK) {
+            HttpOriginRecordConnect(httpPtr, &startTime);
+        }
     }
 
     if (result != TCL_OK) {
@@ -5866,6 +6317,10 @@ HttpClose(
     /*Ns_Log(Notice, "HttpClose bodyfileFd %d spoolFd %d",
       httpPtr->bodyFileFd,  httpPtr->spoolFd);*/
 
+    if (httpPtr->ssl != NULL) {
+        HttpOriginSessionSave(httpPtr);
+    }
+
     if (httpPtr->task != NULL) {
         Ns_Log(Ns_LogTaskDebug, "=== close %p, Ns_TaskFree main task %p",
                (void*)httpPtr, (void*)httpPtr->task);
@@ -5880,8 +6335,10 @@ HttpClose(
             const char *reason;
 
             if (!PersistentConnectionAdd(httpPtr, &reason)) {
-                Ns_Log(Warning, "Could not add persistent connection (reason %s, host %s:%hu)",
-                       reason, httpPtr->host, httpPtr->port);
+                if (reason != NULL) {
+                    Ns_Log(Warning, "Could not add persistent connection (reason %s, host %s:%hu)",
+                           reason, httpPtr->host, httpPtr->port);
+                }
                 /*
                  * Clear keep-alive flag.
                  */
@@ -7533,7 +7990,12 @@ TrailerInitProc(
  *
  *        Get (one) task queue for queueing requests.
  *        If many task queues present, the queue with
- *        the smallest number of tasks is returned.
+ *        the lowest load score is returned. The score
+ *        combines the number of tasks on the queue with
+ *        the recent busy time of the queue thread, such
+ *        that a queue stuck with a few expensive
+ *        transfers is avoided as well as a queue with
+ *        many tasks.
  *
  * Results:
  *        Task queue pointer.
@@ -7552,16 +8014,24 @@ HttpGetTaskQueue(void)
     if (nsconf.tclhttptasks.numqueues == 1) {
         queuePtr = nsconf.tclhttptasks.queues[0];
     } else {
-        int idx, ltql = INT_MAX;
+        int         idx;
+        Tcl_WideInt lowestScore = -1;
 
         for (idx = 0; idx < nsconf.tclhttptasks.numqueues; idx++) {
-            int tql = Ns_TaskQueueLength(nsconf.tclhttptasks.queues[idx]);
-            if (tql < ltql) {
+            Ns_TaskQueueStats stats;
+            Tcl_WideInt       score;
+
+            Ns_TaskQueueGetStats(nsconf.tclhttptasks.queues[idx], &stats);
+            /*
+             * A fully busy queue counts as twice as many tasks.
+             */
+            score = (Tcl_WideInt)(stats.running + 1) * (1000 + stats.load);
+            if (lowestScore < 0 || score < lowestScore) {
                 queuePtr = nsconf.tclhttptasks.queues[idx];
-                if (tql == 0) {
+                if (stats.running == 0 && stats.load == 0) {
                     break;
                 }
-                ltql = tql;
+                lowestScore = score;
             }
         }
     }
@@ -7657,6 +8127,10 @@ PersistentConnectionLookup(const char *remoteHost, unsigned short remotePort,
  *
  *        Add the persistent connection data to the lookup table.
  *
+ *        The connection is not added, when the maximum number of idle
+ *        connections per origin ("keepaliveMaxIdle") is reached. In this
+ *        case, the reason is set to NULL, since this is not an error.
+ *
  * Results:
  *        Boolean value indicating that the lookup was successful.
  *
@@ -7697,6 +8171,18 @@ PersistentConnectionAdd(NsHttpTask *httpPtr, const char **reasonPtr)
 
     Ns_MutexLock(&closeWaitingMutex);
 
+    if (httpPtr->servPtr != NULL
+        && httpPtr->servPtr->httpclient.keepaliveMaxIdle > 0
+        && CloseWaitingIdleCount(httpPtr->host, httpPtr->port)
+           >= (size_t)httpPtr->servPtr->httpclient.keepaliveMaxIdle
+       ) {
+        Ns_MutexUnlock(&closeWaitingMutex);
+        Ns_Log(Ns_LogTaskDebug, "PersistentConnectionAdd: maximum idle connections for %s:%hu reached",
+               httpPtr->host, httpPtr->port);
+        *reasonPtr = NULL;
+        return NS_FALSE;
+    }
+
     if (httpPtr->pos != 0) {
         /*
          * The incoming httpPtr has already a slot assignment. Reuse it.
@@ -7756,6 +8242,7 @@ PersistentConnectionAdd(NsHttpTask *httpPtr, const char **reasonPtr)
     }
     cwDataPtr->host = ns_strdup(httpPtr->host);
     cwDataPtr->port = httpPtr->port;
+    cwDataPtr->minIdle = (httpPtr->servPtr != NULL) ? httpPtr->servPtr->httpclient.keepaliveMinIdle : 0;
 
     Ns_MutexUnlock(&closeWaitingMutex);
 
@@ -7835,6 +8322,616 @@ CloseWaitingDataClean(CloseWaitingData *cwDataPtr)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * CloseWaitingIdleCount --
+ *
+ *        Count the idle (waiting) persistent connections to the specified
+ *        peer.
+ *
+ *        This function is supposed to be called under a closeWaitingMutex
+ *        lock.
+ *
+ * Results:
+ *        Number of idle connections.
+ *
+ * Side effects:
+ *        None.
+ *
+ *----------------------------------------------------------------------
+ */
+static size_t
+CloseWaitingIdleCount(const char *host, unsigned short port)
+{
+    size_t i, count = 0u;
+
+    NS_NONNULL_ASSERT(host != NULL);
+
+    for (i = 0; i < closeWaitingList.size; i ++) {
+        const CloseWaitingData *currentCwDataPtr = closeWaitingList.data[i];
+
+        if (currentCwDataPtr->state == CW_WAITING
+            && currentCwDataPtr->port == port
+            && strcmp(host, currentCwDataPtr->host) == 0) {
+            count ++;
+        }
+    }
+    return count;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpOriginGet --
+ *
+ *        Return the statistics entry of the specified origin, create it if
+ *        necessary.
+ *
+ *        This function is supposed to be called under an originMutex lock.
+ *
+ * Results:
+ *        Pointer to the HttpOrigin entry.
+ *
+ * Side effects:
+ *        Potentially adding an entry to the origin table.
+ *
+ *----------------------------------------------------------------------
+ */
+static HttpOrigin *
+HttpOriginGet(const char *host, unsigned short port)
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_DString    ds;
+    int            isNew;
+
+    NS_NONNULL_ASSERT(host != NULL);
+
+    Tcl_DStringInit(&ds);
+    Ns_DStringPrintf(&ds, "%s:%hu", host, port);
+    hPtr = Tcl_CreateHashEntry(&originTable, ds.string, &isNew);
+    if (isNew != 0) {
+        Tcl_SetHashValue(hPtr, ns_calloc(1u, sizeof(HttpOrigin)));
+    }
+    Tcl_DStringFree(&ds);
+
+    return Tcl_GetHashValue(hPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpOriginIdleCount --
+ *
+ *        Return the number of idle persistent connections of the origin
+ *        identified by the "host:port" key of the origin table.
+ *
+ *        This function is supposed to be called under an originMutex lock.
+ *
+ * Results:
+ *        Number of idle connections.
+ *
+ * Side effects:
+ *        None.
+ *
+ *----------------------------------------------------------------------
+ */
+static size_t
+HttpOriginIdleCount(const char *key)
+{
+    const char *colon = strrchr(key, INTCHAR(':'));
+    Tcl_DString ds;
+    size_t      idle;
+
+    NS_NONNULL_ASSERT(key != NULL);
+
+    Tcl_DStringInit(&ds);
+    Tcl_DStringAppend(&ds, key, (TCL_SIZE_T)(colon - key));
+    Ns_MutexLock(&closeWaitingMutex);
+    idle = CloseWaitingIdleCount(ds.string, (unsigned short)strtol(colon + 1, NULL, 10));
+    Ns_MutexUnlock(&closeWaitingMutex);
+    Tcl_DStringFree(&ds);
+
+    return idle;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpOriginsPrune --
+ *
+ *        Remove the entries of origins without idle persistent connections
+ *        from the origin table. Entries holding a TLS session which can
+ *        still be resumed are kept until the session expires. This function
+ *        is called periodically by the janitor.
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Freeing origin entries together with their statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HttpOriginsPrune(void)
+{
+    Tcl_HashEntry  *hPtr;
+    Tcl_HashSearch  search;
+    time_t          now = time(NULL);
+
+    Ns_MutexLock(&originMutex);
+    hPtr = Tcl_FirstHashEntry(&originTable, &search);
+    while (hPtr != NULL) {
+        HttpOrigin *originPtr = Tcl_GetHashValue(hPtr);
+
+#ifdef HTTP_TLS_SESSION_REUSE
+        if (originPtr->session != NULL
+            && (time_t)(SSL_SESSION_get_time(originPtr->session)
+                        + SSL_SESSION_get_timeout(originPtr->session)) > now) {
+            hPtr = Tcl_NextHashEntry(&search);
+            continue;
+        }
+#else
+        (void)now;
+#endif
+        if (HttpOriginIdleCount(Tcl_GetHashKey(&originTable, hPtr)) == 0u) {
+            Ns_Log(Ns_LogTaskDebug, "HttpOriginsPrune: remove origin %s",
+                   (const char *)Tcl_GetHashKey(&originTable, hPtr));
+#ifdef HTTP_TLS_SESSION_REUSE
+            if (originPtr->session != NULL) {
+                SSL_SESSION_free(originPtr->session);
+            }
+            if (originPtr->sessionCtx != NULL) {
+                SSL_CTX_free(originPtr->sessionCtx);
+            }
+#endif
+            ns_free(originPtr->sessionSni);
+            ns_free(originPtr);
+            Tcl_DeleteHashEntry(hPtr);
+        }
+        hPtr = Tcl_NextHashEntry(&search);
+    }
+    Ns_MutexUnlock(&originMutex);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpOriginRecordConnect --
+ *
+ *        Update the origin statistics after a connection for the task was
+ *        established. For fresh connections, record the connect latency
+ *        (including the TLS handshake) in the latency histogram and count
+ *        full and resumed TLS handshakes.
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Updating statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HttpOriginRecordConnect(const NsHttpTask *httpPtr, const Ns_Time *startTimePtr)
+{
+    NS_NONNULL_ASSERT(httpPtr != NULL);
+    NS_NONNULL_ASSERT(startTimePtr != NULL);
+
+    if (httpPtr->host != NULL) {
+        HttpOrigin *originPtr;
+        Ns_Time     now, diff;
+
+        Ns_GetTime(&now);
+        (void) Ns_DiffTime(&now, startTimePtr, &diff);
+
+        Ns_MutexLock(&originMutex);
+        originPtr = HttpOriginGet(httpPtr->host, httpPtr->port);
+        if (httpPtr->pos > 0u) {
+            originPtr->reuses ++;
+        } else {
+            long   usec = (long)diff.sec * 1000000 + diff.usec;
+            size_t bucket;
+
+            for (bucket = 0u; bucket < HTTP_LATENCY_BUCKETS - 1; bucket++) {
+                if (usec <= latencyBucketBounds[bucket]) {
+                    break;
+                }
+            }
+            originPtr->latency[bucket] ++;
+            originPtr->connects ++;
+#ifdef HAVE_OPENSSL_EVP_H
+            if (httpPtr->ssl != NULL) {
+                if (SSL_session_reused(httpPtr->ssl) != 0) {
+                    originPtr->resumed ++;
+                } else {
+                    originPtr->handshakes ++;
+                }
+            }
+#endif
+        }
+        Ns_MutexUnlock(&originMutex);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpOriginSessionSave --
+ *
+ *        Remember the TLS session of the task's connection for later
+ *        resumption by new connections to the same origin. With TLS 1.3,
+ *        session tickets are sent by the server after the handshake,
+ *        therefore, the session is saved when the request is finished.
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Potentially replacing the session of the origin.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HttpOriginSessionSave(const NsHttpTask *httpPtr)
+{
+    NS_NONNULL_ASSERT(httpPtr != NULL);
+
+#ifdef HTTP_TLS_SESSION_REUSE
+    if (httpPtr->host != NULL && httpPtr->ctx != NULL && httpPtr->ssl != NULL) {
+        SSL_SESSION *session = SSL_get1_session(httpPtr->ssl);
+
+        if (session != NULL) {
+            HttpOrigin *originPtr;
+            const char *sniHostname;
+
+# if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+            if (SSL_SESSION_is_resumable(session) == 0) {
+                SSL_SESSION_free(session);
+                return;
+            }
+# endif
+            sniHostname = SSL_get_servername(httpPtr->ssl, TLSEXT_NAMETYPE_host_name);
+
+            Ns_MutexLock(&originMutex);
+            originPtr = HttpOriginGet(httpPtr->host, httpPtr->port);
+            if (originPtr->session == session) {
+                /*
+                 * Nothing new, the connection resumed the stored session.
+                 */
+                SSL_SESSION_free(session);
+            } else {
+                if (originPtr->session != NULL) {
+                    SSL_SESSION_free(originPtr->session);
+                }
+                if (originPtr->sessionCtx != NULL) {
+                    SSL_CTX_free(originPtr->sessionCtx);
+                }
+                ns_free(originPtr->sessionSni);
+                /*
+                 * Keep a reference to the context, such its address
+                 * cannot be reused for a context with different settings.
+                 */
+                SSL_CTX_up_ref(httpPtr->ctx);
+                originPtr->sessionCtx = httpPtr->ctx;
+                originPtr->session = session;
+                originPtr->sessionSni = ns_strcopy(sniHostname);
+            }
+            Ns_MutexUnlock(&originMutex);
+        }
+    }
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpOriginSessionGet --
+ *
+ *        Return the TLS session stored for the origin, when it was obtained
+ *        with the provided TLS context and SNI hostname. Since shared
+ *        contexts are only used for requests with identical TLS settings,
+ *        this guarantees that a session validated under different settings
+ *        is never resumed.
+ *
+ * Results:
+ *        TLS session with an incremented reference count or NULL. The caller
+ *        has to release the session.
+ *
+ * Side effects:
+ *        None.
+ *
+ *----------------------------------------------------------------------
+ */
+static NS_TLS_SSL_SESSION *
+HttpOriginSessionGet(const char *host, unsigned short port,
+                     const NS_TLS_SSL_CTX *ctx, const char *sniHostname)
+{
+    NS_TLS_SSL_SESSION *session = NULL;
+
+    NS_NONNULL_ASSERT(host != NULL);
+    NS_NONNULL_ASSERT(ctx != NULL);
+
+#ifdef HTTP_TLS_SESSION_REUSE
+    {
+        const HttpOrigin *originPtr;
+
+        Ns_MutexLock(&originMutex);
+        originPtr = HttpOriginGet(host, port);
+        if (originPtr->session != NULL
+            && originPtr->sessionCtx == ctx
+            && (sniHostname == NULL
+                ? originPtr->sessionSni == NULL
+                : (originPtr->sessionSni != NULL && STREQ(sniHostname, originPtr->sessionSni)))
+           ) {
+            session = originPtr->session;
+            SSL_SESSION_up_ref(session);
+        }
+        Ns_MutexUnlock(&originMutex);
+    }
+#else
+    (void)port;
+    (void)sniHostname;
+#endif
+    return session;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpPreconnectSessionSave --
+ *
+ *        Save the TLS session of a preconnected connection, such that
+ *        further connections to the origin can resume it. With TLS 1.3,
+ *        the server sends the session tickets after the handshake. Since
+ *        nothing is read from a preconnected connection, wait for the
+ *        tickets at most as long as the handshake took (at least 10ms) and
+ *        let OpenSSL process them via SSL_peek().
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Potentially replacing the session of the origin.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HttpPreconnectSessionSave(const NsHttpTask *httpPtr, const Ns_Time *startTimePtr)
+{
+    NS_NONNULL_ASSERT(httpPtr != NULL);
+    NS_NONNULL_ASSERT(startTimePtr != NULL);
+
+#ifdef HTTP_TLS_SESSION_REUSE
+    if (httpPtr->ssl != NULL) {
+# ifdef TLS1_3_VERSION
+        if (SSL_version(httpPtr->ssl) >= TLS1_3_VERSION) {
+            Ns_Time now, wait;
+            char    c;
+
+            Ns_GetTime(&now);
+            (void) Ns_DiffTime(&now, startTimePtr, &wait);
+            if (wait.sec == 0 && wait.usec < 10000) {
+                wait.usec = 10000;
+            }
+            if (HttpWaitForSocketEvent(httpPtr->sock, POLLIN, &wait) == NS_OK) {
+                (void) SSL_peek(httpPtr->ssl, &c, 1);
+            }
+        }
+# endif
+        HttpOriginSessionSave(httpPtr);
+    }
+#else
+    (void)startTimePtr;
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpPreconnect --
+ *
+ *        Establish persistent connections to the origin of the provided URL
+ *        until "count" idle connections are available in the close-waiting
+ *        list. The TLS settings and validation defaults are taken from the
+ *        server configuration.
+ *
+ * Results:
+ *        A standard Tcl result. The number of newly established connections
+ *        is returned in connectedPtr.
+ *
+ * Side effects:
+ *        Opening sockets, performing TLS handshakes.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+HttpPreconnect(NsInterp *itPtr, const char *url, int count,
+               const Ns_Time *keepAliveTimeoutPtr, const Ns_Time *timeoutPtr,
+               int *connectedPtr)
+{
+    Tcl_Interp     *interp;
+    NsServer       *servPtr;
+    Ns_URL          u;
+    char           *urlCopy;
+    const char     *errorMsg = NULL, *caFile = NULL, *caPath = NULL;
+    unsigned short  portNr = 0u;
+    bool            https, verifyCert, maxReached = NS_FALSE;
+    int             result = TCL_OK;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(url != NULL);
+    NS_NONNULL_ASSERT(keepAliveTimeoutPtr != NULL);
+    NS_NONNULL_ASSERT(connectedPtr != NULL);
+
+    interp = itPtr->interp;
+    servPtr = itPtr->servPtr;
+    *connectedPtr = 0;
+
+    if (keepAliveTimeoutPtr->sec == 0 && keepAliveTimeoutPtr->usec == 0) {
+        Ns_TclPrintfResult(interp, "preconnect requires a keep-alive timeout");
+        return TCL_ERROR;
+    }
+
+    urlCopy = ns_strdup(url);
+    if (Ns_ParseUrl(urlCopy, NS_FALSE, &u, &errorMsg) != NS_OK
+        || u.protocol == NULL
+        || u.host == NULL) {
+        Ns_TclPrintfResult(interp, "invalid URL \"%s\": %s", url, errorMsg);
+        result = TCL_ERROR;
+
+    } else if (u.port != NULL) {
+        portNr = (unsigned short) strtol(u.port, NULL, 10);
+
+    } else if (STREQ("http", u.protocol)) {
+        portNr = 80u;
+
+    } else if (STREQ("https", u.protocol)) {
+        portNr = 443u;
+
+    } else {
+        Ns_TclPrintfResult(interp, "invalid URL \"%s\": invalid scheme", u.protocol);
+        result = TCL_ERROR;
+    }
+
+    https = (result == TCL_OK && STREQ("https", u.protocol));
+    verifyCert = servPtr->httpclient.validateCertificates;
+
+    if (result == TCL_OK) {
+        result = NsTlsGetParameters(itPtr, https, !verifyCert, NULL, NULL, NULL,
+                                    &caFile, &caPath);
+    }
+
+    if (result == TCL_OK) {
+        size_t idle;
+
+        Ns_MutexLock(&closeWaitingMutex);
+        idle = CloseWaitingIdleCount(u.host, portNr);
+        Ns_MutexUnlock(&closeWaitingMutex);
+
+        for (; (int)idle < count; idle++) {
+            NsHttpTask *httpPtr;
+            Ns_Time     startTime, timeout = *timeoutPtr;
+            const char *reason = NULL;
+
+            httpPtr = NewHttpTask(servPtr, "HEAD", url, NULL, 0);
+            httpPtr->flags |= NS_HTTP_FRESH_CONNECTION;
+            httpPtr->keepAliveTimeout = *keepAliveTimeoutPtr;
+            Ns_GetTime(&startTime);
+            httpPtr->stime = startTime;
+
+            if (https) {
+                result = EstablishTLSConnection(itPtr, httpPtr, &u, portNr,
+                                                NULL, 0u, NS_FALSE, &timeout,
+                                                NULL, NULL, caFile, caPath, verifyCert);
+            } else {
+                result = EstablishTCPConnection(itPtr, httpPtr, &u, portNr,
+                                                NULL, 0u, NS_FALSE, &timeout);
+            }
+            if (result == TCL_OK) {
+                HttpOriginRecordConnect(httpPtr, &startTime);
+                /*
+                 * PersistentConnectionAdd() takes over the TLS connection,
+                 * so HttpClose() cannot save its session.
+                 */
+                HttpPreconnectSessionSave(httpPtr, &startTime);
+                if (PersistentConnectionAdd(httpPtr, &reason)) {
+                    (*connectedPtr) ++;
+                } else if (reason != NULL) {
+                    Ns_TclPrintfResult(interp, "preconnect to %s failed: %s", url, reason);
+                    result = TCL_ERROR;
+                } else {
+                    /*
+                     * The maximum number of idle connections is reached.
+                     */
+                    maxReached = NS_TRUE;
+                }
+            }
+            HttpClose(httpPtr, "Preconnect");
+            if (result != TCL_OK || maxReached) {
+                break;
+            }
+        }
+    }
+    ns_free(urlCopy);
+
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpClientPreconnect --
+ *
+ *        Establish the persistent connections specified via the
+ *        "preconnect" parameters of the httpclient section of the
+ *        server. Every specification consists of a URL and an optional
+ *        number of connections (default 1). This function is registered to
+ *        be called when the server is ready.
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Opening connections, logging.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HttpClientPreconnect(void *arg)
+{
+    NsServer   *servPtr = arg;
+    Tcl_Interp *interp;
+
+    interp = Ns_TclAllocateInterp(servPtr->server);
+    if (interp == NULL) {
+        Ns_Log(Warning, "httpclient: preconnect cannot allocate interpreter for server %s",
+               servPtr->server);
+    } else {
+        NsInterp *itPtr = NsGetInterpData(interp);
+        size_t    i;
+
+        for (i = 0u; i < servPtr->httpclient.preconnects.size; i++) {
+            const char *spec = servPtr->httpclient.preconnects.data[i];
+            TCL_SIZE_T  argc = 0;
+            const char **argv = NULL;
+            int         count = 1, connected = 0;
+
+            if (Tcl_SplitList(interp, spec, &argc, &argv) != TCL_OK) {
+                argv = NULL;
+                Ns_Log(Warning, "httpclient: invalid preconnect specification '%s'", spec);
+            } else if (argc < 1 || argc > 2
+                || (argc == 2 && (Tcl_GetInt(interp, argv[1], &count) != TCL_OK || count < 1))) {
+                Ns_Log(Warning, "httpclient: invalid preconnect specification '%s'", spec);
+            } else if (HttpPreconnect(itPtr, argv[0], count,
+                                      &servPtr->httpclient.keepaliveTimeout,
+                                      &servPtr->httpclient.defaultTimeout,
+                                      &connected) != TCL_OK) {
+                Ns_Log(Warning, "httpclient: preconnect to %s: %s",
+                       argv[0], Tcl_GetStringResult(interp));
+            } else {
+                Ns_Log(Notice, "httpclient: preconnect to %s: %d new connections",
+                       argv[0], connected);
+            }
+            if (argv != NULL) {
+                Tcl_Free((char *)argv);
+            }
+            Tcl_ResetResult(interp);
+        }
+        Ns_TclDeAllocateInterp(interp);
+    }
+}
+
 #ifdef MEM_RECORD_DEBUG
 /*
  *----------------------------------------------------------------------
@@ -68,6 +68,15 @@
 
 #define NS_JOB_DEFAULT_MAXTHREADS 4
 
+/*
+ * A job thread continues with jobs of the queue it served last, as
+ * long as the virtual time of this queue is not more than the
+ * following amount (in microseconds of weighted run time) ahead of
+ * the queue which would be chosen otherwise.
+ */
+
+#define NS_JOB_AFFINITY_SLACK 1000.0
+
 /*
  * Enumeration types for the controlling variables.
  */
@@ -123,8 +132,10 @@ typedef struct Job {
     Tcl_DString       id;
     Tcl_DString       script;
     Tcl_DString       results;
+    Ns_Time           queueTime;
     Ns_Time           startTime;
     Ns_Time           endTime;
+    int               priority;
 } Job;
 
 /*
@@ -132,6 +143,7 @@ typedef struct Job {
  */
 
 typedef struct Queue {
+    struct Queue      *nextPtr;    /* next queue with pending jobs */
     const char        *name;
     const char        *desc;
     Ns_Mutex           lock;
@@ -140,8 +152,20 @@ typedef struct Queue {
     QueueRequests      req;
     int                maxThreads;
     int                nRunning;
+    int                nPending;
+    int                weight;
+    double             vtime;      /* run time in usec divided by weight */
+    Job               *firstPtr;   /* pending jobs, ordered by priority */
     Tcl_HashTable      jobs;
     int                refCount;
+    /*
+     * Statistics
+     */
+    long               nDone;
+    Ns_Time            waitTotal;
+    Ns_Time            waitMax;
+    Ns_Time            runTotal;
+    Ns_Time            runMax;
 } Queue;
 
 
@@ -159,7 +183,9 @@ typedef struct ThreadPool {
     int                nthreads;
     int                nidle;
     int                jobsPerThread;
-    Job               *firstPtr;
+    int                interpCleanup;
+    Queue             *firstPtr;      /* queues with pending jobs */
+    double             vtime;         /* virtual time of last dispatched queue */
     Ns_Time            timeout;
     Ns_Time            logminduration;
 } ThreadPool;
@@ -186,9 +212,9 @@ static TCL_OBJCMDPROC_T  JobWaitAnyObjCmd;
 static TCL_OBJCMDPROC_T  JobWaitObjCmd;
 
 static void   JobThread(void *arg);
-static Job*   GetNextJob(void);
+static Job*   GetNextJob(const char *preferredQueue);
 
-static Queue* NewQueue(const char* queueName, const char* queueDesc, int maxThreads)
+static Queue* NewQueue(const char* queueName, const char* queueDesc, int maxThreads, int weight)
     NS_GNUC_NONNULL(1)  NS_GNUC_NONNULL(2)
     NS_GNUC_RETURNS_NONNULL;
 
@@ -273,6 +299,7 @@ NsTclInitQueueType(void)
     tp.firstPtr = NULL;
     tp.req = THREADPOOL_REQ_NONE;
     tp.jobsPerThread = 0;
+    tp.interpCleanup = -1;
     tp.timeout.sec = 0;
     tp.timeout.usec = 0;
     tp.logminduration.sec = 0;
@@ -370,10 +397,11 @@ static int
 JobConfigureObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
     int               result = TCL_OK;
-    int               jpt = -1;
+    int               jpt = -1, interpCleanup = -1;
     Ns_Time          *timeoutPtr = NULL, *logminPtr = NULL;
     Ns_ObjvValueRange jptRange = {0, INT_MAX};
     Ns_ObjvSpec    lopts[] = {
+        {"-interpcleanup",  Ns_ObjvInt,  &interpCleanup, &jptRange},
         {"-jobsperthread",  Ns_ObjvInt,  &jpt,        &jptRange},
         {"-logminduration", Ns_ObjvTime, &logminPtr,  NULL},
         {"-timeout",        Ns_ObjvTime, &timeoutPtr, NULL},
@@ -389,6 +417,9 @@ JobConfigureObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
         if (jpt >= 0) {
             tp.jobsPerThread = jpt;
         }
+        if (interpCleanup >= 0) {
+            tp.interpCleanup = interpCleanup;
+        }
         if (timeoutPtr != NULL) {
             tp.timeout = *timeoutPtr;
         }
@@ -396,10 +427,11 @@ JobConfigureObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
             tp.logminduration = *logminPtr;
         }
         Ns_TclPrintfResult(interp, "jobsperthread %d timeout " NS_TIME_FMT
-                           " logminduration " NS_TIME_FMT,
+                           " logminduration " NS_TIME_FMT " interpcleanup %d",
                            tp.jobsPerThread,
                            (int64_t)tp.timeout.sec, tp.timeout.usec,
-                           (int64_t)tp.logminduration.sec, tp.logminduration.usec );
+                           (int64_t)tp.logminduration.sec, tp.logminduration.usec,
+                           tp.interpCleanup);
         Ns_MutexUnlock(&tp.queuelock);
     }
 
@@ -413,7 +445,9 @@ JobConfigureObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
  * JobCreateObjCmd, subcommand of NsTclJobObjCmd --
  *
  *          Implements "ns_job create".
- *          Create a new thread pool queue.
+ *          Create a new thread pool queue. The optional "-weight"
+ *          determines the share of the thread pool the queue receives
+ *          relative to other queues with pending jobs.
  *
  * Results:
  *          Standard Tcl result.
@@ -426,12 +460,14 @@ JobConfigureObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
 static int
 JobCreateObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
-    int               result = TCL_OK, maxThreads = NS_JOB_DEFAULT_MAXTHREADS;
+    int               result = TCL_OK, maxThreads = NS_JOB_DEFAULT_MAXTHREADS, weight = 1;
     Tcl_Obj          *queueIdObj;
     const char       *descString  = NS_EMPTY_STRING;
     Ns_ObjvValueRange maxThreadsRange = {1, INT_MAX};
+    Ns_ObjvValueRange weightRange = {1, 1000};
     Ns_ObjvSpec       lopts[] = {
         {"-desc",   Ns_ObjvString,   &descString,   NULL},
+        {"-weight", Ns_ObjvInt,      &weight,       &weightRange},
         {NULL, NULL, NULL, NULL}
     };
     Ns_ObjvSpec args[] = {
@@ -450,7 +486,7 @@ JobCreateObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T ob
         Ns_MutexLock(&tp.queuelock);
         hPtr = Tcl_CreateHashEntry(&tp.queues, queueIdString, &isNew);
         if (isNew != 0) {
-            Queue *queue = NewQueue(Ns_TclGetHashKeyString(&tp.queues, hPtr), descString, maxThreads);
+            Queue *queue = NewQueue(Ns_TclGetHashKeyString(&tp.queues, hPtr), descString, maxThreads, weight);
 
             Tcl_SetHashValue(hPtr, queue);
         }
@@ -515,7 +551,9 @@ JobDeleteObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T ob
  * JobQueueObjCmd, subcommand of NsTclJobObjCmd --
  *
  *          Implements "ns_job queue".
- *          Add a new job the specified queue.
+ *          Add a new job the specified queue. Pending jobs are kept
+ *          ordered by "-priority" (higher values first); jobs with
+ *          equal priority keep FIFO order unless "-head" is given.
  *
  * Results:
  *          Standard Tcl result.
@@ -528,7 +566,7 @@ JobDeleteObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T ob
 static int
 JobQueueObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
-    int         result = TCL_OK, head = 0, detached = 0;
+    int         result = TCL_OK, head = 0, detached = 0, priority = 0;
     bool        create = NS_FALSE;
     char       *script = NULL, *queueIdString = NULL;
     Tcl_Obj    *jobIdObj = NULL;
@@ -537,6 +575,7 @@ JobQueueObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_O
         {"-detached",  Ns_ObjvBool,  &detached,    INT2PTR(NS_TRUE)},
         {"-head",      Ns_ObjvBool,  &head,        INT2PTR(NS_TRUE)},
         {"-jobid",     Ns_ObjvObj,   &jobIdObj, NULL},
+        {"-priority",  Ns_ObjvInt,   &priority, NULL},
         {NULL, NULL, NULL, NULL}
     };
     Ns_ObjvSpec args[] = {
@@ -576,6 +615,8 @@ JobQueueObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_O
         jobPtr = NewJob((itPtr->servPtr != NULL) ? itPtr->servPtr : NULL,
                         queue->name, jobType, script);
         Ns_GetTime(&jobPtr->startTime);
+        jobPtr->queueTime = jobPtr->startTime;
+        jobPtr->priority = priority;
         if (tp.req == THREADPOOL_REQ_STOP
             || queue->req == QUEUE_REQ_DELETE) {
             Ns_TclPrintfResult(interp,
@@ -616,22 +657,38 @@ JobQueueObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_O
         }
 
         /*
-         * Add the job to the thread pool's job list, if "-head" is
-         * specified, insert new job at the beginning, otherwise
-         * append new job to the end.
+         * Add the job to the pending list of the queue, which is ordered
+         * by decreasing priority. If "-head" is specified, insert new job
+         * before all jobs of the same priority, otherwise append it
+         * after them. A queue getting its first pending job is added to
+         * the thread pool's list of queues with pending jobs.
          */
-        if (head != 0) {
-            jobPtr->nextPtr = tp.firstPtr;
-            tp.firstPtr = jobPtr;
-        } else {
-            Job  **nextPtrPtr = &tp.firstPtr;
+        {
+            Job  **nextPtrPtr = &queue->firstPtr;
 
-            while (*nextPtrPtr != NULL) {
+            if (queue->firstPtr == NULL) {
+                queue->nextPtr = tp.firstPtr;
+                tp.firstPtr = queue;
+            }
+
+            while (*nextPtrPtr != NULL
+                   && ((*nextPtrPtr)->priority > priority
+                       || (head == 0 && (*nextPtrPtr)->priority == priority))) {
                 nextPtrPtr = &((*nextPtrPtr)->nextPtr);
             }
+            jobPtr->nextPtr = *nextPtrPtr;
             *nextPtrPtr = jobPtr;
         }
 
+        /*
+         * A queue becoming busy again starts at the current virtual
+         * time, such that it cannot claim the time it was idle.
+         */
+        if (queue->nPending == 0 && queue->nRunning == 0 && queue->vtime < tp.vtime) {
+            queue->vtime = tp.vtime;
+        }
+        queue->nPending++;
+
         /*
          * Start a new thread if there are less than maxThreads
          * currently running and there currently no idle threads.
@@ -1176,6 +1233,7 @@ JobJobListObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T o
                 || AppendField(interp, jobFieldList, "code",   jobCode) != TCL_OK
                 || AppendField(interp, jobFieldList, "type",   jobType) != TCL_OK
                 || AppendField(interp, jobFieldList, "req",    jobReq) != TCL_OK
+                || AppendFieldInt(interp, jobFieldList, "priority", jobPtr->priority) != TCL_OK
                 || AppendField(interp, jobFieldList, "thread", threadId) != TCL_OK
                 || AppendFieldLong(interp, jobFieldList, "time", (long)Ns_TimeToMilliseconds(&diff)) != TCL_OK
                 || AppendFieldLong(interp, jobFieldList, "starttime", (long)jobPtr->startTime.sec) != TCL_OK
@@ -1261,6 +1319,13 @@ JobQueueListObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
                 || AppendFieldInt(interp, queueFieldList, "maxthreads", queue->maxThreads) != TCL_OK
                 || AppendFieldInt(interp, queueFieldList, "numrunning", queue->nRunning) != TCL_OK
                 || AppendField(interp, queueFieldList, "req", queueReq) != TCL_OK
+                || AppendFieldInt(interp, queueFieldList, "weight", queue->weight) != TCL_OK
+                || AppendFieldInt(interp, queueFieldList, "numpending", queue->nPending) != TCL_OK
+                || AppendFieldLong(interp, queueFieldList, "numdone", queue->nDone) != TCL_OK
+                || AppendFieldLong(interp, queueFieldList, "waittime", (long)Ns_TimeToMilliseconds(&queue->waitTotal)) != TCL_OK
+                || AppendFieldLong(interp, queueFieldList, "maxwaittime", (long)Ns_TimeToMilliseconds(&queue->waitMax)) != TCL_OK
+                || AppendFieldLong(interp, queueFieldList, "runtime", (long)Ns_TimeToMilliseconds(&queue->runTotal)) != TCL_OK
+                || AppendFieldLong(interp, queueFieldList, "maxruntime", (long)Ns_TimeToMilliseconds(&queue->runMax)) != TCL_OK
                 ) {
                 Tcl_DecrRefCount(queueFieldList);
                 result = TCL_ERROR;
@@ -1443,8 +1508,11 @@ JobThread(void *UNUSED(arg))
     Tcl_AsyncHandler  async;
     const Ns_Time    *timePtr;
     Ns_Time           wait;
-    int               jpt, njobs;
+    int               jpt, njobs, interpJobs = 0;
     uintptr_t         tid;
+    Tcl_Interp       *interp = NULL;
+    const NsServer   *interpServPtr = NULL;
+    Tcl_DString       lastQueue;
 
     (void)Ns_WaitForStartup();
     Ns_MutexLock(&tp.queuelock);
@@ -1463,10 +1531,10 @@ JobThread(void *UNUSED(arg))
      */
 
     jpt = njobs = tp.jobsPerThread;
+    Tcl_DStringInit(&lastQueue);
 
     while (jpt == 0 || njobs > 0) {
         Job          *jobPtr;
-        Tcl_Interp   *interp;
         int           code;
         Ns_ReturnCode status;
 
@@ -1482,7 +1550,18 @@ JobThread(void *UNUSED(arg))
         jobPtr = NULL;
         while (status == NS_OK &&
                !(tp.req == THREADPOOL_REQ_STOP) &&
-               ((jobPtr = GetNextJob()) == NULL)) {
+               ((jobPtr = GetNextJob(Tcl_DStringValue(&lastQueue))) == NULL)) {
+            if (interp != NULL) {
+                /*
+                 * The thread becomes idle; release the retained interp
+                 * (running the cleanup traces) before waiting.
+                 */
+                Ns_MutexUnlock(&tp.queuelock);
+                Ns_TclDeAllocateInterp(interp);
+                interp = NULL;
+                Ns_MutexLock(&tp.queuelock);
+                continue;
+            }
             status = Ns_CondTimedWait(&tp.cond, &tp.queuelock, timePtr);
         }
         --tp.nidle;
@@ -1496,16 +1575,21 @@ JobThread(void *UNUSED(arg))
         }
         assert(queue != NULL);
 
-        /*
-         * Get an interpreter....
-         */
-        interp = NsTclAllocateInterp((const NsServer*)jobPtr->servPtr);
-
         /*
          * Initialize times ...
          */
         Ns_GetTime(&jobPtr->endTime);
         Ns_GetTime(&jobPtr->startTime);
+        {
+            Ns_Time waitTime;
+
+            (void)Ns_DiffTime(&jobPtr->startTime, &jobPtr->queueTime, &waitTime);
+            Ns_IncrTime(&queue->waitTotal, waitTime.sec, waitTime.usec);
+            if (Ns_DiffTime(&waitTime, &queue->waitMax, NULL) > 0) {
+                queue->waitMax = waitTime;
+            }
+        }
+        queue->nPending--;
 
         /*
          * ... and controlling variables.
@@ -1524,10 +1608,26 @@ JobThread(void *UNUSED(arg))
          */
         Ns_ThreadSetName("-nsjob:%s:%lx", jobPtr->queueId, tid);
         ++queue->nRunning;
+        Tcl_DStringSetLength(&lastQueue, 0);
+        Tcl_DStringAppend(&lastQueue, queue->name, TCL_INDEX_NONE);
 
         Ns_MutexUnlock(&queue->lock);
         Ns_MutexUnlock(&tp.queuelock);
 
+        /*
+         * ... get an interpreter, reusing the one retained from the
+         * previous job when it belongs to the same server ...
+         */
+        if (interp != NULL && interpServPtr != jobPtr->servPtr) {
+            Ns_TclDeAllocateInterp(interp);
+            interp = NULL;
+        }
+        if (interp == NULL) {
+            interp = NsTclAllocateInterp((const NsServer*)jobPtr->servPtr);
+            interpServPtr = jobPtr->servPtr;
+            interpJobs = 0;
+        }
+
         /*
          * ... and execute the job.
          */
@@ -1553,6 +1653,19 @@ JobThread(void *UNUSED(arg))
             Ns_Time diffTime;
 
             (void)Ns_DiffTime(&jobPtr->endTime, &jobPtr->startTime, &diffTime);
+
+            /*
+             * Charge the run time to the queue for weighted fair
+             * scheduling and update the run time statistics.
+             */
+            queue->vtime += ((double)diffTime.sec * 1000000.0 + (double)diffTime.usec)
+                / (double)queue->weight;
+            queue->nDone++;
+            Ns_IncrTime(&queue->runTotal, diffTime.sec, diffTime.usec);
+            if (Ns_DiffTime(&diffTime, &queue->runMax, NULL) > 0) {
+                queue->runMax = diffTime;
+            }
+
             if (Ns_DiffTime(&tp.logminduration, &diffTime, NULL) < 1) {
                 Ns_Log(Notice, "ns_job %s duration " NS_TIME_FMT " secs: '%s'",
                        jobPtr->queueId, (int64_t)diffTime.sec, diffTime.usec,
@@ -1585,7 +1698,17 @@ JobThread(void *UNUSED(arg))
             }
         }
 
-        Ns_TclDeAllocateInterp(interp);
+        /*
+         * Run the interp cleanup after "interpcleanup" jobs; with a
+         * value of 0 the interp is only cleaned up when the thread
+         * becomes idle.
+         */
+        if (tp.interpCleanup > 0 && ++interpJobs >= tp.interpCleanup) {
+            Ns_TclDeAllocateInterp(interp);
+            interp = NULL;
+        } else {
+            Tcl_ResetResult(interp);
+        }
 
         /*
          * Clean any detached jobs.
@@ -1611,6 +1734,12 @@ JobThread(void *UNUSED(arg))
         }
     }
 
+    if (interp != NULL) {
+        Ns_MutexUnlock(&tp.queuelock);
+        Ns_TclDeAllocateInterp(interp);
+        Ns_MutexLock(&tp.queuelock);
+    }
+    Tcl_DStringFree(&lastQueue);
     --tp.nthreads;
 
     Tcl_AsyncDelete(async);
@@ -1660,8 +1789,22 @@ JobAbort(ClientData UNUSED(clientData), Tcl_Interp *interp, int UNUSED(code))
  *      Get the next job from the queue.
  *      The queuelock should be held locked.
  *
+ *      Only jobs of the highest priority with a runnable job are
+ *      considered. Among these, the job of the queue with the
+ *      smallest virtual time (consumed run time divided by the queue
+ *      weight) is chosen, such that queues share the thread pool
+ *      according to their weights (weighted fair queuing). Jobs of
+ *      the same queue are taken in list order. Since the pending
+ *      jobs are kept per queue, the costs depend on the number of
+ *      queues with pending jobs, not on the number of pending jobs.
+ *
+ *      To keep the caches of the thread's interp hot, a job of the
+ *      preferred queue (the queue served last by the calling thread)
+ *      is taken, when this queue is not more than
+ *      NS_JOB_AFFINITY_SLACK ahead of the best queue.
+ *
  * Results:
- *      The job.
+ *      The job or NULL.
  *
  * Side effects:
  *      Queues have a "maxThreads" so if the queue is already
@@ -1671,42 +1814,67 @@ JobAbort(ClientData UNUSED(clientData), Tcl_Interp *interp, int UNUSED(code))
  */
 
 static Job*
-GetNextJob(void)
+GetNextJob(const char *preferredQueue)
 {
-    Queue         *queue;
-    Job           *prevPtr, *jobPtr;
-    bool           done = NS_FALSE;
+    Queue         *queue, *prevPtr, *bestPtr = NULL, *bestPrevPtr = NULL;
+    Queue         *prefPtr = NULL, *prefPrevPtr = NULL;
+    Job           *jobPtr = NULL;
 
-    jobPtr = prevPtr = tp.firstPtr;
+    /*
+     * Only the first job of every queue with pending jobs has to be
+     * considered, since the pending jobs of a queue are ordered by
+     * priority.
+     */
+    for (prevPtr = NULL, queue = tp.firstPtr;
+         queue != NULL;
+         prevPtr = queue, queue = queue->nextPtr) {
 
-    while (!done && jobPtr != NULL) {
+        assert(queue->firstPtr != NULL);
 
-        if (LookupQueue(NULL, jobPtr->queueId, &queue, NS_TRUE) != TCL_OK) {
-            Ns_Log(Fatal, "cannot find queue: %s", jobPtr->queueId);
-            break;
+        if (queue->nRunning >= queue->maxThreads) {
+            continue;
         }
-        assert(queue != NULL);
+        if (bestPtr == NULL
+            || queue->firstPtr->priority > bestPtr->firstPtr->priority
+            || (queue->firstPtr->priority == bestPtr->firstPtr->priority
+                && queue->vtime < bestPtr->vtime)) {
+            bestPtr = queue;
+            bestPrevPtr = prevPtr;
+        }
+        if (preferredQueue != NULL && STREQ(queue->name, preferredQueue)) {
+            prefPtr = queue;
+            prefPrevPtr = prevPtr;
+        }
+    }
 
-        if (queue->nRunning < queue->maxThreads) {
-            /*
-             * Job can be serviced; remove it from the pending list.
-             */
-            if (jobPtr == tp.firstPtr) {
-                tp.firstPtr = jobPtr->nextPtr;
+    if (prefPtr != NULL
+        && prefPtr->firstPtr->priority == bestPtr->firstPtr->priority
+        && prefPtr->vtime <= bestPtr->vtime + NS_JOB_AFFINITY_SLACK) {
+        bestPtr = prefPtr;
+        bestPrevPtr = prefPrevPtr;
+    }
+
+    if (bestPtr != NULL) {
+        /*
+         * Job can be serviced; remove it from the pending list of the
+         * queue, and the queue from the list of queues with pending
+         * jobs, when this was its last pending job.
+         */
+        jobPtr = bestPtr->firstPtr;
+        bestPtr->firstPtr = jobPtr->nextPtr;
+        jobPtr->nextPtr = NULL;
+
+        if (bestPtr->firstPtr == NULL) {
+            if (bestPrevPtr == NULL) {
+                tp.firstPtr = bestPtr->nextPtr;
             } else {
-                prevPtr->nextPtr = jobPtr->nextPtr;
+                bestPrevPtr->nextPtr = bestPtr->nextPtr;
             }
-            done = NS_TRUE;
-
-        } else {
-            /*
-             * Go to next job.
-             */
-            prevPtr = jobPtr;
-            jobPtr = jobPtr->nextPtr;
+            bestPtr->nextPtr = NULL;
+        }
+        if (bestPtr->vtime > tp.vtime) {
+            tp.vtime = bestPtr->vtime;
         }
-
-        (void)ReleaseQueue(queue, NS_TRUE);
     }
 
     return jobPtr;
@@ -1730,7 +1898,7 @@ GetNextJob(void)
  */
 
 static Queue*
-NewQueue(const char *queueName, const char *queueDesc, int maxThreads)
+NewQueue(const char *queueName, const char *queueDesc, int maxThreads, int weight)
 {
     Queue *queue;
 
@@ -1742,6 +1910,8 @@ NewQueue(const char *queueName, const char *queueDesc, int maxThreads)
     queue->name = ns_strdup(queueName);
     queue->desc = ns_strdup(queueDesc);
     queue->maxThreads = maxThreads;
+    queue->weight = weight;
+    queue->vtime = tp.vtime;
     queue->refCount = 0;
 
     Ns_MutexSetName2(&queue->lock, "tcljob", queueName);
@@ -2400,6 +2570,9 @@ SetupJobDefaults(void)
     if (tp.logminduration.sec == 0 && tp.logminduration.usec == 0) {
         tp.logminduration = nsconf.job.logminduration;
     }
+    if (tp.interpCleanup < 0) {
+        tp.interpCleanup = nsconf.job.interpcleanup;
+    }
 }
 
 /*
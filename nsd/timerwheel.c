@@ -0,0 +1,697 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * Copyright (C) 2026 NaviServer project
+ *
+ */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * timerwheel.c --
+ *
+ *      Hierarchical timing wheel for managing a large number of
+ *      deadlines (e.g. socket read or keepalive timeouts) in a single
+ *      event loop thread.
+ *
+ * Overview:
+ *      The wheel consists of NS_TIMERWHEEL_LEVELS levels with
+ *      NS_TIMERWHEEL_SLOTS slots each. The resolution of level 0 is one
+ *      tick (one millisecond), every higher level covers
+ *      NS_TIMERWHEEL_SLOTS times the range of the level below. Entries
+ *      are kept in doubly linked lists per slot, so setting, moving and
+ *      canceling a deadline is O(1). Entries on higher levels are
+ *      cascaded to lower levels when the wheel reaches their slot.
+ *
+ *      A bitmap per level records the non-empty slots. This allows to
+ *      determine the next deadline in O(levels) and to skip over empty
+ *      ranges of the wheel when the wheel is advanced after a longer
+ *      sleep.
+ *
+ *      Deadlines are rounded up to the next tick, the current time is
+ *      rounded down when expiring entries. Therefore, an entry is never
+ *      reported as expired before its deadline.
+ *
+ *      A wheel is not thread-safe, it is intended to be owned by a
+ *      single event loop thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+#include "nsd.h"
+
+#define WHEEL_BITS  6
+#define WHEEL_MASK  ((uint64_t)NS_TIMERWHEEL_SLOTS - 1u)
+
+static Ns_ObjvValueRange posintRange0 = {0, LLONG_MAX};
+
+/*
+ * Local functions defined in this file
+ */
+
+static uint64_t TimeToTick(const Ns_Time *timePtr, bool roundUp)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+static void TickToTime(uint64_t tick, Ns_Time *timePtr)
+    NS_GNUC_NONNULL(2);
+static void WheelLink(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void WheelUnlink(NsTimerWheelEntry *entryPtr)
+    NS_GNUC_NONNULL(1);
+static void WheelCascade(NsTimerWheel *wheelPtr, int level)
+    NS_GNUC_NONNULL(1);
+static uint64_t WheelNextTick(const NsTimerWheel *wheelPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+static int FirstBit(uint64_t bits)
+    NS_GNUC_CONST;
+static void MsToTime(Tcl_WideInt ms, Ns_Time *timePtr)
+    NS_GNUC_NONNULL(2);
+
+static NsTimerWheelProc TimerWheelTestExpire;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelInit --
+ *
+ *      Initialize an empty timer wheel starting at the specified time.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTimerWheelInit(NsTimerWheel *wheelPtr, const Ns_Time *nowPtr)
+{
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    memset(wheelPtr, 0, sizeof(NsTimerWheel));
+    wheelPtr->current = TimeToTick(nowPtr, NS_FALSE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelSet --
+ *
+ *      Arm the entry to expire at the specified deadline. An already
+ *      armed entry is moved to the new deadline. Setting an armed entry
+ *      to the same deadline tick is a no-op, which makes it cheap to
+ *      refresh the deadline of all entries on every loop iteration.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The entry is linked into the wheel.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTimerWheelSet(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr,
+                const Ns_Time *deadlinePtr, void *clientData)
+{
+    uint64_t expires;
+
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(entryPtr != NULL);
+    NS_NONNULL_ASSERT(deadlinePtr != NULL);
+
+    expires = TimeToTick(deadlinePtr, NS_TRUE);
+    entryPtr->clientData = clientData;
+
+    if (entryPtr->wheelPtr == wheelPtr && entryPtr->expires == expires) {
+        return;
+    }
+    if (entryPtr->wheelPtr != NULL) {
+        WheelUnlink(entryPtr);
+    }
+    entryPtr->expires = expires;
+    WheelLink(wheelPtr, entryPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelCancel --
+ *
+ *      Disarm the entry. Canceling an entry which is not armed is
+ *      allowed and has no effect.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The entry is unlinked from its wheel.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTimerWheelCancel(NsTimerWheelEntry *entryPtr)
+{
+    NS_NONNULL_ASSERT(entryPtr != NULL);
+
+    if (entryPtr->wheelPtr != NULL) {
+        WheelUnlink(entryPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelNext --
+ *
+ *      Determine the time, when the wheel has to be advanced next. The
+ *      returned time is never later than the earliest deadline of the
+ *      armed entries. It might be earlier, when entries of higher levels
+ *      have to be cascaded before they can expire.
+ *
+ * Results:
+ *      NS_TRUE when the wheel contains armed entries and *deadlinePtr
+ *      was set, NS_FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+NsTimerWheelNext(const NsTimerWheel *wheelPtr, Ns_Time *deadlinePtr)
+{
+    bool success = NS_FALSE;
+
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(deadlinePtr != NULL);
+
+    if (wheelPtr->count > 0u) {
+        TickToTime(WheelNextTick(wheelPtr), deadlinePtr);
+        success = NS_TRUE;
+    }
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelExpire --
+ *
+ *      Advance the wheel to the specified time and disarm all entries
+ *      with a deadline not later than this time. For every disarmed
+ *      entry the optional callback is invoked. The callback might re-arm
+ *      the entry or cancel other entries.
+ *
+ * Results:
+ *      Number of expired entries.
+ *
+ * Side effects:
+ *      Potentially invokes callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+size_t
+NsTimerWheelExpire(NsTimerWheel *wheelPtr, const Ns_Time *nowPtr,
+                   NsTimerWheelProc *proc, void *arg)
+{
+    uint64_t target;
+    size_t   expired = 0u;
+
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    target = TimeToTick(nowPtr, NS_FALSE);
+
+    while (wheelPtr->current <= target) {
+        uint64_t           next;
+        NsTimerWheelEntry *entryPtr;
+        int                level;
+
+        if (wheelPtr->count == 0u) {
+            wheelPtr->current = target + 1u;
+            break;
+        }
+
+        /*
+         * Skip over empty ranges of the wheel. Since the next tick is not
+         * later than the start of any non-empty slot, no cascade point of
+         * a non-empty slot is skipped.
+         */
+        next = WheelNextTick(wheelPtr);
+        if (next > wheelPtr->current) {
+            wheelPtr->current = MIN(next, target + 1u);
+            continue;
+        }
+
+        /*
+         * Cascade the entries of the higher levels, whose slots start at
+         * the current tick.
+         */
+        for (level = 1; level < NS_TIMERWHEEL_LEVELS; level++) {
+            if ((wheelPtr->current & ((UINT64_C(1) << (WHEEL_BITS * level)) - 1u)) != 0u) {
+                break;
+            }
+            WheelCascade(wheelPtr, level);
+        }
+
+        /*
+         * Expire all entries of the current slot on level 0.
+         */
+        while ((entryPtr = wheelPtr->slots[0][wheelPtr->current & WHEEL_MASK]) != NULL) {
+            WheelUnlink(entryPtr);
+            expired++;
+            if (proc != NULL) {
+                (*proc)(entryPtr->clientData, arg);
+            }
+        }
+        wheelPtr->current++;
+    }
+
+    return expired;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclTimerWheelTestObjCmd --
+ *
+ *      Implements "_ns_timerwheel_test", an internal command for the
+ *      regression tests of the timer wheel. The command applies a list
+ *      of operations to a private wheel and returns a list with one
+ *      element per operation. Times are in milliseconds relative to
+ *      the time 0, the wheel starts at the time specified via "-start".
+ *
+ *          set /id/ /ms/   arm or move entry /id/, returns empty
+ *          cancel /id/     disarm entry /id/, returns empty
+ *          next            next wakeup time, empty when no entry is armed
+ *          expire /ms/     advance the wheel, returns the expired ids
+ *          count           number of armed entries
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclTimerWheelTestObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    int            result = TCL_OK;
+    Tcl_WideInt    start = 0;
+    Tcl_Obj       *opsObj = NULL;
+    Ns_ObjvSpec    opts[] = {
+        {"-start", Ns_ObjvWideInt, &start, &posintRange0},
+        {"--",     Ns_ObjvBreak,   NULL,   NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec    args[] = {
+        {"operations", Ns_ObjvObj, &opsObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        NsTimerWheel   wheel;
+        Tcl_HashTable  entries;
+        Tcl_HashEntry *hPtr;
+        Tcl_HashSearch search;
+        Tcl_Obj      **opv, *resultObj;
+        TCL_SIZE_T     opc, i;
+        Ns_Time        t;
+
+        MsToTime(start, &t);
+        NsTimerWheelInit(&wheel, &t);
+        Tcl_InitHashTable(&entries, TCL_STRING_KEYS);
+        resultObj = Tcl_NewListObj(0, NULL);
+
+        if (Tcl_ListObjGetElements(interp, opsObj, &opc, &opv) != TCL_OK) {
+            result = TCL_ERROR;
+        }
+        for (i = 0; result == TCL_OK && i < opc; i++) {
+            Tcl_Obj   **argv, *elementObj = NULL;
+            TCL_SIZE_T  argc;
+            const char *op;
+            Tcl_WideInt ms;
+
+            if (Tcl_ListObjGetElements(interp, opv[i], &argc, &argv) != TCL_OK) {
+                result = TCL_ERROR;
+                break;
+            }
+            op = (argc > 0) ? Tcl_GetString(argv[0]) : NS_EMPTY_STRING;
+
+            if (STREQ(op, "set") && argc == 3) {
+                int isNew;
+
+                if (Tcl_GetWideIntFromObj(interp, argv[2], &ms) != TCL_OK) {
+                    result = TCL_ERROR;
+                    break;
+                }
+                hPtr = Tcl_CreateHashEntry(&entries, Tcl_GetString(argv[1]), &isNew);
+                if (isNew != 0) {
+                    Tcl_SetHashValue(hPtr, ns_calloc(1u, sizeof(NsTimerWheelEntry)));
+                }
+                MsToTime(ms, &t);
+                NsTimerWheelSet(&wheel, Tcl_GetHashValue(hPtr), &t,
+                                Tcl_GetHashKey(&entries, hPtr));
+                elementObj = Tcl_NewObj();
+
+            } else if (STREQ(op, "cancel") && argc == 2) {
+                hPtr = Tcl_FindHashEntry(&entries, Tcl_GetString(argv[1]));
+                if (hPtr != NULL) {
+                    NsTimerWheelCancel(Tcl_GetHashValue(hPtr));
+                }
+                elementObj = Tcl_NewObj();
+
+            } else if (STREQ(op, "next") && argc == 1) {
+                if (NsTimerWheelNext(&wheel, &t)) {
+                    elementObj = Tcl_NewWideIntObj((Tcl_WideInt)t.sec * 1000 + t.usec / 1000);
+                } else {
+                    elementObj = Tcl_NewObj();
+                }
+
+            } else if (STREQ(op, "expire") && argc == 2) {
+                if (Tcl_GetWideIntFromObj(interp, argv[1], &ms) != TCL_OK) {
+                    result = TCL_ERROR;
+                    break;
+                }
+                MsToTime(ms, &t);
+                elementObj = Tcl_NewListObj(0, NULL);
+                (void) NsTimerWheelExpire(&wheel, &t, TimerWheelTestExpire, elementObj);
+
+            } else if (STREQ(op, "count") && argc == 1) {
+                elementObj = Tcl_NewWideIntObj((Tcl_WideInt)wheel.count);
+
+            } else {
+                Ns_TclPrintfResult(interp, "invalid operation: \"%s\"", Tcl_GetString(opv[i]));
+                result = TCL_ERROR;
+                break;
+            }
+            Tcl_ListObjAppendElement(interp, resultObj, elementObj);
+        }
+
+        for (hPtr = Tcl_FirstHashEntry(&entries, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            ns_free(Tcl_GetHashValue(hPtr));
+        }
+        Tcl_DeleteHashTable(&entries);
+
+        if (result == TCL_OK) {
+            Tcl_SetObjResult(interp, resultObj);
+        } else {
+            Tcl_DecrRefCount(resultObj);
+        }
+    }
+    return result;
+}
+
+static void
+TimerWheelTestExpire(void *clientData, void *arg)
+{
+    Tcl_ListObjAppendElement(NULL, (Tcl_Obj *)arg, Tcl_NewStringObj(clientData, TCL_INDEX_NONE));
+}
+
+static void
+MsToTime(Tcl_WideInt ms, Ns_Time *timePtr)
+{
+    timePtr->sec = (time_t)(ms / 1000);
+    timePtr->usec = (long)(ms % 1000) * 1000;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TimeToTick, TickToTime --
+ *
+ *      Convert between Ns_Time and wheel ticks (milliseconds).
+ *
+ * Results:
+ *      Tick value or time value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint64_t
+TimeToTick(const Ns_Time *timePtr, bool roundUp)
+{
+    uint64_t tick;
+
+    if (timePtr->sec < 0) {
+        tick = 0u;
+    } else {
+        tick = (uint64_t)timePtr->sec * 1000u + (uint64_t)(timePtr->usec / 1000);
+        if (roundUp && (timePtr->usec % 1000) != 0) {
+            tick++;
+        }
+    }
+    return tick;
+}
+
+static void
+TickToTime(uint64_t tick, Ns_Time *timePtr)
+{
+    timePtr->sec = (time_t)(tick / 1000u);
+    timePtr->usec = (long)(tick % 1000u) * 1000;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WheelLink --
+ *
+ *      Link the entry into the slot determined by its expiry relative
+ *      to the current tick. Entries which expired already are placed
+ *      into the current slot of level 0, entries beyond the range of the
+ *      wheel into the farthest slot of the highest level, from where
+ *      they are cascaded again later.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the slot list and the bitmap.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WheelLink(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr)
+{
+    uint64_t expires = MAX(entryPtr->expires, wheelPtr->current);
+    int      level;
+    size_t   slot = 0u;
+
+    for (level = 0; level < NS_TIMERWHEEL_LEVELS; level++) {
+        unsigned int shift = (unsigned int)(WHEEL_BITS * level);
+
+        if ((expires >> shift) - (wheelPtr->current >> shift) < NS_TIMERWHEEL_SLOTS) {
+            slot = (size_t)((expires >> shift) & WHEEL_MASK);
+            break;
+        }
+    }
+    if (level == NS_TIMERWHEEL_LEVELS) {
+        unsigned int shift = (unsigned int)(WHEEL_BITS * (NS_TIMERWHEEL_LEVELS - 1));
+
+        level = NS_TIMERWHEEL_LEVELS - 1;
+        slot = (size_t)(((wheelPtr->current >> shift) + WHEEL_MASK) & WHEEL_MASK);
+    }
+
+    entryPtr->wheelPtr = wheelPtr;
+    entryPtr->level = (unsigned char)level;
+    entryPtr->slot = (unsigned char)slot;
+    entryPtr->prevPtr = NULL;
+    entryPtr->nextPtr = wheelPtr->slots[level][slot];
+    if (entryPtr->nextPtr != NULL) {
+        entryPtr->nextPtr->prevPtr = entryPtr;
+    }
+    wheelPtr->slots[level][slot] = entryPtr;
+    wheelPtr->bitmap[level] |= (UINT64_C(1) << slot);
+    wheelPtr->count++;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WheelUnlink --
+ *
+ *      Remove the entry from its slot.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the slot list and the bitmap.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WheelUnlink(NsTimerWheelEntry *entryPtr)
+{
+    NsTimerWheel *wheelPtr = entryPtr->wheelPtr;
+
+    if (entryPtr->prevPtr != NULL) {
+        entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+    } else {
+        wheelPtr->slots[entryPtr->level][entryPtr->slot] = entryPtr->nextPtr;
+        if (entryPtr->nextPtr == NULL) {
+            wheelPtr->bitmap[entryPtr->level] &= ~(UINT64_C(1) << entryPtr->slot);
+        }
+    }
+    if (entryPtr->nextPtr != NULL) {
+        entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+    }
+    entryPtr->nextPtr = NULL;
+    entryPtr->prevPtr = NULL;
+    entryPtr->wheelPtr = NULL;
+    wheelPtr->count--;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WheelCascade --
+ *
+ *      Redistribute the entries of the slot of the specified level
+ *      starting at the current tick to the lower levels.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the slot lists and the bitmaps.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WheelCascade(NsTimerWheel *wheelPtr, int level)
+{
+    size_t             slot;
+    NsTimerWheelEntry *entryPtr;
+
+    slot = (size_t)((wheelPtr->current >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    while ((entryPtr = wheelPtr->slots[level][slot]) != NULL) {
+        WheelUnlink(entryPtr);
+        WheelLink(wheelPtr, entryPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WheelNextTick --
+ *
+ *      Determine the earliest tick at which a non-empty slot starts. The
+ *      wheel must not be empty.
+ *
+ * Results:
+ *      Tick value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint64_t
+WheelNextTick(const NsTimerWheel *wheelPtr)
+{
+    uint64_t next = UINT64_MAX;
+    int      level;
+
+    for (level = 0; level < NS_TIMERWHEEL_LEVELS; level++) {
+        uint64_t bits = wheelPtr->bitmap[level];
+
+        if (bits != 0u) {
+            unsigned int shift = (unsigned int)(WHEEL_BITS * level);
+            unsigned int index = (unsigned int)((wheelPtr->current >> shift) & WHEEL_MASK);
+            uint64_t     rotated, start;
+
+            /*
+             * Rotate the bitmap such that bit 0 corresponds to the slot
+             * of the current tick and determine the distance to the first
+             * non-empty slot.
+             */
+            rotated = (index == 0u) ? bits : ((bits >> index) | (bits << (NS_TIMERWHEEL_SLOTS - index)));
+            start = ((wheelPtr->current >> shift) + (uint64_t)FirstBit(rotated)) << shift;
+            if (start < wheelPtr->current) {
+                start = wheelPtr->current;
+            }
+            if (start < next) {
+                next = start;
+            }
+        }
+    }
+    return next;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FirstBit --
+ *
+ *      Return the index of the lowest bit set in a non-zero value.
+ *
+ * Results:
+ *      Bit index.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+FirstBit(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+
+    while ((bits & 1u) == 0u) {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -71,6 +71,13 @@ ReportError(Tcl_Interp *interp, const char *fmt, ...)
 # include "nsopenssl.h"
 # include <openssl/ssl.h>
 # include <openssl/err.h>
+# include <openssl/rand.h>
+# include <openssl/sha.h>
+# ifdef HAVE_OPENSSL_3
+#  include <openssl/core_names.h>
+# else
+#  include <openssl/hmac.h>
+# endif
 
 # ifdef HAVE_OPENSSL_OCSP
 #  include <openssl/ocsp.h>
@@ -99,6 +106,47 @@ static FILE *keylog_fp = NULL;
  */
 static int ClientCtxDataIndex;
 
+/*
+ * Session ticket keys loaded from a file, shared between all SSL_CTXs
+ * configured with the same "ticketkeyfile". Each key consists of a
+ * 16 byte key name, a 32 byte HMAC secret and a 32 byte AES key (80
+ * bytes, hex encoded on a single line of the file). The keys are listed
+ * in rotation order: the first key is the previous key, the second one
+ * the current key, and the following ones are the next keys.
+ */
+# define TICKET_KEY_NAME_LENGTH   16
+# define TICKET_KEY_SECRET_LENGTH 32
+# define TICKET_KEY_LENGTH        (TICKET_KEY_NAME_LENGTH + 2 * TICKET_KEY_SECRET_LENGTH)
+
+typedef struct TicketKey {
+    unsigned char name[TICKET_KEY_NAME_LENGTH];
+    unsigned char hmacKey[TICKET_KEY_SECRET_LENGTH];
+    unsigned char aesKey[TICKET_KEY_SECRET_LENGTH];
+} TicketKey;
+
+typedef struct TicketKeyRing {
+    Ns_Mutex    lock;
+    const char *file;          /* File containing the keys */
+    time_t      mtime;         /* Modification time of the loaded file */
+    long        rotate;        /* Rotation interval in seconds, 0 means no rotation */
+    long        slot;          /* Rotation slot of the last key file check */
+    long        epoch;         /* Rotation slot of the file modification time */
+    TicketKey  *keys;
+    size_t      nkeys;
+    size_t      retired;       /* Number of leading keys wiped after rotation */
+    bool        exhausted;     /* Rotation reached the last key of the file */
+    struct {
+        Tcl_WideInt issued;    /* Tickets issued */
+        Tcl_WideInt resumed;   /* Tickets decrypted with the current key */
+        Tcl_WideInt renewed;   /* Tickets decrypted with a non-current key */
+        Tcl_WideInt unknown;   /* Tickets with an unknown key name */
+    } stats;
+} TicketKeyRing;
+
+static Tcl_HashTable  ticketKeyTable;      /* File name -> TicketKeyRing, guarded by master lock */
+static int            TicketKeyRingIndex;  /* SSL_CTX ex_data index */
+static int            TicketKeySSLIndex;   /* SSL ex_data index, key ring of the initial SSL_CTX */
+
 /*
  * Local functions defined in this file
  */
@@ -137,6 +185,24 @@ static Ns_ReturnCode WaitFor(NS_SOCKET sock, unsigned int st, const Ns_Time *tim
 
 static void CertTableInit(void);
 static void CertTableReload(void *UNUSED(arg));
+
+static int HexDigitValue(char c);
+static Ns_ReturnCode TicketKeysLoad(TicketKeyRing *ringPtr, bool force)
+    NS_GNUC_NONNULL(1);
+static TicketKeyRing *TicketKeyRingGet(const char *file, long rotate)
+    NS_GNUC_NONNULL(1);
+static size_t TicketKeyCurrent(TicketKeyRing *ringPtr, time_t now)
+    NS_GNUC_NONNULL(1);
+static void TicketKeysSetup(NS_TLS_SSL_CTX *ctx, const char *section, const char *file)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+static void TicketKeysReloadAll(void);
+# ifdef HAVE_OPENSSL_3
+static int TicketKeyCB(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+                       EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc);
+# else
+static int TicketKeyCB(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+                       EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc);
+# endif
 static void CertTableAdd(const NS_TLS_SSL_CTX *ctx, const char *cert)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 static NS_TLS_SSL_CTX *CertTableGetCtx(const char *cert)
@@ -383,6 +449,15 @@ SSL_serverNameCB(SSL *ssl, int *UNUSED(al), void *arg)
              */
             if (ctx != NULL) {
                 Ns_Log(Debug, "SSL_serverNameCB switches server context to %p", (void*)ctx);
+                /*
+                 * OpenSSL keeps calling the session ticket key callback of
+                 * the initial context, so keep its key ring for the
+                 * connection.
+                 */
+                if (SSL_get_ex_data(ssl, TicketKeySSLIndex) == NULL) {
+                    SSL_set_ex_data(ssl, TicketKeySSLIndex,
+                                    SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), TicketKeyRingIndex));
+                }
                 SSL_set_SSL_CTX(ssl, ctx);
                 result = SSL_TLSEXT_ERR_OK;
             }
@@ -1244,6 +1319,9 @@ NsInitOpenSSL(void)
         OPENSSL_init_ssl(0, NULL);
 #  endif
         ClientCtxDataIndex = SSL_CTX_get_ex_new_index(0, ns_client_info_tag, NULL, NULL, NULL);
+        TicketKeyRingIndex = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+        TicketKeySSLIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+        Tcl_InitHashTable(&ticketKeyTable, TCL_STRING_KEYS);
         initialized = 1;
         /*
          * We do not want to get this message when, e.g., the nsproxy
@@ -1456,10 +1534,13 @@ PartialTimeout(const Ns_Time *endTimePtr, Ns_Time *diffPtr, Ns_Time *defaultPart
 /*
  *----------------------------------------------------------------------
  *
- * Ns_TLS_SSLConnect --
+ * Ns_TLS_SSLConnect, Ns_TLS_SSLConnect2 --
  *
  *      Initialize a socket as ssl socket and wait until the socket is
- *      usable (is connected, handshake performed)
+ *      usable (is connected, handshake performed). Ns_TLS_SSLConnect2()
+ *      accepts an optional TLS session from an earlier connection to the
+ *      same peer, which is offered for resumption to avoid a full
+ *      handshake.
  *
  * Results:
  *      NS_OK, NS_ERROR, or NS_TIMEOUT.
@@ -1473,6 +1554,16 @@ Ns_ReturnCode
 Ns_TLS_SSLConnect(Tcl_Interp *interp, NS_SOCKET sock, NS_TLS_SSL_CTX *ctx,
                   const char *sni_hostname, const char *caFile, const char *caPath,
                   const Ns_Time *timeoutPtr, NS_TLS_SSL **sslPtr)
+{
+    return Ns_TLS_SSLConnect2(interp, sock, ctx, sni_hostname, caFile, caPath,
+                              NULL, timeoutPtr, sslPtr);
+}
+
+Ns_ReturnCode
+Ns_TLS_SSLConnect2(Tcl_Interp *interp, NS_SOCKET sock, NS_TLS_SSL_CTX *ctx,
+                   const char *sni_hostname, const char *caFile, const char *caPath,
+                   NS_TLS_SSL_SESSION *session,
+                   const Ns_Time *timeoutPtr, NS_TLS_SSL **sslPtr)
 {
     NS_TLS_SSL     *ssl;
     Ns_ReturnCode   result = NS_OK;
@@ -1502,6 +1593,9 @@ Ns_TLS_SSLConnect(Tcl_Interp *interp, NS_SOCKET sock, NS_TLS_SSL_CTX *ctx,
                 Ns_Log(Warning, "tls: setting SNI hostname '%s' failed, value ignored", sni_hostname);
             }
         }
+        if (session != NULL && SSL_set_session(ssl, session) != 1) {
+            Ns_Log(Debug, "tls: could not set session for resumption, value ignored");
+        }
         SSL_set_fd(ssl, sock);
         SSL_set_connect_state(ssl);
 
@@ -2153,7 +2247,19 @@ Ns_TLS_CtxServerInit(const char *section, Tcl_Interp *interp,
                 SSL_CTX_set_app_data(*ctxPtr, (void *)dc);
             }
 
-            SSL_CTX_set_session_id_context(*ctxPtr, (const unsigned char *)&nsconf.pid, sizeof(pid_t));
+            {
+                const char *ticketKeyFile = Ns_ConfigGetValue(section, "ticketkeyfile");
+
+                if (ticketKeyFile != NULL && *ticketKeyFile != '\0') {
+                    /*
+                     * Session tickets encrypted with shared keys, usable
+                     * across restarts and cluster nodes.
+                     */
+                    TicketKeysSetup(*ctxPtr, section, ticketKeyFile);
+                } else {
+                    SSL_CTX_set_session_id_context(*ctxPtr, (const unsigned char *)&nsconf.pid, sizeof(pid_t));
+                }
+            }
             SSL_CTX_set_session_cache_mode(*ctxPtr, SSL_SESS_CACHE_SERVER);
 
             SSL_CTX_set_info_callback(*ctxPtr, SSL_infoCB);
@@ -2347,6 +2453,14 @@ static void CertTableReload(void *UNUSED(arg))
         hPtr = Tcl_NextHashEntry(&search);
     }
     Ns_MasterUnlock();
+
+    TicketKeysReloadAll();
+
+    /*
+     * Cached client contexts of ns_http refer to the old certificate and CA
+     * files.
+     */
+    NsHttpClientCtxFlush();
 }
 static NS_TLS_SSL_CTX *CertTableGetCtx(const char *cert)
 {
@@ -2374,6 +2488,521 @@ static NS_TLS_SSL_CTX *CertTableGetCtx(const char *cert)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HexDigitValue --
+ *
+ *      Convert a hex character to its value.
+ *
+ * Results:
+ *      Value 0..15 or -1 for non-hex characters.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+HexDigitValue(char c)
+{
+    int result;
+
+    if (c >= '0' && c <= '9') {
+        result = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        result = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        result = c - 'A' + 10;
+    } else {
+        result = -1;
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeysLoad --
+ *
+ *      Load the session ticket keys of a key ring from its file. Every
+ *      non-empty line not starting with "#" contains a key of 80 bytes
+ *      in hex notation (key name, HMAC secret, AES key). Unless 'force'
+ *      is set, the file is only read when its modification time has
+ *      changed. The caller must hold ringPtr->lock.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR. On error, the previously loaded keys are kept.
+ *
+ * Side effects:
+ *      Replaces ringPtr->keys.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+TicketKeysLoad(TicketKeyRing *ringPtr, bool force)
+{
+    Ns_ReturnCode result = NS_OK;
+    struct stat   st;
+    FILE         *fp;
+
+    NS_NONNULL_ASSERT(ringPtr != NULL);
+
+    if (stat(ringPtr->file, &st) != 0) {
+        Ns_Log(Error, "ticketkeyfile '%s': %s", ringPtr->file, strerror(errno));
+        result = NS_ERROR;
+
+    } else if (!force && ringPtr->keys != NULL && st.st_mtime == ringPtr->mtime) {
+        /*
+         * Unchanged.
+         */
+
+    } else if ((fp = fopen(ringPtr->file, "r")) == NULL) {
+        Ns_Log(Error, "ticketkeyfile '%s': %s", ringPtr->file, strerror(errno));
+        result = NS_ERROR;
+
+    } else {
+        char       line[1024];
+        TicketKey *keys = NULL;
+        size_t     nkeys = 0u, lineNr = 0u;
+
+        while (fgets(line, (int)sizeof(line), fp) != NULL) {
+            unsigned char octets[TICKET_KEY_LENGTH];
+            char         *p = line, *end;
+            size_t        i;
+
+            lineNr++;
+            while (CHARTYPE(space, *p) != 0) {
+                p++;
+            }
+            end = p + strlen(p);
+            while (end > p && CHARTYPE(space, *(end - 1)) != 0) {
+                end--;
+            }
+            if (p == end || *p == '#') {
+                continue;
+            }
+            if ((size_t)(end - p) != 2u * TICKET_KEY_LENGTH) {
+                Ns_Log(Error, "ticketkeyfile '%s' line %" PRIuz ": expected %d hex characters",
+                       ringPtr->file, lineNr, 2 * TICKET_KEY_LENGTH);
+                result = NS_ERROR;
+                break;
+            }
+            for (i = 0u; i < TICKET_KEY_LENGTH; i++) {
+                int hi = HexDigitValue(p[2u * i]), lo = HexDigitValue(p[2u * i + 1u]);
+
+                if (hi < 0 || lo < 0) {
+                    break;
+                }
+                octets[i] = (unsigned char)((hi << 4) | lo);
+            }
+            if (i < TICKET_KEY_LENGTH) {
+                Ns_Log(Error, "ticketkeyfile '%s' line %" PRIuz ": invalid hex character",
+                       ringPtr->file, lineNr);
+                result = NS_ERROR;
+                break;
+            }
+            keys = ns_realloc(keys, (nkeys + 1u) * sizeof(TicketKey));
+            memcpy(keys[nkeys].name, octets, TICKET_KEY_NAME_LENGTH);
+            memcpy(keys[nkeys].hmacKey, octets + TICKET_KEY_NAME_LENGTH, TICKET_KEY_SECRET_LENGTH);
+            memcpy(keys[nkeys].aesKey, octets + TICKET_KEY_NAME_LENGTH + TICKET_KEY_SECRET_LENGTH,
+                   TICKET_KEY_SECRET_LENGTH);
+            OPENSSL_cleanse(octets, sizeof(octets));
+            nkeys++;
+        }
+        OPENSSL_cleanse(line, sizeof(line));
+        (void) fclose(fp);
+
+        if (result == NS_OK && nkeys == 0u) {
+            Ns_Log(Error, "ticketkeyfile '%s': no keys found", ringPtr->file);
+            result = NS_ERROR;
+        }
+        if (result == NS_OK) {
+            if (ringPtr->keys != NULL) {
+                OPENSSL_cleanse(ringPtr->keys, ringPtr->nkeys * sizeof(TicketKey));
+                ns_free(ringPtr->keys);
+            }
+            ringPtr->keys = keys;
+            ringPtr->nkeys = nkeys;
+            ringPtr->retired = 0u;
+            ringPtr->exhausted = NS_FALSE;
+            ringPtr->mtime = st.st_mtime;
+            ringPtr->epoch = ringPtr->rotate > 0 ? (long)(st.st_mtime / ringPtr->rotate) : 0;
+            Ns_Log(Notice, "ticketkeyfile '%s': loaded %" PRIuz " session ticket keys",
+                   ringPtr->file, nkeys);
+        } else if (keys != NULL) {
+            OPENSSL_cleanse(keys, nkeys * sizeof(TicketKey));
+            ns_free(keys);
+        }
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeyRingGet --
+ *
+ *      Return the key ring for the specified file, creating and loading
+ *      it on first use.
+ *
+ * Results:
+ *      TicketKeyRing or NULL, when no keys could be loaded.
+ *
+ * Side effects:
+ *      Might add an entry to the ticketKeyTable.
+ *
+ *----------------------------------------------------------------------
+ */
+static TicketKeyRing *
+TicketKeyRingGet(const char *file, long rotate)
+{
+    TicketKeyRing *ringPtr;
+    Tcl_HashEntry *hPtr;
+    int            isNew;
+
+    NS_NONNULL_ASSERT(file != NULL);
+
+    Ns_MasterLock();
+    hPtr = Tcl_CreateHashEntry(&ticketKeyTable, file, &isNew);
+    if (isNew == 0) {
+        ringPtr = Tcl_GetHashValue(hPtr);
+    } else {
+        ringPtr = ns_calloc(1u, sizeof(TicketKeyRing));
+        ringPtr->file = Tcl_GetHashKey(&ticketKeyTable, hPtr);
+        ringPtr->rotate = rotate;
+        ringPtr->slot = -1;
+        Ns_MutexInit(&ringPtr->lock);
+        Ns_MutexSetName2(&ringPtr->lock, "ns:ticketkeys", file);
+        Tcl_SetHashValue(hPtr, ringPtr);
+    }
+    Ns_MasterUnlock();
+
+    Ns_MutexLock(&ringPtr->lock);
+    if (ringPtr->keys == NULL) {
+        (void) TicketKeysLoad(ringPtr, NS_TRUE);
+    }
+    Ns_MutexUnlock(&ringPtr->lock);
+
+    return ringPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeyCurrent --
+ *
+ *      Determine the index of the key used for issuing tickets. This is
+ *      the second key of the file (the first one is the previous key),
+ *      or the only key. With a rotation interval, the current key
+ *      advances every interval since the modification time of the file,
+ *      based on the wall clock time, such that all nodes sharing the key
+ *      file switch at the same time. The rotation stops at the last key
+ *      of the file; it does not wrap around. Keys older than the
+ *      previous key are wiped from memory. On every new rotation slot,
+ *      the key file is reloaded when it was modified. The caller must
+ *      hold ringPtr->lock.
+ *
+ * Results:
+ *      Index of the current key, 0 when no keys are loaded.
+ *
+ * Side effects:
+ *      Might reload the key file and wipe retired keys.
+ *
+ *----------------------------------------------------------------------
+ */
+static size_t
+TicketKeyCurrent(TicketKeyRing *ringPtr, time_t now)
+{
+    size_t result;
+
+    NS_NONNULL_ASSERT(ringPtr != NULL);
+
+    if (ringPtr->rotate > 0) {
+        long slot = (long)(now / ringPtr->rotate);
+
+        if (slot != ringPtr->slot) {
+            ringPtr->slot = slot;
+            (void) TicketKeysLoad(ringPtr, NS_FALSE);
+        }
+    }
+    result = ringPtr->nkeys > 1u ? 1u : 0u;
+
+    if (ringPtr->rotate > 0 && ringPtr->nkeys > 0u && ringPtr->slot > ringPtr->epoch) {
+        size_t steps = (size_t)(ringPtr->slot - ringPtr->epoch);
+
+        if (result + steps >= ringPtr->nkeys - 1u) {
+            result = ringPtr->nkeys - 1u;
+            if (!ringPtr->exhausted) {
+                ringPtr->exhausted = NS_TRUE;
+                Ns_Log(Warning, "ticketkeyfile '%s': rotation reached the last key;"
+                       " the file should provide new keys", ringPtr->file);
+            }
+        } else {
+            result += steps;
+        }
+    }
+    while (ringPtr->retired + 1u < result) {
+        /*
+         * Keys before the previous key are never used again.
+         */
+        OPENSSL_cleanse(&ringPtr->keys[ringPtr->retired], sizeof(TicketKey));
+        ringPtr->retired++;
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeysSetup --
+ *
+ *      Configure an SSL_CTX to use the session ticket keys from the
+ *      specified file. The session id context is derived from the
+ *      configuration section instead of the process id, such that
+ *      sessions can be resumed after restarts and on other nodes using
+ *      the same configuration.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Registers the ticket key callback for the SSL_CTX, also when no
+ *      keys could be loaded yet; in this case, no tickets are issued
+ *      until the keys are reloaded.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+TicketKeysSetup(NS_TLS_SSL_CTX *ctx, const char *section, const char *file)
+{
+    TicketKeyRing *ringPtr;
+    Ns_Time        rotate;
+    unsigned char  sidCtx[SHA256_DIGEST_LENGTH];
+
+    NS_NONNULL_ASSERT(ctx != NULL);
+    NS_NONNULL_ASSERT(section != NULL);
+    NS_NONNULL_ASSERT(file != NULL);
+
+    Ns_ConfigTimeUnitRange(section, "ticketkeyrotate",
+                           "0s", 0, 0, LONG_MAX, 0, &rotate);
+
+    ringPtr = TicketKeyRingGet(file, (long)rotate.sec);
+
+    (void) SHA256((const unsigned char *)section, strlen(section), sidCtx);
+    SSL_CTX_set_session_id_context(ctx, sidCtx, (unsigned int)sizeof(sidCtx));
+    SSL_CTX_set_ex_data(ctx, TicketKeyRingIndex, ringPtr);
+# ifdef HAVE_OPENSSL_3
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, TicketKeyCB);
+# else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, TicketKeyCB);
+# endif
+    if (ringPtr->keys == NULL) {
+        Ns_Log(Error, "%s: no session ticket keys loaded from '%s';"
+               " no session tickets are issued until the file is reloaded",
+               section, file);
+    } else {
+        Ns_Log(Notice, "%s: using session ticket keys from '%s' (rotate %lds)",
+               section, file, ringPtr->rotate);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeysReloadAll --
+ *
+ *      Reload all session ticket key files (e.g., via "ns_certctl
+ *      reload" or SIGHUP).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Replaces the keys of all key rings.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+TicketKeysReloadAll(void)
+{
+    Tcl_HashEntry  *hPtr;
+    Tcl_HashSearch  search;
+
+    Ns_MasterLock();
+    hPtr = Tcl_FirstHashEntry(&ticketKeyTable, &search);
+    while (hPtr != NULL) {
+        TicketKeyRing *ringPtr = Tcl_GetHashValue(hPtr);
+
+        Ns_MutexLock(&ringPtr->lock);
+        (void) TicketKeysLoad(ringPtr, NS_TRUE);
+        Ns_MutexUnlock(&ringPtr->lock);
+
+        hPtr = Tcl_NextHashEntry(&search);
+    }
+    Ns_MasterUnlock();
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeyCB --
+ *
+ *      OpenSSL session ticket key callback. When issuing a ticket
+ *      (enc == 1), the current key is used; when decrypting a ticket,
+ *      the key is looked up by its name among the previous, current and
+ *      next key. The keys are taken from the SSL_CTX which registered
+ *      the callback, also when the connection was switched via SNI to
+ *      another SSL_CTX.
+ *
+ * Results:
+ *      1 on success, 2 when the ticket was decrypted with the previous
+ *      or next key (requesting a renewed ticket), 0 when the key name
+ *      is unknown or retired (full handshake) or when no keys are
+ *      loaded (no ticket is issued), -1 on error.
+ *
+ * Side effects:
+ *      Initializes the cipher and HMAC contexts; updates the ticket
+ *      statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+# ifdef HAVE_OPENSSL_3
+TicketKeyCB(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+            EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc)
+# else
+TicketKeyCB(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+            EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc)
+# endif
+{
+    TicketKeyRing *ringPtr;
+    TicketKey      key;
+    int            result = -1;
+    size_t         i, current, last;
+    bool           found = NS_FALSE;
+
+    ringPtr = SSL_get_ex_data(ssl, TicketKeySSLIndex);
+    if (ringPtr == NULL) {
+        /*
+         * The context was not switched via SNI.
+         */
+        ringPtr = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), TicketKeyRingIndex);
+    }
+    if (ringPtr == NULL) {
+        return (enc == 1) ? -1 : 0;
+    }
+
+    Ns_MutexLock(&ringPtr->lock);
+    current = TicketKeyCurrent(ringPtr, time(NULL));
+    if (ringPtr->nkeys == 0u) {
+        result = 0;
+    } else if (enc == 1) {
+        key = ringPtr->keys[current];
+        found = NS_TRUE;
+        ringPtr->stats.issued++;
+    } else {
+        last = (current + 1u < ringPtr->nkeys) ? current + 1u : current;
+        for (i = (current > 0u) ? current - 1u : 0u; i <= last; i++) {
+            if (memcmp(keyName, ringPtr->keys[i].name, TICKET_KEY_NAME_LENGTH) == 0) {
+                key = ringPtr->keys[i];
+                found = NS_TRUE;
+                if (i == current) {
+                    ringPtr->stats.resumed++;
+                    result = 1;
+                } else {
+                    ringPtr->stats.renewed++;
+                    result = 2;
+                }
+                break;
+            }
+        }
+        if (!found) {
+            ringPtr->stats.unknown++;
+            result = 0;
+        }
+    }
+    Ns_MutexUnlock(&ringPtr->lock);
+
+    if (found) {
+# ifdef HAVE_OPENSSL_3
+        OSSL_PARAM params[3];
+
+        params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+                                                      key.hmacKey, sizeof(key.hmacKey));
+        params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                     (char *)"SHA256", 0);
+        params[2] = OSSL_PARAM_construct_end();
+# endif
+        if (enc == 1) {
+            if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1
+                || EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aesKey, iv) != 1) {
+                result = -1;
+            } else {
+                memcpy(keyName, key.name, TICKET_KEY_NAME_LENGTH);
+                result = 1;
+            }
+        } else if (EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aesKey, iv) != 1) {
+            result = -1;
+        }
+        if (result > 0) {
+# ifdef HAVE_OPENSSL_3
+            if (EVP_MAC_CTX_set_params(hctx, params) != 1) {
+                result = -1;
+            }
+# else
+            if (HMAC_Init_ex(hctx, key.hmacKey, (int)sizeof(key.hmacKey), EVP_sha256(), NULL) != 1) {
+                result = -1;
+            }
+# endif
+        }
+        OPENSSL_cleanse(&key, sizeof(key));
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTlsDriverStats --
+ *
+ *      Return TLS handshake statistics of a TLS driver (nsssl, quic):
+ *      the number of completed server handshakes and the number of
+ *      resumed sessions (session cache or ticket). For other drivers,
+ *      the values are 0.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+NsTlsDriverStats(const Ns_Driver *driver, Tcl_WideInt *handshakesPtr, Tcl_WideInt *resumedPtr)
+{
+    const Driver *drvPtr = (const Driver *)driver;
+
+    NS_NONNULL_ASSERT(driver != NULL);
+    NS_NONNULL_ASSERT(handshakesPtr != NULL);
+    NS_NONNULL_ASSERT(resumedPtr != NULL);
+
+    *handshakesPtr = 0;
+    *resumedPtr = 0;
+
+    if (drvPtr->arg != NULL
+        && (STREQ(drvPtr->type, "nsssl") || STREQ(drvPtr->type, "quic"))) {
+        const NsTLSConfig *dc = drvPtr->arg;
+
+        if (dc->ctx != NULL) {
+            *handshakesPtr = (Tcl_WideInt)SSL_CTX_sess_accept_good(dc->ctx);
+            *resumedPtr = (Tcl_WideInt)SSL_CTX_sess_hits(dc->ctx);
+        }
+    }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -3402,6 +4031,80 @@ NsCertCtlReloadCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
     return result;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsCertCtlTicketKeysCmd - subcommand of NsTclCertCtlObjCmd --
+ *
+ *      Implements the "ns_certctl ticketkeys" command, returning for
+ *      every configured session ticket key file the number of keys, the
+ *      name of the current key, the rotation interval and the ticket
+ *      statistics.
+ *
+ * Results:
+ *      Standard Tcl result.
+ *
+ * Side effects:
+ *      Might reload modified key files when the rotation slot changed.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+NsCertCtlTicketKeysCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    int result = TCL_OK;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_HashEntry  *hPtr;
+        Tcl_HashSearch  search;
+        Tcl_Obj        *resultListObj = Tcl_NewListObj(0, NULL);
+        time_t          now = time(NULL);
+
+        Ns_MasterLock();
+        hPtr = Tcl_FirstHashEntry(&ticketKeyTable, &search);
+        while (hPtr != NULL) {
+            TicketKeyRing *ringPtr = Tcl_GetHashValue(hPtr);
+            Tcl_Obj       *dictObj = Tcl_NewDictObj();
+            char           nameHex[2 * TICKET_KEY_NAME_LENGTH + 1] = "";
+
+            Ns_MutexLock(&ringPtr->lock);
+            if (ringPtr->keys != NULL) {
+                size_t current = TicketKeyCurrent(ringPtr, now);
+
+                (void) Ns_HexString(ringPtr->keys[current].name, nameHex,
+                                    TICKET_KEY_NAME_LENGTH, NS_FALSE);
+            }
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("file", 4),
+                           Tcl_NewStringObj(ringPtr->file, TCL_INDEX_NONE));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("keys", 4),
+                           Tcl_NewWideIntObj((Tcl_WideInt)ringPtr->nkeys));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("current", 7),
+                           Tcl_NewStringObj(nameHex, TCL_INDEX_NONE));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("rotate", 6),
+                           Tcl_NewLongObj(ringPtr->rotate));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("issued", 6),
+                           Tcl_NewWideIntObj(ringPtr->stats.issued));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("resumed", 7),
+                           Tcl_NewWideIntObj(ringPtr->stats.resumed));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("renewed", 7),
+                           Tcl_NewWideIntObj(ringPtr->stats.renewed));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("unknown", 7),
+                           Tcl_NewWideIntObj(ringPtr->stats.unknown));
+            Ns_MutexUnlock(&ringPtr->lock);
+
+            Tcl_ListObjAppendElement(interp, resultListObj, dictObj);
+            hPtr = Tcl_NextHashEntry(&search);
+        }
+        Ns_MasterUnlock();
+
+        Tcl_SetObjResult(interp, resultListObj);
+    }
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -3431,6 +4134,7 @@ NsTclCertCtlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, T
     const Ns_SubCmdSpec subcmds[] = {
         {"list",                 NsCertCtlListCmd},
         {"reload",               NsCertCtlReloadCmd},
+        {"ticketkeys",           NsCertCtlTicketKeysCmd},
         {NULL, NULL}
     };
 
@@ -3527,6 +4231,16 @@ Ns_TLS_SSLConnect(Tcl_Interp *interp, NS_SOCKET sock, NS_TLS_SSL_CTX *ctx,
     return TCL_ERROR;
 }
 
+int
+Ns_TLS_SSLConnect2(Tcl_Interp *interp, NS_SOCKET UNUSED(sock), NS_TLS_SSL_CTX *UNUSED(ctx),
+                   const char *UNUSED(sni_hostname), const char *UNUSED(caFile), const char *UNUSED(caPath),
+                   NS_TLS_SSL_SESSION *UNUSED(session),
+                   const Ns_Time *UNUSED(timeoutPtr), NS_TLS_SSL **UNUSED(sslPtr))
+{
+    Ns_TclPrintfResult(interp, "SSLCreate failed: no support for OpenSSL built in");
+    return TCL_ERROR;
+}
+
 int
 Ns_TLS_SSLAccept(Tcl_Interp *interp, NS_SOCKET UNUSED(sock), NS_TLS_SSL_CTX *UNUSED(ctx),
                  NS_TLS_SSL **UNUSED(sslPtr))
@@ -3579,6 +4293,13 @@ NsTclCertCtlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, T
     return TCL_ERROR;
 }
 
+void
+NsTlsDriverStats(const Ns_Driver *UNUSED(driver), Tcl_WideInt *handshakesPtr, Tcl_WideInt *resumedPtr)
+{
+    *handshakesPtr = 0;
+    *resumedPtr = 0;
+}
+
 int
 Ns_TLS_CtxServerInit(const char *UNUSED(path), Tcl_Interp *UNUSED(interp),
                      unsigned int UNUSED(flags),
@@ -22,6 +22,19 @@
 
 #include "nsd.h"
 
+/*
+ * SIMD fast paths for skipping runs of characters, which need no
+ * transformation. SSE2 is part of the x86_64 baseline, NEON of
+ * aarch64.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define NS_URL_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define NS_URL_NEON 1
+#endif
+
 /*
  * The following structure defines the encoding attributes
  * of a byte.
@@ -43,9 +56,20 @@ static char *UrlDecode(Tcl_DString *dsPtr, const char *urlSegment,
                        Tcl_Encoding encoding, char percentScheme, Ns_ReturnCode *resultPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
-static TCL_SIZE_T PercentDecode(char *dest, const char *source, char percentScheme)
+static TCL_SIZE_T PercentDecode(char *dest, const char *source, size_t length, char percentScheme)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
+static size_t AlnumPrefixLength(const char *chars, size_t length)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
+static size_t PlainPrefixLength(const char *chars, size_t length)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
+#if defined(NS_URL_SSE2) || defined(NS_URL_NEON)
+static unsigned int FirstBit(uint64_t bits)
+    NS_GNUC_CONST;
+#endif
+
 static int UrlPercentDecode(NsInterp *itPtr, const char *inputStr,
                             char percentScheme, const char *charset,
                             Tcl_Obj *fallbackCharsetObj)
@@ -1350,6 +1374,178 @@ NsTclPercentDecodeObjCmd(ClientData clientData, Tcl_Interp *interp,
     return result;
 }
 
+#if defined(NS_URL_SSE2) || defined(NS_URL_NEON)
+/*
+ *----------------------------------------------------------------------
+ *
+ * FirstBit --
+ *
+ *      Return the index of the lowest bit set in the provided non-zero
+ *      value.
+ *
+ * Results:
+ *      Bit index.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static unsigned int
+FirstBit(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned int)__builtin_ctzll(bits);
+#else
+    unsigned int index = 0u;
+
+    while ((bits & 1u) == 0u) {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+#endif
+
+#if defined(NS_URL_NEON)
+/*
+ * Convert a NEON comparison result (0x00 or 0xFF per lane) into a 64-bit
+ * value with four bits per lane.
+ */
+# define NeonMatchBits(v) \
+    vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0)
+#endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AlnumPrefixLength --
+ *
+ *      Determine the number of ASCII alphanumeric characters at the
+ *      start of the provided string. These characters are not
+ *      transformed by any of the percent encoding schemes, so runs of
+ *      these can be copied in bulk. When available, 16 characters are
+ *      checked at a time.
+ *
+ * Results:
+ *      Number of characters.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static size_t
+AlnumPrefixLength(const char *chars, size_t length)
+{
+    size_t i = 0u;
+
+#if defined(NS_URL_SSE2)
+    if (length >= 16u) {
+        /*
+         * Unsigned range checks via signed comparisons: shift the
+         * lower bound of the range to -128.
+         */
+        const __m128i digitBias = _mm_set1_epi8((char)(0x80 - '0'));
+        const __m128i digitMax  = _mm_set1_epi8((char)(-128 + 10));
+        const __m128i alphaBias = _mm_set1_epi8((char)(0x80 - 'a'));
+        const __m128i alphaMax  = _mm_set1_epi8((char)(-128 + 26));
+        const __m128i lowerCase = _mm_set1_epi8(0x20);
+
+        for (; i + 16u <= length; i += 16u) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(chars + i));
+            const __m128i isDigit = _mm_cmplt_epi8(_mm_add_epi8(v, digitBias), digitMax);
+            const __m128i isAlpha = _mm_cmplt_epi8(_mm_add_epi8(_mm_or_si128(v, lowerCase), alphaBias), alphaMax);
+            unsigned int  mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha));
+
+            if (mask != 0xFFFFu) {
+                return i + FirstBit(~mask & 0xFFFFu);
+            }
+        }
+    }
+#elif defined(NS_URL_NEON)
+    if (length >= 16u) {
+        for (; i + 16u <= length; i += 16u) {
+            const uint8x16_t v = vld1q_u8((const uint8_t *)chars + i);
+            const uint8x16_t isDigit = vcltq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(10));
+            const uint8x16_t isAlpha = vcltq_u8(vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a')),
+                                                vdupq_n_u8(26));
+            uint64_t         bits = NeonMatchBits(vorrq_u8(isDigit, isAlpha));
+
+            if (bits != ~(uint64_t)0u) {
+                return i + (FirstBit(~bits) >> 2);
+            }
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        unsigned char c = UCHAR(chars[i]);
+
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+            break;
+        }
+    }
+    return i;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PlainPrefixLength --
+ *
+ *      Determine the number of characters at the start of the provided
+ *      string, which are neither '%' nor '+', i.e. which are not
+ *      changed by percent decoding. When available, 16 characters are
+ *      checked at a time.
+ *
+ * Results:
+ *      Number of characters.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static size_t
+PlainPrefixLength(const char *chars, size_t length)
+{
+    size_t i = 0u;
+
+#if defined(NS_URL_SSE2)
+    if (length >= 16u) {
+        const __m128i percent = _mm_set1_epi8('%');
+        const __m128i plus    = _mm_set1_epi8('+');
+
+        for (; i + 16u <= length; i += 16u) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(chars + i));
+            unsigned int  mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, percent),
+                                                                              _mm_cmpeq_epi8(v, plus)));
+            if (mask != 0u) {
+                return i + FirstBit(mask);
+            }
+        }
+    }
+#elif defined(NS_URL_NEON)
+    if (length >= 16u) {
+        for (; i + 16u <= length; i += 16u) {
+            const uint8x16_t v = vld1q_u8((const uint8_t *)chars + i);
+            uint64_t         bits = NeonMatchBits(vorrq_u8(vceqq_u8(v, vdupq_n_u8('%')),
+                                                           vceqq_u8(v, vdupq_n_u8('+'))));
+            if (bits != 0u) {
+                return i + (FirstBit(bits) >> 2);
+            }
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (chars[i] == '%' || chars[i] == '+') {
+            break;
+        }
+    }
+    return i;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1373,7 +1569,7 @@ UrlEncode(Tcl_DString *dsPtr, const char *urlSegment, Tcl_Encoding encoding,
 {
     TCL_SIZE_T     i, n;
     register char *q;
-    const char    *p;
+    const char    *p, *end;
     Tcl_DString    ds;
     const ByteKey *enc;
 
@@ -1384,6 +1580,7 @@ UrlEncode(Tcl_DString *dsPtr, const char *urlSegment, Tcl_Encoding encoding,
     if (encoding != NULL) {
         urlSegment = Tcl_UtfToExternalDString(encoding, urlSegment, TCL_INDEX_NONE, &ds);
     }
+    end = urlSegment + strlen(urlSegment);
 
     /*
      * Get the encoding table
@@ -1398,11 +1595,19 @@ UrlEncode(Tcl_DString *dsPtr, const char *urlSegment, Tcl_Encoding encoding,
 
     /*
      * Save old dstring length, determine and set the full required
-     * dstring length.
+     * dstring length. Runs of alphanumeric characters are never
+     * encoded and are skipped in bulk.
      */
     i = dsPtr->length;
     n = 0;
-    for (p = urlSegment; *p != '\0'; p++) {
+    for (p = urlSegment; p < end; p++) {
+        size_t run = AlnumPrefixLength(p, (size_t)(end - p));
+
+        n += (TCL_SIZE_T)run;
+        p += run;
+        if (p == end) {
+            break;
+        }
         n += enc[UCHAR(*p)].len;
     }
     Tcl_DStringSetLength(dsPtr, dsPtr->length + n);
@@ -1412,7 +1617,17 @@ UrlEncode(Tcl_DString *dsPtr, const char *urlSegment, Tcl_Encoding encoding,
      */
 
     q = dsPtr->string + i;
-    for (p = urlSegment; *p != '\0'; p++) {
+    for (p = urlSegment; p < end; p++) {
+        size_t run = AlnumPrefixLength(p, (size_t)(end - p));
+
+        if (run > 0u) {
+            memcpy(q, p, run);
+            q += run;
+            p += run;
+            if (p == end) {
+                break;
+            }
+        }
         if ((unlikely (*p == ' ' && percentScheme == 'q'))) {
             *q++ = '+';
         } else if (enc[UCHAR(*p)].str == NULL) {
@@ -1449,8 +1664,10 @@ UrlEncode(Tcl_DString *dsPtr, const char *urlSegment, Tcl_Encoding encoding,
  * PercentDecode --
  *
  *      Helper function of UrlDecode(), which performs the actual
- *      decoding. It assumes a large enough buffer in 'dest' and returns
- *      the number of decoded characters.
+ *      decoding of 'length' bytes of the NUL-terminated 'source'. It
+ *      assumes a large enough buffer in 'dest' and returns the number
+ *      of decoded characters. Runs of characters without percent
+ *      codes are copied in bulk.
  *
  * Results:
  *      Number of decoded characters.
@@ -1461,10 +1678,11 @@ UrlEncode(Tcl_DString *dsPtr, const char *urlSegment, Tcl_Encoding encoding,
  *----------------------------------------------------------------------
  */
 static TCL_SIZE_T
-PercentDecode(char *dest, const char *source, char percentScheme)
+PercentDecode(char *dest, const char *source, size_t length, char percentScheme)
 {
     register char       *q = dest;
     register const char *p = source;
+    const char          *end = source + length;
     register TCL_SIZE_T  n = 0;
     static const int hex_code[] = {
         /* 0x00 */  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
@@ -1485,9 +1703,20 @@ PercentDecode(char *dest, const char *source, char percentScheme)
         /* 0xf0 */  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
     };
 
-    while (likely(*p != '\0')) {
-        int  i, j;
-        char c1, c2 = '\0';
+    while (likely(p < end)) {
+        int    i, j;
+        char   c1, c2 = '\0';
+        size_t run = PlainPrefixLength(p, (size_t)(end - p));
+
+        if (run > 0u) {
+            memcpy(q, p, run);
+            q += run;
+            p += run;
+            n += (TCL_SIZE_T)run;
+            if (p == end) {
+                break;
+            }
+        }
 
         if (unlikely(p[0] == '%')) {
             /*
@@ -1599,7 +1828,8 @@ UrlDecode(Tcl_DString *dsPtr, const char *urlSegment, Tcl_Encoding encoding,
             memcpy(decoded, urlSegment, (size_t)offset);
             decodedLength = (TCL_SIZE_T)offset;
             dsPtr->length += decodedLength;
-            decodedLength += PercentDecode(decoded+offset, urlSegment+offset, percentScheme);
+            decodedLength += PercentDecode(decoded+offset, urlSegment+offset,
+                                           inputLength - (size_t)offset, percentScheme);
         } else {
             memcpy(decoded, urlSegment, inputLength);
             decodedLength = (TCL_SIZE_T)inputLength;
@@ -31,6 +31,12 @@ NS_EXTERN void             NsDbDriverInit(const char *server, const struct DbDri
     NS_GNUC_NONNULL(2);
 NS_EXTERN uintptr_t        NsDbGetSessionId(const Ns_DbHandle *handle) NS_GNUC_PURE
     NS_GNUC_NONNULL(1);
+NS_EXTERN void            *NsDbGetAsync(const Ns_DbHandle *handle) NS_GNUC_PURE
+    NS_GNUC_NONNULL(1);
+NS_EXTERN void             NsDbSetAsync(Ns_DbHandle *handle, void *asyncPtr)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN void             NsDbAsyncCancel(Ns_DbHandle *handle)
+    NS_GNUC_NONNULL(1);
 
 #endif
 
@@ -43,6 +43,9 @@ typedef int            (SpExecProc) (Ns_DbHandle *handle);
 typedef Ns_ReturnCode  (SpReturnCodeProc) (Ns_DbHandle *dbhandle, const char *returnCode, int bufsize);
 typedef Ns_Set *       (SpGetParamsProc) (Ns_DbHandle *handle);
 typedef Tcl_Obj*       (VersionProc) (Ns_DbHandle *handle);
+typedef Ns_ReturnCode  (ExecAsyncProc) (Ns_DbHandle *handle, const char *sql);
+typedef NS_SOCKET      (AsyncSocketProc) (Ns_DbHandle *handle);
+typedef int            (AsyncResultProc) (Ns_DbHandle *handle);
 
 
 /*
@@ -73,15 +76,40 @@ typedef struct DbDriver {
     SpReturnCodeProc *spreturncodeProc;
     SpGetParamsProc  *spgetparamsProc;
     VersionProc      *versionProc;
+    ExecAsyncProc    *execAsyncProc;
+    AsyncSocketProc  *asyncSocketProc;
+    AsyncResultProc  *asyncResultProc;
 } DbDriver;
 
+/*
+ * The following structure keeps the state of a query submitted via
+ * Ns_DbExecSubmit().  When the driver supports the asynchronous
+ * interface, completion is detected by a task in the nsdb task queue
+ * polling on the socket of the driver; otherwise, the query is
+ * executed synchronously and only the result is kept.
+ */
+
+typedef struct AsyncExec {
+    Ns_DbHandle    *handle;
+    const DbDriver *driverPtr;
+    Ns_Task        *task;
+    char           *sql;
+    Ns_Time         startTime;
+    int             status;      /* NS_PENDING, NS_DML, NS_ROWS or NS_ERROR */
+} AsyncExec;
+
 /*
  * Static variables defined in this file
  */
 
 static Tcl_HashTable driversTable;
+static Ns_TaskQueue *asyncQueue = NULL;
+static Ns_Mutex      asyncLock = NULL;
 
 static void UnsupProcId(const char *name);
+static Ns_TaskQueue *GetAsyncQueue(void) NS_GNUC_RETURNS_NONNULL;
+static void AsyncFree(AsyncExec *asyncPtr) NS_GNUC_NONNULL(1);
+static Ns_TaskProc AsyncExecProc;
 
 
 
@@ -210,6 +238,18 @@ Ns_DbRegisterDriver(const char *driver, const Ns_DbProc *procs)
             driverPtr->versionProc = (VersionProc *) procs->func;
             break;
 
+        case DbFn_ExecAsync:
+            driverPtr->execAsyncProc = (ExecAsyncProc *) procs->func;
+            break;
+
+        case DbFn_AsyncSocket:
+            driverPtr->asyncSocketProc = (AsyncSocketProc *) procs->func;
+            break;
+
+        case DbFn_AsyncResult:
+            driverPtr->asyncResultProc = (AsyncResultProc *) procs->func;
+            break;
+
 #ifdef NS_WITH_DEPRECATED
             /*
              * The following functions are no longer supported.
@@ -762,6 +802,8 @@ NsDbLoadDriver(const char *driver)
 
     if (!initialized) {
         Tcl_InitHashTable(&driversTable, TCL_STRING_KEYS);
+        Ns_MutexInit(&asyncLock);
+        Ns_MutexSetName(&asyncLock, "nsdb:async");
         initialized = NS_TRUE;
     }
 
@@ -1111,6 +1153,383 @@ Ns_DbSpGetParams(Ns_DbHandle *handle)
     return aset;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_DbAsyncCapable --
+ *
+ *      Check, whether the driver of the handle implements the
+ *      asynchronous query interface (DbFn_ExecAsync, DbFn_AsyncSocket
+ *      and DbFn_AsyncResult).
+ *
+ * Results:
+ *      Boolean value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+Ns_DbAsyncCapable(Ns_DbHandle *handle)
+{
+    const DbDriver *driverPtr;
+
+    NS_NONNULL_ASSERT(handle != NULL);
+
+    driverPtr = NsDbGetDriver(handle);
+
+    return (driverPtr != NULL
+            && driverPtr->execAsyncProc != NULL
+            && driverPtr->asyncSocketProc != NULL
+            && driverPtr->asyncResultProc != NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_DbExecSubmit --
+ *
+ *      Submit an SQL statement for execution without waiting for its
+ *      result. The result has to be collected via Ns_DbExecWait() and
+ *      Ns_DbExecResult(). This allows a single thread to run queries
+ *      on several handles concurrently.
+ *
+ *      When the driver does not support the asynchronous interface,
+ *      the statement is executed synchronously, such that the calling
+ *      code does not have to care about the capabilities of the
+ *      driver.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      SQL is sent to database for evaluation, a task watching the
+ *      driver socket is added to the nsdb task queue.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+Ns_DbExecSubmit(Ns_DbHandle *handle, const char *sql)
+{
+    const DbDriver *driverPtr;
+    AsyncExec      *asyncPtr;
+    Ns_ReturnCode   status = NS_OK;
+
+    NS_NONNULL_ASSERT(handle != NULL);
+    NS_NONNULL_ASSERT(sql != NULL);
+
+    driverPtr = NsDbGetDriver(handle);
+
+    if (!handle->connected || driverPtr == NULL) {
+        status = NS_ERROR;
+
+    } else if (NsDbGetAsync(handle) != NULL) {
+        Ns_DbSetException(handle, "NSDB",
+                          "handle has already a pending asynchronous query");
+        status = NS_ERROR;
+
+    } else {
+        asyncPtr = ns_calloc(1u, sizeof(AsyncExec));
+        asyncPtr->handle = handle;
+        asyncPtr->driverPtr = driverPtr;
+        asyncPtr->sql = ns_strdup(sql);
+        Ns_GetTime(&asyncPtr->startTime);
+
+        if (Ns_DbAsyncCapable(handle)) {
+            NS_SOCKET sock = NS_INVALID_SOCKET;
+
+            if ((*driverPtr->execAsyncProc)(handle, sql) == NS_OK) {
+                sock = (*driverPtr->asyncSocketProc)(handle);
+            }
+            if (sock == NS_INVALID_SOCKET) {
+                status = NS_ERROR;
+            } else {
+                asyncPtr->status = (int)NS_PENDING;
+                asyncPtr->task = Ns_TaskCreate(sock, AsyncExecProc, asyncPtr);
+                if (Ns_TaskEnqueue(asyncPtr->task, GetAsyncQueue()) != NS_OK) {
+                    Ns_DbSetException(handle, "NSDB",
+                                      "could not enqueue asynchronous query");
+                    (void) Ns_TaskFree(asyncPtr->task);
+                    asyncPtr->task = NULL;
+                    status = NS_ERROR;
+                }
+            }
+        } else {
+            asyncPtr->status = Ns_DbExec(handle, sql);
+        }
+
+        if (status == NS_OK) {
+            NsDbSetAsync(handle, asyncPtr);
+        } else {
+            NsDbLogSql(&asyncPtr->startTime, handle, sql);
+            AsyncFree(asyncPtr);
+        }
+    }
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_DbExecWait --
+ *
+ *      Wait until the queries submitted on the provided handles are
+ *      completed. Handles without a pending query are ignored. The
+ *      timeout is relative and applies to the full set of handles.
+ *
+ * Results:
+ *      NS_OK when all queries are completed, NS_TIMEOUT otherwise.
+ *
+ * Side effects:
+ *      Completed queries are logged, the tasks are removed from the
+ *      nsdb task queue.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+Ns_DbExecWait(Ns_DbHandle **handles, int nhandles, const Ns_Time *timeoutPtr)
+{
+    Ns_Time       atime, *toPtr = NULL;
+    Ns_ReturnCode status = NS_OK;
+    int           i;
+
+    NS_NONNULL_ASSERT(handles != NULL);
+
+    if (timeoutPtr != NULL) {
+        Ns_GetTime(&atime);
+        Ns_IncrTime(&atime, timeoutPtr->sec, timeoutPtr->usec);
+        toPtr = &atime;
+    }
+
+    for (i = 0; i < nhandles && status == NS_OK; i++) {
+        AsyncExec *asyncPtr = NsDbGetAsync(handles[i]);
+
+        if (asyncPtr != NULL && asyncPtr->task != NULL) {
+            status = Ns_TaskWait(asyncPtr->task, toPtr);
+            if (status == NS_OK) {
+                (void) Ns_TaskFree(asyncPtr->task);
+                asyncPtr->task = NULL;
+                NsDbLogSql(&asyncPtr->startTime, asyncPtr->handle, asyncPtr->sql);
+            }
+        }
+    }
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_DbExecResult --
+ *
+ *      Return the result of a query submitted via Ns_DbExecSubmit().
+ *      When the query is completed, the handle can be used for
+ *      Ns_DbBindRow() and Ns_DbGetRow() as after Ns_DbExec().
+ *
+ * Results:
+ *      NS_DML, NS_ROWS, NS_ERROR or NS_PENDING, when the query is
+ *      still running.
+ *
+ * Side effects:
+ *      Unless NS_PENDING is returned, the submitted query is cleared
+ *      from the handle.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Ns_DbExecResult(Ns_DbHandle *handle)
+{
+    AsyncExec *asyncPtr;
+    int        status;
+
+    NS_NONNULL_ASSERT(handle != NULL);
+
+    asyncPtr = NsDbGetAsync(handle);
+    if (asyncPtr == NULL) {
+        Ns_DbSetException(handle, "NSDB", "no asynchronous query submitted");
+        status = (int)NS_ERROR;
+
+    } else {
+        static const Ns_Time zeroTime = {0, 0};
+
+        if (Ns_DbExecWait(&handle, 1, &zeroTime) != NS_OK) {
+            status = (int)NS_PENDING;
+        } else {
+            status = asyncPtr->status;
+            NsDbSetAsync(handle, NULL);
+            AsyncFree(asyncPtr);
+        }
+    }
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsDbAsyncCancel --
+ *
+ *      Drop a pending asynchronous query from a handle, e.g., when the
+ *      handle is returned to the pool before the result was
+ *      collected.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      A running query is canceled via the driver.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsDbAsyncCancel(Ns_DbHandle *handle)
+{
+    AsyncExec *asyncPtr;
+
+    NS_NONNULL_ASSERT(handle != NULL);
+
+    asyncPtr = NsDbGetAsync(handle);
+    if (asyncPtr != NULL) {
+        if (asyncPtr->task != NULL) {
+            if (Ns_TaskCompleted(asyncPtr->task)) {
+                (void) Ns_TaskWait(asyncPtr->task, NULL);
+            } else {
+                (void) Ns_TaskCancel(asyncPtr->task);
+                Ns_TaskWaitCompleted(asyncPtr->task);
+                (void) Ns_DbCancel(handle);
+            }
+            (void) Ns_TaskFree(asyncPtr->task);
+            asyncPtr->task = NULL;
+        }
+        Ns_Log(Ns_LogSqlDebug, "dbdrv: drop pending asynchronous query '%s'",
+               asyncPtr->sql);
+        NsDbSetAsync(handle, NULL);
+        AsyncFree(asyncPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AsyncExecProc --
+ *
+ *      Task callback watching the socket of a driver with a pending
+ *      asynchronous query. On every read event the driver is asked to
+ *      consume the available input; the task is done, as soon the
+ *      driver reports a final result.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the status in the AsyncExec structure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AsyncExecProc(Ns_Task *task, NS_SOCKET UNUSED(sock), void *arg, Ns_SockState why)
+{
+    AsyncExec *asyncPtr = arg;
+
+    switch (why) {
+    case NS_SOCK_INIT:
+        Ns_TaskCallback(task, NS_SOCK_READ, NULL);
+        break;
+
+    case NS_SOCK_READ: {
+        int status = (*asyncPtr->driverPtr->asyncResultProc)(asyncPtr->handle);
+
+        if (status != (int)NS_PENDING) {
+            asyncPtr->status = status;
+            Ns_TaskDone(task);
+        }
+        break;
+    }
+
+    case NS_SOCK_DONE:
+        break;
+
+    case NS_SOCK_CANCEL:    NS_FALL_THROUGH; /* fall through */
+    case NS_SOCK_EXIT:      NS_FALL_THROUGH; /* fall through */
+    case NS_SOCK_EXCEPTION: NS_FALL_THROUGH; /* fall through */
+    case NS_SOCK_TIMEOUT:   NS_FALL_THROUGH; /* fall through */
+    case NS_SOCK_WRITE:     NS_FALL_THROUGH; /* fall through */
+    case NS_SOCK_AGAIN:     NS_FALL_THROUGH; /* fall through */
+    case NS_SOCK_NONE:
+        asyncPtr->status = (int)NS_ERROR;
+        Ns_TaskDone(task);
+        break;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetAsyncQueue --
+ *
+ *      Return the task queue for asynchronous queries and create it on
+ *      first usage.
+ *
+ * Results:
+ *      Task queue.
+ *
+ * Side effects:
+ *      Might start the task queue thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_TaskQueue *
+GetAsyncQueue(void)
+{
+    Ns_MutexLock(&asyncLock);
+    if (asyncQueue == NULL) {
+        asyncQueue = Ns_CreateTaskQueue("nsdb");
+    }
+    Ns_MutexUnlock(&asyncLock);
+
+    return asyncQueue;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AsyncFree --
+ *
+ *      Free the AsyncExec structure.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees memory.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AsyncFree(AsyncExec *asyncPtr)
+{
+    ns_free(asyncPtr->sql);
+    ns_free(asyncPtr);
+}
+
 /*
  * Local Variables:
  * mode: c
@@ -83,6 +83,7 @@ typedef struct Handle {
     bool            stale;
     bool            used;
     bool            active;
+    void           *asyncPtr;        /* pending asynchronous query */
 } Handle;
 
 /*
@@ -292,6 +293,7 @@ Ns_DbPoolPutHandle(Ns_DbHandle *handle)
      * Cleanup the handle.
      */
 
+    NsDbAsyncCancel(handle);
     (void) Ns_DbFlush(handle);
     (void) Ns_DbResetHandle(handle);
 
@@ -914,6 +916,7 @@ NsDbDisconnect(Ns_DbHandle *handle)
     NS_NONNULL_ASSERT(handle != NULL);
 
     handlePtr = (Handle *) handle;
+    NsDbAsyncCancel(handle);
     (void)NsDbClose(handle);
 
     handlePtr->connected = NS_FALSE;
@@ -1421,6 +1424,7 @@ CreatePool(const char *pool, const char *section, const char *driver)
             Tcl_DStringInit(&handlePtr->dsExceptionMsg);
             handlePtr->poolPtr = poolPtr;
             handlePtr->connection = NULL;
+            handlePtr->asyncPtr = NULL;
             handlePtr->connected = NS_FALSE;
             handlePtr->fetchingRows = NS_FALSE;
             handlePtr->row = Ns_SetCreate(NS_SET_NAME_DB);
@@ -1641,6 +1645,39 @@ NsDbGetSessionId(const Ns_DbHandle *handle)
     return ((const Handle *)handle)->sessionId;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsDbGetAsync, NsDbSetAsync --
+ *
+ *      Query or modify the pending asynchronous query of a handle
+ *      (see Ns_DbExecSubmit).
+ *
+ * Results:
+ *      Opaque pointer or NULL, when no query is pending.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+void *
+NsDbGetAsync(const Ns_DbHandle *handle)
+{
+    NS_NONNULL_ASSERT(handle != NULL);
+
+    return ((const Handle *)handle)->asyncPtr;
+}
+
+void
+NsDbSetAsync(Ns_DbHandle *handle, void *asyncPtr)
+{
+    NS_NONNULL_ASSERT(handle != NULL);
+
+    ((Handle *)handle)->asyncPtr = asyncPtr;
+}
+
 
 /*
  *----------------------------------------------------------------------
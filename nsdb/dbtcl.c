@@ -50,6 +50,9 @@ static void EnterDbHandle(InterpData *idataPtr, Tcl_Interp *interp, Ns_DbHandle
 static int DbGetHandle(InterpData *idataPtr, Tcl_Interp *interp, const char *handleId,
                        Ns_DbHandle **handle, Tcl_HashEntry **hPtrPtr);
 
+static int DbCheckNotPending(Tcl_Interp *interp, Ns_DbHandle *handle, const char *cmd)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
 static Ns_ReturnCode QuoteSqlValue(Tcl_DString *dsPtr, Tcl_Obj *valueObj, int valueType)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
@@ -345,10 +348,12 @@ DbObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *co
         SP_SETPARAM,
         SP_START,
         STATS,
-        USER
+        SUBMIT,
+        USER,
 #ifdef NS_WITH_DEPRECATED
-        ,VERBOSE
+        VERBOSE,
 #endif
+        WAIT
     };
 
     static const char *const subcmd[] = {
@@ -389,10 +394,12 @@ DbObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *co
         "sp_setparam",
         "sp_start",
         "stats",
+        "submit",
         "user",
 #ifdef NS_WITH_DEPRECATED
         "verbose",
 #endif
+        "wait",
         NULL
     };
 
@@ -639,6 +646,28 @@ DbObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *co
         if (DbGetHandle(idataPtr, interp, Tcl_GetString(objv[2]), &handlePtr, &hPtr) != TCL_OK) {
             return TCL_ERROR;
         }
+
+        /*
+         * While an asynchronous query is pending, only commands not
+         * touching the connection and "cancel" are allowed.
+         */
+        switch (cmd) {
+        case BINDROW:        NS_FALL_THROUGH; /* fall through */
+        case DISCONNECT:     NS_FALL_THROUGH; /* fall through */
+        case FLUSH:          NS_FALL_THROUGH; /* fall through */
+        case RELEASEHANDLE:  NS_FALL_THROUGH; /* fall through */
+        case RESETHANDLE:    NS_FALL_THROUGH; /* fall through */
+        case ROWCOUNT:       NS_FALL_THROUGH; /* fall through */
+        case SP_EXEC:        NS_FALL_THROUGH; /* fall through */
+        case SP_GETPARAMS:   NS_FALL_THROUGH; /* fall through */
+        case SP_RETURNCODE:
+            if (DbCheckNotPending(interp, handlePtr, Tcl_GetString(objv[1])) != TCL_OK) {
+                return TCL_ERROR;
+            }
+            break;
+        default:
+            break;
+        }
         Tcl_DStringFree(&handlePtr->dsExceptionMsg);
         handlePtr->cExceptionCode[0] = '\0';
 
@@ -676,6 +705,11 @@ DbObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *co
             break;
 
         case CANCEL:
+            /*
+             * Drop a pending asynchronous query before canceling the
+             * statement in the driver.
+             */
+            NsDbAsyncCancel(handlePtr);
             if (Ns_DbCancel(handlePtr) != NS_OK) {
                 result = DbFail(interp, handlePtr, Tcl_GetString(objv[1]));
             }
@@ -792,6 +826,7 @@ DbObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *co
     case ONE_ROW:           NS_FALL_THROUGH; /* fall through */
     case SELECT:            NS_FALL_THROUGH; /* fall through */
     case SP_START:          NS_FALL_THROUGH; /* fall through */
+    case SUBMIT:            NS_FALL_THROUGH; /* fall through */
     case ZERO_OR_ONE_ROW:
         {
             const char *value;
@@ -818,7 +853,8 @@ DbObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *co
                 return TCL_ERROR;
             }
 
-            if (DbGetHandle(idataPtr, interp, Tcl_GetString(objv[2]), &handlePtr, &hPtr) != TCL_OK) {
+            if (DbGetHandle(idataPtr, interp, Tcl_GetString(objv[2]), &handlePtr, &hPtr) != TCL_OK
+                || DbCheckNotPending(interp, handlePtr, Tcl_GetString(objv[1])) != TCL_OK) {
                 return TCL_ERROR;
             }
             Tcl_DStringFree(&handlePtr->dsExceptionMsg);
@@ -892,6 +928,12 @@ DbObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *co
                 }
                 break;
 
+            case SUBMIT:
+                if (Ns_DbExecSubmit(handlePtr, value) != NS_OK) {
+                    result = DbFail(interp, handlePtr, Tcl_GetString(objv[1]));
+                }
+                break;
+
             case SP_START:
                 if (Ns_DbSpStart(handlePtr, value) != NS_OK) {
                     result = DbFail(interp, handlePtr, Tcl_GetString(objv[1]));
@@ -965,6 +1007,63 @@ DbObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *co
         break;
 #endif
 
+    case WAIT:
+        {
+            TCL_SIZE_T   nargs = 0;
+            Ns_Time     *timeoutPtr = NULL;
+            char        *idString = NULL;
+            Ns_ObjvSpec  opts[] = {
+                {"-timeout", Ns_ObjvTime,  &timeoutPtr, NULL},
+                {"--",       Ns_ObjvBreak,  NULL,       NULL},
+                {NULL, NULL, NULL, NULL}
+            };
+            Ns_ObjvSpec  args[] = {
+                {"handle",   Ns_ObjvString, &idString, NULL},
+                {"?handle",  Ns_ObjvArgs,   &nargs,    NULL},
+                {NULL, NULL, NULL, NULL}
+            };
+
+            if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+                result = TCL_ERROR;
+            } else {
+                Ns_DbHandle **handles;
+                TCL_SIZE_T    i, nhandles = nargs + 1;
+                Tcl_Obj      *listObj;
+
+                handles = ns_calloc((size_t)nhandles, sizeof(Ns_DbHandle *));
+                for (i = 0; i < nhandles && result == TCL_OK; i++) {
+                    result = DbGetHandle(idataPtr, interp,
+                                         Tcl_GetString(objv[objc - nhandles + i]),
+                                         &handles[i], NULL);
+                }
+
+                if (result == TCL_OK
+                    && Ns_DbExecWait(handles, (int)nhandles, timeoutPtr) != NS_OK) {
+                    Ns_TclPrintfResult(interp, "timeout waiting for asynchronous queries");
+                    Tcl_SetErrorCode(interp, "NS_TIMEOUT", NS_SENTINEL);
+                    result = TCL_ERROR;
+                }
+
+                if (result == TCL_OK) {
+                    listObj = Tcl_NewListObj(0, NULL);
+                    for (i = 0; i < nhandles; i++) {
+                        const char *statusString;
+
+                        switch (Ns_DbExecResult(handles[i])) {
+                        case NS_DML:  statusString = "NS_DML"; break;
+                        case NS_ROWS: statusString = "NS_ROWS"; break;
+                        default:      statusString = "NS_ERROR"; break;
+                        }
+                        Tcl_ListObjAppendElement(interp, listObj,
+                                                 Tcl_NewStringObj(statusString, TCL_INDEX_NONE));
+                    }
+                    Tcl_SetObjResult(interp, listObj);
+                }
+                ns_free(handles);
+            }
+        }
+        break;
+
     case SETEXCEPTION:
         if (objc != 5) {
             Tcl_WrongNumArgs(interp, 2, objv, "/handle/ /code/ /message/");
@@ -1480,6 +1579,43 @@ DbGetHandle(InterpData *idataPtr, Tcl_Interp *interp, const char *handleId, Ns_D
     return result;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ * DbCheckNotPending --
+ *
+ *      Check that the handle has no pending asynchronous query (see
+ *      "ns_db submit"). Such a handle must not be used for other
+ *      operations until the result was collected via "ns_db wait" or
+ *      the query was dropped via "ns_db cancel".
+ *
+ * Results:
+ *      Return TCL_OK if no query is pending or TCL_ERROR otherwise.
+ *
+ * Side effects:
+ *      Sets an error message in the interp in the error case.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DbCheckNotPending(Tcl_Interp *interp, Ns_DbHandle *handle, const char *cmd)
+{
+    int result = TCL_OK;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(handle != NULL);
+    NS_NONNULL_ASSERT(cmd != NULL);
+
+    if (NsDbGetAsync(handle) != NULL) {
+        Ns_TclPrintfResult(interp, "Database operation \"%s\" not allowed:"
+                           " handle has a pending asynchronous query", cmd);
+        Tcl_SetErrorCode(interp, "NSDB", "PENDING", NS_SENTINEL);
+        result = TCL_ERROR;
+    }
+    return result;
+}
+
 
 /*
  *----------------------------------------------------------------------
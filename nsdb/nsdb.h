@@ -29,6 +29,7 @@ typedef enum {
     NS_ROWS =             ( 2),
     NS_END_DATA =         ( 4),
     NS_NO_DATA =          ( 8),
+    NS_PENDING =          (16), /* asynchronous query still running */
     NSDB_OK =             (NS_OK), /* success */
     NSDB_ERROR =          (NS_ERROR) /* error */
 } NsDb_ReturnCode;
@@ -58,12 +59,20 @@ typedef enum {
     DbFn_SpGetParams,
     DbFn_GetRowCount,
     DbFn_Version,
+    /*
+     * The three ids after DbFn_Version belong to the deprecated functions
+     * below, independent of NS_WITH_DEPRECATED, such that the ids of the
+     * asynchronous functions do not depend on this setting.
+     */
+    DbFn_ExecAsync = DbFn_Version + 4,
+    DbFn_AsyncSocket,
+    DbFn_AsyncResult,
+    DbFn_End,
 #ifdef NS_WITH_DEPRECATED
-    DbFn_GetTableInfo,
+    DbFn_GetTableInfo = DbFn_Version + 1,
     DbFn_TableList,
     DbFn_BestRowId,
 #endif
-    DbFn_End,
 } Ns_DbProcId;
 
 /*
@@ -147,6 +156,12 @@ NS_EXTERN int           Ns_DbSpExec(Ns_DbHandle *handle)                  NS_GNU
 NS_EXTERN Ns_ReturnCode Ns_DbSpReturnCode(Ns_DbHandle *handle, const char *returnCode, int bufsize)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 NS_EXTERN Ns_Set       *Ns_DbSpGetParams(Ns_DbHandle *handle)             NS_GNUC_NONNULL(1);
+NS_EXTERN bool          Ns_DbAsyncCapable(Ns_DbHandle *handle)            NS_GNUC_NONNULL(1);
+NS_EXTERN Ns_ReturnCode Ns_DbExecSubmit(Ns_DbHandle *handle, const char *sql)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+NS_EXTERN Ns_ReturnCode Ns_DbExecWait(Ns_DbHandle **handles, int nhandles, const Ns_Time *timeoutPtr)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN int           Ns_DbExecResult(Ns_DbHandle *handle)              NS_GNUC_NONNULL(1);
 
 /*
  * dbinit.c:
@@ -33,6 +33,20 @@ static int            Exec(const Ns_DbHandle *handle, char *sql) NS_GNUC_NONNULL
 static int            GetRow(Ns_DbHandle *handle, Ns_Set *row) NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 static Ns_ReturnCode  Flush(Ns_DbHandle *handle) NS_GNUC_NONNULL(1);
 static Ns_ReturnCode  ResetHandle(Ns_DbHandle *handle) NS_GNUC_NONNULL(1);
+static Ns_ReturnCode  ExecAsync(Ns_DbHandle *handle, char *sql) NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static NS_SOCKET      AsyncSocket(const Ns_DbHandle *handle) NS_GNUC_NONNULL(1);
+static int            AsyncResult(const Ns_DbHandle *handle) NS_GNUC_NONNULL(1);
+
+/*
+ * The following structure is used as "connection" of a handle. The
+ * socket pair mimics the socket of a real database connection for the
+ * asynchronous interface.
+ */
+
+typedef struct Connection {
+    NS_SOCKET sockets[2];
+    int       status;
+} Connection;
 
 /*
  * Local variables defined in this file.
@@ -49,6 +63,9 @@ static const Ns_DbProc procs[] = {
     {DbFn_Flush,        (ns_funcptr_t)Flush},
     {DbFn_Cancel,       (ns_funcptr_t)Flush},
     {DbFn_ResetHandle,  (ns_funcptr_t)ResetHandle},
+    {DbFn_ExecAsync,    (ns_funcptr_t)ExecAsync},
+    {DbFn_AsyncSocket,  (ns_funcptr_t)AsyncSocket},
+    {DbFn_AsyncResult,  (ns_funcptr_t)AsyncResult},
     {(Ns_DbProcId)0, NULL}
 };
 
@@ -118,9 +135,21 @@ DbType(Ns_DbHandle *UNUSED(handle))
  */
 
 static Ns_ReturnCode
-OpenDb(Ns_DbHandle *UNUSED(handle))
+OpenDb(Ns_DbHandle *handle)
 {
-    return NS_OK;
+    Connection   *connPtr;
+    Ns_ReturnCode status = NS_OK;
+
+    connPtr = ns_calloc(1u, sizeof(Connection));
+    if (ns_sockpair(connPtr->sockets) != 0) {
+        Ns_Log(Error, "nsdbtest: ns_sockpair() failed: %s",
+               ns_sockstrerror(ns_sockerrno));
+        ns_free(connPtr);
+        status = NS_ERROR;
+    } else {
+        handle->connection = connPtr;
+    }
+    return status;
 }
 
 
@@ -141,8 +170,16 @@ OpenDb(Ns_DbHandle *UNUSED(handle))
  */
 
 static Ns_ReturnCode
-CloseDb(Ns_DbHandle *UNUSED(handle))
+CloseDb(Ns_DbHandle *handle)
 {
+    Connection *connPtr = handle->connection;
+
+    if (connPtr != NULL) {
+        ns_sockclose(connPtr->sockets[0]);
+        ns_sockclose(connPtr->sockets[1]);
+        ns_free(connPtr);
+        handle->connection = NULL;
+    }
     return NS_OK;
 }
 
@@ -287,6 +324,97 @@ ResetHandle(Ns_DbHandle *UNUSED(handle))
     return NS_OK;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExecAsync --
+ *
+ *      Submit an SQL statement without waiting for the result. The
+ *      statement is evaluated immediately, the result is signaled by
+ *      making the connection socket readable.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      Writes to the socket pair of the connection.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+ExecAsync(Ns_DbHandle *handle, char *sql)
+{
+    Connection   *connPtr = handle->connection;
+    Ns_ReturnCode status = NS_OK;
+
+    connPtr->status = Exec(handle, sql);
+    if (ns_send(connPtr->sockets[1], "", 1, 0) != 1) {
+        status = NS_ERROR;
+    }
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AsyncSocket --
+ *
+ *      Return the socket to be polled for the result of a submitted
+ *      statement.
+ *
+ * Results:
+ *      Socket.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static NS_SOCKET
+AsyncSocket(const Ns_DbHandle *handle)
+{
+    const Connection *connPtr = handle->connection;
+
+    return connPtr->sockets[0];
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AsyncResult --
+ *
+ *      Consume input from the connection socket and return the result
+ *      of the submitted statement.
+ *
+ * Results:
+ *      NS_ROWS, NS_DML, NS_ERROR or NS_PENDING.
+ *
+ * Side effects:
+ *      Reads from the socket pair of the connection.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+AsyncResult(const Ns_DbHandle *handle)
+{
+    const Connection *connPtr = handle->connection;
+    char              c;
+    int               result;
+
+    if (ns_recv(connPtr->sockets[0], &c, 1, 0) == 1) {
+        result = connPtr->status;
+    } else {
+        result = (int)NS_PENDING;
+    }
+    return result;
+}
+
 /*
  * Local Variables:
  * mode: c
@@ -43,6 +43,16 @@ NS_EXPORT const int Ns_ModuleVersion = 1;
 #include "../nsd/nsopenssl.h"
 
 #define NSSSL_VERSION  "2.3"
+
+/*
+ * Kernel TLS offload (kTLS) requires OpenSSL 3 compiled with "enable-ktls"
+ * and a kernel providing the "tls" ULP. When available, OpenSSL switches
+ * the socket to kernel encryption after the handshake, and file bodies can
+ * be sent via sendfile().
+ */
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+# define NS_HAVE_KTLS 1
+#endif
 
 typedef struct {
     SSL         *ssl;
@@ -57,10 +67,13 @@ static Ns_DriverListenProc Listen;
 static Ns_DriverAcceptProc Accept;
 static Ns_DriverRecvProc Recv;
 static Ns_DriverSendProc Send;
+static Ns_DriverSendFileProc SendFile;
 static Ns_DriverKeepProc Keep;
 static Ns_DriverConnInfoProc ConnInfo;
+static Tcl_Obj *KtlsStatusObj(SSL *ssl);
 static Ns_DriverCloseProc Close;
 static Ns_DriverClientInitProc ClientInit;
+static Ns_DriverHandshakeProc Handshake;
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 static void SSLLock(int mode, int n, const char *file, int line);
@@ -132,19 +145,21 @@ Ns_ModuleInit(const char *server, const char *module)
     dc->u.h1.nodelay       = Ns_ConfigBool(section, "nodelay", NS_TRUE);
     dc->u.h1.h3advertise   = Ns_ConfigBool(section, "h3advertise", NS_FALSE);
     dc->u.h1.h3persist     = Ns_ConfigBool(section, "h3persist", NS_TRUE);
+    dc->u.h1.ktls          = Ns_ConfigBool(section, "ktls", NS_FALSE);
 
-    init.version = NS_DRIVER_VERSION_5;
+    init.version = NS_DRIVER_VERSION_7;
     init.name = "nsssl";
     init.listenProc = Listen;
     init.acceptProc = Accept;
     init.recvProc = Recv;
     init.sendProc = Send;
-    init.sendFileProc = NULL;
+    init.sendFileProc = SendFile;
     init.keepProc = Keep;
     init.connInfoProc = ConnInfo;
     init.requestProc = NULL;
     init.closeProc = Close;
     init.clientInitProc = ClientInit;
+    init.handshakeProc = Handshake;
     init.opts = NS_DRIVER_SSL|NS_DRIVER_ASYNC;
     init.arg = dc;
     init.path = section;
@@ -187,6 +202,12 @@ Ns_ModuleInit(const char *server, const char *module)
     }
 
     if (result != NS_ERROR) {
+#ifndef NS_HAVE_KTLS
+        if (dc->u.h1.ktls) {
+            Ns_Log(Warning, "nsssl: ktls requested, but OpenSSL was built without kTLS support");
+            dc->u.h1.ktls = NS_FALSE;
+        }
+#endif
         Ns_Log(Notice, "nsssl: OpenSSL %s initialized", SSLeay_version(SSLEAY_VERSION));
         Ns_Log(Notice, "nsssl: version %s loaded, based on %s",
                NSSSL_VERSION, init.libraryVersion);
@@ -297,6 +318,15 @@ Accept(Ns_Sock *sock, NS_SOCKET listensock, struct sockaddr *sockaddrPtr, sockle
             sock->arg = sslCtx;
             SSL_set_fd(sslCtx->ssl, sock->sock);
             SSL_set_accept_state(sslCtx->ssl);
+#ifdef NS_HAVE_KTLS
+            if (dc->u.h1.ktls) {
+                /*
+                 * Set on the SSL object rather than on the SSL_CTX, such that
+                 * the option survives a context switch via SNI.
+                 */
+                SSL_set_options(sslCtx->ssl, SSL_OP_ENABLE_KTLS);
+            }
+#endif
 
             port = Ns_SockGetPort(sock);           /* precise local port */
             if ((unsigned short)(((Driver*)(sock->driver))->listenfd[0]) != port) {
@@ -312,6 +342,68 @@ Accept(Ns_Sock *sock, NS_SOCKET listensock, struct sockaddr *sockaddrPtr, sockle
     return NS_DRIVER_ACCEPT_ERROR;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Handshake --
+ *
+ *      Perform a nonblocking step of the TLS handshake of an accepted
+ *      socket. This function is called from the handshake threads of the
+ *      driver, when "handshakethreads" is configured.
+ *
+ * Results:
+ *      NS_DRIVER_HANDSHAKE_DONE, NS_DRIVER_HANDSHAKE_WANT_READ,
+ *      NS_DRIVER_HANDSHAKE_WANT_WRITE or NS_DRIVER_HANDSHAKE_ERROR.
+ *
+ * Side effects:
+ *      Marks the socket in error state when the handshake fails, such that
+ *      no SSL_shutdown() is attempted on close.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static NS_DRIVER_HANDSHAKE_STATUS
+Handshake(Ns_Sock *sock)
+{
+    const NssslSockCtx        *sslCtx = sock->arg;
+    NS_DRIVER_HANDSHAKE_STATUS status;
+
+    if (sslCtx == NULL) {
+        status = NS_DRIVER_HANDSHAKE_ERROR;
+
+    } else if (SSL_is_init_finished(sslCtx->ssl)) {
+        status = NS_DRIVER_HANDSHAKE_DONE;
+
+    } else {
+        int rc;
+
+        ERR_clear_error();
+        rc = SSL_do_handshake(sslCtx->ssl);
+        if (rc == 1) {
+            status = NS_DRIVER_HANDSHAKE_DONE;
+        } else {
+            int sslerr = SSL_get_error(sslCtx->ssl, rc);
+
+            if (sslerr == SSL_ERROR_WANT_READ) {
+                status = NS_DRIVER_HANDSHAKE_WANT_READ;
+            } else if (sslerr == SSL_ERROR_WANT_WRITE) {
+                status = NS_DRIVER_HANDSHAKE_WANT_WRITE;
+            } else {
+                unsigned long errorCode = ERR_get_error();
+
+                Ns_Log(Debug, "nsssl: handshake failed on sock %d: SSL error %d %s",
+                       sock->sock, sslerr,
+                       errorCode != 0u ? ERR_error_string(errorCode, NULL) : NS_EMPTY_STRING);
+                Ns_SockSetReceiveState(sock, NS_SOCK_EXCEPTION, errorCode);
+                status = NS_DRIVER_HANDSHAKE_ERROR;
+            }
+        }
+    }
+
+    return status;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -492,6 +584,39 @@ Send(Ns_Sock *sock, const struct iovec *bufs, int nbufs, unsigned int UNUSED(fla
     return sent;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SendFile --
+ *
+ *      Send a vector of buffers/files. When the kernel performs the TLS
+ *      encryption for this socket (kTLS), file ranges are sent via
+ *      sendfile() without copying the data to user space. Otherwise, the
+ *      file content is read into memory and encrypted via Send().
+ *
+ * Results:
+ *      Number of bytes sent, -1 on error.
+ *
+ * Side effects:
+ *      May block reading data from disk.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ssize_t
+SendFile(Ns_Sock *sock, Ns_FileVec *bufs, int nbufs, unsigned int flags)
+{
+#ifdef NS_HAVE_KTLS
+    const NssslSockCtx *sslCtx = sock->arg;
+
+    if (sslCtx != NULL && BIO_get_ktls_send(SSL_get_wbio(sslCtx->ssl))) {
+        flags |= NS_DRIVER_CAN_USE_SENDFILE;
+    }
+#endif
+    return Ns_SockSendFileBufs(sock, bufs, nbufs, flags);
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -527,6 +652,43 @@ Keep(Ns_Sock *sock)
     return NS_FALSE;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * KtlsStatusObj --
+ *
+ *      Report the directions in which the kernel performs the TLS
+ *      encryption (kTLS) for the given SSL connection.
+ *
+ * Results:
+ *      Tcl list containing "send" and/or "recv"; the list is empty, when
+ *      kTLS is not active.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj*
+KtlsStatusObj(SSL *ssl)
+{
+    Tcl_Obj *listObj = Tcl_NewListObj(0, NULL);
+
+#ifdef NS_HAVE_KTLS
+    if (BIO_get_ktls_send(SSL_get_wbio(ssl))) {
+        Tcl_ListObjAppendElement(NULL, listObj, Tcl_NewStringObj("send", 4));
+    }
+    if (BIO_get_ktls_recv(SSL_get_rbio(ssl))) {
+        Tcl_ListObjAppendElement(NULL, listObj, Tcl_NewStringObj("recv", 4));
+    }
+#else
+    (void)ssl;
+#endif
+    return listObj;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -564,6 +726,9 @@ ConnInfo(Ns_Sock *sock)
         Tcl_DictObjPut(NULL, resultObj,
                        Tcl_NewStringObj("servername", 10),
                        Tcl_NewStringObj(SSL_get_servername(sslCtx->ssl, TLSEXT_NAMETYPE_host_name), TCL_INDEX_NONE));
+        Tcl_DictObjPut(NULL, resultObj,
+                       Tcl_NewStringObj("ktls", 4),
+                       KtlsStatusObj(sslCtx->ssl));
     }
 
     return resultObj;
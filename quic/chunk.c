@@ -19,14 +19,19 @@
  * -------
  * Provide a tiny, allocation-efficient payload container (Chunk) and a
  * singly-linked FIFO (ChunkQueue) used by higher layers (e.g., HTTP/3 TX).
- * Payload bytes live inline, immediately after the Chunk header, so a
- * single allocation holds both metadata and data.
+ * Payload bytes of CH_DATA chunks live inline, immediately after the
+ * Chunk header, so a single allocation holds both metadata and data.
+ * CH_FILE chunks stand for a file range of arbitrary size but hold only
+ * a bounded window of it (CHUNK_FILE_WINDOW bytes), which is read with
+ * pread() from a private descriptor and refilled whenever the window has
+ * been consumed.
  *
  * Data Structures
  * ---------------
  * - Chunk:
- *     * kind     : CH_DATA (payload-bearing node)
- *     * p,len    : current read pointer and remaining bytes
+ *     * kind     : CH_DATA (inline payload) or CH_FILE (file window)
+ *     * p,len    : current read pointer and remaining bytes (of the
+ *                  window for CH_FILE chunks)
  *     * next     : forward link (singly-linked)
  * - ChunkQueue:
  *     * head/tail: ends of the FIFO
@@ -37,9 +42,13 @@
  * ------------------------------
  * - ChunkAlloc(sz)      : allocate node + inline buffer (uninitialized)
  * - ChunkInit(buf, sz)  : allocate and memcpy() payload
+ * - ChunkInitFile(..)   : file range chunk, reads the first window
+ * - ChunkRefill(ch)     : read the next window of a consumed CH_FILE chunk
+ * - ChunkFree(ch)       : close the file descriptor (if any), free the node
  * - ChunkEnqueue(q, ch) : append node; unread += ch->len
  * - ChunkQueueTrim(q,n) : remove up to n bytes from head (may shrink the
- *                         head by advancing p/len or free whole nodes)
+ *                         head by advancing p/len, refill a CH_FILE
+ *                         window, or free whole nodes)
  * - ChunkQueueClear(q)  : drop all nodes (trim SIZE_MAX)
  * - ChunkQueueMove(s,d,m):
  *                         relink whole nodes from src->dst until >= m bytes
@@ -54,8 +63,8 @@
  * Memory Model
  * ------------
  * Nodes are obtained via ns_malloc(sizeof(Chunk) + payload) and freed by
- * trim/clear paths. Moving between queues relinks nodes (no copies).
- * Trimming advances p/len on the head or frees it entirely.
+ * trim/clear paths via ChunkFree(). Moving between queues relinks nodes
+ * (no copies). Trimming advances p/len on the head or frees it entirely.
  *
  * Typical Use (TX path)
  * ---------------------
@@ -89,7 +98,7 @@
  *
  * Side effects:
  *      Calls ns_malloc(sizeof(Chunk) + sz); ChunkInit also memcpy()s.
- *      No locking/logging. Caller frees with ns_free(). Requires
+ *      No locking/logging. Caller frees with ChunkFree(). Requires
  *      'buffer' non-NULL when sz > 0.
  *
  *----------------------------------------------------------------------
@@ -104,6 +113,10 @@ ChunkAlloc(size_t sz)
       ch->p    = (uint8_t *)(ch + 1);
       ch->len  = sz;
       ch->next = NULL;
+      ch->fd        = NS_INVALID_FD;
+      ch->file_off  = 0;
+      ch->file_left = 0u;
+      ch->window    = 0u;
     }
     return ch;
 }
@@ -118,6 +131,125 @@ ChunkInit(const char *buffer, size_t sz)
     return ch;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ChunkInitFile --
+ *
+ *      Build a CH_FILE chunk for 'sz' bytes of the file 'fd' starting at
+ *      'offset'. The chunk works on a duplicate of 'fd', so the caller
+ *      may close its descriptor, and holds at most CHUNK_FILE_WINDOW
+ *      bytes of the range in memory. The first window is read
+ *      immediately.
+ *
+ * Results:
+ *      Chunk* on success; NULL when the descriptor cannot be duplicated,
+ *      on allocation failure, or when the first window cannot be read.
+ *
+ * Side effects:
+ *      Calls dup(), ns_malloc() and pread().
+ *
+ *----------------------------------------------------------------------
+ */
+Chunk *
+ChunkInitFile(int fd, off_t offset, size_t sz)
+{
+    Chunk *ch = NULL;
+    size_t window = sz < CHUNK_FILE_WINDOW ? sz : CHUNK_FILE_WINDOW;
+    int    dupFd = ns_dup(fd);
+
+    if (dupFd == NS_INVALID_FD) {
+        Ns_Log(Warning, "H3 ChunkInitFile: cannot dup fd %d: %s", fd, strerror(errno));
+    } else {
+        ch = ChunkAlloc(window);
+        if (ch == NULL) {
+            (void) ns_close(dupFd);
+        } else {
+            ch->kind      = CH_FILE;
+            ch->len       = 0u;
+            ch->fd        = dupFd;
+            ch->file_off  = offset;
+            ch->file_left = sz;
+            ch->window    = window;
+            if (!ChunkRefill(ch)) {
+                ChunkFree(ch);
+                ch = NULL;
+            }
+        }
+    }
+    return ch;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ChunkRefill --
+ *
+ *      Read the next window of a CH_FILE chunk whose current window has
+ *      been consumed. A short read means that the file was truncated
+ *      after the range was queued; the rest of the range is dropped,
+ *      such that the stream ends early instead of sending stale bytes.
+ *
+ * Results:
+ *      NS_TRUE when new bytes are available in the window, NS_FALSE
+ *      when nothing is left to read or the read failed.
+ *
+ * Side effects:
+ *      Calls pread() and resets ch->p/len to the refilled window.
+ *
+ *----------------------------------------------------------------------
+ */
+bool
+ChunkRefill(Chunk *ch)
+{
+    bool    success = NS_FALSE;
+
+    if (ch->kind == CH_FILE && ch->len == 0u && ch->file_left > 0u) {
+        size_t  toRead = ch->file_left < ch->window ? ch->file_left : ch->window;
+        ssize_t n;
+
+        ch->p = (uint8_t *)(ch + 1);
+        n = pread(ch->fd, ch->p, toRead, ch->file_off);
+        if (n != (ssize_t)toRead) {
+            Ns_Log(Warning, "H3 ChunkRefill: cannot read %zu bytes at offset %lld"
+                   " from fd %d (file truncated?): %s", toRead, (long long)ch->file_off,
+                   ch->fd, n < 0 ? strerror(errno) : "short read");
+            ch->file_left = 0u;
+        } else {
+            ch->len        = toRead;
+            ch->file_off  += (off_t)toRead;
+            ch->file_left -= toRead;
+            success = NS_TRUE;
+        }
+    }
+    return success;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ChunkFree --
+ *
+ *      Free a chunk node. For CH_FILE chunks, the private file
+ *      descriptor is closed first.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Calls ns_free() and potentially ns_close().
+ *
+ *----------------------------------------------------------------------
+ */
+void
+ChunkFree(Chunk *ch)
+{
+    if (ch->kind == CH_FILE && ch->fd != NS_INVALID_FD) {
+        (void) ns_close(ch->fd);
+    }
+    ns_free(ch);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -166,7 +298,7 @@ ChunkEnqueue(ChunkQueue *q, Chunk *ch, const char *label)
  *
  * Side effects:
  *      Mutates q->head/q->tail and the head chunk's p/len; calls
- *      ns_free() for fully consumed chunks. If 'drain' is true, adds
+ *      ChunkFree() for fully consumed chunks. If 'drain' is true, adds
  *      the requested 'nbytes' to q->drained (not the actual removed).
  *      Not thread-safe; caller must hold the appropriate lock.
  *
@@ -183,11 +315,18 @@ ChunkQueueTrim(ChunkQueue *q, size_t nbytes, bool drain)
             /* consume the entire chunk */
             remaining -= ch->len;
             q->unread -= ch->len;
+            ch->len    = 0u;
+            if (ChunkRefill(ch)) {
+                /* the next window of a file range stays at the head */
+                q->unread  += ch->len;
+                q->refilled = NS_TRUE;
+                continue;
+            }
             q->head    = ch->next;
             if (!q->head) {
                 q->tail = NULL;
             }
-            ns_free(ch);     /* free the chunk node */
+            ChunkFree(ch);   /* free the chunk node */
         } else {
             /* only part of this chunk */
             ch->p   += remaining;
@@ -16,20 +16,28 @@
 extern "C" {
 # endif
 
-typedef enum { CH_DATA = 0 } chunk_kind_t;
+typedef enum { CH_DATA = 0, CH_FILE = 1 } chunk_kind_t;
+
+/* Size of the read window of CH_FILE chunks */
+# define CHUNK_FILE_WINDOW (64u * 1024u)
 
 typedef struct Chunk {
     chunk_kind_t   kind;
     uint8_t       *p;        /* current read ptr */
-    size_t         len;      /* unread bytes left */
+    size_t         len;      /* unread bytes left (CH_FILE: in the window) */
     struct Chunk   *next;
-    /* data[] follows */
+    int            fd;          /* CH_FILE only: private file descriptor */
+    off_t          file_off;    /* CH_FILE only: offset of the next window */
+    size_t         file_left;   /* CH_FILE only: bytes not yet read */
+    size_t         window;      /* CH_FILE only: size of the window buffer */
+    /* data[] follows (CH_DATA payload or CH_FILE window) */
 } Chunk;
 
 typedef struct ChunkQueue {
     Chunk  *head, *tail;
     size_t    unread;
     size_t    drained;   // just for debugging
+    bool      refilled;  /* a CH_FILE chunk read its next window */
 } ChunkQueue;
 
 
@@ -40,6 +48,17 @@ Chunk *
 ChunkInit(const char *buffer, size_t sz)
   NS_GNUC_NONNULL(1);
 
+Chunk *
+ChunkInitFile(int fd, off_t offset, size_t sz);
+
+bool
+ChunkRefill(Chunk *ch)
+  NS_GNUC_NONNULL(1);
+
+void
+ChunkFree(Chunk *ch)
+  NS_GNUC_NONNULL(1);
+
 void
 ChunkEnqueue(ChunkQueue *q, Chunk *ch, const char *label)
  NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
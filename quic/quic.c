@@ -103,6 +103,7 @@ NS_EXPORT Ns_ModuleInitProc Ns_ModuleInit;
 #include <openssl/err.h>
 #include "../nsd/nsopenssl.h"
 #include "shared.h"
+#include "sidwindow.h"
 #include <nghttp3/nghttp3.h>
 
 #if NGHTTP3_VERSION_NUM < 0x010800
@@ -125,6 +126,25 @@ NS_EXPORT Ns_ModuleInitProc Ns_ModuleInit;
 
 #define ERRNO_WOULDBLOCK(e) ((e) == EAGAIN || (EAGAIN != EWOULDBLOCK && (e) == EWOULDBLOCK))
 
+/*
+ * UDP generic segmentation offload (Linux). When available, runs of
+ * equally sized datagrams to the same peer, as produced by the QUIC
+ * stack for bulk transfers, are handed to the kernel in a single
+ * sendmsg() call.
+ */
+#if defined(__linux__)
+# include <netinet/udp.h>
+#endif
+#if defined(__linux__)
+# include <linux/filter.h>
+#endif
+#if defined(UDP_SEGMENT)
+# define NS_QUIC_GSO           1
+# define QUIC_GSO_MAX_SEGMENTS 64
+# define QUIC_GSO_MAX_BYTES    65000
+# define QUIC_BIO_MSG_N(array, stride, n) ((BIO_MSG *)(void *)((char *)(array) + (n)*(stride)))
+#endif
+
 /*
  * Local structs and typedefs
  */
@@ -232,6 +252,7 @@ typedef struct ConnCtx {
     NS_TA_DECLARE(affinity)   /* owned by the H3/QUIC thread */
 
     Tcl_HashTable   streams;        /* key = (long)sid */
+    SidWindow       sidWindow;      /* client bidi streams, see sidwindow.c */
     bool            handshake_done; /* handshake completed */
     bool            settings_seen;
     bool            wants_write;
@@ -371,6 +392,13 @@ static bool     quic_conn_can_be_freed_postloop(SSL *conn, ConnCtx *cc) NS_GNUC_
 
 /* QUIC Utilities */
 static void     quic_udp_set_rcvbuf(int fd, size_t rcvbuf_bytes);
+#ifdef NS_QUIC_GSO
+static bool     quic_udp_gso_attach(SSL *listener, int fd) NS_GNUC_NONNULL(1);
+#endif
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+static void     quic_udp_attach_reuseport_filter(int fd);
+#endif
+static NsTLSConfig *QuicDriverConfig(Driver *drvPtr) NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
 static size_t   quic_varint_len(uint8_t b0);
 static uint64_t quic_varint_decode(const uint8_t *p, size_t n) NS_GNUC_NONNULL(1);
 static SSL*     quic_sid_to_stream(ConnCtx *cc, uint64_t sid) NS_GNUC_NONNULL(1);
@@ -517,6 +545,7 @@ static Ns_DriverListenProc Listen;
 static Ns_DriverAcceptProc Accept;
 static Ns_DriverRecvProc Recv;
 static Ns_DriverSendProc Send;
+static Ns_DriverSendFileProc SendFile;
 static Ns_DriverKeepProc Keep;
 static Ns_DriverCloseProc Close;
 static Ns_DriverConnInfoProc ConnInfo;
@@ -1865,6 +1894,404 @@ quic_udp_set_rcvbuf(int fd, size_t rcvbuf_bytes)
     }
 }
 
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+/*
+ *----------------------------------------------------------------------
+ *
+ * quic_udp_attach_reuseport_filter --
+ *
+ *      Attach a classic BPF program to the SO_REUSEPORT group of the
+ *      UDP socket. The program delivers waker datagrams (first byte
+ *      0, which is not a valid QUIC header byte) to the socket with
+ *      the index given in the second byte, i.e., to the listener of
+ *      the driver thread which has to be woken up. For all other
+ *      datagrams, the program returns an invalid index, such that the
+ *      kernel falls back to the hash of the 4-tuple. Datagrams of a
+ *      QUIC connection are therefore always processed by the same
+ *      driver thread (as long as the client does not migrate).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets the filter of the reuseport group of the socket.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+quic_udp_attach_reuseport_filter(int fd)
+{
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 0),     /* A = payload[0]         */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   0, 0, 2), /* waker datagram?      */
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 1),     /* A = payload[1] (shard) */
+        BPF_STMT(BPF_RET | BPF_A,             0),     /* deliver to shard       */
+        BPF_STMT(BPF_RET | BPF_K,             0xffffffffu), /* use 4-tuple hash */
+    };
+    struct sock_fprog prog;
+
+    prog.len = (unsigned short)(sizeof(code) / sizeof(code[0]));
+    prog.filter = code;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, (socklen_t)sizeof(prog)) != 0) {
+        Ns_Log(Warning, "udp(fd=%d): setsockopt(SO_ATTACH_REUSEPORT_CBPF) failed: %s;"
+               " wakeups might be delivered to a different driver thread",
+               fd, strerror(errno));
+    }
+}
+#endif
+
+#ifdef NS_QUIC_GSO
+/*
+ *----------------------------------------------------------------------
+ *
+ * UDP GSO filter BIO --
+ *
+ *      The QUIC stack of OpenSSL writes datagrams through
+ *      BIO_sendmmsg(). The datagram BIO already batches these via
+ *      sendmmsg(), but every datagram still traverses the UDP stack
+ *      of the kernel individually. This filter BIO sits in front of
+ *      the datagram BIO of the listener and coalesces runs of
+ *      datagrams to the same peer, where all but the last datagram
+ *      have the same size, into a single sendmsg() with the
+ *      UDP_SEGMENT control message. The kernel (or the NIC) splits
+ *      the buffer into the original datagrams.
+ *
+ *      Everything else (receiving, control operations) is passed to
+ *      the datagram BIO. GRO is not enabled on the socket, since the
+ *      QUIC stack expects one datagram per received message.
+ *
+ *      When the kernel rejects a GSO send (e.g., EIO from a device
+ *      without checksum offload), GSO is disabled for this socket and
+ *      the datagrams are sent via the datagram BIO.
+ *
+ *----------------------------------------------------------------------
+ */
+typedef struct QuicGsoBio {
+    int      fd;
+    bool     enabled;
+    uint64_t nsendmsg;    /* number of GSO sendmsg() calls */
+    uint64_t ndatagrams;  /* number of datagrams sent via GSO */
+} QuicGsoBio;
+
+static BIO_METHOD *quicGsoMethod = NULL;
+
+static int
+quic_gso_bio_create(BIO *bio)
+{
+    BIO_set_init(bio, 1);
+    return 1;
+}
+
+static int
+quic_gso_bio_destroy(BIO *bio)
+{
+    QuicGsoBio *gso = BIO_get_data(bio);
+
+    if (gso != NULL) {
+        Ns_Log(Notice, "udp(fd=%d): GSO sent %" PRIu64 " datagrams in %" PRIu64 " sendmsg calls",
+               gso->fd, gso->ndatagrams, gso->nsendmsg);
+        ns_free(gso);
+        BIO_set_data(bio, NULL);
+    }
+    return 1;
+}
+
+static long
+quic_gso_bio_ctrl(BIO *bio, int cmd, long num, void *ptr)
+{
+    BIO *next = BIO_next(bio);
+
+    return (next != NULL) ? BIO_ctrl(next, cmd, num, ptr) : 0;
+}
+
+static int
+quic_gso_bio_read_ex(BIO *bio, char *buf, size_t len, size_t *readbytes)
+{
+    return BIO_read_ex(BIO_next(bio), buf, len, readbytes);
+}
+
+static int
+quic_gso_bio_write_ex(BIO *bio, const char *buf, size_t len, size_t *written)
+{
+    return BIO_write_ex(BIO_next(bio), buf, len, written);
+}
+
+static int
+quic_gso_bio_recvmmsg(BIO *bio, BIO_MSG *msg, size_t stride, size_t num_msg,
+                      uint64_t flags, size_t *msgs_processed)
+{
+    return BIO_recvmmsg(BIO_next(bio), msg, stride, num_msg, flags, msgs_processed);
+}
+
+/*
+ * Compare two BIO_ADDRs (family, address and port).
+ */
+static bool
+quic_bio_addr_equal(const BIO_ADDR *a, const BIO_ADDR *b)
+{
+    unsigned char abuf[16], bbuf[16];
+    size_t        alen = sizeof(abuf), blen = sizeof(bbuf);
+
+    return a == b
+        || (BIO_ADDR_family(a) == BIO_ADDR_family(b)
+            && BIO_ADDR_rawport(a) == BIO_ADDR_rawport(b)
+            && BIO_ADDR_rawaddress(a, NULL, &alen) == 1
+            && BIO_ADDR_rawaddress(b, NULL, &blen) == 1
+            && alen == blen && alen <= sizeof(abuf)
+            && BIO_ADDR_rawaddress(a, abuf, &alen) == 1
+            && BIO_ADDR_rawaddress(b, bbuf, &blen) == 1
+            && memcmp(abuf, bbuf, alen) == 0);
+}
+
+/*
+ * Convert a BIO_ADDR into a sockaddr usable for sendmsg().
+ */
+static bool
+quic_bio_addr_to_sockaddr(const BIO_ADDR *addr, struct sockaddr_storage *sa, socklen_t *salen)
+{
+    bool   success = NS_FALSE;
+    size_t len;
+
+    memset(sa, 0, sizeof(*sa));
+    if (BIO_ADDR_family(addr) == AF_INET) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)(void *)sa;
+
+        len = sizeof(sin->sin_addr);
+        if (BIO_ADDR_rawaddress(addr, &sin->sin_addr, &len) == 1) {
+            sin->sin_family = AF_INET;
+            sin->sin_port = BIO_ADDR_rawport(addr);
+            *salen = (socklen_t)sizeof(*sin);
+            success = NS_TRUE;
+        }
+#ifdef HAVE_IPV6
+    } else if (BIO_ADDR_family(addr) == AF_INET6) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)(void *)sa;
+
+        len = sizeof(sin6->sin6_addr);
+        if (BIO_ADDR_rawaddress(addr, &sin6->sin6_addr, &len) == 1) {
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = BIO_ADDR_rawport(addr);
+            *salen = (socklen_t)sizeof(*sin6);
+            success = NS_TRUE;
+        }
+#endif
+    }
+    return success;
+}
+
+/*
+ * Send "n" datagrams starting at msg[i] with a single GSO sendmsg().
+ */
+static bool
+quic_gso_send(QuicGsoBio *gso, BIO_MSG *msg, size_t stride, size_t i, size_t n)
+{
+    struct iovec            iov[QUIC_GSO_MAX_SEGMENTS];
+    struct sockaddr_storage sa;
+    socklen_t               salen = 0;
+    struct msghdr           mh;
+    struct cmsghdr         *cmsg;
+    union {
+        char           buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control;
+    const BIO_MSG          *first = QUIC_BIO_MSG_N(msg, stride, i);
+    ssize_t                 rc;
+    size_t                  k;
+
+    if (!quic_bio_addr_to_sockaddr(first->peer, &sa, &salen)) {
+        return NS_FALSE;
+    }
+    for (k = 0u; k < n; k++) {
+        const BIO_MSG *m = QUIC_BIO_MSG_N(msg, stride, i + k);
+
+        iov[k].iov_base = m->data;
+        iov[k].iov_len  = m->data_len;
+    }
+
+    memset(&mh, 0, sizeof(mh));
+    memset(&control, 0, sizeof(control));
+    mh.msg_name       = &sa;
+    mh.msg_namelen    = salen;
+    mh.msg_iov        = iov;
+    mh.msg_iovlen     = n;
+    mh.msg_control    = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+
+    cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type  = UDP_SEGMENT;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+    {
+        uint16_t segsize = (uint16_t)first->data_len;
+
+        memcpy(CMSG_DATA(cmsg), &segsize, sizeof(segsize));
+    }
+
+    do {
+        rc = sendmsg(gso->fd, &mh, 0);
+    } while (rc < 0 && errno == EINTR);
+
+    if (rc < 0) {
+        if (!ERRNO_WOULDBLOCK(errno)) {
+            Ns_Log(Warning, "udp(fd=%d): GSO sendmsg failed: %s; disable GSO",
+                   gso->fd, strerror(errno));
+            gso->enabled = NS_FALSE;
+        }
+        return NS_FALSE;
+    }
+    gso->nsendmsg++;
+    gso->ndatagrams += n;
+    return NS_TRUE;
+}
+
+static int
+quic_gso_bio_sendmmsg(BIO *bio, BIO_MSG *msg, size_t stride, size_t num_msg,
+                      uint64_t flags, size_t *msgs_processed)
+{
+    QuicGsoBio *gso = BIO_get_data(bio);
+    BIO        *next = BIO_next(bio);
+    size_t      i = 0u, processed = 0u;
+    int         result = 1;
+
+    while (i < num_msg) {
+        BIO_MSG *first = QUIC_BIO_MSG_N(msg, stride, i);
+        size_t   n = 1u, total = first->data_len;
+
+        /*
+         * Determine the run of datagrams which can be coalesced: same
+         * peer, no explicit local address, all but the last of the
+         * same size as the first one.
+         */
+        if (gso->enabled && first->peer != NULL && first->local == NULL) {
+            while (i + n < num_msg && n < QUIC_GSO_MAX_SEGMENTS) {
+                const BIO_MSG *prev = QUIC_BIO_MSG_N(msg, stride, i + n - 1);
+                const BIO_MSG *m    = QUIC_BIO_MSG_N(msg, stride, i + n);
+
+                if (prev->data_len != first->data_len
+                    || m->data_len > first->data_len
+                    || m->local != NULL
+                    || m->peer == NULL
+                    || total + m->data_len > QUIC_GSO_MAX_BYTES
+                    || !quic_bio_addr_equal(m->peer, first->peer)) {
+                    break;
+                }
+                total += m->data_len;
+                n++;
+            }
+        }
+
+        if (n > 1u && quic_gso_send(gso, msg, stride, i, n)) {
+            size_t k;
+
+            for (k = 0u; k < n; k++) {
+                QUIC_BIO_MSG_N(msg, stride, i + k)->flags = 0;
+            }
+        } else {
+            size_t done = 0u;
+
+            /*
+             * Single datagram or failed GSO send: let the datagram BIO
+             * send the run. Errors after a partial send are reported
+             * as success with the number of processed messages.
+             */
+            (void)ERR_set_mark();
+            if (BIO_sendmmsg(next, first, stride, n, flags, &done) == 0) {
+                if (processed > 0u) {
+                    (void)ERR_pop_to_mark();
+                } else {
+                    (void)ERR_clear_last_mark();
+                    result = 0;
+                }
+                break;
+            }
+            (void)ERR_clear_last_mark();
+            if (done < n) {
+                processed += done;
+                break;
+            }
+        }
+        i += n;
+        processed += n;
+    }
+
+    *msgs_processed = processed;
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * quic_udp_gso_attach --
+ *
+ *      Check whether the socket supports UDP_SEGMENT and, if so,
+ *      attach a datagram BIO with the GSO filter BIO in front to the
+ *      listener.
+ *
+ * Results:
+ *      NS_TRUE when the BIOs were attached, NS_FALSE otherwise (the
+ *      caller has to attach the socket as usual).
+ *
+ * Side effects:
+ *      Creates the BIO method on first usage.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+quic_udp_gso_attach(SSL *listener, int fd)
+{
+    int        segsize = 0;
+    socklen_t  len = (socklen_t)sizeof(segsize);
+    BIO       *dgram, *filter;
+    QuicGsoBio *gso;
+
+    if (getsockopt(fd, SOL_UDP, UDP_SEGMENT, &segsize, &len) != 0) {
+        Ns_Log(Notice, "udp(fd=%d): UDP GSO not supported: %s", fd, strerror(errno));
+        return NS_FALSE;
+    }
+
+    Ns_MasterLock();
+    if (quicGsoMethod == NULL) {
+        BIO_METHOD *method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_FILTER, "ns quic gso");
+
+        if (method != NULL
+            && BIO_meth_set_create(method, quic_gso_bio_create) == 1
+            && BIO_meth_set_destroy(method, quic_gso_bio_destroy) == 1
+            && BIO_meth_set_ctrl(method, quic_gso_bio_ctrl) == 1
+            && BIO_meth_set_read_ex(method, quic_gso_bio_read_ex) == 1
+            && BIO_meth_set_write_ex(method, quic_gso_bio_write_ex) == 1
+            && BIO_meth_set_sendmmsg(method, quic_gso_bio_sendmmsg) == 1
+            && BIO_meth_set_recvmmsg(method, quic_gso_bio_recvmmsg) == 1) {
+            quicGsoMethod = method;
+        } else if (method != NULL) {
+            BIO_meth_free(method);
+        }
+    }
+    Ns_MasterUnlock();
+
+    if (quicGsoMethod == NULL) {
+        return NS_FALSE;
+    }
+
+    dgram = BIO_new_dgram(fd, BIO_NOCLOSE);
+    filter = BIO_new(quicGsoMethod);
+    if (dgram == NULL || filter == NULL) {
+        BIO_free(dgram);
+        BIO_free(filter);
+        return NS_FALSE;
+    }
+    gso = ns_calloc(1u, sizeof(QuicGsoBio));
+    gso->fd = fd;
+    gso->enabled = NS_TRUE;
+    BIO_set_data(filter, gso);
+    (void)BIO_push(filter, dgram);
+    SSL_set_bio(listener, filter, filter);
+
+    Ns_Log(Notice, "udp(fd=%d): UDP GSO enabled", fd);
+    return NS_TRUE;
+}
+#endif /* NS_QUIC_GSO */
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1937,9 +2364,11 @@ static uint64_t quic_varint_decode(const uint8_t *p, size_t n) {
  *      known unidirectional control streams (control, QPACK encoder/
  *      decoder) and dynamically created bidirectional request streams.
  *
- *      The lookup first checks the cached well-known stream IDs stored
- *      in the connection context, then falls back to querying the
- *      StreamCtx table for dynamically allocated streams.
+ *      Client bidi request streams are resolved directly via
+ *      StreamCtxGet() (stream window). For other stream IDs, the lookup
+ *      first checks the cached well-known stream IDs stored in the
+ *      connection context, then falls back to querying the StreamCtx
+ *      table.
  *
  * Arguments:
  *      cc  - Connection context containing QUIC stream mappings.
@@ -1956,7 +2385,15 @@ static uint64_t quic_varint_decode(const uint8_t *p, size_t n) {
  */
 static SSL *quic_sid_to_stream(ConnCtx *cc, uint64_t sid)
 {
-    SSL *stream =
+    SSL *stream;
+
+    if (SID_IS_CLIENT_BIDI(sid)) {
+        /* Request streams: none of the well-known uni streams. */
+        StreamCtx *sc = StreamCtxGet(cc, (int64_t)sid, 0);
+
+        return sc != NULL ? sc->ssl : NULL;
+    }
+    stream =
         sid == cc->h3ssl.cstream_id ? cc->h3ssl.cstream :
         sid == cc->h3ssl.pstream_id ? cc->h3ssl.pstream :
         sid == cc->h3ssl.rstream_id ? cc->h3ssl.rstream :
@@ -3813,6 +4250,7 @@ h3_stream_read_into_hold(StreamCtx *sc, SSL *stream)
  * Side effects:
  *      - Advances nghttp3’s write offset via nghttp3_conn_add_write_offset().
  *      - Removes `nbytes` from the stream’s pending transmit buffer.
+ *      - If a file window was refilled, requests a resume of the stream.
  *      - If EOF-ready, resumes the nghttp3 stream and schedules a write
  *        pass to emit the FIN.
  *      - Produces detailed diagnostic logs about trimming and flow state.
@@ -3834,6 +4272,11 @@ h3_stream_advance_and_trim(StreamCtx *sc, int64_t sid, uint8_t *base, size_t nby
         nghttp3_conn_add_write_offset(cc->h3conn, sid, nbytes);
 
         body_trimmed = SharedTrimPendingFromVec(&sc->sh, base, nbytes);
+        if (SharedTakeRefilled(&sc->sh)) {
+            /* The next window of a file range is ready; offer it again. */
+            SharedRequestResume(&cc->shared, &sc->sh, sc->h3_sid);
+            PollsetEnableWrite(cc->dc, sc->ssl, sc, "file window refilled");
+        }
         if (body_trimmed) {
             Ns_Log(Notice, "[%lld] H3[%lld] h3_stream_advance_and_trim TRIM body %zu (vec len %zu)",
                    (long long)cc->dc->iter, (long long)sc->quic_sid, body_trimmed, (size_t)nbytes);
@@ -4579,14 +5022,19 @@ inline void h3_conn_wake(NsTLSConfig *dc) {
 
     if (dc->u.h3.waker_addrlen > 0) {
         int                 fd = socket(sa->sa_family, SOCK_DGRAM, 0);
-        const unsigned char b = 0; /* not a QUIC header byte */
+        /*
+         * First byte 0 is not a valid QUIC header byte; the second byte
+         * is the shard, used by the SO_REUSEPORT filter to deliver the
+         * datagram to the listener of this driver thread.
+         */
+        const unsigned char b[2] = {0u, (unsigned char)dc->u.h3.shard};
 
         if (fd < 0) {
             return;
         }
         Ns_Log(Notice, "[%lld] H3: h3_conn_wake", (long long)dc->iter);
 
-        (void)sendto(fd, (const char *)&b, 1, 0, sa, dc->u.h3.waker_addrlen);
+        (void)sendto(fd, (const char *)b, sizeof(b), 0, sa, dc->u.h3.waker_addrlen);
         ns_sockclose(fd);
     }
 }
@@ -5276,6 +5724,10 @@ static int on_deferred_consume(nghttp3_conn *UNUSED(conn),
     }
 
     actual_consumed = SharedTrimPending(&sc->sh, consumed, /*drain*/NS_TRUE);
+    if (SharedTakeRefilled(&sc->sh)) {
+        SharedRequestResume(&sc->cc->shared, &sc->sh, sc->h3_sid);
+        PollsetEnableWrite(sc->cc->dc, sc->ssl, sc, "file window refilled");
+    }
 
     if (actual_consumed != consumed) {
         Ns_Log(Warning, "H3[%lld] consumed %zu bytes from %zu available",
@@ -5367,6 +5819,7 @@ ConnCtxFree(ConnCtx *cc)
     Ns_Log(Notice, "[%lld] H3 ConnCtxFree for cc %p", (long long)cc->dc->iter, (void*)cc);
 
     Tcl_DeleteHashTable(&cc->streams);
+    SidWindowFree(&cc->sidWindow);
     SharedStateDestroy(&cc->shared);
 }
 
@@ -5542,8 +5995,10 @@ StreamCtxLookup(Tcl_HashTable *ht, int64_t sid, int create) {
  * StreamCtxGet --
  *
  *      Retrieve the StreamCtx associated with a given QUIC or HTTP/3
- *      stream ID from the connection’s stream hash table.  Optionally
- *      creates and initializes a new StreamCtx if it does not yet exist.
+ *      stream ID. Client bidi streams are resolved via the dense stream
+ *      window, other streams via the connection’s stream hash table.
+ *      Optionally creates and initializes a new StreamCtx if it does not
+ *      yet exist.
  *
  * Results:
  *      Returns a pointer to the StreamCtx for the given stream ID, or
@@ -5553,7 +6008,8 @@ StreamCtxLookup(Tcl_HashTable *ht, int64_t sid, int create) {
  *      - When 'create' is nonzero and the entry does not exist, a new
  *        StreamCtx is allocated, initialized (StreamCtxInit), and linked
  *        to the connection’s shared state via SharedStreamInit.
- *      - Inserts the StreamCtx into the connection’s stream hash table.
+ *      - Inserts the StreamCtx into the connection’s stream hash table
+ *        and the stream window.
  *      - Logs an error if called with an invalid (negative) stream ID.
  *
  *----------------------------------------------------------------------
@@ -5562,10 +6018,15 @@ static StreamCtx *
 StreamCtxGet(ConnCtx *cc, int64_t sid, int create) {
     Tcl_HashEntry *e;
     StreamCtx     *sc = NULL;
+    bool           inWindow;
 
     if (sid < 0) {
         Ns_Log(Error, "H3: StreamCtxGet called with invalid stream ID: %lld", (long long)sid);
     } else {
+        sc = SidWindowGet(&cc->sidWindow, sid, &inWindow);
+        if (sc != NULL || (inWindow && !create)) {
+            return sc;
+        }
         e = StreamCtxLookup(&cc->streams, sid, create);
         if (e != NULL) {
             sc = (StreamCtx *)Tcl_GetHashValue(e);
@@ -5575,6 +6036,7 @@ StreamCtxGet(ConnCtx *cc, int64_t sid, int create) {
                     StreamCtxInit(sc);
                     SharedStreamInit(&sc->sh, &cc->shared, sid);
                     Tcl_SetHashValue(e, sc);
+                    SidWindowPut(&cc->sidWindow, sid, sc);
                 }
             }
         }
@@ -5676,7 +6138,7 @@ StreamCtxRegister(ConnCtx *cc, SSL *s, uint64_t sid, H3StreamKind kind)
  *
  * Side effects:
  *      - Deletes the Tcl_HashEntry for the stream ID from the connection’s
- *        stream table, if present.
+ *        stream table, if present, and clears its stream window slot.
  *      - Leaves the StreamCtx memory itself intact; freeing is performed
  *        separately by StreamCtxFree().
  *      - Emits a diagnostic log message showing stream IDs and SSL pointers.
@@ -5699,6 +6161,7 @@ static void StreamCtxUnregister(StreamCtx *sc)
     if (e != NULL) {
         Tcl_DeleteHashEntry(e);
     }
+    SidWindowPut(&cc->sidWindow, (int64_t)sc->quic_sid, NULL);
 }
 
 /*
@@ -7061,6 +7524,7 @@ NS_EXPORT Ns_ReturnCode Ns_ModuleInit(const char *server, const char *module)
 
     dc->u.h3.recvbufsize = (size_t)Ns_ConfigMemUnitRange(section, "recvbufsize", "8MB",
                                                          1024*8000, 0, INT_MAX);
+    dc->u.h3.udpgso = Ns_ConfigBool(section, "udpgso", NS_TRUE);
     Ns_ConfigTimeUnitRange(section, "idletimeout",
                            "3s", 0, 0, LONG_MAX, 0,
                            &timeout);
@@ -7079,7 +7543,7 @@ NS_EXPORT Ns_ReturnCode Ns_ModuleInit(const char *server, const char *module)
     init.recvProc = Recv;
     init.requestProc = NULL;
     init.sendProc = Send;
-    init.sendFileProc = NULL;
+    init.sendFileProc = SendFile;
     init.keepProc = Keep;
     init.connInfoProc = ConnInfo;
     init.closeProc = Close;
@@ -7168,6 +7632,71 @@ NS_EXPORT Ns_ReturnCode Ns_ModuleInit(const char *server, const char *module)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * QuicDriverConfig --
+ *
+ *      Return the driver configuration for a QUIC driver thread.
+ *
+ *      When "driverthreads" is larger than one, the driver
+ *      infrastructure creates multiple driver instances sharing the
+ *      same argument (the NsTLSConfig created in Ns_ModuleInit). Each
+ *      QUIC driver thread needs its own pollset, connection list and
+ *      waker, so the first thread claims the configuration, and every
+ *      further thread receives a copy sharing the SSL_CTX and the
+ *      configuration values, but with fresh runtime state. The copy
+ *      replaces the driver argument of this driver instance.
+ *
+ *      The threads are started one after the other, and each thread
+ *      binds its listening sockets before the next one is started.
+ *      Therefore, the shard number is as well the index of the
+ *      listener in the SO_REUSEPORT group of the address.
+ *
+ * Results:
+ *      NsTLSConfig for this driver thread.
+ *
+ * Side effects:
+ *      Might allocate a new NsTLSConfig and update drvPtr->arg.
+ *
+ *----------------------------------------------------------------------
+ */
+static NsTLSConfig *
+QuicDriverConfig(Driver *drvPtr)
+{
+    NsTLSConfig *dc = drvPtr->arg;
+
+    NS_NONNULL_ASSERT(drvPtr != NULL);
+
+    Ns_MasterLock();
+    if (dc->driver == NULL) {
+        dc->driver = (Ns_Driver *)drvPtr;
+        dc->u.h3.shard = 0;
+        dc->u.h3.nshards = 1;
+
+    } else if (dc->driver != (Ns_Driver *)drvPtr) {
+        NsTLSConfig *shardPtr = ns_malloc(sizeof(NsTLSConfig));
+
+        *shardPtr = *dc;
+        shardPtr->driver             = (Ns_Driver *)drvPtr;
+        shardPtr->iter               = 0u;
+        shardPtr->u.h3.shard         = dc->u.h3.nshards++;
+        shardPtr->u.h3.npoll         = (size_t)-1;
+        shardPtr->u.h3.nr_listeners  = 0u;
+        shardPtr->u.h3.first_dead    = 0u;
+        shardPtr->u.h3.waker_addrlen = 0;
+        shardPtr->u.h3.waker_lock    = NULL;
+        Ns_MutexInit(&shardPtr->u.h3.waker_lock);
+        PollsetInit(shardPtr);
+
+        drvPtr->arg = shardPtr;
+        dc = shardPtr;
+    }
+    Ns_MasterUnlock();
+
+    return dc;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -7211,14 +7740,14 @@ QuicThread(void *arg)
 {
     Driver             *drvPtr = (Driver*)arg;
     TCL_SIZE_T          nrBindaddrs;
-    NsTLSConfig        *dc = drvPtr->arg;
+    NsTLSConfig        *dc = QuicDriverConfig(drvPtr);
     SSL_CTX            *h3ctx;
     bool                stopping = NS_FALSE;
     unsigned int        flags = NS_DRIVER_THREAD_STARTED;
     struct timeval     *polltimeout_ptr;
 
-    Ns_ThreadSetName("-quic:%s-", "h3");
-    Ns_Log(Notice, "H3D QUIC THREAD started");
+    Ns_ThreadSetName("-quic:h3:%d-", dc->u.h3.shard);
+    Ns_Log(Notice, "H3D QUIC THREAD started (shard %d)", dc->u.h3.shard);
 
     nrBindaddrs = NsDriverBindAddresses(drvPtr);
 
@@ -7246,21 +7775,25 @@ QuicThread(void *arg)
      *  - listener is listening via SSL_listen
      *  - listener is nonblocking
      */
-    h3_callbacks.recv_settings        = on_recv_settings;
-    h3_callbacks.begin_headers        = on_begin_headers;
-    h3_callbacks.recv_header          = on_recv_header;
-    h3_callbacks.end_headers          = on_end_headers;
-    h3_callbacks.recv_data            = on_recv_data;
-    h3_callbacks.end_stream           = on_end_stream;
-    h3_callbacks.acked_stream_data    = on_acked_stream_data;
-    h3_callbacks.stream_close         = on_stream_close;
-    h3_callbacks.deferred_consume     = on_deferred_consume;
-
-    h3_mem.user_data = NULL;
-    h3_mem.malloc    = h3_malloc_cb;
-    h3_mem.free      = h3_free_cb;
-    h3_mem.calloc    = h3_calloc_cb;
-    h3_mem.realloc   = h3_realloc_cb;
+    Ns_MasterLock();
+    if (h3_callbacks.recv_settings == NULL) {
+        h3_callbacks.recv_settings        = on_recv_settings;
+        h3_callbacks.begin_headers        = on_begin_headers;
+        h3_callbacks.recv_header          = on_recv_header;
+        h3_callbacks.end_headers          = on_end_headers;
+        h3_callbacks.recv_data            = on_recv_data;
+        h3_callbacks.end_stream           = on_end_stream;
+        h3_callbacks.acked_stream_data    = on_acked_stream_data;
+        h3_callbacks.stream_close         = on_stream_close;
+        h3_callbacks.deferred_consume     = on_deferred_consume;
+
+        h3_mem.user_data = NULL;
+        h3_mem.malloc    = h3_malloc_cb;
+        h3_mem.free      = h3_free_cb;
+        h3_mem.calloc    = h3_calloc_cb;
+        h3_mem.realloc   = h3_realloc_cb;
+    }
+    Ns_MasterUnlock();
 
     polltimeout_ptr = &dc->u.h3.idle_timeout;
 
@@ -7757,7 +8290,12 @@ Listen(Ns_Driver *driver, const char *address, unsigned short port, int UNUSED(b
                 goto fail;
             }
 
-            OSSL_TRY(SSL_set_fd(listener, sock));
+#ifdef NS_QUIC_GSO
+            if (!dc->u.h3.udpgso || !quic_udp_gso_attach(listener, sock))
+#endif
+            {
+                OSSL_TRY(SSL_set_fd(listener, sock));
+            }
             OSSL_TRY(SSL_set_blocking_mode(listener, 0));
             if (!SSL_listen(listener)) {
                 /* log error */
@@ -7789,6 +8327,11 @@ Listen(Ns_Driver *driver, const char *address, unsigned short port, int UNUSED(b
         }
         (void) Ns_SockSetNonBlocking(sock);
         quic_udp_set_rcvbuf(sock, dc->u.h3.recvbufsize);
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+        if (reuseport) {
+            quic_udp_attach_reuseport_filter(sock);
+        }
+#endif
 
         /*
          * Set app data of listener ssl to listen fd
@@ -8033,6 +8576,91 @@ Send(Ns_Sock *sock, const struct iovec *iov, int niov, unsigned int UNUSED(flags
     return consumed;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SendFile --
+ *
+ *      HTTP/3 (QUIC) driver callback for sending a mix of memory and
+ *      file ranges (e.g., fastpath responses). Like Send(), the data is
+ *      handed to the per-stream shared buffer, but file ranges are
+ *      queued as CH_FILE chunks, which read the file in bounded windows
+ *      as the stream drains instead of loading the full range at once.
+ *      Reading via pread() keeps a file truncated while queued from
+ *      faulting the QUIC thread; the stream ends early instead.
+ *      Without this callback, the generic Ns_SockSendFileBufs() would
+ *      call sendfile() on the UDP socket.
+ *
+ * Results:
+ *      Returns the total number of bytes accepted for transmission,
+ *      or -1 on error.
+ *
+ * Side effects:
+ *      Same as Send(); additionally duplicates the file descriptors,
+ *      which remain open until the corresponding chunks are trimmed.
+ *
+ *----------------------------------------------------------------------
+ */
+static ssize_t
+SendFile(Ns_Sock *sock, Ns_FileVec *bufs, int nbufs, unsigned int UNUSED(flags))
+{
+    NsTLSConfig *dc = sock->driver->arg;
+    ssize_t      consumed = 0;
+    StreamCtx   *sc;
+    int          i;
+    bool         need_resume = NS_FALSE;
+
+    Ns_Log(Notice, "[%lld] H3 SendFile (sock %d) nbufs %d", (long long)dc->iter, sock->sock, nbufs);
+
+    sc = StreamCtxFromSock(dc, sock);
+    if (sc == NULL) {
+        Ns_Log(Error, "h3: cannot determine H3 stream context from Ns_Sock structure");
+        return -1;
+    }
+
+    if (!H3_TX_WRITABLE(sc)) {          /* honors H3_IO_TX_FIN/H3_IO_RESET */
+        return 0;
+    }
+
+    if (!sc->hdrs_submitted && !SharedHdrsIsReady(&sc->sh)) {
+        SharedHdrsSetReady(&sc->sh);
+        need_resume = NS_TRUE;
+    }
+
+    for (i = 0; i < nbufs; i++) {
+        size_t length = bufs[i].length;
+
+        if (length == 0) {
+            continue;
+        }
+        if (bufs[i].fd == NS_INVALID_FD) {
+            (void)SharedEnqueueBody(&sc->sh, bufs[i].buffer + bufs[i].offset, length,
+                                    "sendfile:buffer");
+        } else {
+            Chunk *ch = ChunkInitFile(bufs[i].fd, bufs[i].offset, length);
+
+            if (ch == NULL) {
+                if (consumed == 0) {
+                    consumed = -1;
+                }
+                break;
+            }
+            (void)SharedEnqueueChunk(&sc->sh, ch, "sendfile:file");
+        }
+        consumed    += (ssize_t)length;
+        need_resume  = NS_TRUE;
+    }
+
+    if (need_resume) {
+        SharedRequestResume(&sc->cc->shared, &sc->sh, sc->h3_sid);
+        PollsetEnableWrite(dc, sc->ssl, sc, "SendFile: staged/enqueued");
+    }
+
+    Ns_Log(Notice, "[%lld] H3 SendFile nbufs %d -> DONE (consumed %ld)",
+           (long long)dc->iter, nbufs, consumed);
+    return consumed;
+}
+
 /*
  *----------------------------------------------------------------------
  *
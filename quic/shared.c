@@ -23,14 +23,20 @@
  *
  *   - Chunk / ChunkQueue:
  *       A zero-copy, singly-linked FIFO of payload "chunks". Each chunk
- *       stores its payload inline (one allocation), and moves between
- *       queues by relinking (no memcpy). Typical use is per-stream TX:
- *       "queued" (app-owned) -> "pending" (about to write on wire).
+ *       stores its payload inline (one allocation) or a bounded window
+ *       of a file range (CH_FILE), and moves between queues by
+ *       relinking (no memcpy). Typical use is
+ *       per-stream TX: "inbox" (app-owned) -> "pending" (about to write
+ *       on wire).
  *
  *   - SharedStream:
- *       Per-stream state with a mutex protecting TX queues, header/close
- *       flags, and lightweight counters. Helpers build nghttp3_vec views
- *       over the pending queue and trim it after successful writes.
+ *       Per-stream state. Producers push body chunks onto a lock-free
+ *       inbox (a CAS-linked stack plus an atomic byte counter); the H3
+ *       thread takes the whole inbox with a single atomic exchange and
+ *       re-establishes FIFO order while splicing it into the pending
+ *       queue. A mutex protects the pending queue, header/close flags,
+ *       and lightweight counters. Helpers build nghttp3_vec views over
+ *       the pending queue and trim it after successful writes.
  *       (See: https://nghttp2.org/nghttp3/)
  *
  *   - SharedState (resume ring):
@@ -42,19 +48,25 @@
  *
  * Concurrency model
  * -----------------
- * - Per-stream data (queues, hdrs flags, closed_by_app) is protected by
- *   ss->lock.
+ * - Per-stream data (pending queue, hdrs flags, closed_by_app) is
+ *   protected by ss->lock. The inbox (ss->tx_inbox, ss->tx_inbox_bytes)
+ *   is accessed only via atomic operations; the byte counter is bumped
+ *   before the push, so it may transiently over-report but never
+ *   under-report queued data (EOF is never signaled prematurely).
  * - The global resume ring is protected by st->lock.
  * - The resume_enqueued flag is set under st->lock in the enqueue path,
  *   and cleared under ss->lock by the consumer after the SID is serviced.
  *   This avoids duplicate enqueues while minimizing cross-lock holding.
  * - Callers must not hold ss->lock while performing potentially blocking
  *   I/O; build vecs under the lock, then write, then trim under the lock.
+ *   The only exception is the refill of a consumed CH_FILE window by the
+ *   trim helpers, which reads at most CHUNK_FILE_WINDOW bytes.
  *
  * Memory & logging
  * ----------------
- * - Chunks are allocated via ns_malloc(sizeof(Chunk) + payload) and freed
- *   by trim/clear helpers; moving between queues never copies data.
+ * - Chunks are allocated via ns_malloc(sizeof(Chunk) + payload) (or
+ *   + window for CH_FILE) and freed by trim/clear helpers via
+ *   ChunkFree(); moving between queues never copies data.
  * - Functions here are generally allocation-free except for Chunk* and
  *   resume ring growth (resume_grow()). Logging is conservative and at
  *   Notice level in debug helpers.
@@ -81,8 +93,19 @@
 #if defined(HAVE_NGHTTP3)
 #include "shared.h"
 
+/*
+ * The inbox uses the GCC/Clang __atomic builtins. Other compilers fall
+ * back to the stream mutex.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+# define SHARED_ATOMIC_INBOX 1
+#endif
+
 /* ---------- Prototypes ---------- */
 static int resume_grow(SharedState *st) NS_GNUC_NONNULL(1);
+static void inbox_push(SharedStream *ss, Chunk *ch) NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static Chunk *inbox_take(SharedStream *ss) NS_GNUC_NONNULL(1);
+static size_t inbox_bytes(SharedStream *ss) NS_GNUC_NONNULL(1);
 
 
 /*======================================================================
@@ -132,6 +155,82 @@ static int resume_grow(SharedState *st) {
     return 0;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * inbox_push, inbox_take, inbox_bytes --
+ *
+ *      Lock-free producer inbox of a SharedStream. inbox_push() links
+ *      a chunk onto the inbox stack via compare-and-swap (any number of
+ *      producers), inbox_take() detaches the complete stack with one
+ *      atomic exchange (single consumer, the H3 thread), and
+ *      inbox_bytes() reads the number of bytes in the inbox.
+ *
+ *      Since nodes are never removed individually, the stack is not
+ *      subject to the ABA problem.
+ *
+ * Results:
+ *      inbox_take() returns the detached chunks in LIFO order (or NULL),
+ *      inbox_bytes() the current byte count.
+ *
+ * Side effects:
+ *      inbox_push() increments ss->tx_inbox_bytes before publishing the
+ *      chunk; the consumer decrements it after taking the chunks.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+inbox_push(SharedStream *ss, Chunk *ch)
+{
+#if defined(SHARED_ATOMIC_INBOX)
+    Chunk *head;
+
+    (void)__atomic_add_fetch(&ss->tx_inbox_bytes, ch->len, __ATOMIC_RELEASE);
+    head = __atomic_load_n(&ss->tx_inbox, __ATOMIC_RELAXED);
+    do {
+        ch->next = head;
+    } while (!__atomic_compare_exchange_n(&ss->tx_inbox, &head, ch, NS_TRUE,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#else
+    Ns_MutexLock(&ss->lock);
+    ss->tx_inbox_bytes += ch->len;
+    ch->next = ss->tx_inbox;
+    ss->tx_inbox = ch;
+    Ns_MutexUnlock(&ss->lock);
+#endif
+}
+
+static Chunk *
+inbox_take(SharedStream *ss)
+{
+#if defined(SHARED_ATOMIC_INBOX)
+    return __atomic_exchange_n(&ss->tx_inbox, NULL, __ATOMIC_ACQUIRE);
+#else
+    Chunk *ch;
+
+    Ns_MutexLock(&ss->lock);
+    ch = ss->tx_inbox;
+    ss->tx_inbox = NULL;
+    Ns_MutexUnlock(&ss->lock);
+    return ch;
+#endif
+}
+
+static size_t
+inbox_bytes(SharedStream *ss)
+{
+#if defined(SHARED_ATOMIC_INBOX)
+    return __atomic_load_n(&ss->tx_inbox_bytes, __ATOMIC_ACQUIRE);
+#else
+    size_t n;
+
+    Ns_MutexLock(&ss->lock);
+    n = ss->tx_inbox_bytes;
+    Ns_MutexUnlock(&ss->lock);
+    return n;
+#endif
+}
+
 /*======================================================================
  * Function Implementations: SharedState
  *======================================================================
@@ -210,7 +309,7 @@ void SharedStateDestroy(SharedState *st) {
  *
  * Side effects:
  *      Initializes ss->lock; writes ss->st and ss->sid_hint; leaves the
- *      tx_queued/tx_pending chunk queues zeroed (no allocations here).
+ *      tx_inbox/tx_pending chunk queues zeroed (no allocations here).
  *      Must be called exactly once before any concurrent use of *ss*.
  *      The caller must ensure that *owner* outlives *ss* or otherwise
  *      coordinates teardown.
@@ -229,20 +328,29 @@ void SharedStreamInit(SharedStream *ss, SharedState *owner, int64_t sid) {
  *----------------------------------------------------------------------
  * SharedStreamDestroy --
  *
- *      Teardown helper: clear TX queues under the stream lock.
+ *      Teardown helper: release the inbox and clear the pending queue
+ *      under the stream lock.
  *
  * Results:
  *      None.
  *
  * Side effects:
- *      Acquires ss->lock; calls ChunkQueueClear() on tx_queued/pending,
- *      releasing any queued buffers. Does not destroy ss->lock or free ss;
+ *      Frees all inbox chunks; acquires ss->lock and calls
+ *      ChunkQueueClear() on tx_pending, releasing any queued buffers. Does not destroy ss->lock or free ss;
  *      caller must ensure no concurrent users.
  *----------------------------------------------------------------------
  */
 void SharedStreamDestroy(SharedStream *ss) {
+    Chunk *ch = inbox_take(ss);
+
+    while (ch != NULL) {
+        Chunk *next = ch->next;
+        ChunkFree(ch);
+        ch = next;
+    }
+    ss->tx_inbox_bytes = 0u;
+
     Ns_MutexLock(&ss->lock);
-    ChunkQueueClear(&ss->tx_queued);
     ChunkQueueClear(&ss->tx_pending);
     Ns_MutexUnlock(&ss->lock);
 }
@@ -322,17 +430,17 @@ void SharedHdrsClear(SharedStream *ss) {
  *----------------------------------------------------------------------
  * SharedEnqueueBody --
  *
- *      Enqueue a payload into the stream TX queue (thread-safe); does
- *      not issue a resume tick.
+ *      Enqueue a copy of a payload into the stream TX inbox
+ *      (thread-safe); does not issue a resume tick.
  *
  * Results:
- *      Returns len on success; 0 if buf is NULL or len == 0.
+ *      Returns len on success; 0 if buf is NULL, len == 0, or the
+ *      chunk cannot be allocated.
  *
  * Side effects:
- *      Allocates a Chunk from (buf,len); acquires ss->lock; appends to
- *      ss->tx_queued with label (default "enqueue"); logs at Notice with
- *      ss->sid_hint and projected queued bytes. Caller must trigger
- *      SharedRequestResume() for this SID if needed.
+ *      Allocates a Chunk from (buf,len) and hands it to
+ *      SharedEnqueueChunk(). Caller must trigger SharedRequestResume()
+ *      for this SID if needed.
  *----------------------------------------------------------------------
  */
 size_t SharedEnqueueBody(SharedStream *ss, const void *buf, size_t len, const char *label) {
@@ -341,13 +449,38 @@ size_t SharedEnqueueBody(SharedStream *ss, const void *buf, size_t len, const ch
     return 0;
   }
 
-  Ns_Log(Notice, "H3[%lld] SharedEnqueueBody: +%zu (queued=%zu)",
-       (long long)ss->sid_hint, len, ss->tx_queued.unread + len);
-
   ch = ChunkInit(buf, len);
-  Ns_MutexLock(&ss->lock);
-  ChunkEnqueue(&ss->tx_queued, ch, label ? label : "enqueue");
-  Ns_MutexUnlock(&ss->lock);
+  if (ch == NULL) {
+    return 0;
+  }
+  return SharedEnqueueChunk(ss, ch, label);
+}
+
+/*
+ *----------------------------------------------------------------------
+ * SharedEnqueueChunk --
+ *
+ *      Enqueue a prepared chunk (CH_DATA or CH_FILE) into the stream TX
+ *      inbox without taking the stream lock. Ownership of the chunk
+ *      transfers to the stream; does not issue a resume tick.
+ *
+ * Results:
+ *      Returns the number of payload bytes of the chunk.
+ *
+ * Side effects:
+ *      Lock-free push onto ss->tx_inbox; logs at Notice with
+ *      ss->sid_hint and projected queued bytes. Caller must trigger
+ *      SharedRequestResume() for this SID if needed.
+ *----------------------------------------------------------------------
+ */
+size_t SharedEnqueueChunk(SharedStream *ss, Chunk *ch, const char *label) {
+  size_t len = ch->len;
+
+  Ns_Log(Notice, "H3[%lld] SharedEnqueueChunk: +%zu (queued=%zu) (%s)",
+         (long long)ss->sid_hint, len, inbox_bytes(ss) + len,
+         label ? label : "enqueue");
+
+  inbox_push(ss, ch);
   /* NOTE: we do NOT push resume here; caller should call SharedRequestResume() for this SID */
   return len;
 }
@@ -384,41 +517,65 @@ void SharedMarkClosedByApp(SharedStream *ss) {
  *      Thread-safe predicate: returns whether TX has unread bytes.
  *
  * Results:
- *      Nonzero if ss->tx_queued.unread > 0; 0 otherwise.
+ *      Nonzero if the inbox holds unread bytes; 0 otherwise.
  *
  * Side effects:
- *      Temporarily acquires ss->lock.
+ *      None (atomic load).
  *----------------------------------------------------------------------
  */
 int SharedTxReadable(SharedStream *ss) {
-    int v;
-    Ns_MutexLock(&ss->lock);
-    v = (ss->tx_queued.unread > 0);
-    Ns_MutexUnlock(&ss->lock);
-    return v;
+    return (inbox_bytes(ss) > 0);
 }
 
 /*
  *----------------------------------------------------------------------
  * SharedSpliceQueuedToPending --
  *
- *      Thread-safe splice of up to maxbytes from ss->tx_queued to
- *      ss->tx_pending, preserving FIFO order.
+ *      Splice the producer inbox into ss->tx_pending, preserving FIFO
+ *      order. The inbox is always taken as a whole (one atomic
+ *      exchange); when more than 'maxbytes' are taken, the rest is kept
+ *      at the pending tail anyway, since chunks are never split. Must
+ *      only be called from the consumer (H3) thread.
  *
  * Results:
- *      Returns the number of bytes moved (<= maxbytes).
+ *      Returns the number of bytes moved.
  *
  * Side effects:
- *      Acquires ss->lock; relinks chunks between queues and updates
- *      counters. No logging or resume/wake is triggered.
+ *      Reverses the detached inbox list, acquires ss->lock to append it
+ *      to tx_pending, and decrements ss->tx_inbox_bytes. No logging or
+ *      resume/wake is triggered.
  *----------------------------------------------------------------------
  */
-size_t SharedSpliceQueuedToPending(SharedStream *ss, size_t maxbytes) {
-    size_t moved;
+size_t SharedSpliceQueuedToPending(SharedStream *ss, size_t UNUSED(maxbytes)) {
+    Chunk     *ch = inbox_take(ss);
+    ChunkQueue fifo = {NULL, NULL, 0u, 0u, NS_FALSE};
+
+    if (ch == NULL) {
+        return 0u;
+    }
+
+    /* Reverse the LIFO inbox into FIFO order. */
+    fifo.tail = ch;
+    while (ch != NULL) {
+        Chunk *next = ch->next;
+
+        ch->next    = fifo.head;
+        fifo.head   = ch;
+        fifo.unread += ch->len;
+        ch = next;
+    }
+
+#if defined(SHARED_ATOMIC_INBOX)
+    (void)__atomic_sub_fetch(&ss->tx_inbox_bytes, fifo.unread, __ATOMIC_RELEASE);
+#endif
     Ns_MutexLock(&ss->lock);
-    moved = ChunkQueueMove(&ss->tx_queued, &ss->tx_pending, maxbytes);
+#if !defined(SHARED_ATOMIC_INBOX)
+    ss->tx_inbox_bytes -= fifo.unread;
+#endif
+    (void)ChunkQueueMove(&fifo, &ss->tx_pending, SIZE_MAX);
     Ns_MutexUnlock(&ss->lock);
-    return moved;
+
+    return fifo.drained;
 }
 
 /*
@@ -433,7 +590,8 @@ size_t SharedSpliceQueuedToPending(SharedStream *ss, size_t maxbytes) {
  *      Number of bytes actually trimmed (<= nbytes).
  *
  * Side effects:
- *      Acquires ss->lock; mutates ss->tx_pending counters/links.
+ *      Acquires ss->lock; mutates ss->tx_pending counters/links and
+ *      may refill consumed CH_FILE windows (see SharedTakeRefilled()).
  *      Emits Notice logs with before/after unread byte counts.
  *      Does not trigger wake/resume.
  *----------------------------------------------------------------------
@@ -467,8 +625,8 @@ size_t SharedTrimPending(SharedStream *ss, size_t nbytes, bool drain) {
  *
  * Side effects:
  *      Acquires ss->lock; mutates head chunk pointers (p/len), updates
- *      ss->tx_pending.unread, may free exhausted chunks, and leaves the
- *      queue head/tail consistent. Emits Notice logs before/after with
+ *      ss->tx_pending.unread, may refill a consumed CH_FILE window or
+ *      free exhausted chunks, and leaves the queue head/tail consistent. Emits Notice logs before/after with
  *      unread and trimmed counts. No wake/resume is triggered.
  *----------------------------------------------------------------------
  */
@@ -505,11 +663,18 @@ size_t SharedTrimPendingFromVec(SharedStream *ss, const uint8_t *base, size_t le
           trimmed += take;
           len     -= take;
 
+          // refill a consumed file window; the vec cannot reach beyond it
+          if (ch->len == 0 && ChunkRefill(ch)) {
+            ss->tx_pending.unread  += ch->len;
+            ss->tx_pending.refilled = NS_TRUE;
+            break;
+          }
+
           // drop exhausted chunk
           if (ch->len == 0) {
             ss->tx_pending.head = ch->next;
             if (!ss->tx_pending.head) ss->tx_pending.tail = NULL;
-            ns_free(ch);
+            ChunkFree(ch);
           } else {
             // vec ended inside this chunk
             break;
@@ -533,14 +698,15 @@ size_t SharedTrimPendingFromVec(SharedStream *ss, const uint8_t *base, size_t le
  * SharedPendingUnreadBytes / SharedQueuedUnreadBytes --
  *
  *      Thread-safe accessors for unread byte counters in the TX queues:
- *      'Pending' reports ss->tx_pending.unread; 'Queued' reports
- *      ss->tx_queued.unread.
+ *      'Pending' reports ss->tx_pending.unread; 'Queued' reports the
+ *      bytes in the producer inbox.
  *
  * Results:
  *      Returns the number of unread bytes for the respective queue.
  *
  * Side effects:
- *      Temporarily acquires ss->lock; no allocation or logging.
+ *      'Pending' temporarily acquires ss->lock; no allocation or
+ *      logging.
  *
  *----------------------------------------------------------------------
  */
@@ -552,11 +718,33 @@ size_t SharedPendingUnreadBytes(SharedStream *ss) {
     return n;
 }
 size_t SharedQueuedUnreadBytes(SharedStream *ss) {
-    size_t n;
+    return inbox_bytes(ss);
+}
+
+/*
+ *----------------------------------------------------------------------
+ * SharedTakeRefilled --
+ *
+ *      Report whether a trim helper refilled the window of a CH_FILE
+ *      chunk in tx_pending since the last call, and reset the flag.
+ *      The caller has to offer the new bytes to nghttp3 again.
+ *
+ * Results:
+ *      NS_TRUE when a window was refilled.
+ *
+ * Side effects:
+ *      Acquires ss->lock and clears ss->tx_pending.refilled.
+ *
+ *----------------------------------------------------------------------
+ */
+bool SharedTakeRefilled(SharedStream *ss) {
+    bool refilled;
+
     Ns_MutexLock(&ss->lock);
-    n = ss->tx_queued.unread;
+    refilled = ss->tx_pending.refilled;
+    ss->tx_pending.refilled = NS_FALSE;
     Ns_MutexUnlock(&ss->lock);
-    return n;
+    return refilled;
 }
 
 /*
@@ -565,7 +753,10 @@ size_t SharedQueuedUnreadBytes(SharedStream *ss) {
  *
  *      Build (not snapshot) an array of nghttp3_vec from the pending TX
  *      queue: copies pointers/lengths only, preserving FIFO order and
- *      without mutating the queue. See: https://nghttp2.org/nghttp3/
+ *      without mutating the queue. The vecs end after a CH_FILE chunk
+ *      with unread file bytes, since the rest of its range becomes
+ *      available only after its window was consumed and refilled.
+ *      See: https://nghttp2.org/nghttp3/
  *
  * Results:
  *      Number of vectors written (<= veccnt); 0 if vecs is NULL, veccnt
@@ -594,6 +785,10 @@ size_t SharedBuildVecsFromPending(SharedStream *ss, nghttp3_vec *vecs, size_t ve
         vecs[out].base = ch->p;
         vecs[out].len  = ch->len;
         out++;
+        if (ch->kind == CH_FILE && ch->file_left > 0u) {
+            /* the rest of the file range must precede later chunks */
+            break;
+        }
     }
     Ns_MutexUnlock(&ss->lock);
 
@@ -759,7 +954,9 @@ SharedDrainResume(SharedState *st, int64_t *out, size_t cap)
  *
  *      Populate 'out' with a consistent snapshot of selected stream
  *      state (queued/pending byte counts and closed_by_app). Uses the
- *      stream mutex to read an atomic view.
+ *      stream mutex to read pending/closed; the inbox byte count is read
+ *      afterwards, so data enqueued before the producer closed the
+ *      stream is always visible.
  *
  * Results:
  *      None.
@@ -773,10 +970,10 @@ SharedDrainResume(SharedState *st, int64_t *out, size_t cap)
 void SharedSnapshotRead(SharedStream *ss, SharedSnapshot *out)
 {
     Ns_MutexLock(&ss->lock);
-    out->queued_bytes   = ss->tx_queued.unread;
     out->pending_bytes  = ss->tx_pending.unread;
     out->closed_by_app  = ss->closed_by_app;
     Ns_MutexUnlock(&ss->lock);
+    out->queued_bytes   = inbox_bytes(ss);
 }
 #endif
 
@@ -19,7 +19,8 @@
  *
  * - Producers (writer/conn threads) call:
  *     SharedMarkHdrsReady(...), SharedEnqueue(...), SharedMarkEOF(...)
- *   These never call nghttp3 and are safe from non-H3 threads.
+ *   These never call nghttp3 and are safe from non-H3 threads. Body
+ *   enqueue does not take the stream lock (lock-free inbox).
  *
  * - The H3 thread calls:
  *     SharedPopResumes(...), SharedMarkResumed(...), SharedSpliceToPending(...)
@@ -73,8 +74,9 @@ typedef struct SharedStream {
     Ns_Mutex    lock;
 
     /* Cross-thread body state */
-    ChunkQueue  tx_queued;     /* producer pushes here */
-    ChunkQueue  tx_pending;    /* consumer snapshots from queued -> pending */
+    Chunk      *tx_inbox;      /* producer pushes here (lock-free, LIFO order) */
+    size_t      tx_inbox_bytes;/* unread bytes in tx_inbox (atomic) */
+    ChunkQueue  tx_pending;    /* consumer splices from inbox -> pending */
     int         closed_by_app; /* producer finished; EOF once pending drains */
 
     /* Cross-thread header readiness bit (header array stays in sc) */
@@ -102,15 +104,17 @@ void SharedHdrsClear(SharedStream *ss);
 
 /* --- Body enqueue/EOF from producer side --- */
 size_t SharedEnqueueBody(SharedStream *ss, const void *buf, size_t len, const char *label);
+size_t SharedEnqueueChunk(SharedStream *ss, Chunk *ch, const char *label) NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 void   SharedMarkClosedByApp(SharedStream *ss);
 
 /* --- Body helpers used by data_reader / writer --- */
-int    SharedTxReadable(SharedStream *ss);                 /* queued.unread > 0 */
+int    SharedTxReadable(SharedStream *ss);                 /* inbox bytes > 0 */
 size_t SharedSpliceQueuedToPending(SharedStream *ss, size_t maxbytes);
 size_t SharedTrimPending(SharedStream *ss, size_t nbytes, bool drain);
 size_t SharedTrimPendingFromVec(SharedStream *ss, const uint8_t *base, size_t len);
 size_t SharedPendingUnreadBytes(SharedStream *ss);
 size_t SharedQueuedUnreadBytes(SharedStream *ss);
+bool   SharedTakeRefilled(SharedStream *ss);
 size_t SharedBuildVecsFromPending(SharedStream *ss, nghttp3_vec *vecs, size_t veccnt);
 
 /* --- Connection-level resume ring --- */
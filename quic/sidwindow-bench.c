@@ -0,0 +1,214 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * The Initial Developer of the Original Code and related documentation
+ * is America Online, Inc. Portions created by AOL are Copyright (C) 1999
+ * America Online, Inc. All Rights Reserved.
+ *
+ * Copyright (C) 2025 Gustaf Neumann
+ */
+
+/*
+ * sidwindow-bench.c --
+ *
+ *      Microbenchmark of the stream-ID window (sidwindow.c) against the
+ *      one-word-key Tcl hash table used as stream registry in quic.c.
+ *      The program is not built by default:
+ *
+ *          make -C quic sidwindow-bench
+ *          ./quic/sidwindow-bench ?concurrent? ?streams? ?lookups?
+ *
+ *      A connection is simulated with "concurrent" open request streams
+ *      (client bidi IDs 0, 4, 8, ...). Per step, a random open stream
+ *      completes, the next stream is opened, and "lookups" random open
+ *      streams are resolved. The window run maintains the hash table
+ *      as well and falls back to it like StreamCtxGet() does; the hash
+ *      run uses the hash table alone. Both runs use the same random
+ *      sequence, and their results are compared.
+ */
+
+#include "../include/ns.h"
+#include "sidwindow.h"
+
+typedef struct Stream {
+    int64_t sid;
+} Stream;
+
+typedef struct Run {
+    Tcl_HashTable  streams;
+    SidWindow      window;
+    bool           useWindow;
+    size_t         windowHits;
+    uintptr_t      checksum;
+} Run;
+
+static Stream *
+Lookup(Run *runPtr, int64_t sid)
+{
+    Stream        *streamPtr = NULL;
+    Tcl_HashEntry *hPtr;
+
+    if (runPtr->useWindow) {
+        bool inWindow;
+
+        streamPtr = SidWindowGet(&runPtr->window, sid, &inWindow);
+        if (streamPtr != NULL || inWindow) {
+            runPtr->windowHits++;
+            return streamPtr;
+        }
+    }
+    hPtr = Tcl_FindHashEntry(&runPtr->streams, (const char *)(intptr_t)sid);
+    if (hPtr != NULL) {
+        streamPtr = Tcl_GetHashValue(hPtr);
+    }
+    return streamPtr;
+}
+
+static void
+Open(Run *runPtr, Stream *streamPtr)
+{
+    int isNew;
+    Tcl_HashEntry *hPtr = Tcl_CreateHashEntry(&runPtr->streams,
+                                              (const char *)(intptr_t)streamPtr->sid, &isNew);
+    Tcl_SetHashValue(hPtr, streamPtr);
+    if (runPtr->useWindow) {
+        SidWindowPut(&runPtr->window, streamPtr->sid, streamPtr);
+    }
+}
+
+static void
+Close(Run *runPtr, const Stream *streamPtr)
+{
+    Tcl_HashEntry *hPtr = Tcl_FindHashEntry(&runPtr->streams,
+                                            (const char *)(intptr_t)streamPtr->sid);
+    if (hPtr != NULL) {
+        Tcl_DeleteHashEntry(hPtr);
+    }
+    if (runPtr->useWindow) {
+        SidWindowPut(&runPtr->window, streamPtr->sid, NULL);
+    }
+}
+
+/*
+ * Simple deterministic PRNG, such that both runs see the same sequence.
+ */
+static uint64_t
+NextRandom(uint64_t *statePtr)
+{
+    *statePtr ^= *statePtr << 13;
+    *statePtr ^= *statePtr >> 7;
+    *statePtr ^= *statePtr << 17;
+    return *statePtr;
+}
+
+static double
+Simulate(Run *runPtr, size_t concurrent, size_t nStreams, size_t lookups)
+{
+    Stream   *all = ns_calloc(nStreams, sizeof(Stream));
+    Stream  **open = ns_calloc(concurrent, sizeof(Stream *));
+    uint64_t  state = 4711u;
+    size_t    i, next = 0u, step;
+    Ns_Time   start, end, diff;
+
+    Tcl_InitHashTable(&runPtr->streams, TCL_ONE_WORD_KEYS);
+    memset(&runPtr->window, 0, sizeof(runPtr->window));
+    runPtr->windowHits = 0u;
+    runPtr->checksum = 0u;
+
+    for (i = 0u; i < nStreams; i++) {
+        all[i].sid = (int64_t)(i * 4u);
+    }
+
+    Ns_GetTime(&start);
+    for (i = 0u; i < concurrent; i++) {
+        open[i] = &all[next++];
+        Open(runPtr, open[i]);
+    }
+    for (step = 0u; next < nStreams; step++) {
+        size_t slot = (size_t)(NextRandom(&state) % concurrent), j;
+
+        for (j = 0u; j < lookups; j++) {
+            const Stream *streamPtr = open[NextRandom(&state) % concurrent];
+
+            const Stream *foundPtr = Lookup(runPtr, streamPtr->sid);
+
+            runPtr->checksum += (foundPtr == streamPtr) ? (uintptr_t)foundPtr->sid + 1u : 0u;
+        }
+        /*
+         * Closed streams must not be found anymore.
+         */
+        Close(runPtr, open[slot]);
+        if (Lookup(runPtr, open[slot]->sid) != NULL) {
+            runPtr->checksum ++;
+        }
+        open[slot] = &all[next++];
+        Open(runPtr, open[slot]);
+    }
+    Ns_GetTime(&end);
+    (void)Ns_DiffTime(&end, &start, &diff);
+
+    Tcl_DeleteHashTable(&runPtr->streams);
+    SidWindowFree(&runPtr->window);
+    ns_free(open);
+    ns_free(all);
+
+    return ((double)diff.sec * 1e9 + (double)diff.usec * 1e3) / (double)(step * (lookups + 1u));
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t concurrent[2] = {100u, 400u}, nConcurrent = 2u, i;
+    size_t nStreams = 1000000u, lookups = 10u;
+    int    result = 0;
+
+    Tcl_FindExecutable(argv[0]);
+    Nsthreads_LibInit();
+
+    if (argc > 1) {
+        concurrent[0] = strtoul(argv[1], NULL, 10);
+        nConcurrent = 1u;
+    }
+    if (argc > 2) {
+        nStreams = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        lookups = strtoul(argv[3], NULL, 10);
+    }
+
+    for (i = 0u; i < nConcurrent; i++) {
+        Run    windowRun, hashRun;
+        double windowNs, hashNs;
+
+        if (concurrent[i] == 0u || concurrent[i] >= nStreams) {
+            fprintf(stderr, "invalid number of concurrent streams: %lu\n", (unsigned long)concurrent[i]);
+            return 1;
+        }
+        windowRun.useWindow = NS_TRUE;
+        hashRun.useWindow = NS_FALSE;
+        windowNs = Simulate(&windowRun, concurrent[i], nStreams, lookups);
+        hashNs = Simulate(&hashRun, concurrent[i], nStreams, lookups);
+
+        printf("%5lu concurrent streams: window %6.1f ns, hash table %6.1f ns per lookup,"
+               " %5.1f%% resolved via window, results %s\n",
+               (unsigned long)concurrent[i], windowNs, hashNs,
+               100.0 * (double)windowRun.windowHits
+               / (double)((nStreams - concurrent[i]) * (lookups + 1u)),
+               windowRun.checksum == hashRun.checksum ? "identical" : "DIFFER");
+        if (windowRun.checksum != hashRun.checksum) {
+            result = 1;
+        }
+    }
+    return result;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
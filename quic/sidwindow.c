@@ -0,0 +1,201 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * The Initial Developer of the Original Code and related documentation
+ * is America Online, Inc. Portions created by AOL are Copyright (C) 1999
+ * America Online, Inc. All Rights Reserved.
+ *
+ * Copyright (C) 2025 Gustaf Neumann
+ */
+
+/*
+ *======================================================================
+ * sidwindow.c: Dense sliding window for client bidi stream IDs
+ *======================================================================
+ *
+ * Purpose
+ * -------
+ * Resolve client-initiated bidirectional QUIC stream IDs (the HTTP/3
+ * request streams) without hashing. The peer hands these IDs out
+ * densely (0, 4, 8, ...), so the streams of a connection can be kept in
+ * an array indexed by (sid >> 2) relative to a sliding base.
+ *
+ * Data Structures
+ * ---------------
+ * - SidWindow:
+ *     * slots : array of "size" entries, slot = (sid >> 2) - base
+ *     * base  : stream index of slots[0]
+ *     * size  : allocated slots (grows from SID_WINDOW_INITIAL up to
+ *               SID_WINDOW_MAX)
+ *
+ * Operations
+ * ----------
+ * - SidWindowGet(w, sid, &in) : O(1) lookup; "in" tells whether the
+ *                               window is authoritative for the sid
+ * - SidWindowPut(w, sid, v)   : set or clear (v == NULL) a slot; slides
+ *                               and grows the window when needed
+ * - SidWindowFree(w)          : release the slot array
+ *
+ * The window is a cache in front of the stream hash table of the
+ * connection: IDs below or beyond the window and other stream types
+ * must be resolved via the hash table. See quic/sidwindow-bench.c for a
+ * microbenchmark comparing both.
+ *
+ * Concurrency
+ * -----------
+ * This module is not thread-safe. The window is owned by the H3/QUIC
+ * thread of the connection.
+ */
+
+#include "../include/ns.h"
+#include "sidwindow.h"
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SidWindowGet --
+ *
+ *      Resolve a client bidi stream ID via the window without hashing.
+ *
+ * Results:
+ *      The stored value or NULL. *inWindowPtr is set to NS_TRUE when the
+ *      window is authoritative for the sid (i.e., a NULL result means
+ *      that the stream is not registered); otherwise the caller has to
+ *      consult the hash table.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+void *
+SidWindowGet(const SidWindow *w, int64_t sid, bool *inWindowPtr)
+{
+    void     *value = NULL;
+    uint64_t  idx = (uint64_t)sid >> 2;
+
+    if (SID_IS_CLIENT_BIDI(sid)
+        && idx >= w->base
+        && idx - w->base < w->size) {
+        value = w->slots[idx - w->base];
+        *inWindowPtr = NS_TRUE;
+    } else {
+        *inWindowPtr = NS_FALSE;
+    }
+    return value;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SidWindowPut --
+ *
+ *      Set (or clear, when value == NULL) the window slot of a client
+ *      bidi stream. When the sid lies beyond the window, the window
+ *      first slides over leading free slots (completed streams), then
+ *      grows up to SID_WINDOW_MAX slots, and finally slides forward
+ *      dropping the oldest slots; such streams remain reachable via the
+ *      hash table. Stream IDs below the window are not cached.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May (re)allocate the slots and update the window base.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+SidWindowPut(SidWindow *w, int64_t sid, void *value)
+{
+    uint64_t idx = (uint64_t)sid >> 2;
+
+    if (!SID_IS_CLIENT_BIDI(sid) || idx < w->base) {
+        return;
+    }
+
+    if (idx - w->base >= w->size) {
+        size_t skip = 0u;
+
+        if (value == NULL) {
+            /* Clearing a slot outside the window: nothing cached. */
+            return;
+        }
+        if (w->size == 0u) {
+            w->slots = ns_calloc(SID_WINDOW_INITIAL, sizeof(void *));
+            w->size = SID_WINDOW_INITIAL;
+            w->base = idx;
+        } else {
+            /*
+             * Slide over leading free slots.
+             */
+            while (skip < w->size && w->slots[skip] == NULL) {
+                skip++;
+            }
+            if (idx - w->base - skip >= w->size) {
+                /*
+                 * Still not enough room: grow, or drop the oldest
+                 * slots when the maximum size is reached.
+                 */
+                uint64_t need = idx - w->base - skip + 1u;
+                size_t   newSize = w->size;
+
+                while (newSize < need && newSize < SID_WINDOW_MAX) {
+                    newSize *= 2u;
+                }
+                if (newSize != w->size) {
+                    w->slots = ns_realloc(w->slots, newSize * sizeof(void *));
+                    memset(w->slots + w->size, 0, (newSize - w->size) * sizeof(void *));
+                    w->size = newSize;
+                }
+                if (need > newSize) {
+                    skip += (size_t)(need - newSize);
+                }
+            }
+            if (skip >= w->size) {
+                memset(w->slots, 0, w->size * sizeof(void *));
+            } else if (skip > 0u) {
+                memmove(w->slots, w->slots + skip, (w->size - skip) * sizeof(void *));
+                memset(w->slots + (w->size - skip), 0, skip * sizeof(void *));
+            }
+            w->base += skip;
+        }
+    }
+    w->slots[idx - w->base] = value;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SidWindowFree --
+ *
+ *      Release the slots of the window. The stored values are not
+ *      touched.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees memory, resets the window to its initial state.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+SidWindowFree(SidWindow *w)
+{
+    ns_free(w->slots);
+    w->slots = NULL;
+    w->base = 0u;
+    w->size = 0u;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
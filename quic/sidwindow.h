@@ -0,0 +1,50 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * The Initial Developer of the Original Code and related documentation
+ * is America Online, Inc. Portions created by AOL are Copyright (C) 1999
+ * America Online, Inc. All Rights Reserved.
+ *
+ * Copyright (C) 2025 Gustaf Neumann
+ */
+#ifndef H3_SIDWINDOW_H
+# define H3_SIDWINDOW_H
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/*
+ * Client-initiated bidirectional stream IDs (sid & 0x3 == 0) are handed
+ * out densely by the peer.
+ */
+# define SID_IS_CLIENT_BIDI(sid) (((sid) & 0x3) == 0)
+
+# define SID_WINDOW_INITIAL 64u
+# define SID_WINDOW_MAX     4096u
+
+typedef struct SidWindow {
+    void     **slots;   /* client bidi streams, slot = (sid>>2) - base */
+    uint64_t   base;
+    size_t     size;    /* 0 until the first stream is added */
+} SidWindow;
+
+void *
+SidWindowGet(const SidWindow *w, int64_t sid, bool *inWindowPtr)
+  NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
+
+void
+SidWindowPut(SidWindow *w, int64_t sid, void *value)
+  NS_GNUC_NONNULL(1);
+
+void
+SidWindowFree(SidWindow *w)
+  NS_GNUC_NONNULL(1);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* H3_SIDWINDOW_H */